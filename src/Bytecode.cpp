@@ -0,0 +1,93 @@
+/**
+ * @file Bytecode.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Register bytecode that the VM executes
+ */
+
+#include "Bytecode.hpp"
+
+namespace vm {
+
+namespace {
+
+struct op_info_t {
+  const char *name;
+  const char *operands;
+};
+
+const op_info_t op_info[] = {
+#define BYTECODE_OP_INFO(name, operands) {#name, operands},
+    BYTECODE_OPS(BYTECODE_OP_INFO)
+#undef BYTECODE_OP_INFO
+};
+
+} // namespace
+
+/**
+ * @brief get the mnemonic of an instruction
+ */
+const char *op_name(Op op) { return op_info[static_cast<int>(op)].name; }
+
+/**
+ * @brief write a readable listing of a program
+ *
+ * @param program program to list
+ * @param os output stream
+ */
+void disassemble(Program const &program, std::ostream &os) {
+  for (auto const &function : program.functions) {
+    os << function.name << ": params " << function.params << ", locals "
+       << function.locals << ", registers " << function.registers << "\n";
+
+    std::uint32_t end = static_cast<std::uint32_t>(program.code.size());
+    for (auto const &other : program.functions) {
+      if (other.entry > function.entry && other.entry < end) {
+        end = other.entry;
+      }
+    }
+
+    for (auto pc = function.entry; pc < end; pc++) {
+      auto const &instr = program.code[pc];
+      auto const &info = op_info[static_cast<int>(instr.op)];
+
+      std::string name = info.name;
+      // `and_` and friends are named after the keywords they stand for
+      if (name.back() == '_') {
+        name.pop_back();
+      }
+      os << "  " << pc << "\t" << name;
+
+      std::int32_t fields[] = {instr.a, instr.b, instr.c};
+      const char *separator = " ";
+      for (int i = 0; info.operands[i] != '\0'; i++) {
+        auto value = fields[i];
+        switch (info.operands[i]) {
+        case 'r':
+          os << separator << "r" << value;
+          break;
+        case 'i':
+          os << separator << value;
+          break;
+        case 'g':
+          os << separator << "g" << value;
+          break;
+        case 'f':
+          os << separator << program.functions[value].name;
+          break;
+        case 's':
+          os << separator << "s" << value;
+          break;
+        case 't':
+          os << separator << "-> " << value;
+          break;
+        default:
+          continue;
+        }
+        separator = ", ";
+      }
+      os << "\n";
+    }
+  }
+}
+
+} // namespace vm
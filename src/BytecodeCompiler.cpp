@@ -0,0 +1,882 @@
+/**
+ * @file BytecodeCompiler.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Lower a checked J-- AST to register bytecode for the VM
+ */
+
+#include "BytecodeCompiler.hpp"
+#include "SideEffects.hpp"
+#include "Wasm.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+using vm::Op;
+
+namespace {
+
+/**
+ * @brief get the jump taken when a comparison holds
+ */
+Op jump_of(Op cmp) {
+  switch (cmp) {
+  case Op::eq:
+    return Op::jeq;
+  case Op::ne:
+    return Op::jne;
+  case Op::lt:
+    return Op::jlt;
+  case Op::le:
+    return Op::jle;
+  case Op::gt:
+    return Op::jgt;
+  default:
+    return Op::jge;
+  }
+}
+
+/**
+ * @brief get the form of a compare-and-jump that takes a constant
+ */
+Op with_immediate(Op jump) {
+  return static_cast<Op>(static_cast<int>(jump) + static_cast<int>(Op::jeqi) -
+                         static_cast<int>(Op::jeq));
+}
+
+/**
+ * @brief get the comparison that holds when `cmp` doesn't
+ */
+Op negate(Op cmp) {
+  switch (cmp) {
+  case Op::eq:
+    return Op::ne;
+  case Op::ne:
+    return Op::eq;
+  case Op::lt:
+    return Op::ge;
+  case Op::le:
+    return Op::gt;
+  case Op::gt:
+    return Op::le;
+  default:
+    return Op::lt;
+  }
+}
+
+/**
+ * @brief get the comparison with its operands swapped
+ */
+Op mirror(Op cmp) {
+  switch (cmp) {
+  case Op::lt:
+    return Op::gt;
+  case Op::le:
+    return Op::ge;
+  case Op::gt:
+    return Op::lt;
+  case Op::ge:
+    return Op::le;
+  default:
+    return cmp;
+  }
+}
+
+bool is_jump(Op op) { return op >= Op::jmp && op <= Op::jgei; }
+
+/**
+ * @brief check if an instruction writes register `a` and nothing else
+ */
+bool writes_a(Op op) {
+  return (op >= Op::mov && op <= Op::getg) || (op >= Op::add && op <= Op::ge) ||
+         op == Op::getgx || op == Op::getx || op == Op::getchar;
+}
+
+} // namespace
+
+/**
+ * @brief compile the program
+ *
+ * @return vm::Program compiled program
+ * @throws std::runtime_error if a function needs more registers than an
+ * instruction can address
+ */
+vm::Program BytecodeCompiler::compile() {
+  program = vm::Program();
+
+  // functions can be called before they are declared, so number them first
+  for (auto *node : ast->children) {
+    if (node->type == Node::function_decl ||
+        node->type == Node::main_func_decl) {
+      auto *id = node->find_first(Node::id);
+      auto index = static_cast<std::uint32_t>(program.functions.size());
+      function_index[id->function_symbol] = index;
+      if (node->type == Node::main_func_decl) {
+        program.main = index;
+      }
+
+      vm::function_t function;
+      function.name = name_str(id->name);
+      program.functions.push_back(function);
+    }
+  }
+
+  std::uint64_t globals = 0;
+  for (auto const &[name, sym] :
+       sym_table->get_scope(sym_table->global_scope())) {
+    if (sym->kind == "variable") {
+      global_index.insert(name, static_cast<std::int32_t>(globals));
+      globals += sym->is_array() ? sym->length : 1;
+    }
+  }
+  if (globals > INT32_MAX) {
+    throw std::runtime_error("global arrays take more than " +
+                             std::to_string(INT32_MAX) + " globals");
+  }
+  program.globals = static_cast<std::uint32_t>(globals);
+
+  effects = find_side_effects(ast.get());
+  visit(ast.get());
+  return std::move(program);
+}
+
+/**
+ * @brief pre-order step, opens functions and statements
+ */
+Visit BytecodeCompiler::enter(ASTNode *node) {
+  path.push_back(node);
+
+  switch (node->type) {
+  case Node::global_var_decl:
+  case Node::variable_decl:
+  case Node::formal_params:
+    // registers and globals are assigned from the symbol table
+    return Visit::skip_children;
+  case Node::main_func_decl:
+  case Node::function_decl:
+    begin_function(node);
+    break;
+  case Node::if_statement:
+  case Node::if_else_statement:
+    controls.push_back({node});
+    break;
+  case Node::while_statement: {
+    control_t control{node};
+    control.cond_start = pc();
+    controls.push_back(control);
+    break;
+  }
+  default:
+    break;
+  }
+
+  return Visit::next;
+}
+
+/**
+ * @brief post-order step, emits the instructions of a node once its
+ * operands are compiled
+ */
+void BytecodeCompiler::leave(ASTNode *node) {
+  path.pop_back();
+
+  switch (node->type) {
+  case Node::main_func_decl:
+  case Node::function_decl:
+    end_function(node);
+    break;
+  case Node::int_t:
+  case Node::boolean_t:
+    if (node->is_const()) {
+      push({operand_t::imm, node->type == Node::boolean_t
+                                ? node->value == "true"
+                                : std::stoi(node->value)});
+    }
+    break;
+  case Node::string: {
+    auto text = wasm::unescape(node->value);
+    auto iter = string_index.find(text);
+    if (iter == string_index.end()) {
+      iter = string_index
+                 .emplace(text, static_cast<std::int32_t>(
+                                    program.strings.size()))
+                 .first;
+      program.strings.push_back(text);
+    }
+    push({operand_t::imm, iter->second});
+    break;
+  }
+  case Node::id: {
+    auto *parent = path.back();
+    // names of functions, arrays and targets of assignments aren't read
+    if (parent->type == Node::function_decl ||
+        parent->type == Node::main_func_decl ||
+        ((parent->type == Node::eq_op ||
+          parent->type == Node::function_call ||
+          parent->type == Node::index_op) &&
+         parent->children[0] == node)) {
+      break;
+    }
+
+    auto *sym = node->symbol;
+    if (sym->is_global()) {
+      auto target = next_slot();
+      emit(Op::getg, target, *global_index.find(sym->name));
+      push({operand_t::reg, target});
+    } else {
+      push({operand_t::reg, *local_register.find(sym->name)});
+    }
+    break;
+  }
+  case Node::index_op:
+    element(node);
+    break;
+  case Node::eq_op: {
+    auto value = pop();
+    auto *sym = node->children[0]->symbol;
+
+    if (node->children[0]->type == Node::index_op) {
+      // the index was checked before the value was computed
+      auto index = pop();
+      auto reg = in_register(value, slot(operands.size() + 1));
+      access(node->children[0]->children[0]->symbol, reg, index, true);
+      push(value.kind == operand_t::imm ? value
+                                        : operand_t{operand_t::reg, reg});
+      break;
+    }
+
+    if (sym->is_global()) {
+      auto reg = in_register(value, slot(operands.size()));
+      emit(Op::setg, reg, *global_index.find(sym->name));
+      push(value.kind == operand_t::imm ? value
+                                        : operand_t{operand_t::reg, reg});
+      break;
+    }
+
+    auto local = *local_register.find(sym->name);
+    detach(local);
+
+    auto &last = program.code;
+    if (value.kind == operand_t::reg && value.value >= frame_base &&
+        label != pc() && !last.empty() && writes_a(last.back().op) &&
+        last.back().a == value.value) {
+      // the temporary was just computed, compute the local instead
+      last.back().a = static_cast<std::uint16_t>(local);
+    } else if (value.kind == operand_t::imm) {
+      emit(Op::movi, local, value.value);
+    } else {
+      auto reg = in_register(value, local);
+      if (reg != local) {
+        emit(Op::mov, local, reg);
+      }
+    }
+    push({operand_t::reg, local});
+    break;
+  }
+  case Node::sub_op:
+    if (node->children.size() == 1) {
+      auto value = pop();
+      auto target = slot(operands.size());
+      emit(Op::neg, target, in_register(value, target));
+      push({operand_t::reg, target});
+      break;
+    }
+    // fall through
+  case Node::add_op:
+  case Node::mul_op:
+  case Node::div_op:
+  case Node::mod_op:
+  case Node::bin_and_op:
+  case Node::bin_or_op: {
+    if ((node->type == Node::bin_and_op || node->type == Node::bin_or_op) &&
+        effects.count(node->children[1]) != 0) {
+      // the left side is in the result already, unless it was jumped over
+      auto right = pop();
+      auto result = pop();
+      auto reg = in_register(right, result.value);
+      if (reg != result.value) {
+        emit(Op::mov, result.value, reg);
+      }
+      bind(short_circuits.back());
+      short_circuits.pop_back();
+      push(result);
+      break;
+    }
+
+    auto right = pop();
+    auto left = pop();
+    auto target = slot(operands.size());
+
+    bool is_add = node->type == Node::add_op;
+    bool is_sub = node->type == Node::sub_op;
+    if (is_add && left.kind == operand_t::imm &&
+        right.kind != operand_t::imm) {
+      std::swap(left, right);
+    }
+
+    if ((is_add || is_sub) && right.kind == operand_t::imm) {
+      // adding a constant is a single instruction, `i = i + 1` included
+      auto constant = static_cast<std::uint32_t>(right.value);
+      emit(Op::addi, target, in_register(left, target),
+           static_cast<std::int32_t>(is_sub ? 0u - constant : constant));
+    } else {
+      Op op = Op::add;
+      switch (node->type) {
+      case Node::sub_op:
+        op = Op::sub;
+        break;
+      case Node::mul_op:
+        op = Op::mul;
+        break;
+      case Node::div_op:
+        op = Op::div;
+        break;
+      case Node::mod_op:
+        op = Op::mod;
+        break;
+      case Node::bin_and_op:
+        op = Op::and_;
+        break;
+      case Node::bin_or_op:
+        op = Op::or_;
+        break;
+      default:
+        break;
+      }
+
+      auto l = in_register(left, target);
+      auto r = in_register(right, slot(operands.size() + 1));
+      emit(op, target, l, r);
+    }
+    push({operand_t::reg, target});
+    break;
+  }
+  case Node::eqeq_op:
+  case Node::noteq_op:
+  case Node::lt_op:
+  case Node::lteq_op:
+  case Node::gt_op:
+  case Node::gteq_op: {
+    auto right = pop();
+    auto left = pop();
+
+    Op op = Op::eq;
+    switch (node->type) {
+    case Node::noteq_op:
+      op = Op::ne;
+      break;
+    case Node::lt_op:
+      op = Op::lt;
+      break;
+    case Node::lteq_op:
+      op = Op::le;
+      break;
+    case Node::gt_op:
+      op = Op::gt;
+      break;
+    case Node::gteq_op:
+      op = Op::ge;
+      break;
+    default:
+      break;
+    }
+
+    if (left.kind == operand_t::imm && right.kind != operand_t::imm) {
+      std::swap(left, right);
+      op = mirror(op);
+    }
+
+    // the comparison is emitted once it's known if it's a value or a jump
+    operand_t result{operand_t::cmp, in_register(left, slot(operands.size()))};
+    result.op = op;
+    if (right.kind == operand_t::imm) {
+      result.right = right.value;
+      result.right_imm = true;
+    } else {
+      result.right = in_register(right, slot(operands.size() + 1));
+    }
+    push(result);
+    break;
+  }
+  case Node::not_op: {
+    auto value = pop();
+    if (value.kind == operand_t::cmp) {
+      value.op = negate(value.op);
+      push(value);
+    } else if (value.kind == operand_t::imm) {
+      push({operand_t::imm, value.value ^ 1});
+    } else {
+      auto target = slot(operands.size());
+      emit(Op::not_, target, value.value);
+      push({operand_t::reg, target});
+    }
+    break;
+  }
+  case Node::function_call:
+    call(node);
+    break;
+  case Node::statement_expr:
+    if (!node->children.empty()) {
+      pop();
+    }
+    break;
+  case Node::return_statement:
+    if (node->children.empty()) {
+      emit(Op::ret0);
+    } else {
+      auto value = pop();
+      if (value.kind == operand_t::imm) {
+        emit(Op::reti, 0, value.value);
+      } else {
+        emit(Op::ret, in_register(value, slot(operands.size())));
+      }
+    }
+    break;
+  case Node::break_statement:
+    for (auto control = controls.rbegin(); control != controls.rend();
+         ++control) {
+      if (control->node->type == Node::while_statement) {
+        control->exits.push_back(pc());
+        emit(Op::jmp);
+        break;
+      }
+    }
+    break;
+  case Node::if_statement:
+    bind(controls.back().false_jumps);
+    controls.pop_back();
+    break;
+  case Node::if_else_statement:
+    bind(controls.back().exits);
+    controls.pop_back();
+    break;
+  case Node::while_statement: {
+    auto control = std::move(controls.back());
+    controls.pop_back();
+
+    // the condition is checked again at the bottom of the loop, so an
+    // iteration takes a single jump
+    if (!is_unreachable()) {
+      auto start = pc();
+      for (auto i = control.cond_start; i < control.cond_end; i++) {
+        auto instr = program.code[i];
+        if (is_jump(instr.op)) {
+          auto &target = instr.op <= Op::jnz ? instr.b : instr.c;
+          if (static_cast<std::uint32_t>(target) >= control.cond_start &&
+              static_cast<std::uint32_t>(target) <= control.cond_end) {
+            target += start - control.cond_start;
+          }
+        }
+        program.code.push_back(instr);
+      }
+
+      std::vector<std::uint32_t> jumps;
+      branch(control.cond, true, jumps);
+      for (auto jump : jumps) {
+        set_target(jump, control.body_start);
+      }
+    }
+    bind(control.exits);
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (!path.empty()) {
+    after_child(path.back(), node);
+  }
+}
+
+/**
+ * @brief a child of an if, while, && or || is compiled, emit the jumps that
+ * follow it
+ */
+void BytecodeCompiler::after_child(ASTNode *parent, ASTNode *child) {
+  switch (parent->type) {
+  case Node::if_statement:
+  case Node::if_else_statement: {
+    auto &control = controls.back();
+    if (child == parent->children[0]) {
+      branch(pop(), false, control.false_jumps);
+    } else if (parent->type == Node::if_else_statement &&
+               child == parent->children[1]) {
+      // end of the then branch, jump over the else branch
+      if (!is_unreachable()) {
+        control.exits.push_back(pc());
+        emit(Op::jmp);
+      }
+      bind(control.false_jumps);
+    }
+    break;
+  }
+  case Node::while_statement: {
+    if (child == parent->children[0]) {
+      auto &control = controls.back();
+      control.cond = pop();
+      control.cond_end = pc();
+      branch(control.cond, false, control.exits);
+      control.body_start = pc();
+      label = pc();
+    }
+    break;
+  }
+  case Node::bin_and_op:
+  case Node::bin_or_op: {
+    // the right side isn't evaluated when the left one decides the result
+    if (child != parent->children[0] ||
+        effects.count(parent->children[1]) == 0) {
+      break;
+    }
+
+    auto left = pop();
+    auto target = slot(operands.size());
+    auto reg = in_register(left, target);
+    if (reg != target) {
+      emit(Op::mov, target, reg);
+    }
+
+    short_circuits.emplace_back();
+    branch({operand_t::reg, target}, parent->type == Node::bin_or_op,
+           short_circuits.back());
+    push({operand_t::reg, target});
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void BytecodeCompiler::begin_function(ASTNode *node) {
+  auto *id = node->find_first(Node::id);
+  auto &function = program.functions[function_index.at(id->function_symbol)];
+  function.entry = pc();
+  label = pc();
+
+  // parameters come first, in the order the arguments are passed
+  local_register = IdMap<std::int32_t>();
+  std::int32_t next = 0;
+  for (auto *formal : node->find_first(Node::formal_params)->children) {
+    local_register.insert(formal->children[1]->name, next++);
+  }
+  function.params = static_cast<std::uint32_t>(next);
+
+  std::vector<Symbol *> arrays;
+  for (auto const &[name, sym] : sym_table->get_scope(id->name)) {
+    if (sym->kind == "variable" && sym->is_array()) {
+      arrays.push_back(sym);
+    } else if (sym->kind == "variable") {
+      local_register.insert(name, next++);
+    }
+  }
+
+  // the temporaries come after the arrays, they have to stay addressable
+  array_register = IdMap<std::int32_t>();
+  std::int64_t end = next;
+  for (auto *sym : arrays) {
+    array_register.insert(sym->name, static_cast<std::int32_t>(end));
+    end = std::min<std::int64_t>(end + sym->length, UINT16_MAX + 1);
+  }
+  next = static_cast<std::int32_t>(end);
+  function.locals = static_cast<std::uint32_t>(next) - function.params;
+
+  frame_base = next;
+  max_register = next - 1;
+  operands.clear();
+}
+
+void BytecodeCompiler::end_function(ASTNode *node) {
+  auto *fun_sym = node->find_first(Node::id)->function_symbol;
+  auto &function = program.functions[function_index.at(fun_sym)];
+
+  if (!is_unreachable()) {
+    if (node->type == Node::main_func_decl) {
+      emit(Op::halt);
+    } else if (fun_sym->type == Node::void_t) {
+      emit(Op::ret0);
+    } else {
+      // fell off the end of a function that returns a value
+      emit(Op::trap);
+    }
+  }
+
+  function.registers = static_cast<std::uint32_t>(max_register + 1);
+  if (function.registers > UINT16_MAX) {
+    throw std::runtime_error("function `" + function.name +
+                             "` needs more than " +
+                             std::to_string(UINT16_MAX) + " registers");
+  }
+}
+
+/**
+ * @brief check the index of an element access, and load the element unless
+ * it is assigned to
+ */
+void BytecodeCompiler::element(ASTNode *node) {
+  auto *sym = node->children[0]->symbol;
+  auto index = pop();
+  auto length = static_cast<std::int32_t>(sym->length);
+
+  // a constant index that is in bounds doesn't need a check
+  if (index.kind != operand_t::imm || index.value < 0 ||
+      index.value >= length) {
+    auto reg = in_register(index, slot(operands.size()));
+    emit(Op::bound, reg, length);
+    index = {operand_t::reg, reg};
+  }
+
+  auto *parent = path.back();
+  if (parent->type == Node::eq_op && parent->children[0] == node) {
+    push(index);
+    return;
+  }
+
+  auto target = slot(operands.size());
+  access(sym, target, index, false);
+  push({operand_t::reg, target});
+}
+
+/**
+ * @brief emit a load or store of an array element
+ *
+ * @param sym array
+ * @param reg register loaded or stored
+ * @param index index, already checked
+ * @param store true for a store, false for a load
+ */
+void BytecodeCompiler::access(Symbol *sym, std::int32_t reg,
+                              operand_t const &index, bool store) {
+  if (sym->is_global()) {
+    auto base = *global_index.find(sym->name);
+    if (index.kind == operand_t::imm) {
+      emit(store ? Op::setg : Op::getg, reg, base + index.value);
+    } else {
+      emit(store ? Op::setgx : Op::getgx, reg, base, index.value);
+    }
+    return;
+  }
+
+  // above the value that is stored, if the index has to be loaded
+  auto index_reg = in_register(index, slot(operands.size() + 2));
+  emit(store ? Op::setx : Op::getx, reg, *array_register.find(sym->name),
+       index_reg);
+}
+
+void BytecodeCompiler::call(ASTNode *node) {
+  static const name_id_t getchar_name = intern("getchar");
+  static const name_id_t halt_name = intern("halt");
+  static const name_id_t printb_name = intern("printb");
+  static const name_id_t printc_name = intern("printc");
+  static const name_id_t prints_name = intern("prints");
+
+  auto *fun_sym = node->children[0]->function_symbol;
+  auto *actuals = node->find_first(Node::actual_params);
+  std::size_t count = actuals != nullptr ? actuals->children.size() : 0;
+
+  auto iter = function_index.find(fun_sym);
+  if (iter == function_index.end()) {
+    // builtins are instructions of their own
+    if (fun_sym->name == getchar_name) {
+      auto target = next_slot();
+      emit(Op::getchar, target);
+      push({operand_t::reg, target});
+      return;
+    }
+
+    if (fun_sym->name == halt_name) {
+      emit(Op::halt);
+    } else if (fun_sym->name == prints_name) {
+      emit(Op::prints, 0, pop().value);
+    } else {
+      auto arg = pop();
+      auto reg = in_register(arg, slot(operands.size()));
+      emit(fun_sym->name == printb_name   ? Op::printb
+           : fun_sym->name == printc_name ? Op::printc
+                                          : Op::printi,
+           reg);
+    }
+    push({operand_t::imm, 0});
+    return;
+  }
+
+  // arguments are passed in consecutive temporaries, which become the first
+  // registers of the callee
+  std::size_t first = operands.size() - count;
+  if (count == 0) {
+    next_slot();
+  }
+  for (std::size_t i = 0; i < count; i++) {
+    auto target = slot(first + i);
+    auto reg = in_register(operands[first + i], target);
+    if (reg != target) {
+      emit(Op::mov, target, reg);
+    }
+  }
+  operands.resize(first);
+
+  auto base = slot(first);
+  emit(Op::call, base, static_cast<std::int32_t>(iter->second));
+  push(fun_sym->type == Node::void_t ? operand_t{operand_t::imm, 0}
+                                     : operand_t{operand_t::reg, base});
+}
+
+void BytecodeCompiler::emit(Op op, std::int32_t a, std::int32_t b,
+                            std::int32_t c) {
+  program.code.push_back({op, static_cast<std::uint16_t>(a), b, c});
+}
+
+/**
+ * @brief register of the temporary at a position of the operand stack
+ */
+std::int32_t BytecodeCompiler::slot(std::size_t position) {
+  auto reg = frame_base + static_cast<std::int32_t>(position);
+  max_register = std::max(max_register, reg);
+  return reg;
+}
+
+/**
+ * @brief register of the next temporary. a pending comparison on top of
+ * the operand stack is emitted first, so it can't be overwritten
+ */
+std::int32_t BytecodeCompiler::next_slot() {
+  if (!operands.empty() && operands.back().kind == operand_t::cmp) {
+    auto &top = operands.back();
+    top = {operand_t::reg, in_register(top, slot(operands.size() - 1))};
+  }
+  return slot(operands.size());
+}
+
+void BytecodeCompiler::push(operand_t operand) {
+  next_slot();
+  operands.push_back(operand);
+}
+
+BytecodeCompiler::operand_t BytecodeCompiler::pop() {
+  auto operand = operands.back();
+  operands.pop_back();
+  return operand;
+}
+
+/**
+ * @brief get an operand into a register
+ *
+ * @param operand operand to load
+ * @param target register to use if the operand isn't in one already
+ * @return std::int32_t register that holds the operand
+ */
+std::int32_t BytecodeCompiler::in_register(operand_t const &operand,
+                                           std::int32_t target) {
+  switch (operand.kind) {
+  case operand_t::reg:
+    return operand.value;
+  case operand_t::imm:
+    emit(Op::movi, target, operand.value);
+    return target;
+  case operand_t::cmp: {
+    auto right = operand.right;
+    if (operand.right_imm) {
+      // above every temporary that can be live
+      right = slot(operands.size() + 2);
+      emit(Op::movi, right, operand.right);
+    }
+    emit(operand.op, target, operand.value, right);
+    return target;
+  }
+  }
+  return target;
+}
+
+/**
+ * @brief copy the pending operands that read a local into their own
+ * temporaries, before the local is assigned
+ */
+void BytecodeCompiler::detach(std::int32_t reg) {
+  for (std::size_t i = 0; i < operands.size(); i++) {
+    auto &operand = operands[i];
+    bool reads = operand.value == reg;
+    if (operand.kind == operand_t::imm) {
+      reads = false;
+    } else if (operand.kind == operand_t::cmp && !operand.right_imm) {
+      reads = reads || operand.right == reg;
+    }
+
+    if (reads) {
+      auto target = slot(i);
+      if (operand.kind == operand_t::reg) {
+        emit(Op::mov, target, reg);
+      } else {
+        in_register(operand, target);
+      }
+      operand = {operand_t::reg, target};
+    }
+  }
+}
+
+/**
+ * @brief emit a jump taken when the truth of `cond` is `when`
+ *
+ * @param jumps gets the jumps whose target has to be set
+ */
+void BytecodeCompiler::branch(operand_t const &cond, bool when,
+                              std::vector<std::uint32_t> &jumps) {
+  switch (cond.kind) {
+  case operand_t::imm:
+    if ((cond.value != 0) == when) {
+      jumps.push_back(pc());
+      emit(Op::jmp);
+    }
+    break;
+  case operand_t::reg:
+    jumps.push_back(pc());
+    emit(when ? Op::jnz : Op::jz, cond.value);
+    break;
+  case operand_t::cmp: {
+    // compare and jump in one instruction
+    auto jump = jump_of(when ? cond.op : negate(cond.op));
+    jumps.push_back(pc());
+    emit(cond.right_imm ? with_immediate(jump) : jump, cond.value, cond.right);
+    break;
+  }
+  }
+}
+
+/**
+ * @brief set the target of jumps to the current position
+ */
+void BytecodeCompiler::bind(std::vector<std::uint32_t> const &jumps) {
+  for (auto jump : jumps) {
+    set_target(jump, pc());
+  }
+  if (!jumps.empty()) {
+    label = pc();
+  }
+}
+
+void BytecodeCompiler::set_target(std::uint32_t jump, std::uint32_t target) {
+  auto &instr = program.code[jump];
+  if (instr.op <= Op::jnz) {
+    instr.b = static_cast<std::int32_t>(target);
+  } else {
+    instr.c = static_cast<std::int32_t>(target);
+  }
+}
+
+/**
+ * @brief check if the last instruction never falls through to the current
+ * position
+ */
+bool BytecodeCompiler::is_unreachable() const {
+  if (program.code.empty() || label == pc()) {
+    return false;
+  }
+
+  switch (program.code.back().op) {
+  case Op::jmp:
+  case Op::ret:
+  case Op::reti:
+  case Op::ret0:
+  case Op::halt:
+  case Op::trap:
+    return true;
+  default:
+    return false;
+  }
+}
@@ -0,0 +1,693 @@
+/**
+ * @file CGenerator.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Generate a self-contained C file for J-- code
+ */
+
+#include "CGenerator.hpp"
+#include "SideEffects.hpp"
+#include "Wasm.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+/**
+ * @brief builtins and the int32 helpers every generated file starts with.
+ * The helpers compute in uint32_t so overflow wraps instead of being
+ * undefined, and division traps where i32.div_s and i32.rem_s do
+ */
+const char *RUNTIME = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned char jay_out[65536];
+static size_t jay_out_len;
+
+static void jay_flush(void) {
+  fwrite(jay_out, 1, jay_out_len, stdout);
+  fflush(stdout);
+  jay_out_len = 0;
+}
+
+static void jay_trap(const char *reason) {
+  jay_flush();
+  fprintf(stderr, "error: trap: %s\n", reason);
+  exit(1);
+}
+
+static void jay_halt(void) {
+  jay_flush();
+  exit(0);
+}
+
+static void jay_printc(int32_t c) {
+  if (jay_out_len == sizeof(jay_out)) {
+    jay_flush();
+  }
+  jay_out[jay_out_len++] = (unsigned char)c;
+}
+
+static void jay_prints(const unsigned char *str, size_t length) {
+  if (jay_out_len + length > sizeof(jay_out)) {
+    jay_flush();
+  }
+  if (length > sizeof(jay_out)) {
+    fwrite(str, 1, length, stdout);
+    return;
+  }
+  memcpy(jay_out + jay_out_len, str, length);
+  jay_out_len += length;
+}
+
+static void jay_printi(int32_t i) {
+  char digits[16];
+  char *end = digits + sizeof(digits);
+  char *p = end;
+  /* negated as unsigned, so INT32_MIN is fine */
+  uint32_t u = i < 0 ? 0u - (uint32_t)i : (uint32_t)i;
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (i < 0) {
+    *--p = '-';
+  }
+  jay_prints((const unsigned char *)p, (size_t)(end - p));
+}
+
+static int32_t jay_getchar(void) {
+  int c;
+  jay_flush();
+  c = getchar();
+  return c == EOF ? -1 : c;
+}
+
+static int32_t jay_add(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static int32_t jay_sub(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+static int32_t jay_mul(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+static int32_t jay_neg(int32_t a) { return (int32_t)(0u - (uint32_t)a); }
+
+static int32_t jay_div(int32_t a, int32_t b) {
+  if (b == 0) {
+    jay_trap("integer divide by zero");
+  }
+  if (a == INT32_MIN && b == -1) {
+    jay_trap("integer overflow");
+  }
+  return a / b;
+}
+
+static int32_t jay_rem(int32_t a, int32_t b) {
+  if (b == 0) {
+    jay_trap("integer divide by zero");
+  }
+  /* INT32_MIN % -1 overflows in C, but is 0 in wasm */
+  return b == -1 ? 0 : a % b;
+}
+
+static uint32_t jay_index(int32_t i, uint32_t length) {
+  /* a negative index is a large unsigned one */
+  if ((uint32_t)i >= length) {
+    jay_trap("index out of bounds");
+  }
+  return (uint32_t)i;
+}
+)";
+
+std::string function_name(name_id_t name) {
+  return "jay_fn_" + name_str(name);
+}
+
+std::string variable_name(Symbol const *sym) {
+  return (sym->is_global() ? "g_" : "l_") + name_str(sym->name);
+}
+
+/**
+ * @brief get the variables of a scope, sorted by their C names
+ */
+std::vector<Symbol *> scope_variables(SymTable &sym_table,
+                                      name_id_t scope_name) {
+  std::vector<Symbol *> vars;
+  for (auto const &[name, sym] : sym_table.get_scope(scope_name)) {
+    if (sym->kind == "variable") {
+      vars.push_back(sym);
+    }
+  }
+  std::sort(vars.begin(), vars.end(), [](Symbol *a, Symbol *b) {
+    return variable_name(a) < variable_name(b);
+  });
+  return vars;
+}
+
+/**
+ * @brief C declaration of a variable or an array, without an initializer
+ */
+std::string declaration(Symbol const *sym) {
+  auto text = "int32_t " + variable_name(sym);
+  if (sym->is_array()) {
+    text += "[" + std::to_string(sym->length) + "]";
+  }
+  return text;
+}
+
+std::string constant(std::int32_t value) {
+  if (value == INT32_MIN) {
+    return "(-2147483647 - 1)";
+  }
+  if (value < 0) {
+    return "(" + std::to_string(value) + ")";
+  }
+  return std::to_string(value);
+}
+
+/**
+ * @brief drop the parentheses around a whole expression
+ */
+std::string unwrap(std::string const &text) {
+  if (text.size() < 2 || text.front() != '(' || text.back() != ')') {
+    return text;
+  }
+  int open = 0;
+  for (std::size_t i = 0; i + 1 < text.size(); i++) {
+    if (text[i] == '(') {
+      open++;
+    } else if (text[i] == ')' && --open == 0) {
+      // the first parenthesis closes before the end
+      return text;
+    }
+  }
+  return text.substr(1, text.size() - 2);
+}
+
+} // namespace
+
+/**
+ * @brief generate the C file and write it to the out stream
+ */
+void CGenerator::generate() {
+  effects = find_side_effects(ast.get());
+
+  std::vector<ASTNode *> declarations;
+  for (auto *node : ast->children) {
+    if (node->type == Node::function_decl ||
+        node->type == Node::main_func_decl) {
+      functions.insert(node->find_first(Node::id)->function_symbol);
+      declarations.push_back(node);
+    }
+  }
+
+  // strings are leaves, so a pre-order scan finds them in source order
+  walk(
+      ast.get(),
+      [this](ASTNode *node) {
+        if (node->type == Node::string) {
+          auto text = wasm::unescape(node->value);
+          if (!str_table.contains(text)) {
+            str_table.define(text);
+          }
+        }
+        return Visit::next;
+      },
+      [](ASTNode *) {});
+
+  out << "/* generated by jay, build with `cc -O2` */\n\n" << RUNTIME;
+
+  std::vector<unsigned char> bytes;
+  for (auto const &[text, entry] : str_table.entries()) {
+    bytes.resize(std::max<std::size_t>(bytes.size(),
+                                       entry.offset + entry.length));
+    std::copy(text.begin(), text.end(), bytes.begin() + entry.offset);
+  }
+  out << "\nstatic const unsigned char jay_strings[] = {";
+  for (std::size_t i = 0; i < bytes.size(); i++) {
+    out << (i % 12 == 0 ? "\n   " : "") << " "
+        << static_cast<unsigned>(bytes[i]) << ",";
+  }
+  out << "\n};\n";
+
+  out << "\nstatic void jay_printb(int32_t b) {\n";
+  auto true_entry = str_table.lookup("true");
+  auto false_entry = str_table.lookup("false");
+  out << "  if (b > 0) {\n    jay_prints(jay_strings + " << true_entry.offset
+      << ", " << true_entry.length << ");\n  } else {\n"
+      << "    jay_prints(jay_strings + " << false_entry.offset << ", "
+      << false_entry.length << ");\n  }\n}\n";
+
+  auto globals = scope_variables(*sym_table, sym_table->global_scope());
+  if (!globals.empty()) {
+    out << "\n";
+    for (auto *sym : globals) {
+      out << "static " << declaration(sym) << ";\n";
+    }
+  }
+
+  out << "\n";
+  for (auto *node : declarations) {
+    out << signature(node) << ";\n";
+  }
+
+  visit(ast.get());
+
+  auto *main_decl = ast->find_first(Node::main_func_decl);
+  out << "\nint main(void) {\n";
+  if (main_decl != nullptr) {
+    out << "  " << function_name(main_decl->find_first(Node::id)->name)
+        << "();\n";
+  }
+  out << "  jay_flush();\n  return 0;\n}\n";
+}
+
+/**
+ * @brief pre-order step, opens functions and loops
+ */
+Visit CGenerator::enter(ASTNode *node) {
+  path.push_back(node);
+
+  switch (node->type) {
+  case Node::global_var_decl:
+  case Node::variable_decl:
+  case Node::formal_params:
+    return Visit::skip_children;
+  case Node::main_func_decl:
+  case Node::function_decl:
+    begin_function(node);
+    break;
+  case Node::while_statement:
+    loops.push_back(lines.size());
+    break;
+  default:
+    break;
+  }
+
+  return Visit::next;
+}
+
+/**
+ * @brief post-order step, builds the expression or emits the statement of
+ * a node once its children are generated
+ */
+void CGenerator::leave(ASTNode *node) {
+  path.pop_back();
+
+  switch (node->type) {
+  case Node::main_func_decl:
+  case Node::function_decl:
+    end_function(node);
+    break;
+  case Node::int_t:
+  case Node::boolean_t:
+    if (node->is_const()) {
+      push({constant(node->type == Node::boolean_t ? node->value == "true"
+                                                   : std::stoi(node->value)),
+            true});
+    }
+    break;
+  case Node::string: {
+    // prints gets the address and the length of the string
+    auto entry = str_table.lookup(wasm::unescape(node->value));
+    push({"jay_strings + " + std::to_string(entry.offset) + ", " +
+              std::to_string(entry.length),
+          true});
+    break;
+  }
+  case Node::id: {
+    auto *parent = path.back();
+    // names of functions, arrays and targets of assignments aren't read
+    if (parent->type == Node::function_decl ||
+        parent->type == Node::main_func_decl ||
+        ((parent->type == Node::eq_op ||
+          parent->type == Node::function_call ||
+          parent->type == Node::index_op) &&
+         parent->children[0] == node)) {
+      break;
+    }
+    push({variable_name(node->symbol)});
+    break;
+  }
+  case Node::index_op:
+    element(node);
+    break;
+  case Node::eq_op: {
+    auto value = pop();
+    auto target = node->children[0]->type == Node::index_op
+                      ? pop().text
+                      : variable_name(node->children[0]->symbol);
+    push({"(" + target + " = " + unwrap(value.text) + ")"});
+    break;
+  }
+  case Node::sub_op:
+    if (node->children.size() == 1) {
+      push({"jay_neg(" + unwrap(pop().text) + ")"});
+      break;
+    }
+    [[fallthrough]];
+  case Node::add_op:
+  case Node::mul_op:
+  case Node::div_op:
+  case Node::mod_op: {
+    auto right = pop();
+    auto left = pop();
+    const char *helper = node->type == Node::add_op   ? "jay_add("
+                         : node->type == Node::sub_op ? "jay_sub("
+                         : node->type == Node::mul_op ? "jay_mul("
+                         : node->type == Node::div_op ? "jay_div("
+                                                      : "jay_rem(";
+    push({helper + unwrap(left.text) + ", " + unwrap(right.text) + ")"});
+    break;
+  }
+  case Node::eqeq_op:
+  case Node::noteq_op:
+  case Node::lt_op:
+  case Node::lteq_op:
+  case Node::gt_op:
+  case Node::gteq_op:
+  case Node::bin_and_op:
+  case Node::bin_or_op: {
+    auto right = pop();
+    auto left = pop();
+    if ((node->type == Node::bin_and_op || node->type == Node::bin_or_op) &&
+        effects.count(node->children[1]) != 0) {
+      // close the if that skips the right side
+      emit(left.text + " = " + unwrap(right.text) + ";");
+      depth--;
+      emit("}");
+      push(left);
+      break;
+    }
+
+    // booleans are 0 or 1, so when the right side can be evaluated either
+    // way && and || are the bitwise operators
+    const char *op = node->type == Node::eqeq_op    ? " == "
+                     : node->type == Node::noteq_op ? " != "
+                     : node->type == Node::lt_op    ? " < "
+                     : node->type == Node::lteq_op  ? " <= "
+                     : node->type == Node::gt_op    ? " > "
+                     : node->type == Node::gteq_op  ? " >= "
+                     : node->type == Node::bin_and_op ? " & "
+                                                      : " | ";
+    push({"(" + left.text + op + right.text + ")"});
+    break;
+  }
+  case Node::not_op:
+    push({"!" + pop().text});
+    break;
+  case Node::function_call:
+    call(node);
+    break;
+  case Node::statement_expr:
+    if (!node->children.empty()) {
+      auto value = pop();
+      if (effects.count(node) != 0) {
+        emit(unwrap(value.text) + ";");
+      } else {
+        emit("(void)" + value.text + ";");
+      }
+    }
+    break;
+  case Node::return_statement:
+    if (!node->children.empty()) {
+      emit("return " + unwrap(pop().text) + ";");
+    } else {
+      emit("return;");
+    }
+    break;
+  case Node::break_statement:
+    emit("break;");
+    break;
+  case Node::if_statement:
+  case Node::if_else_statement:
+    depth--;
+    emit("}");
+    break;
+  case Node::while_statement:
+    loops.pop_back();
+    depth--;
+    emit("}");
+    break;
+  default:
+    break;
+  }
+
+  if (!path.empty()) {
+    after_child(path.back(), node);
+  }
+}
+
+/**
+ * @brief a child of a statement, operator or call is generated, emit what
+ * follows it
+ */
+void CGenerator::after_child(ASTNode *parent, ASTNode *child) {
+  switch (parent->type) {
+  case Node::if_statement:
+  case Node::if_else_statement:
+    if (child == parent->children[0]) {
+      emit("if (" + unwrap(pop().text) + ") {");
+      depth++;
+    } else if (parent->type == Node::if_else_statement &&
+               child == parent->children[1]) {
+      depth--;
+      emit("} else {");
+      depth++;
+    }
+    break;
+  case Node::while_statement:
+    if (child == parent->children[0]) {
+      auto cond = pop();
+      auto start = loops.back();
+      if (start == lines.size()) {
+        emit("while (" + unwrap(cond.text) + ") {");
+      } else {
+        // the condition needs statements of its own, which have to run
+        // before every iteration
+        for (auto i = start; i < lines.size(); i++) {
+          lines[i] = "  " + lines[i];
+        }
+        lines.insert(lines.begin() + start,
+                     std::string(2 * depth, ' ') + "for (;;) {");
+        depth++;
+        emit("if (!" + cond.text + ") {");
+        emit("  break;");
+        emit("}");
+        depth--;
+      }
+      depth++;
+    }
+    break;
+  case Node::add_op:
+  case Node::sub_op:
+  case Node::mul_op:
+  case Node::div_op:
+  case Node::mod_op:
+  case Node::eqeq_op:
+  case Node::noteq_op:
+  case Node::lt_op:
+  case Node::lteq_op:
+  case Node::gt_op:
+  case Node::gteq_op:
+    if (child == parent->children[0]) {
+      sequence(parent->children, 0);
+    }
+    break;
+  case Node::bin_and_op:
+  case Node::bin_or_op: {
+    if (child != parent->children[0]) {
+      break;
+    }
+    if (effects.count(parent->children[1]) == 0) {
+      sequence(parent->children, 0);
+      break;
+    }
+
+    // the right side is only evaluated if the left one doesn't decide the
+    // result, the statements it needs go in an if
+    auto temp = "t" + std::to_string(next_temp++);
+    emit("int32_t " + temp + " = " + unwrap(pop().text) + ";");
+    emit(std::string(parent->type == Node::bin_and_op ? "if (" : "if (!") +
+         temp + ") {");
+    depth++;
+    push({temp});
+    break;
+  }
+  case Node::actual_params:
+    for (std::size_t i = 0; i < parent->children.size(); i++) {
+      if (parent->children[i] == child) {
+        sequence(parent->children, i);
+        break;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void CGenerator::begin_function(ASTNode *node) {
+  lines.clear();
+  depth = 1;
+  next_temp = 0;
+
+  auto *id = node->find_first(Node::id);
+  for (auto *sym : scope_variables(*sym_table, id->name)) {
+    emit(declaration(sym) + (sym->is_array() ? " = {0};" : " = 0;"));
+  }
+}
+
+/**
+ * @brief access an element of an array. the index is checked where the
+ * element is used, or before the value is computed if it's assigned
+ */
+void CGenerator::element(ASTNode *node) {
+  auto *sym = node->children[0]->symbol;
+  auto *index_node = node->children[1];
+  auto index = pop();
+
+  // a constant index that is in bounds doesn't need a check
+  bool in_bounds = index_node->type == Node::int_t && index_node->is_const() &&
+                   index_node->value[0] != '-' &&
+                   std::stoll(index_node->value) < sym->length;
+  auto text = in_bounds ? index.text
+                        : "jay_index(" + unwrap(index.text) + ", " +
+                              std::to_string(sym->length) + ")";
+
+  // C doesn't order the two sides of an assignment, J-- checks the index
+  // before the value is computed
+  auto *parent = path.back();
+  if (!in_bounds && parent->type == Node::eq_op &&
+      parent->children[0] == node && effects.count(parent->children[1]) != 0) {
+    auto temp = "t" + std::to_string(next_temp++);
+    emit("uint32_t " + temp + " = " + text + ";");
+    text = temp;
+  }
+  push({variable_name(sym) + "[" + text + "]"});
+}
+
+void CGenerator::end_function(ASTNode *node) {
+  auto *fun_sym = node->find_first(Node::id)->function_symbol;
+  if (node->type != Node::main_func_decl && fun_sym->type != Node::void_t &&
+      (lines.empty() || lines.back().rfind("  return ", 0) != 0)) {
+    // fell off the end of a function that returns a value
+    emit("jay_trap(\"function ended without returning a value\");");
+    emit("return 0;");
+  }
+
+  out << "\n" << signature(node) << " {\n";
+  for (auto const &line : lines) {
+    out << line << "\n";
+  }
+  out << "}\n";
+}
+
+void CGenerator::call(ASTNode *node) {
+  static const name_id_t getchar_name = intern("getchar");
+  static const name_id_t halt_name = intern("halt");
+  static const name_id_t printb_name = intern("printb");
+  static const name_id_t printc_name = intern("printc");
+  static const name_id_t printi_name = intern("printi");
+
+  auto *fun_sym = node->children[0]->function_symbol;
+  auto *actuals = node->find_first(Node::actual_params);
+  std::size_t count = actuals != nullptr ? actuals->children.size() : 0;
+
+  std::vector<std::string> args(count);
+  for (std::size_t i = count; i > 0; i--) {
+    args[i - 1] = unwrap(pop().text);
+  }
+
+  std::string text;
+  if (functions.count(fun_sym) != 0) {
+    text = function_name(fun_sym->name);
+  } else if (fun_sym->name == getchar_name) {
+    text = "jay_getchar";
+  } else if (fun_sym->name == halt_name) {
+    text = "jay_halt";
+  } else if (fun_sym->name == printb_name) {
+    text = "jay_printb";
+  } else if (fun_sym->name == printc_name) {
+    text = "jay_printc";
+  } else if (fun_sym->name == printi_name) {
+    text = "jay_printi";
+  } else {
+    text = "jay_prints";
+  }
+
+  text += "(";
+  for (std::size_t i = 0; i < count; i++) {
+    text += (i > 0 ? ", " : "") + args[i];
+  }
+  push({text + ")"});
+}
+
+/**
+ * @brief store the operand on top of the stack in a temporary if one of the
+ * siblings evaluated after it could change it or depends on it
+ *
+ * @param siblings operands of the same operator or call
+ * @param index position of the operand among them
+ */
+void CGenerator::sequence(NodeList const &siblings, std::size_t index) {
+  if (operands.back().constant) {
+    return;
+  }
+
+  bool later_effects = false;
+  bool later_reads = false;
+  for (auto i = index + 1; i < siblings.size(); i++) {
+    later_effects = later_effects || effects.count(siblings[i]) != 0;
+    later_reads = later_reads || !siblings[i]->is_const();
+  }
+  if (later_effects ||
+      (effects.count(siblings[index]) != 0 && later_reads)) {
+    auto temp = "t" + std::to_string(next_temp++);
+    emit("int32_t " + temp + " = " + unwrap(pop().text) + ";");
+    push({temp});
+  }
+}
+
+void CGenerator::emit(std::string line) {
+  lines.push_back(std::string(2 * depth, ' ') + line);
+}
+
+void CGenerator::push(operand_t operand) {
+  operands.push_back(std::move(operand));
+}
+
+CGenerator::operand_t CGenerator::pop() {
+  auto operand = std::move(operands.back());
+  operands.pop_back();
+  return operand;
+}
+
+/**
+ * @brief C declaration of a J-- function
+ */
+std::string CGenerator::signature(ASTNode *node) const {
+  auto *fun_sym = node->find_first(Node::id)->function_symbol;
+  std::string text =
+      std::string(node->type == Node::main_func_decl ||
+                          fun_sym->type == Node::void_t
+                      ? "static void "
+                      : "static int32_t ") +
+      function_name(fun_sym->name) + "(";
+
+  auto &formals = node->find_first(Node::formal_params)->children;
+  if (formals.empty()) {
+    return text + "void)";
+  }
+  for (std::size_t i = 0; i < formals.size(); i++) {
+    text += (i > 0 ? ", int32_t l_" : "int32_t l_") +
+            name_str(formals[i]->children[1]->name);
+  }
+  return text + ")";
+}
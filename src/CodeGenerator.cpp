@@ -1,96 +1,167 @@
 /**
  * @file CodeGenerator.cpp
  * @author Artem Golovin (30018900)
- * @brief Generate WebAssembly text format for J-- code
+ * @brief Generate WebAssembly for J-- code, as text or in the binary format
  */
 
 #include "CodeGenerator.hpp"
+#include "Runtime.hpp"
+#include "SideEffects.hpp"
+#include <algorithm>
+
+using wasm::Op;
+
+namespace {
+
+// shorter if/else-if chains are left as they are
+const std::size_t MIN_SWITCH_CASES = 4;
+// cases in the binary search that are compared one by one
+const std::size_t LINEAR_SEARCH_CASES = 3;
+// room for frames on top of the largest one, recursion that needs more
+// runs off the end of the memory and traps
+const std::uint64_t STACK_SIZE = 1 << 20;
+const std::uint64_t PAGE_SIZE = 65536;
+const std::uint64_t MAX_PAGES = 65536;
+// output a buffered runtime collects before it calls the host
+const std::uint64_t OUTPUT_BUFFER_SIZE = 65536;
+// a node that isn't a child of the innermost construct
+const std::size_t NO_ARM = static_cast<std::size_t>(-1);
+// printi of the runtime writes a number at the end of SCRATCH_SIZE bytes
+// after the two digits of 00 to 99, enough for "-2147483648". it expects
+// them right after "true" and "false", at 9 and 209
+const unsigned int SCRATCH_SIZE = 11;
 
 /**
- * @brief Generate wasm code and output it to out stream (by default it goes
- * to stdout)
+ * @brief get the decimal digits of 0 to 99, two for each: "0001...9899"
  */
-void CodeGenerator::generate_wasm() {
-  this->traverse(ast.get(), nullptr,
-                 std::bind(&CodeGenerator::build_string_table_post_traversal_cb,
-                           this, std::placeholders::_1, std::placeholders::_2),
-                 this->out);
-
-  this->traverse(ast.get(),
-                 std::bind(&CodeGenerator::codegen_pre_traversal_cb, this,
-                           std::placeholders::_1, std::placeholders::_2),
-                 std::bind(&CodeGenerator::codegen_post_traversal_cb, this,
-                           std::placeholders::_1, std::placeholders::_2),
-                 this->out);
+std::string digit_pairs() {
+  std::string digits;
+  for (char tens = '0'; tens <= '9'; tens++) {
+    for (char ones = '0'; ones <= '9'; ones++) {
+      digits += tens;
+      digits += ones;
+    }
+  }
+  return digits;
 }
 
 /**
- * @brief YATM (Yet Another Traversal Method). Method to traverse AST
- * TODO: make this *actually* generic
- *
- * @param node AST node
- * @param pre pre traversal hook/callback
- * @param post  post traversal hook/callback
- * @param out output stream
+ * @brief get the size of an array element, booleans take a byte
  */
-void CodeGenerator::traverse(
-    ASTNode *node, std::function<void(ASTNode *n, std::ostream &out)> pre,
-    std::function<void(ASTNode *n, std::ostream &out)> post,
-    std::ostream &out) {
-  if (pre != nullptr) {
-    pre(node, out);
-  }
+std::uint64_t element_size(Symbol *sym) {
+  return sym->type == Node::boolean_t ? 1 : 4;
+}
 
-  for (auto *next : node->children) {
-    traverse(next, pre, post, out);
-  }
+/**
+ * @brief round up to a multiple of 4, so int elements are aligned
+ */
+std::uint64_t align(std::uint64_t offset) { return (offset + 3) & ~3ull; }
 
-  if (post != nullptr) {
-    post(node, out);
+/**
+ * @brief get the instruction that loads or stores an element of an array
+ */
+Op element_op(Symbol *sym, bool store) {
+  if (sym->type == Node::boolean_t) {
+    return store ? Op::i32_store8 : Op::i32_load8_u;
   }
+  return store ? Op::i32_store : Op::i32_load;
 }
 
+const name_id_t sp_name = intern("__sp");
+const name_id_t frame_name = intern("__frame");
+const name_id_t index_name = intern("__index");
+const name_id_t flush_name = intern("__flush");
+
 /**
- * @brief Generate a string table that will be inserted in the generated WASM
- * code
+ * @brief get the variable an if compares with a constant, as in `x == 2`
+ * or `-1 == x`
  *
- * @param node AST node
+ * @param cond condition of the if
+ * @param value set to the constant
+ * @return Symbol* the variable, nullptr if the condition is something else
  */
-void CodeGenerator::build_string_table_post_traversal_cb(ASTNode *node,
-                                                         std::ostream &out) {
-  switch (node->type) {
-  case Node::string:
-    str_table->define(node->value);
-    break;
-  default:
-    break;
+Symbol *compared_variable(ASTNode *cond, std::int32_t &value) {
+  if (cond->type != Node::eqeq_op) {
+    return nullptr;
+  }
+
+  for (std::size_t i = 0; i < 2; i++) {
+    auto *var = cond->children[i];
+    auto *constant = cond->children[1 - i];
+    if (var->type == Node::id && var->symbol != nullptr &&
+        var->function_symbol == nullptr && constant->type == Node::int_t &&
+        constant->is_const()) {
+      value = std::stoi(constant->value);
+      return var->symbol;
+    }
   }
+  return nullptr;
 }
 
-void CodeGenerator::codegen_pre_traversal_cb(ASTNode *node, std::ostream &out) {
+} // namespace
 
-  auto iter = printer->decorations.find(node);
-  if (iter != printer->decorations.end()) {
-    if (iter->second.pre != nullptr) {
-      iter->second.pre(node);
-    }
+/**
+ * @brief Generate wasm code and output it to out stream (by default it goes
+ * to stdout)
+ *
+ * @throws std::runtime_error if the binary module can't be built, e.g. the
+ * runtime doesn't assemble
+ */
+void CodeGenerator::generate_wasm() {
+  build_string_table();
+  layout_memory();
+  effects = find_side_effects(ast.get());
+
+  visit(ast.get());
+}
+
+/**
+ * @brief Generate a string table that will be inserted in the generated WASM
+ * code. strings are leaves, so a linear scan over the flat ast visits them in
+ * the same order as a full traversal would. a program that calls printi
+ * gets the digit pairs and the scratch space it uses first
+ */
+void CodeGenerator::build_string_table() {
+  auto printi = intern("printi");
+  bool prints_ints = false;
+  flat_ast->root().for_each(Node::function_call, [&](FlatNode call) {
+    auto *id = call.node()->find_first(Node::id);
+    prints_ints = prints_ints || id->function_symbol->name == printi;
+  });
+  if (prints_ints) {
+    str_table->define(digit_pairs());
+    str_table->reserve(SCRATCH_SIZE);
+  }
+
+  flat_ast->root().for_each(Node::string, [this](FlatNode node) {
+    str_table->define(std::string(node.value()));
+  });
+}
+
+/**
+ * @brief pre-order step of the code generation, opens the WAT construct of
+ * the node
+ *
+ * @param node visited node
+ */
+Visit CodeGenerator::enter(ASTNode *node) {
+  auto arm = arm_of(node);
+  if (arm != NO_ARM && begin_arm(node, arm) == Visit::skip_children) {
+    return Visit::skip_children;
   }
 
   switch (node->type) {
   case Node::program: {
-    out << printer->add("(module", false) << printer->indent();
-    out << printer->line(
-        R"((import "host" "exit" (func $exit)))");
-    out << printer->line(
-        R"((import "host" "putchar" (func $putchar (param i32))))");
-    out << printer->line(
-        R"((import "host" "getchar" (func $getchar (result i32))))");
-    out << printer->line("(memory 1)");
-
-    // TODO: inject runtime functions
+    emitter->begin_module(memory_pages, runtime_mode);
+
     inject_runtime();
 
-    generate_vars("global");
+    for (auto name : scope_vars(sym_table->global_scope())) {
+      emitter->global(name, 0);
+    }
+    if (!frame_sizes.empty()) {
+      emitter->global(sp_name, static_cast<std::int32_t>(stack_base));
+    }
     break;
   }
   case Node::main_func_decl:
@@ -98,318 +169,334 @@ void CodeGenerator::codegen_pre_traversal_cb(ASTNode *node, std::ostream &out) {
     auto *id = node->find_first(Node::id);
     auto *type = node->children[0];
     auto *formal_params = node->find_first(Node::formal_params);
-    auto *fun_sym = sym_table->find_function(id->value);
+    auto *fun_sym = id->function_symbol;
 
     if (node->type == Node::main_func_decl) {
       // @NOTE: explicitly state start function name because it DOESN'T have to
       // be main
-      this->start_func_name = fun_sym->wasm_name;
+      this->start_func_name = fun_sym->name;
     }
 
-    out << printer->line("") << printer->line("(func " + fun_sym->wasm_name);
-
-    // print formal args
+    // formal args
+    std::vector<name_id_t> params;
     for (auto formal : formal_params->children) {
-      auto id = formal->find_first(Node::id);
-      out << printer->add_param(id->value);
-    }
-
-    // print the return type (result i32)
-    if (type->type == Node::int_t || type->type == Node::boolean_t) {
-      out << printer->add("(result i32)");
+      params.push_back(formal->find_first(Node::id)->name);
     }
 
-    out << printer->line("");
+    // the return type (result i32)
+    bool has_result =
+        type->type == Node::int_t || type->type == Node::boolean_t;
 
-    // print all the local variables at the very beginning of the function
-    generate_vars(id->value);
+    // all the local variables go at the very beginning of the function
+    auto locals = scope_vars(id->name);
+    bool has_frame = frame_sizes.count(fun_sym->name) != 0;
+    if (has_frame) {
+      locals.push_back(frame_name);
+    }
+    if (has_frame || indexing_functions.count(fun_sym->name) != 0) {
+      locals.push_back(index_name);
+    }
 
-    out << printer->indent();
-    out << printer->line("");
+    current_function = fun_sym->name;
+    emitter->begin_func(fun_sym->name, params, has_result, locals);
+    push_frame();
     break;
   }
   case Node::if_statement:
   case Node::if_else_statement: {
-    out << printer->line("(if") << printer->indent();
-
-    printer->decorations[node->next_child()] = {
-        [this](ASTNode *) {
-          this->out << this->printer->line("(block (result i32)")
-                    << this->printer->indent();
-        },
-        [this](ASTNode *) {
-          this->out << this->printer->dedent() << this->printer->line(")");
-        }};
-
-    printer->decorations[node->children[1]] = {
-        [this](ASTNode *) {
-          this->out << this->printer->line("(then ") << this->printer->indent();
-        },
-        [this](ASTNode *) {
-          this->out << this->printer->dedent() << this->printer->line(")");
-        }};
-
-    if (node->type == Node::if_else_statement) {
-      printer->decorations[node->children[2]] = {
-          [this](ASTNode *) {
-            this->out << this->printer->line("(else ")
-                      << this->printer->indent();
-          },
-          [this](ASTNode *) {
-            this->out << this->printer->dedent() << this->printer->line(")");
-          }};
+    // the cases of a compiled chain after the first one are already open
+    bool open = !constructs.empty() && constructs.back().node == node;
+    if (!open && !switch_chain(node)) {
+      emitter->begin_if(false);
+      constructs.push_back({node, Construct::if_});
+    }
+    break;
+  }
+  case Node::bin_and_op:
+  case Node::bin_or_op: {
+    // booleans are 0 or 1, so when the right side can be evaluated either
+    // way the bitwise operator gives the same value without a branch
+    if (effects.count(node->children[1]) == 0) {
+      break;
     }
 
+    // a && b: (if (result i32) a (then b) (else 0))
+    // a || b: (if (result i32) a (then 1) (else b))
+    emitter->begin_if(true);
+    constructs.push_back({node, node->type == Node::bin_and_op
+                                    ? Construct::and_
+                                    : Construct::or_});
+    break;
+  }
+  case Node::sub_op: {
+    // -x is 0 - x
+    if (node->children.size() == 1) {
+      emitter->i32_const(0);
+    }
+    break;
+  }
+  case Node::index_op: {
+    // the frame is the base of the address of a local element
+    if (!node->children[0]->symbol->is_global()) {
+      emitter->variable(Op::local_get, frame_name);
+    }
+    break;
+  }
+  case Node::eq_op: {
+    if (node->children[0]->type == Node::index_op) {
+      stores.insert(node->children[0]);
+    }
     break;
   }
   case Node::while_statement: {
-    out << printer->line("(block $_block" + get_block_state())
-        << printer->indent();
-    out << printer->line("(loop $_loop" + get_block_state())
-        << printer->indent();
-
-    printer->decorations[node->next_child()] = {
-        nullptr, [this](ASTNode *) {
-          // this->out << this->printer->dedent() << this->printer->line(")");
-          this->out << this->printer->line("i32.eqz");
-          this->out << this->printer->line("br_if $_block" +
-                                           this->get_block_state());
-
-          next_block_state();
-        }};
-
+    emitter->begin_block("_block" + get_block_state());
+    emitter->begin_loop("_loop" + get_block_state());
+    constructs.push_back({node, Construct::while_});
     break;
   }
   default:
     break;
   }
+  return Visit::next;
 }
 
-void CodeGenerator::codegen_post_traversal_cb(ASTNode *node,
-                                              std::ostream &out) {
+/**
+ * @brief post-order step of the code generation, emits the instructions of
+ * the node once its operands are generated and closes its WAT construct
+ *
+ * @param node visited node
+ */
+void CodeGenerator::leave(ASTNode *node) {
+  // the dispatch of a compiled chain already compared the variable
+  if (!constructs.empty() &&
+      constructs.back().kind == Construct::switch_case &&
+      constructs.back().node->children[0] == node) {
+    return;
+  }
+
   switch (node->type) {
   case Node::program: {
-    out << printer->line("");
-    out << printer->line(";;");
-    out << printer->line(";; STRINGS");
-    out << printer->line(";;");
-    out << "\n" << str_table->build_wasm_code();
-
-    out << printer->line("(start " + this->start_func_name + ")")
-        << printer->dedent() << printer->line(")\n");
-
+    emitter->end_module(*str_table, this->start_func_name);
     break;
   }
   case Node::main_func_decl: {
+    static const name_id_t halt_name = intern("halt");
     auto *block = node->find_first(Node::block);
+    bool halted = true;
     if (!block->children.empty()) {
+      halted = false;
       auto *last_expr = block->children.back();
 
       if (last_expr->type == Node::statement_expr &&
           !last_expr->children.empty()) {
+        // an assignment leaves nothing on the stack
         auto *fun_call = last_expr->find_first(Node::function_call);
-        auto *fun_id = fun_call->next_child();
-        auto *fun_sym = sym_table->find_function(fun_id->value);
-
-        if (fun_sym->type != Node::void_t) {
-          out << printer->line("drop");
-          out << printer->line("call $halt");
+        auto *fun_sym = fun_call != nullptr
+                            ? fun_call->next_child()->function_symbol
+                            : nullptr;
+
+        if (fun_sym != nullptr && fun_sym->type != Node::void_t) {
+          emitter->op(Op::drop);
+          emitter->call(halt_name);
+          halted = true;
         }
       }
 
     } else {
-      out << printer->line("call $halt");
+      emitter->call(halt_name);
     }
 
-    out << printer->dedent() << printer->line(")");
+    // halt() writes out the buffered output, otherwise it's written when
+    // main ends
+    if (runtime_mode == RuntimeMode::buffered && !halted) {
+      emitter->call(flush_name);
+    }
+    emitter->end_func();
     break;
   }
   case Node::function_decl: {
-    auto *id = node->find_first(Node::id);
-    auto *fun_sym = sym_table->find_function(id->value);
+    auto *fun_sym = node->find_first(Node::id)->function_symbol;
+    auto *block = node->find_first(Node::block);
 
+    // falling off the end of a function that returns a value traps. after
+    // a return at the end of the body there is nothing left to run
     if (fun_sym->type != Node::void_t) {
-      out << printer->line("unreachable");
+      if (block->children.empty() ||
+          block->children.back()->type != Node::return_statement) {
+        emitter->op(Op::unreachable);
+      }
+    } else {
+      pop_frame();
     }
 
-    out << printer->dedent() << printer->line(")");
+    emitter->end_func();
     break;
   }
   case Node::id: {
-    if (!node->function_name.empty() && !node->is_formal_param &&
-        node->can_generate_wasm_getter) {
-      auto name = node->value;
-      auto sym = sym_table->lookup(name, node->function_name);
-      if (sym->is_global()) {
-        out << printer->line("") << "global.get"
-            << printer->add_name(sym->name);
-      } else {
-        out << printer->line("") << "local.get" << printer->add_name(sym->name);
-      }
+    // arrays are read element by element by index_op
+    if (node->function_name != NO_NAME && !node->is_formal_param &&
+        node->can_generate_wasm_getter && node->symbol != nullptr &&
+        !node->symbol->is_array()) {
+      variable(node->symbol, false);
     }
 
     break;
   }
   case Node::function_call: {
-    auto id = node->find_first(Node::id);
-    auto fun_sym = sym_table->find_function(id->value);
+    auto *fun_sym = node->find_first(Node::id)->function_symbol;
     auto actual_params = node->find_first(Node::actual_params);
 
-    if (fun_sym->name == "prints") {
+    static const name_id_t prints_name = intern("prints");
+    static const name_id_t halt_name = intern("halt");
+
+    if (fun_sym->name == prints_name) {
       for (auto actual : actual_params->children) {
         if (actual->type == Node::string) {
           // strings are a special case because we need to pass two params to it
           // in wasm - an offset and a length of the string
           auto entry = str_table->lookup(actual->value);
-          out << printer->line("") << "i32.const " << entry.offset;
-          out << printer->line("") << "i32.const " << entry.length;
+          emitter->i32_const(static_cast<std::int32_t>(entry.offset));
+          emitter->i32_const(static_cast<std::int32_t>(entry.length));
         }
       }
     }
 
     if (actual_params != nullptr && !actual_params->children.empty()) {
       if (actual_params->next_child()->type == Node::eq_op) {
-        auto *id = actual_params->next_child()->find_first(Node::id);
-        auto *sym = sym_table->lookup(id->value, id->function_name);
-        if (sym->is_global()) {
-          out << printer->line("global.get") << printer->add_name(sym->name);
-        } else {
-          out << printer->line("local.get") << printer->add_name(sym->name);
-        }
+        auto *sym = actual_params->next_child()->find_first(Node::id)->symbol;
+        variable(sym, false);
       }
     }
 
-    out << printer->line("call") << printer->add_name(fun_sym->name);
-    if (fun_sym->name == "halt") {
-      out << printer->line("unreachable");
+    emitter->call(fun_sym->name);
+    if (fun_sym->name == halt_name) {
+      emitter->op(Op::unreachable);
     }
     break;
   }
   case Node::if_statement:
   case Node::if_else_statement: {
-    out << printer->dedent() << printer->line(")");
+    // the first if of a compiled chain closes the block all the cases leave
+    // to, the others have nothing to close
+    auto &construct = constructs.back();
+    if (construct.kind == Construct::if_ || construct.first) {
+      emitter->end();
+    }
+    constructs.pop_back();
     break;
   }
   case Node::while_statement: {
+    constructs.pop_back();
     // @HACK: pretty ugly, but whatever
     prev_block_state();
-    out << printer->line("br $_loop" + get_block_state());
-    out << printer->dedent() << printer->line(")");
-    out << printer->dedent() << printer->line(")");
+    emitter->branch(Op::br, "_loop" + get_block_state());
+    emitter->end();
+    emitter->end();
     break;
   }
   case Node::break_statement: {
-    out << printer->line("br $_block" + get_block_state());
+    // the state was moved past the innermost loop after its condition
+    emitter->branch(Op::br, "_block" + std::to_string(while_block_state - 1));
     break;
   }
   case Node::return_statement: {
     if (!node->children.empty()) {
       if (node->next_child()->type == Node::eq_op) {
-        auto return_id = node->next_child()->next_child();
-        auto sym =
-            sym_table->lookup(return_id->value, return_id->function_name);
-        if (sym->is_global()) {
-          out << printer->line("global.get") << printer->add_name(sym->name);
-        } else {
-          out << printer->line("local.get") << printer->add_name(sym->name);
-        }
+        variable(node->next_child()->next_child()->symbol, false);
       }
     }
-    out << printer->line("return");
+    pop_frame();
+    emitter->op(Op::return_);
     break;
   }
   case Node::eq_op: {
-    auto id = node->next_child();
-    auto name = id->value;
-    auto sym = sym_table->lookup(name, id->function_name);
+    auto *target = node->next_child();
+    auto *sym = target->symbol;
 
     // @HACK: a very hacky way to generate nested assignments (i = j = k = 1;)
     // should be handled recursively
     auto *assigned = node->children[1];
     if (assigned != nullptr && assigned->type == Node::eq_op) {
-      auto *nested_assigned_id = assigned->next_child();
-      auto *nested_assigned_sym = sym_table->lookup(
-          nested_assigned_id->value, nested_assigned_id->function_name);
+      auto *nested_assigned_sym = assigned->next_child()->symbol;
 
       if (nested_assigned_sym != nullptr) {
-        if (nested_assigned_sym->is_global()) {
-          out << printer->line("global.get " + nested_assigned_sym->wasm_name);
-        } else {
-          out << printer->line("local.get " + nested_assigned_sym->wasm_name);
-        }
+        variable(nested_assigned_sym, false);
       }
     }
 
-    if (sym != nullptr) {
-      if (sym->is_global()) {
-        out << printer->line("") << "global.set"
-            << printer->add_name(sym->name);
-      } else {
-        out << printer->line("") << "local.set" << printer->add_name(sym->name);
-      }
+    if (target->type == Node::index_op) {
+      // the address is generated before the value
+      auto *array = target->children[0]->symbol;
+      emitter->memory(element_op(array, true), array_offsets[array]);
+    } else if (sym != nullptr) {
+      variable(sym, true);
     }
 
     break;
   }
+  case Node::index_op: {
+    element(node);
+    break;
+  }
   case Node::add_op: {
-    out << printer->line("") << "i32.add";
+    emitter->op(Op::i32_add);
     break;
   }
   case Node::sub_op: {
-    if (node->children.size() > 1) {
-      out << printer->line("i32.sub");
-    }
+    emitter->op(Op::i32_sub);
     break;
   }
   case Node::mul_op: {
-    out << printer->line("") << "i32.mul";
+    emitter->op(Op::i32_mul);
     break;
   }
   case Node::div_op: {
-    out << printer->line("") << "i32.div_s";
+    emitter->op(Op::i32_div_s);
     break;
   }
   case Node::mod_op: {
-    out << printer->line("") << "i32.rem_s";
+    emitter->op(Op::i32_rem_s);
     break;
   }
   case Node::lt_op: {
-    out << printer->line("") << "i32.lt_s";
+    emitter->op(Op::i32_lt_s);
     break;
   }
   case Node::lteq_op: {
-    out << printer->line("") << "i32.le_s";
+    emitter->op(Op::i32_le_s);
     break;
   }
   case Node::gt_op: {
-    out << printer->line("") << "i32.gt_s";
+    emitter->op(Op::i32_gt_s);
     break;
   }
   case Node::gteq_op: {
-    out << printer->line("") << "i32.ge_s";
+    emitter->op(Op::i32_ge_s);
     break;
   }
   case Node::eqeq_op: {
-    out << printer->line("") << "i32.eq";
+    emitter->op(Op::i32_eq);
     break;
   }
   case Node::noteq_op: {
-    out << printer->line("") << "i32.ne";
+    emitter->op(Op::i32_ne);
     break;
   }
   case Node::not_op: {
-    out << printer->line("") << "i32.const 1";
-    out << printer->line("") << "i32.xor";
-    break;
-  }
-  case Node::bin_and_op: {
-    auto *fun_sym = sym_table->find_function("__and_op");
-    out << printer->line("") << "call" << printer->add_name(fun_sym->name);
+    emitter->i32_const(1);
+    emitter->op(Op::i32_xor);
     break;
   }
+  case Node::bin_and_op:
   case Node::bin_or_op: {
-    auto *fun_sym = sym_table->find_function("__or_op");
-    out << printer->line("") << "call" << printer->add_name(fun_sym->name);
+    if (!constructs.empty() && constructs.back().node == node) {
+      // the branches are already generated
+      constructs.pop_back();
+      emitter->end();
+    } else {
+      emitter->op(node->type == Node::bin_and_op ? Op::i32_and : Op::i32_or);
+    }
+    break;
   }
   case Node::int_t:
   case Node::boolean_t: {
@@ -417,11 +504,9 @@ void CodeGenerator::codegen_post_traversal_cb(ASTNode *node,
       auto type = node->type;
       auto value = node->value;
       if (type == Node::boolean_t) {
-        out << printer->line("") << "i32.const"
-            << printer->add_bool_const(value == "true");
+        emitter->i32_const(value == "true");
       } else {
-        out << printer->line("") << "i32.const"
-            << printer->add_int_const(std::stoi(value));
+        emitter->i32_const(std::stoi(value));
       }
     }
 
@@ -431,52 +516,473 @@ void CodeGenerator::codegen_post_traversal_cb(ASTNode *node,
     break;
   }
 
-  auto iter = printer->decorations.find(node);
-  if (iter != printer->decorations.end()) {
-    if (iter->second.post != nullptr) {
-      iter->second.post(node);
+  // constructs are closed by now, they can be a child of the one around them
+  auto arm = arm_of(node);
+  if (arm != NO_ARM) {
+    end_arm(arm);
+  }
+}
+
+/**
+ * @brief find which child of the innermost construct a node is
+ *
+ * @param node visited node
+ * @return std::size_t index of the child, NO_ARM if it isn't one
+ */
+std::size_t CodeGenerator::arm_of(ASTNode *node) const {
+  if (constructs.empty()) {
+    return NO_ARM;
+  }
+
+  // a construct has at most three children
+  auto const &children = constructs.back().node->children;
+  for (std::size_t i = 0; i < children.size(); i++) {
+    if (children[i] == node) {
+      return i;
+    }
+  }
+  return NO_ARM;
+}
+
+/**
+ * @brief open the block a child of the innermost construct is generated
+ * in, before the child
+ *
+ * @param node visited node
+ * @param arm index of the node in the construct
+ * @return Visit::skip_children for the comparisons of a compiled chain
+ */
+Visit CodeGenerator::begin_arm(ASTNode *node, std::size_t arm) {
+  auto &construct = constructs.back();
+  switch (construct.kind) {
+  case Construct::if_:
+    if (arm == 0) {
+      emitter->begin_condition();
+    } else if (arm == 1) {
+      emitter->begin_then();
+    } else {
+      emitter->begin_else();
+    }
+    break;
+  case Construct::and_:
+  case Construct::or_:
+    // a && b: (if (result i32) a (then b) (else 0))
+    // a || b: (if (result i32) a (then 1) (else b))
+    if (arm == 0) {
+      emitter->begin_condition();
+    } else if (construct.kind == Construct::and_) {
+      emitter->begin_then();
+    } else {
+      emitter->begin_then();
+      emitter->i32_const(1);
+      emitter->end();
+      emitter->begin_else();
+    }
+    break;
+  case Construct::while_:
+    break;
+  case Construct::switch_case:
+    if (arm == 0) {
+      return Visit::skip_children;
+    }
+    // the else branch is the next case, or the default one after the last
+    if (arm == 2 && construct.remaining != 0) {
+      construct_t next{node, Construct::switch_case, construct.label};
+      next.remaining = construct.remaining - 1;
+      constructs.push_back(std::move(next));
+    }
+    break;
+  }
+  return Visit::next;
+}
+
+/**
+ * @brief close the block a child of the innermost construct is generated
+ * in, after the child
+ *
+ * @param arm index of the node in the construct
+ */
+void CodeGenerator::end_arm(std::size_t arm) {
+  auto &construct = constructs.back();
+  switch (construct.kind) {
+  case Construct::if_:
+    emitter->end();
+    break;
+  case Construct::and_:
+    emitter->end();
+    if (arm == 1) {
+      emitter->begin_else();
+      emitter->i32_const(0);
+      emitter->end();
     }
+    break;
+  case Construct::or_:
+    emitter->end();
+    break;
+  case Construct::while_:
+    if (arm == 0) {
+      emitter->op(Op::i32_eqz);
+      emitter->branch(Op::br_if, "_block" + get_block_state());
+      next_block_state();
+    }
+    break;
+  case Construct::switch_case:
+    if (arm == 1) {
+      // the last case falls through to the end if there is no default
+      if (construct.remaining != 0 ||
+          construct.node->type == Node::if_else_statement) {
+        emitter->branch(Op::br, construct.label + "_end");
+      }
+      // the block of the next case, or the default one
+      emitter->end();
+    }
+    break;
   }
 }
 
 /**
- * @brief Generate variables for given scope (function or global)
+ * @brief Get the variables of a scope (function or global), sorted by name
  *
  * @param scope_name name of the scope
+ * @return std::vector<name_id_t> names of the variables
  */
-void CodeGenerator::generate_vars(std::string scope_name) {
-  bool is_global = scope_name == "global";
-
-  auto scope = sym_table->get_scope(scope_name);
+std::vector<name_id_t> CodeGenerator::scope_vars(name_id_t scope_name) {
+  // arrays are in the memory
+  std::vector<name_id_t> names;
+  for (auto *sym : scope_symbols(scope_name)) {
+    if (!sym->is_array()) {
+      names.push_back(sym->name);
+    }
+  }
+  return names;
+}
 
-  for (auto const &[_, sym] : scope) {
+/**
+ * @brief Get the variables and arrays of a scope, sorted by name
+ *
+ * @param scope_name name of the scope
+ * @return std::vector<Symbol *> symbols of the variables
+ */
+std::vector<Symbol *> CodeGenerator::scope_symbols(name_id_t scope_name) {
+  // keep the declarations sorted by name, independent of the interning order
+  std::vector<Symbol *> vars;
+  for (auto const &[_, sym] : sym_table->get_scope(scope_name)) {
     if (sym->kind == "variable") {
-      if (is_global) {
-        out << printer->line("(global") << printer->add_name(sym->name)
-            << printer->add("(mut i32)") << printer->add("(i32.const 0)")
-            << printer->add(")");
-      } else {
-        // out << printer->indent() << printer->add_local(sym->name)
-        //     << printer->dedent();
-        out << printer->indent() << printer->line("(local")
-            << printer->add_name(sym->name) << printer->add("i32")
-            << printer->add(")") << printer->dedent();
-      }
+      vars.push_back(sym);
     }
   }
+
+  std::sort(vars.begin(), vars.end(), [](Symbol *a, Symbol *b) {
+    return name_str(a->name) < name_str(b->name);
+  });
+  return vars;
 }
 
 /**
- * @brief Read runtime functions specified in PROJECT_ROOT/src/lib/runtime.wat
- * and inject them to generated WAT code
+ * @brief place the output buffer of a buffered runtime and the global
+ * arrays after the strings and the local arrays of every function in its
+ * frame, and size the memory to fit them and the stack the frames are
+ * allocated on
+ *
+ * @throws std::runtime_error if the arrays don't fit in 4 GiB
  */
-void CodeGenerator::inject_runtime() {
-  std::ifstream runtime("src/lib/runtime.wat");
-  if (runtime.is_open()) {
-    std::string line;
-    while (std::getline(runtime, line)) {
-      out << printer->line(line);
+void CodeGenerator::layout_memory() {
+  std::uint64_t end = str_table->size();
+  if (runtime_mode == RuntimeMode::buffered) {
+    end = align(end);
+    output_buffer = static_cast<std::uint32_t>(end);
+    end += OUTPUT_BUFFER_SIZE;
+  }
+  for (auto *sym : scope_symbols(sym_table->global_scope())) {
+    if (sym->is_array()) {
+      end = align(end);
+      array_offsets[sym] = static_cast<std::uint32_t>(end);
+      end += sym->length * element_size(sym);
+    }
+  }
+
+  std::uint64_t largest_frame = 0;
+  for (auto *decl : ast->children) {
+    if (decl->type != Node::function_decl &&
+        decl->type != Node::main_func_decl) {
+      continue;
+    }
+
+    auto name = decl->find_first(Node::id)->name;
+    std::uint64_t frame = 0;
+    for (auto *sym : scope_symbols(name)) {
+      if (sym->is_array()) {
+        frame = align(frame);
+        array_offsets[sym] = static_cast<std::uint32_t>(frame);
+        frame += sym->length * element_size(sym);
+      }
+    }
+
+    if (frame != 0) {
+      frame_sizes[name] = static_cast<std::uint32_t>(align(frame));
+      largest_frame = std::max(largest_frame, align(frame));
     }
-    out << "\n";
+    flat_ast->at(decl).for_each(Node::index_op, [this, name](FlatNode) {
+      indexing_functions.insert(name);
+    });
+  }
+
+  end = align(end);
+  stack_base = static_cast<std::uint32_t>(end);
+  if (largest_frame != 0) {
+    end += STACK_SIZE + largest_frame;
+  }
+
+  auto pages = std::max<std::uint64_t>((end + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+  if (pages > MAX_PAGES) {
+    throw std::runtime_error("arrays take " + std::to_string(end) +
+                             " bytes, the memory can only hold 4 GiB");
+  }
+  memory_pages = static_cast<std::uint32_t>(pages);
+}
+
+/**
+ * @brief allocate the frame of the current function on the stack and zero
+ * it
+ */
+void CodeGenerator::push_frame() {
+  auto iter = frame_sizes.find(current_function);
+  if (iter == frame_sizes.end()) {
+    return;
+  }
+
+  auto size = static_cast<std::int32_t>(iter->second);
+  emitter->variable(Op::global_get, sp_name);
+  emitter->variable(Op::local_tee, frame_name);
+  emitter->i32_const(size);
+  emitter->op(Op::i32_add);
+  emitter->variable(Op::global_set, sp_name);
+
+  // the memory below the stack pointer has frames of earlier calls in it
+  emitter->begin_loop("_zero");
+  emitter->variable(Op::local_get, frame_name);
+  emitter->variable(Op::local_get, index_name);
+  emitter->op(Op::i32_add);
+  emitter->i32_const(0);
+  emitter->memory(Op::i32_store, 0);
+  emitter->variable(Op::local_get, index_name);
+  emitter->i32_const(4);
+  emitter->op(Op::i32_add);
+  emitter->variable(Op::local_tee, index_name);
+  emitter->i32_const(size);
+  emitter->op(Op::i32_lt_u);
+  emitter->branch(Op::br_if, "_zero");
+  emitter->end();
+}
+
+/**
+ * @brief free the frame of the current function, if it has one
+ */
+void CodeGenerator::pop_frame() {
+  if (frame_sizes.count(current_function) != 0) {
+    emitter->variable(Op::local_get, frame_name);
+    emitter->variable(Op::global_set, sp_name);
+  }
+}
+
+/**
+ * @brief emit the address of an element once its index is on the stack,
+ * trapping if the index is out of bounds, then load the element unless it
+ * is assigned to
+ *
+ * @param node index_op
+ */
+void CodeGenerator::element(ASTNode *node) {
+  auto *sym = node->children[0]->symbol;
+
+  // a negative index is a large unsigned one
+  emitter->variable(Op::local_set, index_name);
+  emitter->begin_if(false);
+  emitter->begin_condition();
+  emitter->variable(Op::local_get, index_name);
+  emitter->i32_const(static_cast<std::int32_t>(sym->length));
+  emitter->op(Op::i32_ge_u);
+  emitter->end();
+  emitter->begin_then();
+  emitter->op(Op::unreachable);
+  emitter->end();
+  emitter->end();
+
+  emitter->variable(Op::local_get, index_name);
+  if (element_size(sym) == 4) {
+    emitter->i32_const(2);
+    emitter->op(Op::i32_shl);
+  }
+  if (!sym->is_global()) {
+    emitter->op(Op::i32_add);
+  }
+
+  if (stores.count(node) == 0) {
+    emitter->memory(element_op(sym, false), array_offsets[sym]);
+  }
+}
+
+/**
+ * @brief emit local.get/set or global.get/set of a variable
+ *
+ * @param sym symbol of the variable
+ * @param set true for a set, false for a get
+ */
+void CodeGenerator::variable(Symbol *sym, bool set) {
+  if (sym->is_global()) {
+    emitter->variable(set ? Op::global_set : Op::global_get, sym->name);
+  } else {
+    emitter->variable(set ? Op::local_set : Op::local_get, sym->name);
   }
 }
+
+/**
+ * @brief compile an if/else-if chain that compares the same variable with
+ * constants into blocks, one per case, and a single dispatch to them. dense
+ * constants use br_table, sparse ones a binary search
+ *
+ * @param node first if of the chain
+ * @return true if the chain is long enough and the dispatch is emitted
+ */
+bool CodeGenerator::switch_chain(ASTNode *node) {
+  std::vector<ASTNode *> chain;
+  std::vector<case_t> cases;
+  std::unordered_set<std::int32_t> values;
+  Symbol *sym = nullptr;
+
+  for (auto *it = node; it != nullptr;) {
+    std::int32_t value;
+    auto *var = it->type == Node::if_statement ||
+                        it->type == Node::if_else_statement
+                    ? compared_variable(it->children[0], value)
+                    : nullptr;
+    // the rest of the chain is the default case
+    if (var == nullptr || (sym != nullptr && var != sym)) {
+      break;
+    }
+
+    sym = var;
+    // a repeated constant never matches its later case, which is still
+    // generated, but nothing jumps to it
+    if (values.insert(value).second) {
+      cases.push_back({value, chain.size()});
+    }
+    chain.push_back(it);
+    it = it->type == Node::if_else_statement ? it->children[2] : nullptr;
+  }
+
+  if (cases.size() < MIN_SWITCH_CASES) {
+    return false;
+  }
+
+  // (block $end
+  //   (block $default
+  //     (block $case_n ... (block $case_0 dispatch) case 0 (br $end) ...)
+  //     case n (br $end))
+  //   else branch)
+  auto label = "_switch" + std::to_string(switch_count++);
+  auto case_label = [label](std::size_t index) {
+    return label + "_case" + std::to_string(index);
+  };
+  emitter->begin_block(label + "_end");
+  emitter->begin_block(label + "_default");
+  for (std::size_t i = chain.size(); i > 0; i--) {
+    emitter->begin_block(case_label(i - 1));
+  }
+
+  std::sort(cases.begin(), cases.end(),
+            [](case_t a, case_t b) { return a.value < b.value; });
+  std::int64_t min = cases.front().value;
+  std::int64_t range = std::int64_t(cases.back().value) - min + 1;
+  if (range <= 2 * static_cast<std::int64_t>(cases.size())) {
+    // values below the first case wrap around to large indices, so they go
+    // to the default block as well
+    variable(sym, false);
+    if (min != 0) {
+      emitter->i32_const(static_cast<std::int32_t>(min));
+      emitter->op(Op::i32_sub);
+    }
+
+    std::vector<std::string> labels(static_cast<std::size_t>(range),
+                                    label + "_default");
+    for (auto const &c : cases) {
+      labels[static_cast<std::size_t>(c.value - min)] = case_label(c.index);
+    }
+    labels.push_back(label + "_default");
+    emitter->branch_table(labels);
+  } else {
+    binary_search(sym, cases, 0, cases.size(), label);
+  }
+  emitter->end();
+
+  // the cases after the first one are opened as the else branch of the case
+  // before them is entered
+  construct_t first{node, Construct::switch_case, label};
+  first.first = true;
+  first.remaining = chain.size() - 1;
+  constructs.push_back(std::move(first));
+  return true;
+}
+
+/**
+ * @brief emit a binary search over sorted cases, branching to the block of
+ * the matching case or to the default one
+ *
+ * @param sym compared variable
+ * @param cases cases sorted by value
+ * @param lo first case to search
+ * @param hi one past the last case to search
+ * @param label prefix of the block labels
+ */
+void CodeGenerator::binary_search(Symbol *sym,
+                                  std::vector<case_t> const &cases,
+                                  std::size_t lo, std::size_t hi,
+                                  std::string const &label) {
+  if (hi - lo <= LINEAR_SEARCH_CASES) {
+    for (auto i = lo; i < hi; i++) {
+      variable(sym, false);
+      emitter->i32_const(cases[i].value);
+      emitter->op(Op::i32_eq);
+      emitter->branch(Op::br_if,
+                      label + "_case" + std::to_string(cases[i].index));
+    }
+    emitter->branch(Op::br, label + "_default");
+    return;
+  }
+
+  auto mid = lo + (hi - lo) / 2;
+  emitter->begin_if(false);
+  emitter->begin_condition();
+  variable(sym, false);
+  emitter->i32_const(cases[mid].value);
+  emitter->op(Op::i32_lt_s);
+  emitter->end();
+  emitter->begin_then();
+  binary_search(sym, cases, lo, mid, label);
+  emitter->end();
+  emitter->begin_else();
+  binary_search(sym, cases, mid, hi, label);
+  emitter->end();
+  emitter->end();
+}
+
+/**
+ * @brief add the functions of the embedded runtime the program needs: the
+ * builtins it calls, the runtime functions they call and halt, which ends
+ * main. A buffered runtime gets the globals of its buffer first
+ */
+void CodeGenerator::inject_runtime() {
+  if (runtime_mode == RuntimeMode::buffered) {
+    auto end = output_buffer + static_cast<std::uint32_t>(OUTPUT_BUFFER_SIZE);
+    emitter->global(intern("__out"), static_cast<std::int32_t>(output_buffer));
+    emitter->global(intern("__out_pos"),
+                    static_cast<std::int32_t>(output_buffer));
+    emitter->global(intern("__out_end"), static_cast<std::int32_t>(end));
+  }
+
+  std::unordered_set<name_id_t> called = {intern("halt")};
+  flat_ast->root().for_each(Node::function_call, [&called](FlatNode call) {
+    called.insert(call.node()->find_first(Node::id)->function_symbol->name);
+  });
+  emitter->runtime(Runtime::embedded(runtime_mode).functions(called));
+}
@@ -0,0 +1,332 @@
+/**
+ * @file ConstantFolding.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Fold constant expressions and conditions of a checked program
+ */
+
+#include "ConstantFolding.hpp"
+#include "SideEffects.hpp"
+#include "Visitor.hpp"
+#include <cstdint>
+#include <unordered_set>
+
+namespace {
+
+/**
+ * @brief get the value of an int constant
+ *
+ * @param node node to check
+ * @param value set to the value of the constant
+ * @return true if the node is an int constant that fits in an i32
+ */
+bool int_value(ASTNode const *node, std::int32_t &value) {
+  // longer literals don't fit, whatever their digits are
+  if (node->type != Node::int_t || !node->is_const() ||
+      node->value.size() > 11) {
+    return false;
+  }
+
+  auto wide = std::stoll(node->value);
+  if (wide < INT32_MIN || wide > INT32_MAX) {
+    return false;
+  }
+  value = static_cast<std::int32_t>(wide);
+  return true;
+}
+
+/**
+ * @brief get the value of a boolean constant
+ *
+ * @param node node to check
+ * @param value set to the value of the constant
+ * @return true if the node is a boolean constant
+ */
+bool bool_value(ASTNode const *node, bool &value) {
+  if (node->type != Node::boolean_t || !node->is_const()) {
+    return false;
+  }
+  value = node->value == "true";
+  return true;
+}
+
+/**
+ * @brief check if a node is the given int constant
+ */
+bool is_int(ASTNode const *node, std::int32_t expected) {
+  std::int32_t value;
+  return int_value(node, value) && value == expected;
+}
+
+/**
+ * @brief check if a node is the given boolean constant
+ */
+bool is_bool(ASTNode const *node, bool expected) {
+  bool value;
+  return bool_value(node, value) && value == expected;
+}
+
+/**
+ * @brief truncate a result to 32 bits, the way i32 arithmetic wraps around
+ */
+std::int32_t wrap(std::int64_t value) {
+  return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+}
+
+/**
+ * @brief Folder rewrites a node once all of its children are rewritten. A
+ * node that becomes a constant or an empty statement is changed in place; a
+ * node that is replaced by one of its children is swapped out by its parent,
+ * which is left right after it
+ */
+class Folder : public Visitor<Folder> {
+public:
+  explicit Folder(std::unordered_set<ASTNode *> const &effects)
+      : effects(effects) {}
+
+  std::size_t folded = 0;
+
+private:
+  std::unordered_set<ASTNode *> const &effects;
+
+  friend class Visitor<Folder>;
+
+  void leave(ASTNode *node) {
+    for (auto &child : node->children) {
+      auto *replacement = simplified(child);
+      if (replacement != child) {
+        child = replacement;
+        folded++;
+      }
+    }
+    fold(node);
+  }
+
+  /**
+   * @brief find the node that computes the same as `node` with less work,
+   * one of its children
+   *
+   * @param node node whose children are already rewritten
+   * @return ASTNode* the node to use instead, `node` if there is none
+   */
+  ASTNode *simplified(ASTNode *node) {
+    auto &children = node->children;
+    switch (node->type) {
+    case Node::add_op:
+      // x + 0, 0 + x
+      if (is_int(children[1], 0)) {
+        return children[0];
+      }
+      if (is_int(children[0], 0)) {
+        return children[1];
+      }
+      break;
+    case Node::sub_op:
+      // x - 0
+      if (children.size() == 2 && is_int(children[1], 0)) {
+        return children[0];
+      }
+      break;
+    case Node::mul_op:
+      // x * 1, 1 * x
+      if (is_int(children[1], 1)) {
+        return children[0];
+      }
+      if (is_int(children[0], 1)) {
+        return children[1];
+      }
+      break;
+    case Node::div_op:
+      // x / 1
+      if (is_int(children[1], 1)) {
+        return children[0];
+      }
+      break;
+    case Node::not_op:
+      // !!b
+      if (children[0]->type == Node::not_op) {
+        return children[0]->children[0];
+      }
+      break;
+    case Node::bin_and_op:
+      // true && b, b && true
+      if (is_bool(children[0], true)) {
+        return children[1];
+      }
+      if (is_bool(children[1], true)) {
+        return children[0];
+      }
+      break;
+    case Node::bin_or_op:
+      // false || b, b || false
+      if (is_bool(children[0], false)) {
+        return children[1];
+      }
+      if (is_bool(children[1], false)) {
+        return children[0];
+      }
+      break;
+    case Node::if_statement:
+    case Node::if_else_statement:
+      // only the branch that is taken is left
+      if (is_bool(children[0], true)) {
+        return children[1];
+      }
+      if (node->type == Node::if_else_statement &&
+          is_bool(children[0], false)) {
+        return children[2];
+      }
+      break;
+    default:
+      break;
+    }
+    return node;
+  }
+
+  /**
+   * @brief turn a node into a constant or an empty statement if its value or
+   * effect is known
+   *
+   * @param node node whose children are already rewritten
+   */
+  void fold(ASTNode *node) {
+    auto &children = node->children;
+    std::int32_t a, b;
+    bool p, q;
+
+    switch (node->type) {
+    case Node::sub_op:
+      if (children.size() == 1) {
+        if (int_value(children[0], a)) {
+          set_int(node, wrap(-static_cast<std::int64_t>(a)));
+        }
+        break;
+      }
+      // fall through
+    case Node::add_op:
+    case Node::mul_op:
+      if (int_value(children[0], a) && int_value(children[1], b)) {
+        std::int64_t x = a, y = b;
+        set_int(node, wrap(node->type == Node::add_op   ? x + y
+                           : node->type == Node::sub_op ? x - y
+                                                        : x * y));
+      } else if (node->type == Node::mul_op &&
+                 ((is_int(children[0], 0) && pure(children[1])) ||
+                  (is_int(children[1], 0) && pure(children[0])))) {
+        set_int(node, 0);
+      }
+      break;
+    case Node::div_op:
+      // dividing by zero and INT_MIN / -1 trap at run time
+      if (int_value(children[0], a) && int_value(children[1], b) && b != 0 &&
+          !(a == INT32_MIN && b == -1)) {
+        set_int(node, a / b);
+      }
+      break;
+    case Node::mod_op:
+      // INT_MIN % -1 is 0, it doesn't trap
+      if (int_value(children[1], b) && b != 0) {
+        if (int_value(children[0], a)) {
+          set_int(node, b == -1 ? 0 : a % b);
+        } else if ((b == 1 || b == -1) && pure(children[0])) {
+          set_int(node, 0);
+        }
+      }
+      break;
+    case Node::lt_op:
+    case Node::lteq_op:
+    case Node::gt_op:
+    case Node::gteq_op:
+      if (int_value(children[0], a) && int_value(children[1], b)) {
+        set_bool(node, node->type == Node::lt_op     ? a < b
+                       : node->type == Node::lteq_op ? a <= b
+                       : node->type == Node::gt_op   ? a > b
+                                                     : a >= b);
+      }
+      break;
+    case Node::eqeq_op:
+    case Node::noteq_op:
+      if (int_value(children[0], a) && int_value(children[1], b)) {
+        set_bool(node, (a == b) == (node->type == Node::eqeq_op));
+      } else if (bool_value(children[0], p) && bool_value(children[1], q)) {
+        set_bool(node, (p == q) == (node->type == Node::eqeq_op));
+      }
+      break;
+    case Node::not_op:
+      if (bool_value(children[0], p)) {
+        set_bool(node, !p);
+      }
+      break;
+    case Node::bin_and_op:
+    case Node::bin_or_op: {
+      // false && b and true || b never evaluate b. b && false and b || true
+      // have the same value, but b can only be dropped if it has no effects
+      bool decides = node->type == Node::bin_or_op;
+      if (is_bool(children[0], decides) ||
+          (is_bool(children[1], decides) && pure(children[0]))) {
+        set_bool(node, decides);
+      }
+      break;
+    }
+    case Node::if_statement:
+      if (is_bool(children[0], false)) {
+        set_empty(node);
+      }
+      break;
+    case Node::while_statement:
+      if (is_bool(children[0], false)) {
+        set_empty(node);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  /**
+   * @brief check if an expression can be dropped without changing what the
+   * program does
+   */
+  bool pure(ASTNode *node) const { return effects.count(node) == 0; }
+
+  void set_int(ASTNode *node, std::int32_t value) {
+    node->type = Node::int_t;
+    node->value = std::to_string(value);
+    node->children = NodeList();
+    folded++;
+  }
+
+  void set_bool(ASTNode *node, bool value) {
+    node->type = Node::boolean_t;
+    node->value = value ? "true" : "false";
+    node->children = NodeList();
+    folded++;
+  }
+
+  void set_empty(ASTNode *node) {
+    node->type = Node::null_statement;
+    node->children = NodeList();
+    folded++;
+  }
+};
+
+} // namespace
+
+/**
+ * @brief evaluate the expressions of a checked program whose operands are
+ * constants, with the i32 semantics of the generated code, and drop the
+ * operations that don't change their operand (x * 1, x + 0, !!b). An `if` or
+ * `while` with a constant condition is replaced by the branch that is taken.
+ * A division that would trap is left for the program to run.
+ *
+ * the tree is rewritten in place, a FlatAST built from it before has to be
+ * built again
+ *
+ * @param root root of the program
+ * @return std::size_t number of nodes folded or dropped
+ */
+std::size_t fold_constants(ASTNode *root) {
+  auto effects = find_side_effects(root);
+  Folder folder(effects);
+  folder.visit(root);
+  return folder.folded;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file DeadCode.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Remove the code of a checked program that never runs
+ */
+
+#include "DeadCode.hpp"
+#include "Visitor.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+/**
+ * @brief count the nodes of a subtree
+ */
+std::size_t subtree_size(ASTNode *root) {
+  std::size_t size = 0;
+  walk(root, [&size](ASTNode *) { size++; }, nullptr);
+  return size;
+}
+
+/**
+ * @brief StatementTrimmer marks the statements that never complete: return,
+ * break, a call of halt(), a block that ends with one of them and an if/else
+ * whose branches both are. Statements are marked once their children are, so
+ * the check doesn't recurse down a long else-if chain. The statements after
+ * a marked one in a block are removed
+ */
+class StatementTrimmer : public Visitor<StatementTrimmer> {
+public:
+  explicit StatementTrimmer(removed_code_t &removed) : removed(removed) {}
+
+private:
+  removed_code_t &removed;
+  std::unordered_set<ASTNode *> jumps;
+
+  friend class Visitor<StatementTrimmer>;
+
+  void leave(ASTNode *node) {
+    static const name_id_t halt_name = intern("halt");
+
+    switch (node->type) {
+    case Node::return_statement:
+    case Node::break_statement:
+      jumps.insert(node);
+      break;
+    case Node::statement_expr: {
+      auto *expr = node->children[0];
+      auto *callee = expr->type == Node::function_call
+                         ? expr->find_first(Node::id)->function_symbol
+                         : nullptr;
+      if (callee != nullptr && callee->name == halt_name) {
+        jumps.insert(node);
+      }
+      break;
+    }
+    case Node::block: {
+      auto &children = node->children;
+      auto jump = std::find_if(
+          children.begin(), children.end(),
+          [this](ASTNode *child) { return jumps.count(child) != 0; });
+      if (jump == children.end()) {
+        break;
+      }
+
+      for (auto iter = jump + 1; iter != children.end(); iter++) {
+        removed.statements++;
+        removed.nodes += subtree_size(*iter);
+      }
+      children.erase(jump + 1, children.end());
+      jumps.insert(node);
+      break;
+    }
+    case Node::if_else_statement:
+      if (jumps.count(node->children[1]) != 0 &&
+          jumps.count(node->children[2]) != 0) {
+        jumps.insert(node);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+/**
+ * @brief check if a node declares a function
+ */
+bool is_function(ASTNode const *node) {
+  return node->type == Node::function_decl ||
+         node->type == Node::main_func_decl;
+}
+
+} // namespace
+
+/**
+ * @brief remove the statements of a checked program that follow a return,
+ * break or halt() in the same block, then build the call graph from main and
+ * remove the functions it doesn't reach and the globals they don't use. The
+ * removed functions and globals are taken out of the global scope of the
+ * symbol table too, so no backend emits them
+ *
+ * the tree is rewritten in place, a FlatAST built from it before has to be
+ * built again
+ *
+ * @param root root of the program
+ * @param sym_table symbol table built by semantic analysis
+ * @return removed_code_t what was removed
+ */
+removed_code_t eliminate_dead_code(ASTNode *root, SymTable &sym_table) {
+  removed_code_t removed;
+  removed.total = subtree_size(root);
+  StatementTrimmer(removed).visit(root);
+
+  // call graph: the declaration of every function and what it calls
+  std::unordered_map<Symbol *, ASTNode *> declarations;
+  std::vector<Symbol *> work;
+  for (auto *decl : root->children) {
+    if (is_function(decl)) {
+      auto *fun_sym = decl->find_first(Node::id)->function_symbol;
+      declarations[fun_sym] = decl;
+      if (decl->type == Node::main_func_decl) {
+        work.push_back(fun_sym);
+      }
+    }
+  }
+
+  // functions reachable from main, and the globals they use
+  std::unordered_set<Symbol *> called(work.begin(), work.end());
+  std::unordered_set<Symbol *> used;
+  while (!work.empty()) {
+    auto *decl = declarations[work.back()];
+    work.pop_back();
+
+    walk(
+        decl,
+        [&](ASTNode *node) {
+          if (node->type != Node::id) {
+            return;
+          }
+          if (node->symbol != nullptr && node->symbol->is_global()) {
+            used.insert(node->symbol);
+          }
+          // the builtins have no declaration
+          auto *callee = node->function_symbol;
+          if (callee != nullptr && declarations.count(callee) != 0 &&
+              called.insert(callee).second) {
+            work.push_back(callee);
+          }
+        },
+        nullptr);
+  }
+
+  auto &children = root->children;
+  children.erase(
+      std::remove_if(
+          children.begin(), children.end(),
+          [&](ASTNode *decl) {
+            auto *id = decl->find_first(Node::id);
+            if (is_function(decl)) {
+              if (called.count(id->function_symbol) != 0) {
+                return false;
+              }
+              removed.functions++;
+            } else if (decl->type == Node::global_var_decl) {
+              auto *sym = sym_table.lookup_in_local(id->name,
+                                                    sym_table.global_scope());
+              if (sym == nullptr || used.count(sym) != 0) {
+                return false;
+              }
+              removed.globals++;
+            } else {
+              return false;
+            }
+
+            removed.nodes += subtree_size(decl);
+            sym_table.remove(id->name, sym_table.global_scope());
+            return true;
+          }),
+      children.end());
+
+  return removed;
+}
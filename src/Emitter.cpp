@@ -0,0 +1,307 @@
+/**
+ * @file Emitter.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Output formats of the code generator: WebAssembly text (WAT) and
+ * the binary format
+ */
+
+#include "Emitter.hpp"
+#include "WatAssembler.hpp"
+#include <algorithm>
+
+using wasm::Op;
+
+/**
+ * @brief create the emitter of a format
+ *
+ * @param format output format
+ * @param out stream the module is written to
+ */
+std::unique_ptr<Emitter> make_emitter(OutputFormat format, std::ostream &out) {
+  if (format == OutputFormat::wasm) {
+    return std::make_unique<WasmEmitter>(out);
+  }
+  return std::make_unique<WatEmitter>(out);
+}
+
+void WatEmitter::add_name(name_id_t name) {
+  text.add(Interner::global().wasm_name(name));
+}
+
+void WatEmitter::begin_module(std::uint32_t pages, RuntimeMode mode) {
+  text.append("(module");
+  text.indent();
+  text.line(R"((import "host" "exit" (func $exit)))");
+  if (mode == RuntimeMode::buffered) {
+    text.line(R"((import "host" "write" (func $write (param i32 i32))))");
+  } else {
+    text.line(R"((import "host" "putchar" (func $putchar (param i32))))");
+  }
+  text.line(R"((import "host" "getchar" (func $getchar (result i32))))");
+  text.line("(memory ");
+  text.number(pages);
+  text.append(")");
+}
+
+void WatEmitter::runtime(std::string const &wat) {
+  std::string_view rest = wat;
+  while (!rest.empty()) {
+    auto end = std::min(rest.find('\n'), rest.size());
+    text.line(rest.substr(0, end));
+    rest.remove_prefix(std::min(end + 1, rest.size()));
+  }
+  text.append("\n");
+}
+
+void WatEmitter::global(name_id_t name, std::int32_t value) {
+  text.line("(global");
+  add_name(name);
+  text.add("(mut i32) (i32.const ");
+  text.number(value);
+  text.append(") )");
+}
+
+void WatEmitter::begin_func(name_id_t name,
+                            std::vector<name_id_t> const &params,
+                            bool has_result,
+                            std::vector<name_id_t> const &locals) {
+  text.line("");
+  text.line("(func");
+  add_name(name);
+
+  for (auto param : params) {
+    text.add("(param");
+    add_name(param);
+    text.append(" i32)");
+  }
+
+  if (has_result) {
+    text.add("(result i32)");
+  }
+
+  text.line("");
+
+  // all the local variables go at the very beginning of the function
+  text.indent();
+  for (auto local : locals) {
+    text.line("(local");
+    add_name(local);
+    text.append(" i32 )");
+  }
+
+  text.line("");
+}
+
+void WatEmitter::end_func() {
+  text.dedent();
+  text.line(")");
+}
+
+void WatEmitter::end_module(StringTable &strings, name_id_t start) {
+  text.line("");
+  text.line(";;");
+  text.line(";; STRINGS");
+  text.line(";;");
+  text.append("\n");
+  text.append(strings.build_wasm_code());
+
+  text.line("(start");
+  add_name(start);
+  text.append(")");
+  text.dedent();
+  text.line(")\n");
+  text.flush(out);
+}
+
+void WatEmitter::op(Op op) { text.line(wasm::op_name(op)); }
+
+void WatEmitter::i32_const(std::int32_t value) {
+  text.line("i32.const ");
+  text.number(value);
+}
+
+void WatEmitter::variable(Op op, name_id_t name) {
+  text.line(wasm::op_name(op));
+  add_name(name);
+}
+
+void WatEmitter::memory(Op op, std::uint32_t offset) {
+  text.line(wasm::op_name(op));
+  if (offset != 0) {
+    text.add("offset=");
+    text.number(offset);
+  }
+}
+
+void WatEmitter::call(name_id_t name) {
+  text.line("call");
+  add_name(name);
+}
+
+void WatEmitter::branch(Op op, std::string const &label) {
+  text.line(wasm::op_name(op));
+  text.add("$");
+  text.append(label);
+}
+
+void WatEmitter::branch_table(std::vector<std::string> const &labels) {
+  text.line("br_table");
+  for (auto const &label : labels) {
+    text.add("$");
+    text.append(label);
+  }
+}
+
+void WatEmitter::begin_block(std::string const &label) {
+  text.line("(block $");
+  text.append(label);
+  text.indent();
+}
+
+void WatEmitter::begin_loop(std::string const &label) {
+  text.line("(loop $");
+  text.append(label);
+  text.indent();
+}
+
+void WatEmitter::begin_if(bool has_result) {
+  text.line("(if");
+  if (has_result) {
+    text.add("(result i32)");
+  }
+  text.indent();
+}
+
+void WatEmitter::begin_condition() {
+  text.line("(block (result i32)");
+  text.indent();
+}
+
+void WatEmitter::begin_then() {
+  text.line("(then ");
+  text.indent();
+}
+
+void WatEmitter::begin_else() {
+  text.line("(else ");
+  text.indent();
+}
+
+void WatEmitter::end() {
+  text.dedent();
+  text.line(")");
+}
+
+void WasmEmitter::begin_module(std::uint32_t pages, RuntimeMode mode) {
+  module.import("host", "exit", intern("exit"), {0, false});
+  if (mode == RuntimeMode::buffered) {
+    module.import("host", "write", intern("write"), {2, false});
+  } else {
+    module.import("host", "putchar", intern("putchar"), {1, false});
+  }
+  module.import("host", "getchar", intern("getchar"), {0, true});
+  module.set_memory(pages);
+}
+
+void WasmEmitter::runtime(std::string const &wat) {
+  WatAssembler(module).assemble(wat);
+}
+
+void WasmEmitter::global(name_id_t name, std::int32_t value) {
+  module.global(name, value);
+}
+
+void WasmEmitter::begin_func(name_id_t name,
+                             std::vector<name_id_t> const &params,
+                             bool has_result,
+                             std::vector<name_id_t> const &locals) {
+  function = &module.function(name, params, has_result);
+  for (auto local : locals) {
+    function->local(local);
+  }
+}
+
+void WasmEmitter::end_func() {
+  function->finish();
+  function = nullptr;
+}
+
+void WasmEmitter::end_module(StringTable &strings, name_id_t start) {
+  for (auto const &[text, entry] : strings.entries()) {
+    module.data(entry.offset, wasm::unescape(text));
+  }
+  module.set_start(start);
+
+  std::string binary = module.encode();
+  out.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+}
+
+void WasmEmitter::op(Op op) { function->op(op); }
+
+void WasmEmitter::i32_const(std::int32_t value) { function->i32_const(value); }
+
+void WasmEmitter::variable(Op op, name_id_t name) {
+  if (op == Op::global_get || op == Op::global_set) {
+    function->global_op(op, name);
+  } else {
+    function->local_op(op, name);
+  }
+}
+
+void WasmEmitter::memory(Op op, std::uint32_t offset) {
+  function->memory_op(op, wasm::op_alignment(op), offset);
+}
+
+void WasmEmitter::call(name_id_t name) { function->call(name); }
+
+void WasmEmitter::branch(Op op, std::string const &label) {
+  function->branch(op, intern(label));
+}
+
+void WasmEmitter::branch_table(std::vector<std::string> const &labels) {
+  std::vector<std::uint32_t> depths;
+  depths.reserve(labels.size());
+  for (auto const &label : labels) {
+    depths.push_back(function->label_depth(intern(label)));
+  }
+  function->branch_table(depths);
+}
+
+void WasmEmitter::begin_block(std::string const &label) {
+  function->begin(Op::block, intern(label), false);
+  open.push_back(Construct::block);
+}
+
+void WasmEmitter::begin_loop(std::string const &label) {
+  function->begin(Op::loop, intern(label), false);
+  open.push_back(Construct::block);
+}
+
+void WasmEmitter::begin_if(bool has_result) {
+  open.push_back(has_result ? Construct::if_result : Construct::if_);
+}
+
+void WasmEmitter::begin_condition() {
+  function->begin(Op::block, NO_NAME, true);
+  open.push_back(Construct::condition);
+}
+
+void WasmEmitter::begin_then() {
+  // the condition is on the stack, the if itself starts here
+  function->begin(Op::if_, NO_NAME, open.back() == Construct::if_result);
+  open.push_back(Construct::then);
+}
+
+void WasmEmitter::begin_else() {
+  function->else_();
+  open.push_back(Construct::else_);
+}
+
+void WasmEmitter::end() {
+  Construct construct = open.back();
+  open.pop_back();
+
+  if (construct != Construct::then && construct != Construct::else_) {
+    function->end();
+  }
+}
@@ -0,0 +1,133 @@
+/**
+ * @file FlatAST.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Compact struct-of-arrays representation of the AST
+ */
+
+#include "FlatAST.hpp"
+
+namespace yy {
+
+/**
+ * @brief flatten the tree starting at `root`. also records each node's
+ * position in `ASTNode::index`
+ *
+ * @param root root of the pointer-based ast
+ */
+FlatAST::FlatAST(ASTNode *root) {
+  if (root == nullptr) {
+    return;
+  }
+
+  // pre-order walk with an explicit stack, children pushed in reverse so they
+  // come out left to right
+  struct pending_t {
+    ASTNode *node;
+    std::uint32_t parent;
+  };
+
+  std::vector<pending_t> stack{{root, NONE}};
+  std::vector<std::uint32_t> last_child;
+
+  while (!stack.empty()) {
+    auto [node, parent] = stack.back();
+    stack.pop_back();
+
+    auto i = static_cast<std::uint32_t>(kinds.size());
+    node->index = i;
+
+    kinds.push_back(node->type);
+    lines.push_back(node->linenum);
+    first_child.push_back(NONE);
+    next_sibling.push_back(NONE);
+    subtree_end.push_back(i + 1);
+    value_offset.push_back(static_cast<std::uint32_t>(text.size()));
+    value_length.push_back(static_cast<std::uint32_t>(node->value.size()));
+    nodes.push_back(node);
+    last_child.push_back(NONE);
+    text += node->value;
+
+    if (parent != NONE) {
+      if (last_child[parent] == NONE) {
+        first_child[parent] = i;
+      } else {
+        next_sibling[last_child[parent]] = i;
+      }
+      last_child[parent] = i;
+    }
+
+    for (auto it = node->children.end(); it != node->children.begin();) {
+      stack.push_back({*--it, i});
+    }
+  }
+
+  // a subtree ends where the subtree of its last child ends. children always
+  // have larger indices, so one backwards sweep is enough
+  for (auto i = static_cast<std::uint32_t>(kinds.size()); i-- > 0;) {
+    if (last_child[i] != NONE) {
+      subtree_end[i] = subtree_end[last_child[i]];
+    }
+  }
+}
+
+/**
+ * @brief approximate amount of memory used per node, including the shared
+ * text buffer
+ */
+std::size_t FlatAST::bytes_per_node() const {
+  if (kinds.empty()) {
+    return 0;
+  }
+
+  std::size_t per_node = sizeof(Node) + sizeof(int) +
+                         5 * sizeof(std::uint32_t) + sizeof(ASTNode *);
+  return per_node + text.size() / kinds.size();
+}
+
+/**
+ * @brief find all direct children of specified type
+ *
+ * @param node_type type of node to be found
+ * @return std::vector<FlatNode> all nodes of specified type
+ */
+std::vector<FlatNode> FlatNode::find_all(Node node_type) const {
+  std::vector<FlatNode> res;
+  for (auto c = first_child(); c.valid(); c = c.next_sibling()) {
+    if (c.type() == node_type) {
+      res.push_back(c);
+    }
+  }
+
+  return res;
+}
+
+/**
+ * @brief find the first direct child of specified type
+ *
+ * @param node_type type of node to be found
+ * @return FlatNode node, if it exists, invalid handle otherwise
+ */
+FlatNode FlatNode::find_first(Node node_type) const {
+  for (auto c = first_child(); c.valid(); c = c.next_sibling()) {
+    if (c.type() == node_type) {
+      return c;
+    }
+  }
+
+  return FlatNode(ast, FlatAST::NONE);
+}
+
+/**
+ * @brief find all descendants of specified type. this is a linear scan over
+ * the subtree range, so results come in pre-order (source) order
+ *
+ * @param node_type type of node to be found
+ * @return std::vector<FlatNode> all descendants of specified type
+ */
+std::vector<FlatNode> FlatNode::find_recursive(Node node_type) const {
+  std::vector<FlatNode> res;
+  for_each(node_type, [&res](FlatNode n) { res.push_back(n); });
+  return res;
+}
+
+} // namespace yy
@@ -0,0 +1,44 @@
+/**
+ * @file Interner.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Global identifier interner, maps every identifier to a dense id
+ */
+
+#include "Interner.hpp"
+
+Interner::Interner() {
+  // reserve id 0 for "no name"
+  names.emplace_back();
+  wasm_names.emplace_back();
+}
+
+/**
+ * @brief get the interner shared by the whole compiler
+ */
+Interner &Interner::global() {
+  static Interner interner;
+  return interner;
+}
+
+/**
+ * @brief get the id of an identifier, assigning a new one if needed
+ *
+ * @param name identifier text
+ * @return name_id_t id of the identifier
+ */
+name_id_t Interner::intern(std::string_view name) {
+  if (name.empty()) {
+    return NO_NAME;
+  }
+
+  auto it = ids.find(name);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  auto id = static_cast<name_id_t>(names.size());
+  names.emplace_back(name);
+  wasm_names.emplace_back("$" + names.back());
+  ids.emplace(names.back(), id);
+  return id;
+}
@@ -0,0 +1,888 @@
+/**
+ * @file Interpreter.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Interpreter for the WebAssembly modules the compiler generates
+ */
+
+#include "Interpreter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace wasm {
+
+namespace {
+
+const std::uint8_t I32 = 0x7f;
+const std::uint8_t EMPTY_BLOCK = 0x40;
+const std::uint8_t FUNC_TYPE = 0x60;
+const std::uint8_t EXTERNAL_FUNC = 0x00;
+const std::uint32_t PAGE_SIZE = 65536;
+
+// values the stack holds, locals included, and frames that can be active
+const std::size_t STACK_SIZE = 1 << 20;
+const std::size_t MAX_CALL_DEPTH = 1 << 16;
+
+/**
+ * @brief Reader reads the parts of a binary module
+ */
+struct Reader {
+  std::string_view bytes;
+  std::size_t pos = 0;
+
+  bool done() const { return pos == bytes.size(); }
+
+  [[noreturn]] void error(std::string const &message) const {
+    throw std::runtime_error("malformed module at byte " +
+                             std::to_string(pos) + ": " + message);
+  }
+
+  std::uint8_t u8() {
+    if (pos >= bytes.size()) {
+      error("unexpected end");
+    }
+    return static_cast<std::uint8_t>(bytes[pos++]);
+  }
+
+  void expect(std::uint8_t byte, const char *what) {
+    if (u8() != byte) {
+      error(std::string("expected ") + what);
+    }
+  }
+
+  std::uint32_t u32() {
+    std::uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+      std::uint8_t byte = u8();
+      value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    error("LEB128 number is too long");
+  }
+
+  std::int32_t i32() {
+    std::uint32_t value = 0;
+    int shift = 0;
+    std::uint8_t byte;
+    do {
+      if (shift >= 35) {
+        error("LEB128 number is too long");
+      }
+      byte = u8();
+      value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+
+    // sign extend
+    if (shift < 32 && (byte & 0x40)) {
+      value |= UINT32_MAX << shift;
+    }
+    return static_cast<std::int32_t>(value);
+  }
+
+  std::string_view bytes_of(std::uint32_t size) {
+    if (size > bytes.size() - pos) {
+      error("unexpected end");
+    }
+    auto result = bytes.substr(pos, size);
+    pos += size;
+    return result;
+  }
+
+  std::string_view name() { return bytes_of(u32()); }
+
+  /**
+   * @brief read a constant expression, `i32.const N end`
+   */
+  std::int32_t const_expr() {
+    expect(static_cast<std::uint8_t>(Op::i32_const), "i32.const");
+    std::int32_t value = i32();
+    expect(static_cast<std::uint8_t>(Op::end), "end");
+    return value;
+  }
+};
+
+/**
+ * @brief control construct that is open while a body is decoded
+ */
+struct control_t {
+  Op op;
+  bool has_result;
+  // height of the value stack when the construct was entered
+  std::uint32_t height;
+  // first instruction of a loop
+  std::uint32_t start;
+  // the if instruction, whose target is the else branch or the end
+  std::uint32_t if_pc;
+  // instructions that branch to the end of the construct
+  std::vector<std::uint32_t> exits;
+  // rest of the construct is not reachable, its stack is polymorphic
+  bool unreachable = false;
+};
+
+} // namespace
+
+/**
+ * @brief decode a module
+ *
+ * @param binary module in the binary format
+ * @throws std::runtime_error if the module is malformed or uses something
+ * outside the i32 subset the compiler generates
+ */
+Interpreter::Interpreter(std::string_view binary) {
+  Reader reader{binary};
+  if (reader.bytes_of(8) != std::string_view("\0asm\1\0\0\0", 8)) {
+    reader.error("not a version 1 module");
+  }
+
+  std::vector<std::string_view> bodies;
+  while (!reader.done()) {
+    std::uint8_t id = reader.u8();
+    Reader section{reader.bytes_of(reader.u32())};
+
+    switch (id) {
+    case 0:
+      // custom sections don't affect execution
+      continue;
+    case 1:
+      for (auto count = section.u32(); count > 0; count--) {
+        section.expect(FUNC_TYPE, "a function type");
+        Signature signature;
+        signature.params = section.u32();
+        for (std::uint32_t i = 0; i < signature.params; i++) {
+          section.expect(I32, "an i32 parameter");
+        }
+        auto results = section.u32();
+        if (results > 1) {
+          section.error("more than one result");
+        }
+        if (results == 1) {
+          section.expect(I32, "an i32 result");
+        }
+        signature.has_result = results == 1;
+        types.push_back(signature);
+      }
+      break;
+    case 2:
+      for (auto count = section.u32(); count > 0; count--) {
+        auto module_name = section.name();
+        auto field = section.name();
+        section.expect(EXTERNAL_FUNC, "an imported function");
+        auto type = section.u32();
+        if (type >= types.size()) {
+          section.error("unknown type");
+        }
+
+        Signature const &signature = types[type];
+        if (module_name == "host" && field == "exit" &&
+            signature == Signature{0, false}) {
+          imports.push_back(Host::exit);
+        } else if (module_name == "host" && field == "putchar" &&
+                   signature == Signature{1, false}) {
+          imports.push_back(Host::putchar);
+        } else if (module_name == "host" && field == "write" &&
+                   signature == Signature{2, false}) {
+          imports.push_back(Host::write);
+        } else if (module_name == "host" && field == "getchar" &&
+                   signature == Signature{0, true}) {
+          imports.push_back(Host::getchar);
+        } else {
+          throw std::runtime_error("unknown import `" +
+                                   std::string(module_name) + "." +
+                                   std::string(field) + "`");
+        }
+      }
+      break;
+    case 3:
+      for (auto count = section.u32(); count > 0; count--) {
+        function_t function;
+        auto type = section.u32();
+        if (type >= types.size()) {
+          section.error("unknown type");
+        }
+        function.signature = types[type];
+        functions.push_back(function);
+      }
+      break;
+    case 5:
+      if (section.u32() != 1) {
+        section.error("expected a single memory");
+      }
+      if (section.u8() != 0) {
+        // a maximum doesn't matter, memory never grows
+        section.u32();
+      }
+      memory_pages = section.u32();
+      if (memory_pages > PAGE_SIZE) {
+        section.error("memory is too large");
+      }
+      break;
+    case 6:
+      for (auto count = section.u32(); count > 0; count--) {
+        section.expect(I32, "an i32 global");
+        section.u8();
+        initial_globals.push_back(section.const_expr());
+      }
+      break;
+    case 7:
+      // exports are not needed to run the start function
+      section.pos = section.bytes.size();
+      break;
+    case 8:
+      start = section.u32();
+      break;
+    case 10:
+      if (section.u32() != functions.size()) {
+        section.error("function and code sections don't match");
+      }
+      for (std::size_t i = 0; i < functions.size(); i++) {
+        bodies.push_back(section.bytes_of(section.u32()));
+      }
+      break;
+    case 11:
+      for (auto count = section.u32(); count > 0; count--) {
+        if (section.u32() != 0) {
+          section.error("expected an active segment of memory 0");
+        }
+        auto offset = static_cast<std::uint32_t>(section.const_expr());
+        segments.push_back({offset, std::string(section.name())});
+      }
+      break;
+    default:
+      reader.error("unsupported section " + std::to_string(id));
+    }
+
+    if (!section.done()) {
+      section.error("unexpected bytes at the end of section " +
+                    std::to_string(id));
+    }
+  }
+
+  if (bodies.size() != functions.size()) {
+    reader.error("missing code section");
+  }
+  for (std::size_t i = 0; i < functions.size(); i++) {
+    decode_body(functions[i], bodies[i]);
+  }
+}
+
+/**
+ * @brief decode the body of a function into `code`
+ */
+void Interpreter::decode_body(function_t &function, std::string_view body) {
+  Reader reader{body};
+
+  std::uint32_t locals = function.signature.params;
+  for (auto groups = reader.u32(); groups > 0; groups--) {
+    auto count = reader.u32();
+    reader.expect(I32, "i32 locals");
+    if (count > STACK_SIZE - locals) {
+      reader.error("too many locals");
+    }
+    locals += count;
+  }
+  function.locals = locals - function.signature.params;
+  function.entry = static_cast<std::uint32_t>(code.size());
+
+  // the value stack height of the frame, locals included
+  std::uint32_t height = locals;
+  std::uint32_t max_height = height;
+  std::vector<control_t> controls;
+  controls.push_back({Op::block, function.signature.has_result, height, 0, 0});
+
+  auto pop = [&](std::uint32_t count) {
+    control_t &control = controls.back();
+    if (height < control.height + count) {
+      if (!control.unreachable) {
+        reader.error("value stack underflow");
+      }
+      height = control.height;
+      return;
+    }
+    height -= count;
+  };
+  auto push = [&](std::uint32_t count) {
+    height += count;
+    max_height = std::max(max_height, height);
+  };
+  auto emit = [&](Op op, std::uint32_t a = 0, std::uint32_t b = 0,
+                  std::uint8_t keep = 0) {
+    code.push_back({op, keep, a, b});
+  };
+  auto pc = [&]() { return static_cast<std::uint32_t>(code.size()); };
+
+  auto emit_branch = [&](Op op, std::uint32_t depth) {
+    if (depth >= controls.size()) {
+      reader.error("unknown label");
+    }
+    control_t &target = controls[controls.size() - 1 - depth];
+    if (target.op == Op::loop) {
+      emit(op, target.start, target.height);
+    } else {
+      target.exits.push_back(pc());
+      emit(op, 0, target.height, target.has_result);
+    }
+  };
+  auto unreachable = [&]() {
+    control_t &control = controls.back();
+    control.unreachable = true;
+    height = control.height;
+  };
+
+  while (!controls.empty()) {
+    auto byte = reader.u8();
+    auto op = static_cast<Op>(byte);
+    if (op_name(op) == nullptr) {
+      reader.error("unsupported instruction " + std::to_string(byte));
+    }
+
+    switch (op) {
+    case Op::nop:
+      break;
+    case Op::unreachable:
+      emit(op);
+      unreachable();
+      break;
+    case Op::block:
+    case Op::loop:
+    case Op::if_: {
+      auto type = reader.u8();
+      if (type != EMPTY_BLOCK && type != I32) {
+        reader.error("unsupported block type");
+      }
+      if (op == Op::if_) {
+        pop(1);
+      }
+      controls.push_back({op, type == I32, height, pc(), pc()});
+      if (op == Op::if_) {
+        emit(op);
+      }
+      break;
+    }
+    case Op::else_: {
+      control_t &control = controls.back();
+      if (control.op != Op::if_) {
+        reader.error("else outside of an if");
+      }
+      pop(control.has_result ? 1 : 0);
+      // the end of the then branch jumps over the else branch
+      control.exits.push_back(pc());
+      emit(Op::else_);
+      code[control.if_pc].a = pc();
+      control.op = Op::else_;
+      control.unreachable = false;
+      height = control.height;
+      break;
+    }
+    case Op::end: {
+      control_t &control = controls.back();
+      pop(control.has_result ? 1 : 0);
+      if (controls.size() == 1) {
+        // the end of the body returns, so do branches to it
+        for (auto exit : control.exits) {
+          code[exit].a = pc();
+        }
+        emit(Op::return_, 0, 0, control.has_result);
+        controls.pop_back();
+        break;
+      }
+
+      if (control.op == Op::if_) {
+        if (control.has_result) {
+          reader.error("if with a result has no else");
+        }
+        code[control.if_pc].a = pc();
+      }
+      for (auto exit : control.exits) {
+        code[exit].a = pc();
+      }
+      height = control.height;
+      bool has_result = control.has_result;
+      controls.pop_back();
+      push(has_result ? 1 : 0);
+      break;
+    }
+    case Op::br:
+      emit_branch(op, reader.u32());
+      unreachable();
+      break;
+    case Op::br_if:
+      pop(1);
+      emit_branch(op, reader.u32());
+      break;
+    case Op::br_table: {
+      pop(1);
+      // followed by a br per label, the one at the index is executed next
+      auto count = reader.u32();
+      emit(op, count);
+      for (std::uint32_t i = 0; i <= count; i++) {
+        emit_branch(Op::br, reader.u32());
+      }
+      unreachable();
+      break;
+    }
+    case Op::return_:
+      emit(op, 0, 0, function.signature.has_result);
+      unreachable();
+      break;
+    case Op::call: {
+      auto index = reader.u32();
+      Signature signature;
+      if (index < imports.size()) {
+        switch (imports[index]) {
+        case Host::exit:
+          signature = {0, false};
+          break;
+        case Host::putchar:
+          signature = {1, false};
+          break;
+        case Host::write:
+          signature = {2, false};
+          break;
+        case Host::getchar:
+          signature = {0, true};
+          break;
+        }
+      } else if (index - imports.size() < functions.size()) {
+        signature = functions[index - imports.size()].signature;
+      } else {
+        reader.error("unknown function");
+      }
+      pop(signature.params);
+      push(signature.has_result ? 1 : 0);
+      emit(op, index);
+      break;
+    }
+    case Op::drop:
+      pop(1);
+      emit(op);
+      break;
+    case Op::select:
+      pop(3);
+      push(1);
+      emit(op);
+      break;
+    case Op::local_get:
+    case Op::local_set:
+    case Op::local_tee: {
+      auto index = reader.u32();
+      if (index >= locals) {
+        reader.error("unknown local");
+      }
+      if (op != Op::local_get) {
+        pop(1);
+      }
+      if (op != Op::local_set) {
+        push(1);
+      }
+      emit(op, index);
+      break;
+    }
+    case Op::global_get:
+    case Op::global_set: {
+      auto index = reader.u32();
+      if (index >= initial_globals.size()) {
+        reader.error("unknown global");
+      }
+      if (op == Op::global_get) {
+        push(1);
+      } else {
+        pop(1);
+      }
+      emit(op, index);
+      break;
+    }
+    case Op::i32_load:
+    case Op::i32_load8_s:
+    case Op::i32_load8_u:
+    case Op::i32_load16_u:
+    case Op::i32_store:
+    case Op::i32_store8:
+    case Op::i32_store16: {
+      if (memory_pages == 0) {
+        reader.error("memory access without a memory");
+      }
+      // the alignment is only a hint
+      reader.u32();
+      auto offset = reader.u32();
+      bool store = op == Op::i32_store || op == Op::i32_store8 ||
+                   op == Op::i32_store16;
+      pop(store ? 2 : 1);
+      push(store ? 0 : 1);
+      emit(op, offset);
+      break;
+    }
+    case Op::i32_const:
+      push(1);
+      emit(op, static_cast<std::uint32_t>(reader.i32()));
+      break;
+    case Op::i32_eqz:
+    case Op::i32_clz:
+    case Op::i32_ctz:
+    case Op::i32_popcnt:
+      pop(1);
+      push(1);
+      emit(op);
+      break;
+    default:
+      // the rest are binary operators
+      pop(2);
+      push(1);
+      emit(op);
+      break;
+    }
+  }
+
+  if (!reader.done()) {
+    reader.error("unexpected bytes after the end of a function");
+  }
+  function.frame_size = max_height;
+}
+
+/**
+ * @brief instantiate the module and run its start function
+ *
+ * @param in stream `getchar` reads from
+ * @param out stream `putchar` and `write` write to
+ * @throws Trap if the module traps
+ */
+void Interpreter::run(std::istream &in, std::ostream &out) {
+  execute<false>(in, out);
+}
+
+/**
+ * @brief run the module like run() does and count the instructions it
+ * executes. block, loop and end only mark the branch targets, they aren't
+ * executed and aren't counted
+ *
+ * @return std::uint64_t number of instructions executed
+ * @throws Trap if the module traps
+ */
+std::uint64_t Interpreter::count(std::istream &in, std::ostream &out) {
+  return execute<true>(in, out);
+}
+
+/**
+ * @brief run the module, the instructions are only counted if `counted`,
+ * so run() doesn't pay for it
+ *
+ * @return std::uint64_t number of instructions executed, if counted
+ */
+template <bool counted>
+std::uint64_t Interpreter::execute(std::istream &in, std::ostream &out) {
+  if (start < imports.size() || start - imports.size() >= functions.size()) {
+    throw std::runtime_error("module has no start function");
+  }
+  function_t const &main = functions[start - imports.size()];
+  if (main.signature.params != 0 || main.signature.has_result) {
+    throw std::runtime_error("start function has to take no arguments");
+  }
+
+  std::vector<std::uint8_t> memory(std::size_t(memory_pages) * PAGE_SIZE);
+  for (auto const &segment : segments) {
+    if (std::uint64_t(segment.offset) + segment.bytes.size() >
+        memory.size()) {
+      throw std::runtime_error("data segment is out of bounds");
+    }
+    std::memcpy(memory.data() + segment.offset, segment.bytes.data(),
+                segment.bytes.size());
+  }
+  std::vector<std::int32_t> globals = initial_globals;
+
+  struct frame_t {
+    std::uint32_t pc;
+    std::int32_t *base;
+  };
+  std::vector<frame_t> frames;
+  // left uninitialized, locals are zeroed on every call
+  std::unique_ptr<std::int32_t[]> stack(new std::int32_t[STACK_SIZE]);
+  std::int32_t *const stack_end = stack.get() + STACK_SIZE;
+
+  if (main.frame_size > STACK_SIZE) {
+    throw Trap("call stack exhausted");
+  }
+
+  const instr_t *instrs = code.data();
+  const std::uint32_t import_count = static_cast<std::uint32_t>(imports.size());
+  std::uint8_t *const mem = memory.data();
+  const std::uint64_t mem_size = memory.size();
+
+  std::int32_t *base = stack.get();
+  std::int32_t *sp = base + main.locals;
+  std::fill(base, sp, 0);
+  std::uint32_t pc = main.entry;
+  std::uint64_t steps = 0;
+
+  auto address = [&](std::uint32_t offset, std::uint32_t size) {
+    std::uint64_t effective = std::uint64_t(std::uint32_t(*--sp)) + offset;
+    if (effective + size > mem_size) {
+      throw Trap("out of bounds memory access");
+    }
+    return mem + effective;
+  };
+
+#define BINARY(expr)                                                           \
+  {                                                                            \
+    std::uint32_t r = std::uint32_t(sp[-1]);                                   \
+    std::uint32_t l = std::uint32_t(sp[-2]);                                   \
+    (void)r;                                                                   \
+    (void)l;                                                                   \
+    sp[-2] = std::int32_t(expr);                                               \
+    --sp;                                                                      \
+    break;                                                                     \
+  }
+#define SIGNED(value) std::int32_t(value)
+
+  while (true) {
+    instr_t const &instr = instrs[pc++];
+    if constexpr (counted) {
+      steps++;
+    }
+    switch (instr.op) {
+    case Op::unreachable:
+      throw Trap("unreachable executed");
+    case Op::br_if:
+      if (*--sp == 0) {
+        break;
+      }
+      // fall through
+    case Op::br:
+      if (instr.keep) {
+        std::int32_t value = sp[-1];
+        sp = base + instr.b;
+        *sp++ = value;
+      } else {
+        sp = base + instr.b;
+      }
+      pc = instr.a;
+      break;
+    case Op::br_table: {
+      std::uint32_t index = std::uint32_t(*--sp);
+      pc += index < instr.a ? index : instr.a;
+      break;
+    }
+    case Op::if_:
+      if (*--sp == 0) {
+        pc = instr.a;
+      }
+      break;
+    case Op::else_:
+      pc = instr.a;
+      break;
+    case Op::return_:
+      if (instr.keep) {
+        base[0] = sp[-1];
+        sp = base + 1;
+      } else {
+        sp = base;
+      }
+      if (frames.empty()) {
+        return steps;
+      }
+      pc = frames.back().pc;
+      base = frames.back().base;
+      frames.pop_back();
+      break;
+    case Op::call: {
+      if (instr.a < import_count) {
+        switch (imports[instr.a]) {
+        case Host::exit:
+          out.flush();
+          return steps;
+        case Host::putchar:
+          out.put(static_cast<char>(*--sp));
+          break;
+        case Host::write: {
+          std::uint32_t length = std::uint32_t(*--sp);
+          auto *bytes = address(0, length);
+          out.write(reinterpret_cast<char const *>(bytes), length);
+          break;
+        }
+        case Host::getchar:
+          *sp++ = in.get();
+          break;
+        }
+        break;
+      }
+
+      function_t const &callee = functions[instr.a - import_count];
+      // arguments become the first locals of the callee
+      std::int32_t *callee_base = sp - callee.signature.params;
+      if (frames.size() == MAX_CALL_DEPTH ||
+          callee.frame_size > std::size_t(stack_end - callee_base)) {
+        throw Trap("call stack exhausted");
+      }
+      frames.push_back({pc, base});
+      base = callee_base;
+      std::fill(sp, sp + callee.locals, 0);
+      sp += callee.locals;
+      pc = callee.entry;
+      break;
+    }
+    case Op::drop:
+      --sp;
+      break;
+    case Op::select: {
+      std::int32_t condition = *--sp;
+      --sp;
+      if (condition == 0) {
+        sp[-1] = sp[0];
+      }
+      break;
+    }
+    case Op::local_get:
+      *sp++ = base[instr.a];
+      break;
+    case Op::local_set:
+      base[instr.a] = *--sp;
+      break;
+    case Op::local_tee:
+      base[instr.a] = sp[-1];
+      break;
+    case Op::global_get:
+      *sp++ = globals[instr.a];
+      break;
+    case Op::global_set:
+      globals[instr.a] = *--sp;
+      break;
+    case Op::i32_load: {
+      std::int32_t value;
+      std::memcpy(&value, address(instr.a, 4), 4);
+      *sp++ = value;
+      break;
+    }
+    case Op::i32_load8_s: {
+      std::int8_t value = static_cast<std::int8_t>(*address(instr.a, 1));
+      *sp++ = value;
+      break;
+    }
+    case Op::i32_load8_u: {
+      std::uint8_t value = *address(instr.a, 1);
+      *sp++ = value;
+      break;
+    }
+    case Op::i32_load16_u: {
+      std::uint16_t value;
+      std::memcpy(&value, address(instr.a, 2), 2);
+      *sp++ = value;
+      break;
+    }
+    case Op::i32_store: {
+      std::int32_t value = *--sp;
+      std::memcpy(address(instr.a, 4), &value, 4);
+      break;
+    }
+    case Op::i32_store8: {
+      std::int32_t value = *--sp;
+      *address(instr.a, 1) = static_cast<std::uint8_t>(value);
+      break;
+    }
+    case Op::i32_store16: {
+      auto value = static_cast<std::uint16_t>(*--sp);
+      std::memcpy(address(instr.a, 2), &value, 2);
+      break;
+    }
+    case Op::i32_const:
+      *sp++ = static_cast<std::int32_t>(instr.a);
+      break;
+    case Op::i32_eqz:
+      sp[-1] = sp[-1] == 0;
+      break;
+    case Op::i32_clz: {
+      auto value = std::uint32_t(sp[-1]);
+      sp[-1] = value == 0 ? 32 : __builtin_clz(value);
+      break;
+    }
+    case Op::i32_ctz: {
+      auto value = std::uint32_t(sp[-1]);
+      sp[-1] = value == 0 ? 32 : __builtin_ctz(value);
+      break;
+    }
+    case Op::i32_popcnt:
+      sp[-1] = __builtin_popcount(std::uint32_t(sp[-1]));
+      break;
+    case Op::i32_eq:
+      BINARY(l == r)
+    case Op::i32_ne:
+      BINARY(l != r)
+    case Op::i32_lt_s:
+      BINARY(SIGNED(l) < SIGNED(r))
+    case Op::i32_lt_u:
+      BINARY(l < r)
+    case Op::i32_gt_s:
+      BINARY(SIGNED(l) > SIGNED(r))
+    case Op::i32_gt_u:
+      BINARY(l > r)
+    case Op::i32_le_s:
+      BINARY(SIGNED(l) <= SIGNED(r))
+    case Op::i32_le_u:
+      BINARY(l <= r)
+    case Op::i32_ge_s:
+      BINARY(SIGNED(l) >= SIGNED(r))
+    case Op::i32_ge_u:
+      BINARY(l >= r)
+    case Op::i32_add:
+      BINARY(l + r)
+    case Op::i32_sub:
+      BINARY(l - r)
+    case Op::i32_mul:
+      BINARY(l * r)
+    case Op::i32_div_s:
+    case Op::i32_rem_s: {
+      std::int32_t r = sp[-1];
+      std::int32_t l = sp[-2];
+      if (r == 0) {
+        throw Trap("integer divide by zero");
+      }
+      if (instr.op == Op::i32_div_s) {
+        if (l == INT32_MIN && r == -1) {
+          throw Trap("integer overflow");
+        }
+        sp[-2] = l / r;
+      } else {
+        // INT32_MIN % -1 overflows in C++, it's 0 in wasm
+        sp[-2] = r == -1 ? 0 : l % r;
+      }
+      --sp;
+      break;
+    }
+    case Op::i32_div_u:
+    case Op::i32_rem_u: {
+      auto r = std::uint32_t(sp[-1]);
+      auto l = std::uint32_t(sp[-2]);
+      if (r == 0) {
+        throw Trap("integer divide by zero");
+      }
+      sp[-2] = std::int32_t(instr.op == Op::i32_div_u ? l / r : l % r);
+      --sp;
+      break;
+    }
+    case Op::i32_and:
+      BINARY(l & r)
+    case Op::i32_or:
+      BINARY(l | r)
+    case Op::i32_xor:
+      BINARY(l ^ r)
+    case Op::i32_shl:
+      BINARY(l << (r & 31))
+    case Op::i32_shr_s:
+      BINARY(SIGNED(l) >> (r & 31))
+    case Op::i32_shr_u:
+      BINARY(l >> (r & 31))
+    case Op::i32_rotl:
+      BINARY((l << (r & 31)) | (l >> ((32 - (r & 31)) & 31)))
+    case Op::i32_rotr:
+      BINARY((l >> (r & 31)) | (l << ((32 - (r & 31)) & 31)))
+    default:
+      // block, loop, end and nop are not in the decoded stream
+      throw Trap("corrupt instruction stream");
+    }
+  }
+
+#undef SIGNED
+#undef BINARY
+}
+
+} // namespace wasm
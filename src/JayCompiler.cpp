@@ -10,17 +10,52 @@ namespace yy {
  * @param is input stream, can be file input or stdin
  * @param file filename that will be opened and parsed; used for better error
  * handling
- * @return ASTNode* an Abstract Syntax Tree of the specified  input
+ * @return ASTNode* an Abstract Syntax Tree of the specified  input. the tree
+ * is owned by the compiler and stays valid until the next call to `parse`
  */
 ASTNode *JayCompiler::parse(std::istream *is, std::string file) {
+  return parse(std::make_unique<Lexer>(is), file);
+}
+
+/**
+ * @brief Parse a source buffer in place and return resulting Abstract Syntax
+ * Tree. token text is read straight from the buffer, which only has to stay
+ * alive until this returns
+ *
+ * @param source source text, usually a memory mapped file
+ * @param file filename of the source; used for better error handling
+ * @param backend scanner to read the source with
+ * @return ASTNode* an Abstract Syntax Tree of the source. the tree is owned
+ * by the compiler and stays valid until the next call to `parse`
+ */
+ASTNode *JayCompiler::parse(const SourceBuffer &source, std::string file,
+                            Lexer::Backend backend) {
+  return parse(std::make_unique<Lexer>(&source, backend), file);
+}
+
+/**
+ * @brief run the parser over the tokens of `lexer`
+ *
+ * @param lexer lexer to read tokens from
+ * @param file filename of the input
+ * @return ASTNode* resulting ast, nullptr if parsing failed
+ */
+ASTNode *JayCompiler::parse(std::unique_ptr<Lexer> lexer, std::string file) {
   ast = nullptr;
-  lexer = std::make_unique<Lexer>(is);
+  flat_ast = nullptr;
+  arena = std::make_unique<NodeArena>();
+  this->lexer = std::move(lexer);
   parser = std::make_unique<Parser>(*this);
   filename = file;
 #ifdef YYTRACE
   parser->set_debug_level(1);
 #endif
   parser->parse();
+
+  if (ast != nullptr) {
+    flat_ast = std::make_shared<FlatAST>(ast);
+  }
+
   return ast;
 }
 
@@ -0,0 +1,407 @@
+/**
+ * @file Lexer.cpp
+ * @author Artem Golovin (30018900)
+ * @brief In-place scanner for memory mapped sources. Follows the rules of
+ * `scanner.l` exactly, including its error messages. Runs of whitespace,
+ * comments, identifiers and string characters are skipped with the kernels
+ * of ScanKernels.hpp
+ */
+
+#include "Lexer.hpp"
+#include "Interner.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+using token = yy::Parser::token;
+
+namespace {
+
+struct keyword_t {
+  std::string_view text;
+  int token;
+};
+
+/**
+ * @brief perfect hash of the keywords, no two keywords share a slot. an
+ * identifier is a keyword only if it matches the keyword in its slot
+ */
+std::size_t keyword_hash(std::string_view id) {
+  return (id.size() * 7 + static_cast<unsigned char>(id[0])) & 15;
+}
+
+const keyword_t keyword_table[16] = {
+    /* 0 */ {"true", token::T_RESERVED_TRUE},
+    /* 1 */ {"else", token::T_RESERVED_ELSE},
+    /* 2 */ {"void", token::T_TYPE_VOID},
+    /* 3 */ {"boolean", token::T_TYPE_BOOLEAN},
+    /* 4 */ {},
+    /* 5 */ {"break", token::T_RESERVED_BREAK},
+    /* 6 */ {},
+    /* 7 */ {"if", token::T_RESERVED_IF},
+    /* 8 */ {},
+    /* 9 */ {"false", token::T_RESERVED_FALSE},
+    /* 10 */ {"while", token::T_RESERVED_WHILE},
+    /* 11 */ {},
+    /* 12 */ {"return", token::T_RESERVED_RETURN},
+    /* 13 */ {},
+    /* 14 */ {"int", token::T_TYPE_INT},
+    /* 15 */ {},
+};
+
+/**
+ * @brief get the token of a keyword
+ *
+ * @param id identifier text
+ * @return int keyword token, 0 if `id` isn't a keyword
+ */
+int find_keyword(std::string_view id) {
+  if (id.size() < 2 || id.size() > 7) {
+    return 0;
+  }
+
+  auto const &keyword = keyword_table[keyword_hash(id)];
+  return keyword.text == id ? keyword.token : 0;
+}
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+bool is_id_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+} // namespace
+
+Lexer::Lexer(const SourceBuffer *source, Backend backend)
+    : yyFlexLexer(nullptr, nullptr),
+      backend(is_supported(backend) ? backend : best_backend()),
+      source(source), source_buf(source->text()) {
+  if (this->backend == Backend::flex) {
+    switch_streams(&source_stream, nullptr);
+  }
+}
+
+/**
+ * @brief get the fastest backend the machine supports
+ */
+Lexer::Backend Lexer::best_backend() {
+  if (scan::has_avx2()) {
+    return Backend::avx2;
+  } else if (scan::has_sse2()) {
+    return Backend::sse2;
+  }
+  return Backend::scalar;
+}
+
+/**
+ * @brief check if the machine can run a backend
+ */
+bool Lexer::is_supported(Backend backend) {
+  switch (backend) {
+  case Backend::sse2:
+    return scan::has_sse2();
+  case Backend::avx2:
+    return scan::has_avx2();
+  default:
+    return true;
+  }
+}
+
+/**
+ * @brief find a backend by name: flex, scalar, sse2, avx2 or simd (the
+ * fastest supported one)
+ *
+ * @param name name of the backend
+ * @param backend set to the backend, if the name is valid
+ * @return true if the name is valid
+ */
+bool Lexer::backend_from_name(std::string_view name, Backend &backend) {
+  if (name == "flex") {
+    backend = Backend::flex;
+  } else if (name == "scalar") {
+    backend = Backend::scalar;
+  } else if (name == "sse2") {
+    backend = Backend::sse2;
+  } else if (name == "avx2") {
+    backend = Backend::avx2;
+  } else if (name == "simd") {
+    backend = best_backend();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief scan the next token with the selected backend
+ *
+ * @param semval semantic value of the token
+ * @return int token type, 0 at the end of the input
+ */
+int Lexer::lex(TokenType *semval) {
+  m_val = semval;
+  switch (backend) {
+  case Backend::scalar:
+    return scan<scan::scalar_kernels>();
+  case Backend::sse2:
+    return scan<scan::sse2_kernels>();
+  case Backend::avx2:
+    return scan<scan::avx2_kernels>();
+  default:
+    return yylex();
+  }
+}
+
+/**
+ * @brief get the text of a literal token. the view stays valid while the
+ * lexer and its source buffer are alive
+ *
+ * @param span span of the token, as returned with T_NUM or T_STR
+ * @return std::string_view text of the token
+ */
+std::string_view Lexer::text(span_t span) const {
+  std::size_t source_size = source != nullptr ? source->size() : 0;
+  if (span.offset >= source_size) {
+    return std::string_view(spilled).substr(span.offset - source_size,
+                                            span.length);
+  }
+
+  return source->substr(span);
+}
+
+/**
+ * @brief copy token text to the spill buffer
+ *
+ * @param text token text
+ * @return span_t span of the copy
+ */
+span_t Lexer::spill(std::string_view text) {
+  std::size_t source_size = source != nullptr ? source->size() : 0;
+  span_t span{static_cast<std::uint32_t>(source_size + spilled.size()),
+              static_cast<std::uint32_t>(text.size())};
+  spilled.append(text);
+  return span;
+}
+
+/**
+ * @brief scan the next token from `source`
+ *
+ * @tparam Kernels character class scans to use, see ScanKernels.hpp
+ * @return int token type, 0 at the end of the input
+ */
+template <typename Kernels> int Lexer::scan() {
+  const char *s = source->text().data();
+  const std::size_t n = source->size();
+
+  while (pos < n) {
+    std::size_t start = pos;
+    char c = s[pos++];
+    char next = pos < n ? s[pos] : '\0';
+
+    switch (c) {
+    case '\n':
+      yylineno++;
+      [[fallthrough]];
+    case ' ':
+    case '\t':
+    case '\r':
+      // a newline is `\n`, `\r` or `\r\n`, so counting `\n` counts lines
+      pos = Kernels::skip_blanks(s, pos, n, yylineno);
+      continue;
+    case '"':
+      if (scan_string<Kernels>()) {
+        return token::T_STR;
+      }
+      continue;
+    case '(':
+      return token::T_SEPARATOR_LPAREN;
+    case ')':
+      return token::T_SEPARATOR_RPAREN;
+    case '{':
+      return token::T_SEPARATOR_LBRACE;
+    case '}':
+      return token::T_SEPARATOR_RBRACE;
+    case ';':
+      return token::T_SEPARATOR_SEMI;
+    case ',':
+      return token::T_SEPARATOR_COMMA;
+    case '[':
+      return token::T_SEPARATOR_LBRACKET;
+    case ']':
+      return token::T_SEPARATOR_RBRACKET;
+    case '+':
+      return token::T_OP_PLUS;
+    case '-':
+      return token::T_OP_MINUS;
+    case '*':
+      return token::T_OP_TIMES;
+    case '%':
+      return token::T_OP_MOD;
+    case '/':
+      if (next == '/') {
+        // comment, up to the end of the line
+        pos = Kernels::find_eol(s, pos + 1, n);
+        continue;
+      }
+      return token::T_OP_DIV;
+    case '>':
+      if (next == '=') {
+        pos++;
+        return token::T_OP_GTEQ;
+      }
+      return token::T_OP_GT;
+    case '<':
+      if (next == '=') {
+        pos++;
+        return token::T_OP_LTEQ;
+      }
+      return token::T_OP_LT;
+    case '=':
+      if (next == '=') {
+        pos++;
+        return token::T_OP_EQEQ;
+      }
+      return token::T_OP_EQ;
+    case '!':
+      if (next == '=') {
+        pos++;
+        return token::T_OP_NOTEQ;
+      }
+      return token::T_OP_NOT;
+    case '&':
+      if (next == '&') {
+        pos++;
+        return token::T_OP_AND;
+      }
+      break;
+    case '|':
+      if (next == '|') {
+        pos++;
+        return token::T_OP_OR;
+      }
+      break;
+    default:
+      if (is_digit(c)) {
+        while (pos < n && is_digit(s[pos])) {
+          pos++;
+        }
+        m_val->span = {static_cast<std::uint32_t>(start),
+                       static_cast<std::uint32_t>(pos - start)};
+        return token::T_NUM;
+      }
+
+      if (is_id_start(c)) {
+        pos = Kernels::skip_id(s, pos, n);
+
+        std::string_view id(s + start, pos - start);
+        if (int keyword = find_keyword(id)) {
+          return keyword;
+        }
+
+        m_val->name = Interner::global().intern(id);
+        return token::T_ID;
+      }
+      break;
+    }
+
+    unknown_char();
+  }
+
+  return 0;
+}
+
+/**
+ * @brief scan the rest of a string literal, after the opening quote
+ *
+ * @tparam Kernels character class scans to use, see ScanKernels.hpp
+ * @return true if the string was terminated and its span is set
+ * @return false if it ran into a newline or the end of the input
+ */
+template <typename Kernels> bool Lexer::scan_string() {
+  const char *s = source->text().data();
+  const std::size_t n = source->size();
+  const std::size_t start = pos;
+  bool has_nul = false;
+
+  while ((pos = Kernels::find_string_special(s, pos, n)) < n) {
+    char c = s[pos];
+
+    if (c == '"') {
+      std::string_view body(s + start, pos - start);
+      std::size_t quote = pos++;
+
+      if (has_nul) {
+        // the scanner drops NUL characters, so the text can't be used as is
+        std::string copy;
+        for (char b : body) {
+          if (b != '\0') {
+            copy += b;
+          }
+        }
+
+        if (!copy.empty()) {
+          m_val->span = spill(copy);
+          return true;
+        }
+      } else if (!body.empty()) {
+        m_val->span = {static_cast<std::uint32_t>(start),
+                       static_cast<std::uint32_t>(body.size())};
+        return true;
+      }
+
+      // the text of an empty string is the closing quote
+      m_val->span = {static_cast<std::uint32_t>(quote), 1};
+      return true;
+    }
+
+    if (c == '\n' || c == '\r') {
+      // a newline ends the string, `\r\n` counts as one
+      pos++;
+      if (c == '\r' && pos < n && s[pos] == '\n') {
+        pos++;
+      }
+      if (s[pos - 1] == '\n') {
+        yylineno++;
+      }
+      fprintf(stderr, "unterminated string on line %d\n", yylineno);
+      warning_count++;
+      return false;
+    }
+
+    if (c == '\\' && pos + 1 < n) {
+      switch (s[pos + 1]) {
+      case 't':
+      case 'n':
+      case 'r':
+      case 'b':
+      case 'f':
+      case '\'':
+      case '"':
+        // escape sequences are kept as they are
+        pos += 2;
+        continue;
+      default:
+        break;
+      }
+    }
+
+    has_nul |= c == '\0';
+    pos++;
+  }
+
+  fprintf(stderr, "unterminated string on line %d\n", yylineno);
+  warning_count++;
+  return false;
+}
+
+/**
+ * @brief report a character that doesn't start any token
+ */
+void Lexer::unknown_char() {
+  fprintf(stderr, "unknown char at line: %d\n", yylineno);
+  if (warning_count >= warning_threshold) {
+    fprintf(stderr, "too many errors. aborting\n");
+    exit(EXIT_FAILURE);
+  } else {
+    warning_count++;
+  }
+}
@@ -0,0 +1,170 @@
+/**
+ * @file NodeArena.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Per-compilation arena for AST nodes and their children lists
+ */
+
+#include "NodeArena.hpp"
+#include "ASTNode.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace yy {
+
+NodeList::NodeList(NodeArena *arena, std::initializer_list<ASTNode *> nodes)
+    : arena(arena) {
+  if (nodes.size() == 0) {
+    return;
+  }
+
+  items = arena->allocate_slots(nodes.size());
+  std::copy(nodes.begin(), nodes.end(), items);
+  count = capacity = static_cast<std::uint32_t>(nodes.size());
+}
+
+/**
+ * @brief append a node to the list, growing the storage inside the arena
+ *
+ * @param node node to append
+ */
+void NodeList::push_back(ASTNode *node) {
+  if (count == capacity) {
+    std::uint32_t new_capacity = capacity == 0 ? 4 : capacity * 2;
+    ASTNode **new_items = arena->allocate_slots(new_capacity);
+    if (count != 0) {
+      std::memcpy(new_items, items, count * sizeof(ASTNode *));
+    }
+    items = new_items;
+    capacity = new_capacity;
+  }
+
+  items[count++] = node;
+}
+
+/**
+ * @brief remove the nodes in [first, last), keeping the order of the
+ * others. the storage is kept
+ *
+ * @param first first node to remove
+ * @param last node after the last one to remove
+ * @return iterator position of the node that followed the removed ones
+ */
+NodeList::iterator NodeList::erase(iterator first, iterator last) {
+  std::copy(last, end(), first);
+  count -= static_cast<std::uint32_t>(last - first);
+  return first;
+}
+
+/**
+ * @brief create a new node inside of the arena
+ *
+ * @param type type of the node
+ * @param value value associated with the node
+ * @param linenum line number where the token was found
+ * @param children children of the node
+ * @return ASTNode* newly created node
+ */
+ASTNode *NodeArena::make(Node type, std::string value, int linenum,
+                         NodeList children) {
+  return new (next_node_slot())
+      ASTNode{type, std::move(value), linenum, children};
+}
+
+ASTNode *NodeArena::make(Node type, std::string value, int linenum,
+                         std::initializer_list<ASTNode *> children) {
+  return make(type, std::move(value), linenum, NodeList(this, children));
+}
+
+/**
+ * @brief create an empty, arena-backed list of nodes
+ *
+ * @return NodeList* newly created list
+ */
+NodeList *NodeArena::make_list() {
+  return new (allocate(sizeof(NodeList), alignof(NodeList)))
+      NodeList(this, {});
+}
+
+/**
+ * @brief allocate uninitialized storage for `n` node pointers
+ *
+ * @param n number of slots
+ * @return ASTNode** pointer to the first slot
+ */
+ASTNode **NodeArena::allocate_slots(std::size_t n) {
+  return static_cast<ASTNode **>(
+      allocate(n * sizeof(ASTNode *), alignof(ASTNode *)));
+}
+
+/**
+ * @brief destroy all nodes and free every slab and block owned by the arena
+ */
+void NodeArena::release() {
+  std::size_t remaining = nodes_allocated;
+  for (auto *slab : node_slabs) {
+    std::size_t in_slab = std::min(remaining, NODES_PER_SLAB);
+    for (std::size_t i = 0; i < in_slab; i++) {
+      slab[i].~ASTNode();
+    }
+    remaining -= in_slab;
+    ::operator delete(slab);
+  }
+
+  for (auto *block : blocks) {
+    ::operator delete(block);
+  }
+
+  node_slabs.clear();
+  blocks.clear();
+  slab_used = NODES_PER_SLAB;
+  nodes_allocated = 0;
+  block_bytes = 0;
+  cursor = limit = nullptr;
+}
+
+std::size_t NodeArena::bytes_reserved() const {
+  return node_slabs.size() * NODES_PER_SLAB * sizeof(ASTNode) + block_bytes;
+}
+
+/**
+ * @brief bump-allocate `size` bytes from the current block, starting a new
+ * block when the current one is exhausted. requests larger than a block get a
+ * block of their own.
+ */
+void *NodeArena::allocate(std::size_t size, std::size_t align) {
+  auto aligned = (reinterpret_cast<std::uintptr_t>(cursor) + align - 1) &
+                 ~(std::uintptr_t)(align - 1);
+  char *start = reinterpret_cast<char *>(aligned);
+
+  if (cursor == nullptr || start + size > limit) {
+    std::size_t block_size = std::max(size, BLOCK_SIZE);
+    char *block = static_cast<char *>(::operator new(block_size));
+    blocks.push_back(block);
+    block_bytes += block_size;
+
+    if (block_size > BLOCK_SIZE) {
+      // oversized request, keep bumping from the previous block
+      return block;
+    }
+
+    start = block;
+    limit = block + block_size;
+  }
+
+  cursor = start + size;
+  return start;
+}
+
+ASTNode *NodeArena::next_node_slot() {
+  if (slab_used == NODES_PER_SLAB) {
+    node_slabs.push_back(
+        static_cast<ASTNode *>(::operator new(NODES_PER_SLAB * sizeof(ASTNode))));
+    slab_used = 0;
+  }
+
+  nodes_allocated++;
+  return &node_slabs.back()[slab_used++];
+}
+
+} // namespace yy
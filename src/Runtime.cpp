@@ -0,0 +1,158 @@
+/**
+ * @file Runtime.cpp
+ * @author Artem Golovin (30018900)
+ * @brief The WAT runtime of the generated modules, split into its functions
+ */
+
+#include "Runtime.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * @brief get the name after a `$` at `pos`, up to a space or a parenthesis
+ */
+std::string_view name_at(std::string_view code, std::size_t pos) {
+  auto end = code.find_first_of(" \t()", pos);
+  return code.substr(pos, std::min(end, code.size()) - pos);
+}
+
+} // namespace
+
+/**
+ * @brief get the runtime embedded in the compiler, it's split the first
+ * time it's used
+ *
+ * @param mode how the runtime prints
+ */
+Runtime const &Runtime::embedded(RuntimeMode mode) {
+  if (mode == RuntimeMode::buffered) {
+    static const Runtime buffered(std::string(RUNTIME_WAT) + "\n" +
+                                  RUNTIME_BUFFERED_WAT);
+    return buffered;
+  }
+  static const Runtime runtime(RUNTIME_WAT);
+  return runtime;
+}
+
+/**
+ * @brief split the text of a runtime into its functions
+ *
+ * @param wat top level functions and comments
+ * @throws std::runtime_error if a function isn't closed
+ */
+Runtime::Runtime(std::string_view text) : wat(text) {
+  static const std::string_view func = "(func $";
+  static const std::string_view call = "call $";
+
+  std::unordered_map<name_id_t, std::size_t> index;
+  std::vector<std::vector<name_id_t>> callees;
+  // the comment above a function is a part of it
+  auto begin = std::string::npos;
+  // function the line is in
+  std::size_t current = 0;
+  bool open = false;
+  int depth = 0;
+
+  for (std::size_t pos = 0; pos < wat.size();) {
+    auto end = std::min(wat.find('\n', pos), wat.size());
+    std::string_view line(wat.data() + pos, end - pos);
+    // parentheses and calls in comments don't count
+    auto code = line.substr(0, line.find(";;"));
+
+    if (depth == 0) {
+      if (begin == std::string::npos &&
+          line.find_first_not_of(" \t\r") != std::string::npos) {
+        begin = pos;
+      }
+      if (code.compare(0, func.size(), func) == 0) {
+        auto name = intern(name_at(code, func.size()));
+        // a function defined again takes the place of the earlier one
+        auto [iter, added] = index.emplace(name, fragments.size());
+        current = iter->second;
+        if (added) {
+          fragments.emplace_back();
+          callees.emplace_back();
+        }
+        fragments[current] = {name, begin, 0, {}};
+        callees[current].clear();
+        open = true;
+      }
+    }
+
+    for (auto at = code.find(call); open && at != std::string::npos;
+         at = code.find(call, at + call.size())) {
+      callees[current].push_back(intern(name_at(code, at + call.size())));
+    }
+
+    for (char c : code) {
+      depth += c == '(' ? 1 : c == ')' ? -1 : 0;
+    }
+    if (depth == 0 && open) {
+      fragments[current].end = end;
+      begin = std::string::npos;
+      open = false;
+    }
+    pos = end + 1;
+  }
+
+  if (depth != 0 || open) {
+    throw std::runtime_error("runtime function $" +
+                             name_str(fragments[current].name) +
+                             " isn't closed");
+  }
+
+  for (std::size_t i = 0; i < fragments.size(); i++) {
+    for (auto name : callees[i]) {
+      auto iter = index.find(name);
+      if (iter != index.end()) {
+        fragments[i].calls.push_back(iter->second);
+      }
+    }
+  }
+}
+
+/**
+ * @brief get the functions a program needs: the builtins it calls and the
+ * runtime functions they call, in the order of the runtime
+ *
+ * @param called names of the functions the program calls, names that
+ * aren't in the runtime are ignored
+ * @return std::string WAT text of the functions
+ */
+std::string
+Runtime::functions(std::unordered_set<name_id_t> const &called) const {
+  std::vector<bool> needed(fragments.size(), false);
+  std::vector<std::size_t> work;
+  for (std::size_t i = 0; i < fragments.size(); i++) {
+    if (called.count(fragments[i].name) != 0) {
+      needed[i] = true;
+      work.push_back(i);
+    }
+  }
+
+  while (!work.empty()) {
+    auto i = work.back();
+    work.pop_back();
+    for (auto callee : fragments[i].calls) {
+      if (!needed[callee]) {
+        needed[callee] = true;
+        work.push_back(callee);
+      }
+    }
+  }
+
+  std::string text;
+  for (std::size_t i = 0; i < fragments.size(); i++) {
+    if (needed[i]) {
+      if (!text.empty()) {
+        text += "\n\n";
+      }
+      text.append(wat, fragments[i].begin,
+                  fragments[i].end - fragments[i].begin);
+    }
+  }
+  return text;
+}
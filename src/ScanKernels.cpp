@@ -0,0 +1,322 @@
+/**
+ * @file ScanKernels.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Character class scans of the in-place scanner, in scalar, SSE2 and
+ * AVX2 versions
+ */
+
+#include "ScanKernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_id_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+bool is_string_special(char c) {
+  return c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\0';
+}
+
+} // namespace
+
+std::size_t scalar_kernels::skip_blanks(const char *s, std::size_t pos,
+                                        std::size_t n, int &lines) {
+  while (pos < n && is_blank(s[pos])) {
+    lines += s[pos] == '\n';
+    pos++;
+  }
+  return pos;
+}
+
+std::size_t scalar_kernels::skip_id(const char *s, std::size_t pos,
+                                    std::size_t n) {
+  while (pos < n && is_id_char(s[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+std::size_t scalar_kernels::find_eol(const char *s, std::size_t pos,
+                                     std::size_t n) {
+  while (pos < n && s[pos] != '\n' && s[pos] != '\r') {
+    pos++;
+  }
+  return pos;
+}
+
+std::size_t scalar_kernels::find_string_special(const char *s,
+                                                std::size_t pos,
+                                                std::size_t n) {
+  while (pos < n && !is_string_special(s[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+#ifdef SCAN_X86
+
+namespace {
+
+// bytes of `v` in [lo, hi]. bytes are compared as signed, so the range is
+// moved to start at -128 first
+__m128i in_range_sse2(__m128i v, char lo, char hi) {
+  __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(char(0x80 - lo)));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8(char(-128 + (hi - lo) + 1)));
+}
+
+__m128i eq_sse2(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+__m128i load_sse2(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+__attribute__((target("avx2"))) __m256i in_range_avx2(__m256i v, char lo,
+                                                      char hi) {
+  __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8(char(0x80 - lo)));
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(char(-128 + (hi - lo) + 1)),
+                           shifted);
+}
+
+__attribute__((target("avx2"))) __m256i eq_avx2(__m256i v, char c) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+__attribute__((target("avx2"))) __m256i load_avx2(const char *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+
+} // namespace
+
+std::size_t sse2_kernels::skip_blanks(const char *s, std::size_t pos,
+                                      std::size_t n, int &lines) {
+  // most runs are a single character, don't load a vector for those
+  if (pos < n && !is_blank(s[pos])) {
+    return pos;
+  }
+
+  for (; pos + 16 <= n; pos += 16) {
+    __m128i v = load_sse2(s + pos);
+    __m128i newline = eq_sse2(v, '\n');
+    __m128i blank =
+        _mm_or_si128(_mm_or_si128(eq_sse2(v, ' '), eq_sse2(v, '\t')),
+                     _mm_or_si128(newline, eq_sse2(v, '\r')));
+
+    unsigned stop = ~_mm_movemask_epi8(blank) & 0xFFFF;
+    unsigned newlines = _mm_movemask_epi8(newline);
+    if (stop != 0) {
+      unsigned skipped = __builtin_ctz(stop);
+      lines += __builtin_popcount(newlines & ((1u << skipped) - 1));
+      return pos + skipped;
+    }
+    lines += __builtin_popcount(newlines);
+  }
+
+  return scalar_kernels::skip_blanks(s, pos, n, lines);
+}
+
+std::size_t sse2_kernels::skip_id(const char *s, std::size_t pos,
+                                  std::size_t n) {
+  if (pos < n && !is_id_char(s[pos])) {
+    return pos;
+  }
+
+  for (; pos + 16 <= n; pos += 16) {
+    __m128i v = load_sse2(s + pos);
+    // setting bit 5 maps upper case letters onto lower case ones
+    __m128i letter =
+        in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i id = _mm_or_si128(_mm_or_si128(letter, in_range_sse2(v, '0', '9')),
+                              eq_sse2(v, '_'));
+
+    unsigned stop = ~_mm_movemask_epi8(id) & 0xFFFF;
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+  }
+
+  return scalar_kernels::skip_id(s, pos, n);
+}
+
+std::size_t sse2_kernels::find_eol(const char *s, std::size_t pos,
+                                   std::size_t n) {
+  for (; pos + 16 <= n; pos += 16) {
+    __m128i v = load_sse2(s + pos);
+    unsigned found =
+        _mm_movemask_epi8(_mm_or_si128(eq_sse2(v, '\n'), eq_sse2(v, '\r')));
+    if (found != 0) {
+      return pos + __builtin_ctz(found);
+    }
+  }
+
+  return scalar_kernels::find_eol(s, pos, n);
+}
+
+std::size_t sse2_kernels::find_string_special(const char *s, std::size_t pos,
+                                              std::size_t n) {
+  for (; pos + 16 <= n; pos += 16) {
+    __m128i v = load_sse2(s + pos);
+    __m128i newline = _mm_or_si128(eq_sse2(v, '\n'), eq_sse2(v, '\r'));
+    __m128i special =
+        _mm_or_si128(_mm_or_si128(eq_sse2(v, '"'), eq_sse2(v, '\\')),
+                     _mm_or_si128(newline, eq_sse2(v, '\0')));
+    unsigned found = _mm_movemask_epi8(special);
+    if (found != 0) {
+      return pos + __builtin_ctz(found);
+    }
+  }
+
+  return scalar_kernels::find_string_special(s, pos, n);
+}
+
+__attribute__((target("avx2"))) std::size_t
+avx2_kernels::skip_blanks(const char *s, std::size_t pos, std::size_t n,
+                          int &lines) {
+  if (pos < n && !is_blank(s[pos])) {
+    return pos;
+  }
+
+  for (; pos + 32 <= n; pos += 32) {
+    __m256i v = load_avx2(s + pos);
+    __m256i newline = eq_avx2(v, '\n');
+    __m256i blank =
+        _mm256_or_si256(_mm256_or_si256(eq_avx2(v, ' '), eq_avx2(v, '\t')),
+                        _mm256_or_si256(newline, eq_avx2(v, '\r')));
+
+    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(blank));
+    unsigned newlines = static_cast<unsigned>(_mm256_movemask_epi8(newline));
+    if (stop != 0) {
+      unsigned skipped = __builtin_ctz(stop);
+      lines += __builtin_popcount(newlines & ((1u << skipped) - 1));
+      return pos + skipped;
+    }
+    lines += __builtin_popcount(newlines);
+  }
+
+  return sse2_kernels::skip_blanks(s, pos, n, lines);
+}
+
+__attribute__((target("avx2"))) std::size_t
+avx2_kernels::skip_id(const char *s, std::size_t pos, std::size_t n) {
+  if (pos < n && !is_id_char(s[pos])) {
+    return pos;
+  }
+
+  for (; pos + 32 <= n; pos += 32) {
+    __m256i v = load_avx2(s + pos);
+    // setting bit 5 maps upper case letters onto lower case ones
+    __m256i letter =
+        in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i id =
+        _mm256_or_si256(_mm256_or_si256(letter, in_range_avx2(v, '0', '9')),
+                        eq_avx2(v, '_'));
+
+    unsigned stop = ~static_cast<unsigned>(_mm256_movemask_epi8(id));
+    if (stop != 0) {
+      return pos + __builtin_ctz(stop);
+    }
+  }
+
+  return sse2_kernels::skip_id(s, pos, n);
+}
+
+__attribute__((target("avx2"))) std::size_t
+avx2_kernels::find_eol(const char *s, std::size_t pos, std::size_t n) {
+  for (; pos + 32 <= n; pos += 32) {
+    __m256i v = load_avx2(s + pos);
+    unsigned found = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_or_si256(eq_avx2(v, '\n'), eq_avx2(v, '\r'))));
+    if (found != 0) {
+      return pos + __builtin_ctz(found);
+    }
+  }
+
+  return sse2_kernels::find_eol(s, pos, n);
+}
+
+__attribute__((target("avx2"))) std::size_t
+avx2_kernels::find_string_special(const char *s, std::size_t pos,
+                                  std::size_t n) {
+  for (; pos + 32 <= n; pos += 32) {
+    __m256i v = load_avx2(s + pos);
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(eq_avx2(v, '"'), eq_avx2(v, '\\')),
+        _mm256_or_si256(_mm256_or_si256(eq_avx2(v, '\n'), eq_avx2(v, '\r')),
+                        eq_avx2(v, '\0')));
+    unsigned found = static_cast<unsigned>(_mm256_movemask_epi8(special));
+    if (found != 0) {
+      return pos + __builtin_ctz(found);
+    }
+  }
+
+  return sse2_kernels::find_string_special(s, pos, n);
+}
+
+bool has_sse2() { return __builtin_cpu_supports("sse2"); }
+
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#else
+
+// no SIMD on this architecture, everything runs the scalar code
+
+std::size_t sse2_kernels::skip_blanks(const char *s, std::size_t pos,
+                                      std::size_t n, int &lines) {
+  return scalar_kernels::skip_blanks(s, pos, n, lines);
+}
+
+std::size_t sse2_kernels::skip_id(const char *s, std::size_t pos,
+                                  std::size_t n) {
+  return scalar_kernels::skip_id(s, pos, n);
+}
+
+std::size_t sse2_kernels::find_eol(const char *s, std::size_t pos,
+                                   std::size_t n) {
+  return scalar_kernels::find_eol(s, pos, n);
+}
+
+std::size_t sse2_kernels::find_string_special(const char *s, std::size_t pos,
+                                              std::size_t n) {
+  return scalar_kernels::find_string_special(s, pos, n);
+}
+
+std::size_t avx2_kernels::skip_blanks(const char *s, std::size_t pos,
+                                      std::size_t n, int &lines) {
+  return scalar_kernels::skip_blanks(s, pos, n, lines);
+}
+
+std::size_t avx2_kernels::skip_id(const char *s, std::size_t pos,
+                                  std::size_t n) {
+  return scalar_kernels::skip_id(s, pos, n);
+}
+
+std::size_t avx2_kernels::find_eol(const char *s, std::size_t pos,
+                                   std::size_t n) {
+  return scalar_kernels::find_eol(s, pos, n);
+}
+
+std::size_t avx2_kernels::find_string_special(const char *s, std::size_t pos,
+                                              std::size_t n) {
+  return scalar_kernels::find_string_special(s, pos, n);
+}
+
+bool has_sse2() { return false; }
+
+bool has_avx2() { return false; }
+
+#endif
+
+} // namespace scan
@@ -6,9 +6,30 @@
 
 #include "SemanticAnalyzer.hpp"
 
+namespace {
+const std::int8_t EXPR_UNKNOWN = -1;
+// 64 MiB of elements, every backend can address that
+const std::uint64_t MAX_ARRAY_LENGTH = 1 << 24;
+
+/**
+ * @brief get the length of an array type, saturated to UINT32_MAX
+ */
+std::uint64_t array_length(ASTNode *type_node) {
+  // the scanner only lets digits through
+  std::uint64_t length = 0;
+  for (char c : type_node->value) {
+    length = std::min<std::uint64_t>(length * 10 + (c - '0'), UINT32_MAX);
+  }
+  return length;
+}
+} // namespace
+
 /**
  * @brief perform semantic validation of the ast and build a symtable. the
- * method traverses ast multiple times to find all semantic errors
+ * method declares all global symbols, then walks the ast once, keeping the
+ * enclosing function, loop and block on an explicit context stack. type
+ * checks that need the complete symbol table are queued during the walk and
+ * run afterwards, so diagnostics come out in the same order as before
  *
  * @return true if ast is semantically correct and passed all the checks
  * @return false otherwise
@@ -22,38 +43,25 @@ bool SemanticAnalyzer::validate() {
       return false;
     }
 
-    // Pass 1
-    std::vector<bool> glob_error_stack;
-    this->traverse(ast.get(), nullptr,
-                   std::bind(&SemanticAnalyzer::globals_post_order_pass_cb,
-                             this, std::placeholders::_1,
-                             std::placeholders::_2),
-                   glob_error_stack);
-    bool global_pass = glob_error_stack.empty();
-
-    // Pass 2
-    // fill out symbol table
-    std::vector<bool> sym_table_error_stack;
-    this->traverse(ast.get(),
-                   std::bind(&SemanticAnalyzer::build_scope_cb, this,
-                             std::placeholders::_1, std::placeholders::_2),
-                   std::bind(&SemanticAnalyzer::sym_table_post_pass_cb, this,
-                             std::placeholders::_1, std::placeholders::_2),
-                   sym_table_error_stack);
-    bool sym_table_pass = sym_table_error_stack.empty();
-
-    // Pass 3
+    declare_globals();
+
+    context_stack.clear();
+    context_stack.push_back({ast.get(), NO_NAME, Node::void_t, 0, 0});
+    deferred_type_checks.clear();
+    expr_validity.assign(flat_ast->size(), EXPR_UNKNOWN);
+
+    // fill out symbol table and check declarations
+    declaration_errors.clear();
+    visit(ast.get());
+    bool sym_table_pass = declaration_errors.empty();
+
     std::vector<bool> type_checking_err_stack;
-    this->traverse(
-        ast.get(),
-        std::bind(&SemanticAnalyzer::enter_scope_cb, this,
-                  std::placeholders::_1, std::placeholders::_2),
-        std::bind(&SemanticAnalyzer::type_checking_post_order_pass_cb, this,
-                  std::placeholders::_1, std::placeholders::_2),
-        type_checking_err_stack);
+    for (auto *node : deferred_type_checks) {
+      type_check(node, type_checking_err_stack);
+    }
     bool type_checking_pass = type_checking_err_stack.empty();
 
-    return global_pass && sym_table_pass && type_checking_pass;
+    return sym_table_pass && type_checking_pass;
   } else {
     semantic_error("No `main()` found. Aborting");
     return false;
@@ -63,117 +71,201 @@ bool SemanticAnalyzer::validate() {
 }
 
 /**
- * @brief traverse the ast with possible pre and post order callbacks.
- *
- * @param node ast node to start traversing from
- * @param pre pre-order callback function
- * @param post pos-order callback function
- * @param err_stack a vector to keep track of errors displayed. Rather
- * **hacky** way to allow semantic analyzer to print all errors after checks
- * have been performed
+ * @brief populate the symtable with global variables, functions and their
+ * parameters. only looks at the top level of the program
  */
-void SemanticAnalyzer::traverse(
-    ASTNode *node,
-    std::function<void(ASTNode *n, std::vector<bool> &err_stack)> pre,
-    std::function<void(ASTNode *n, std::vector<bool> &err_stack)> post,
-    std::vector<bool> &err_stack) {
+void SemanticAnalyzer::declare_globals() {
+  for (auto *node : ast->children) {
+    switch (node->type) {
+    case Node::main_func_decl:
+    case Node::function_decl: {
+      // TODO: ensure `main` doesn't have args
+      if (node->children.empty()) {
+        break;
+      }
 
-  if (pre != nullptr) {
-    pre(node, err_stack);
-  }
+      auto id = node->children[1]->name;
+      auto type = node->children[0]->type;
+      auto *params = node->find_first(Node::formal_params);
+      auto *block = node->find_first(Node::block);
+
+      sym_table->push_scope(id);
+
+      std::vector<Symbol> sym_params;
+      if (params != nullptr) {
+        for (auto *formal : params->children) {
+          auto *formal_id = formal->children[1];
+          auto *formal_type = formal->children[0];
+          auto *param_sym = new Symbol(
+              formal_id->name, "parameter", formal_type->type,
+              sym_table->current_scope_level + 1, sym_table->current_scope);
 
-  for (auto *next : node->children) {
-    traverse(next, pre, post, err_stack);
+          sym_params.push_back(*param_sym);
+
+          sym_table->define(param_sym, id);
+        }
+
+        flat_ast->at(params).for_each(Node::id, [&id](FlatNode _id) {
+          _id.node()->function_name = id;
+          _id.node()->is_formal_param = true;
+        });
+      }
+
+      // mark if the block supposed to have return statement
+      if (block != nullptr) {
+        block->is_return_block = type != Node::void_t;
+      }
+
+      sym_table->define(new FunctionSymbol(id, sym_params, type,
+                                           sym_table->current_scope_level,
+                                           sym_table->current_scope),
+                        sym_table->global_scope());
+      break;
+    }
+    case Node::global_var_decl: {
+      if (node->children.empty()) {
+        break;
+      }
+
+      sym_table->define(make_variable(node), sym_table->global_scope());
+      break;
+    }
+    default:
+      break;
+    }
   }
 
-  if (post != nullptr) {
-    post(node, err_stack);
+  // every function is known, bind the declarations to their symbols
+  for (auto *node : ast->children) {
+    if (node->type == Node::function_decl ||
+        node->type == Node::main_func_decl) {
+      auto *id = node->find_first(Node::id);
+      if (id != nullptr) {
+        id->function_symbol = sym_table->find_function(id->name);
+      }
+    }
   }
 }
 
 /**
- * @brief post-order callback function, used to collect & populate sym table
- * with information about global variables and functions. In addition it also
- * creates scopes for all global functions and specifies allowed function
- * scope for all identifiers found in the function block.
+ * @brief create the symbol of a variable declaration
  *
- * @param node ast node returned from `#traverse`
- * @param err_stack error stack returned from `#traverse`
+ * @param node global or local variable declaration
+ * @return Symbol* the variable, an array if it's declared with a length
  */
-void SemanticAnalyzer::globals_post_order_pass_cb(
-    ASTNode *node, std::vector<bool> &err_stack) {
-  switch (node->type) {
-  case Node::main_func_decl:
-  case Node::function_decl: {
-    // TODO: ensure `main` doesn't have args
-    if (node->children.empty()) {
-      break;
-    }
-
-    auto id = node->children[1]->value;
-    auto type = node->children[0]->type;
-    auto *params = node->find_first(Node::formal_params);
-    auto *block = node->find_first(Node::block);
-
-    sym_table->push_scope(id);
+Symbol *SemanticAnalyzer::make_variable(ASTNode *node) {
+  auto *type_node = node->children[0];
+  auto *id_node = node->children[1];
+  bool is_array = type_node->type == Node::array_t;
+
+  auto *sym = new Symbol(
+      id_node->name, "variable",
+      is_array ? type_node->children[0]->type : type_node->type,
+      sym_table->current_scope_level, sym_table->current_scope);
+  if (is_array) {
+    // a length of 0 is reported by check_array, it's still an array
+    sym->length = static_cast<std::uint32_t>(
+        std::max<std::uint64_t>(array_length(type_node), 1));
+  }
+  return sym;
+}
 
-    std::vector<Symbol> sym_params;
-    if (params != nullptr) {
-      auto ids = params->find_recursive(Node::id);
+/**
+ * @brief check the length of an array declaration
+ *
+ * @param node global or local variable declaration
+ * @param err_stack error stack of the traversal
+ */
+void SemanticAnalyzer::check_array(ASTNode *node,
+                                   std::vector<bool> &err_stack) {
+  auto *type_node = node->children[0];
+  if (type_node->type != Node::array_t) {
+    return;
+  }
 
-      for (auto *formal : params->children) {
-        auto *formal_id = formal->children[1];
-        auto *formal_type = formal->children[0];
-        auto *param_sym = new Symbol(
-            formal_id->value, "parameter", formal_type->type,
-            sym_table->current_scope_level + 1, sym_table->current_scope);
+  auto length = array_length(type_node);
+  if (length == 0 || length > MAX_ARRAY_LENGTH) {
+    semantic_error("Array `" + node->children[1]->value +
+                       "` must have between 1 and " +
+                       std::to_string(MAX_ARRAY_LENGTH) + " elements.",
+                   node->linenum);
+    err_stack.push_back(false);
+  }
+}
 
-        sym_params.push_back(*param_sym);
+/**
+ * @brief bind every identifier under `node` to the symbol it refers to. has
+ * to run once all the symbols visible from `node` are defined
+ *
+ * @param node function or global declaration
+ */
+void SemanticAnalyzer::resolve_ids(ASTNode *node) {
+  flat_ast->at(node).for_each(Node::id, [this](FlatNode id) {
+    auto *n = id.node();
+    n->symbol = sym_table->lookup(n->name, n->function_name);
+  });
+}
 
-        sym_table->define(param_sym, id);
-      }
+/**
+ * @brief pre-order step of the traversal. opens function, loop and block
+ * contexts and tags identifiers with the function they belong to
+ *
+ * @param node visited node
+ */
+void SemanticAnalyzer::enter(ASTNode *node) {
+  context_t context = context_stack.back();
 
-      for (auto *_id : ids) {
-        _id->function_name = id;
-        _id->is_formal_param = true;
-      }
+  switch (node->type) {
+  case Node::main_func_decl:
+  case Node::function_decl: {
+    if (node->type == Node::main_func_decl) {
+      sym_table->push_scope(main_name);
     }
 
-    // mark if the block supposed to have return statement
-    if (block != nullptr) {
-      block->is_return_block = type != Node::void_t;
-      auto ids = block->find_recursive(Node::id);
+    function_returns.clear();
+    function_blocks.clear();
+    context_stack.push_back(
+        {node, node->children[1]->name, node->children[0]->type, 0, 0});
+    break;
+  }
+  case Node::block: {
+    sym_table->enter_scope();
 
-      // assign function name to all ids inside the function block
-      for (auto *_id : ids) {
-        _id->function_name = id;
-      }
+    if (context.loop_depth > 0) {
+      node->is_while_block = true;
     }
 
-    sym_table->define(new FunctionSymbol(id, sym_params, type,
-                                         sym_table->current_scope_level,
-                                         sym_table->current_scope),
-                      "global");
+    context_stack.push_back({node, context.function, context.return_type,
+                             context.loop_depth, context.block_depth + 1});
     break;
   }
-  case Node::global_var_decl: {
-    if (node->children.empty()) {
-      break;
+  case Node::while_statement: {
+    context_stack.push_back({node, context.function, context.return_type,
+                             context.loop_depth + 1, context.block_depth});
+    break;
+  }
+  case Node::id: {
+    // assign function name to all ids inside the function block
+    if (context.function != NO_NAME && context.block_depth > 0) {
+      node->function_name = context.function;
     }
-
-    sym_table->define(new Symbol(node->children[1]->value, "variable",
-                                 node->children[0]->type,
-                                 sym_table->current_scope_level,
-                                 sym_table->current_scope),
-                      "global");
     break;
   }
-  case Node::while_statement: {
-    auto blocks = node->find_recursive(Node::block);
-    for (auto *block : blocks) {
-      block->is_while_block = true;
+  case Node::function_call: {
+    auto *id = node->find_first(Node::id);
+    id->function_symbol = sym_table->find_function(id->name);
+    break;
+  }
+  case Node::index_op: {
+    array_ids.insert(node->children[0]);
+    break;
+  }
+  case Node::global_var_decl:
+  case Node::variable_decl: {
+    if (!node->children.empty() &&
+        node->children[0]->type == Node::array_t) {
+      array_ids.insert(node->children[1]);
     }
-
     break;
   }
   case Node::add_op:
@@ -182,12 +274,6 @@ void SemanticAnalyzer::globals_post_order_pass_cb(
   case Node::div_op:
   case Node::mod_op: {
     node->expected_type = Node::int_t;
-
-    // @HACK: indicate that a number is negative (it *should* be done in parser)
-    if (node->type == Node::sub_op && node->children.size() == 1 &&
-        node->next_child()->type == Node::int_t) {
-      node->next_child()->value = "-" + node->next_child()->value;
-    }
     break;
   }
   default:
@@ -196,274 +282,470 @@ void SemanticAnalyzer::globals_post_order_pass_cb(
 }
 
 /**
- * @brief post-order callback function, used to populate the symtable. In
- * addition it performs lookups to make sure identifiers haven't been
- * re-declared multiple times or if they exist.
+ * @brief post-order step of the traversal. defines local variables, checks
+ * declarations, calls and assignments of each block and closes contexts
  *
- * @param node ast node returned from `#traverse`
- * @param err_stack error stack returned from `#traverse`
+ * @param node visited node
  */
-void SemanticAnalyzer::sym_table_post_pass_cb(ASTNode *node,
-                                              std::vector<bool> &err_stack) {
-  if (node->type != Node::program) {
-    switch (node->type) {
-    case Node::variable_decl: {
-      if (node->children.empty()) {
-        std::throw_with_nested(
-            std::runtime_error("Wrong variable declaration"));
-        break;
+void SemanticAnalyzer::leave(ASTNode *node) {
+  auto &err_stack = declaration_errors;
+
+  // a node is left after all of its descendants, so collecting direct
+  // children here reproduces the order of `find_recursive`
+  if (context_stack.back().function != NO_NAME) {
+    for (auto *c : node->children) {
+      if (c->type == Node::return_statement) {
+        function_returns.push_back(c);
+      } else if (c->type == Node::block) {
+        function_blocks.push_back(c);
       }
+    }
+  }
 
-      auto type_node = node->children[0];
-      auto id_node = node->children[1];
+  switch (node->type) {
+  case Node::variable_decl: {
+    if (node->children.empty()) {
+      std::throw_with_nested(std::runtime_error("Wrong variable declaration"));
+      break;
+    }
 
-      if (!is_declaration_allowed()) {
-        semantic_error(
-            "`" + get_str_for_type(type_node->type) + " " + id_node->value +
-                "` A local declaration was not in an outermost block.",
-            node->linenum);
-        err_stack.push_back(false);
-        break;
-      } else if (sym_table->lookup_in_local(
-                     id_node->value, id_node->function_name) != nullptr) {
-        semantic_error(
-            "`" + get_str_for_type(type_node->type) + " " + id_node->value +
-                "`: Duplicated declaration of variables is not allowed.",
-            node->linenum);
-        err_stack.push_back(false);
-        break;
-      }
+    auto type_node = node->children[0];
+    auto id_node = node->children[1];
 
-      sym_table->define(new Symbol(id_node->value, "variable", type_node->type,
-                                   sym_table->current_scope_level,
-                                   sym_table->current_scope),
-                        id_node->function_name);
+    if (!is_declaration_allowed()) {
+      semantic_error(
+          "`" + get_str_for_type(type_node->type) + " " + id_node->value +
+              "` A local declaration was not in an outermost block.",
+          node->linenum);
+      err_stack.push_back(false);
+      break;
+    } else if (sym_table->lookup_in_local(id_node->name,
+                                          id_node->function_name) != nullptr) {
+      semantic_error(
+          "`" + get_str_for_type(type_node->type) + " " + id_node->value +
+              "`: Duplicated declaration of variables is not allowed.",
+          node->linenum);
+      err_stack.push_back(false);
       break;
     }
-    case Node::main_func_decl:
-    case Node::function_decl: {
-      auto *block = node->find_first(Node::block);
-      auto return_nodes = block->find_recursive(Node::return_statement);
-      auto *id = node->find_first(Node::id);
-      auto *type = node->children[0];
-      auto break_nodes = block->find_recursive(Node::break_statement);
 
-      if (block->is_return_block) {
-        if (return_nodes.empty()) {
-          semantic_error("Missing `return` statement.", node->linenum);
+    sym_table->define(make_variable(node), id_node->function_name);
+    check_array(node, err_stack);
+    break;
+  }
+  case Node::global_var_decl: {
+    resolve_ids(node);
+    check_array(node, err_stack);
+    break;
+  }
+  case Node::main_func_decl:
+  case Node::function_decl: {
+    // every local of the function is defined by now
+    resolve_ids(node);
+    check_function(node, err_stack);
+    mark_getters(node);
+    context_stack.pop_back();
+    break;
+  }
+  case Node::block: {
+    for (auto *c : node->children) {
+      switch (c->type) {
+      case Node::statement_expr: {
+        auto *expression = c->children[0];
+        if (expression->type == Node::function_call) {
+          auto *actual_params = expression->find_first(Node::actual_params);
+
+          auto *fun_name = expression->find_first(Node::id);
+          auto *fun_sym = fun_name->function_symbol;
+
+          if (fun_name->name == main_name) {
+            semantic_error("Cannot call `main()` function directly.",
+                           expression->linenum);
+            err_stack.push_back(false);
+            break;
+          }
+
+          if (actual_params->children.size() != fun_sym->params.size()) {
+            semantic_error(
+                "Error: Mismatched number of actual parameters, expected: " +
+                    std::to_string(fun_sym->params.size()) + ", but got " +
+                    std::to_string(actual_params->children.size()),
+                expression->linenum);
+            err_stack.push_back(false);
+            break;
+          }
+        } else if (expression->type == Node::eq_op) {
+          // ids are bound once the whole function is done, this checks the
+          // variable is declared before the assignment
+          auto *id = expression->children[0];
+          if (id->type == Node::index_op) {
+            id = id->children[0];
+          }
+          if (sym_table->lookup(id->name, id->function_name) == nullptr) {
+            semantic_error("Undefined identifier `" + id->value + "`.",
+                           expression->linenum);
+            err_stack.push_back(false);
+            break;
+          }
+        }
+      }
+      default:
+        break;
+      }
+    }
+
+    sym_table->exit_scope();
+    context_stack.pop_back();
+    break;
+  }
+  case Node::while_statement: {
+    context_stack.pop_back();
+    break;
+  }
+  default:
+    break;
+  }
+
+  switch (node->type) {
+  case Node::id:
+  case Node::function_call:
+  case Node::if_statement:
+  case Node::while_statement:
+  case Node::if_else_statement:
+  case Node::eq_op:
+  case Node::not_op:
+  case Node::eqeq_op:
+  case Node::noteq_op:
+  case Node::bin_or_op:
+  case Node::bin_and_op:
+  case Node::add_op:
+  case Node::sub_op:
+  case Node::mul_op:
+  case Node::div_op:
+  case Node::mod_op:
+  case Node::index_op:
+    deferred_type_checks.push_back(node);
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief check return statements and `break` placement of a function, once
+ * the whole function has been visited
+ *
+ * @param node function declaration
+ * @param err_stack error stack of the traversal
+ */
+void SemanticAnalyzer::check_function(ASTNode *node,
+                                      std::vector<bool> &err_stack) {
+  auto *block = node->find_first(Node::block);
+  auto *id = node->find_first(Node::id);
+  auto return_type = context_stack.back().return_type;
+
+  if (block->is_return_block) {
+    if (function_returns.empty()) {
+      semantic_error("Missing `return` statement.", node->linenum);
+      err_stack.push_back(false);
+      return;
+    } else {
+      for (auto *return_node : function_returns) {
+        if (return_node->children.empty()) {
+          semantic_error("Function should return a value.",
+                         return_node->linenum);
           err_stack.push_back(false);
           break;
         } else {
-          for (auto *return_node : return_nodes) {
-            if (return_node->children.empty()) {
-              semantic_error("Function should return a value.",
-                             return_node->linenum);
-              err_stack.push_back(false);
-              break;
-            } else {
-              // return exists, check if value matches function return type
-              auto *return_val = return_node->children[0];
-              bool is_valid_return = true;
-              Node found_type;
-
-              if (return_val->type == Node::id) {
-                auto *sym = sym_table->lookup(return_val->value,
-                                              return_val->function_name);
-                found_type = sym->type;
-                is_valid_return = sym->type == type->type;
-              } else if (return_val->type == Node::function_call) {
-                auto *id = return_val->find_first(Node::id);
-                auto *sym = sym_table->find_function(id->value);
-                found_type = sym->type;
-                is_valid_return = sym->type == type->type;
-              } else if (return_val->type == Node::eq_op) {
-                auto *lhs = return_val->next_child();
-                auto *lhs_sym =
-                    sym_table->lookup(lhs->value, lhs->function_name);
-                found_type = lhs_sym->type;
-                is_valid_return = validate_expr(
-                    return_val, expression_types.at(return_val->type));
-              } else if (return_val->is_bool_expr() ||
-                         return_val->is_num_expr()) {
-                if (return_val->is_bool_expr()) {
-                  found_type = Node::boolean_t;
-                } else if (return_val->is_num_expr()) {
-                  found_type = Node::int_t;
-                }
-
-                is_valid_return = validate_expr(
-                    return_val, expression_types.at(return_val->type));
-              } else {
-                found_type = return_val->type;
-                is_valid_return = return_val->type == type->type;
-              }
-
-              if (!is_valid_return) {
-                semantic_error("Mismatched return type. Was expecting `" +
-                                   get_str_for_type(type->type) +
-                                   "`, but got `" +
-                                   get_str_for_type(found_type) + "`",
-                               return_node->linenum);
-                err_stack.push_back(false);
-                break;
-              }
+          // return exists, check if value matches function return type
+          auto *return_val = return_node->children[0];
+          bool is_valid_return = true;
+          Node found_type;
+
+          if (return_val->type == Node::id ||
+              return_val->type == Node::index_op) {
+            found_type = value_type(return_val);
+            is_valid_return = found_type == return_type;
+          } else if (return_val->type == Node::function_call) {
+            auto *id = return_val->find_first(Node::id);
+            auto *sym = id->function_symbol;
+            found_type = sym->type;
+            is_valid_return = sym->type == return_type;
+          } else if (return_val->type == Node::eq_op) {
+            auto *lhs = return_val->next_child();
+            auto *lhs_sym = lhs->symbol;
+            found_type = lhs_sym->type;
+            is_valid_return = validate_expr(
+                return_val, expression_types.at(return_val->type));
+          } else if (return_val->is_bool_expr() || return_val->is_num_expr()) {
+            if (return_val->is_bool_expr()) {
+              found_type = Node::boolean_t;
+            } else if (return_val->is_num_expr()) {
+              found_type = Node::int_t;
             }
-          }
-        }
-      } else if (type->type == Node::void_t) {
-        bool found_return_val_in_void = false;
-        bool found_return_in_main = false;
-        for (auto *return_node : return_nodes) {
-          if (id->value == "main") {
-            semantic_error("`main()` cannot have `return` statements.",
-                           return_node->linenum);
-            err_stack.push_back(false);
-            found_return_in_main = true;
+
+            is_valid_return = validate_expr(
+                return_val, expression_types.at(return_val->type));
+          } else {
+            found_type = return_val->type;
+            is_valid_return = return_val->type == return_type;
           }
 
-          if (!return_node->children.empty()) {
-            semantic_error("void function `" + id->value +
-                               "` cannot return values.",
+          if (!is_valid_return) {
+            semantic_error("Mismatched return type. Was expecting `" +
+                               get_str_for_type(return_type) +
+                               "`, but got `" + get_str_for_type(found_type) +
+                               "`",
                            return_node->linenum);
             err_stack.push_back(false);
-            found_return_val_in_void = true;
+            break;
           }
         }
+      }
+    }
+  } else if (return_type == Node::void_t) {
+    bool found_return_val_in_void = false;
+    bool found_return_in_main = false;
+    for (auto *return_node : function_returns) {
+      if (id->name == main_name) {
+        semantic_error("`main()` cannot have `return` statements.",
+                       return_node->linenum);
+        err_stack.push_back(false);
+        found_return_in_main = true;
+      }
 
-        if (found_return_in_main || found_return_val_in_void) {
-          break;
-        }
+      if (!return_node->children.empty()) {
+        semantic_error("void function `" + id->value +
+                           "` cannot return values.",
+                       return_node->linenum);
+        err_stack.push_back(false);
+        found_return_val_in_void = true;
       }
+    }
 
-      auto block_nodes = node->find_recursive(Node::block);
-      for (auto *b : block_nodes) {
-        auto *break_node = b->find_first(Node::break_statement);
-        if (!b->is_while_block && break_node != nullptr) {
-          semantic_error("`break` statement can only occur in `while` "
-                         "loops.",
-                         break_node->linenum);
-          err_stack.push_back(false);
-        }
+    if (found_return_in_main || found_return_val_in_void) {
+      return;
+    }
+  }
+
+  for (auto *b : function_blocks) {
+    auto *break_node = b->find_first(Node::break_statement);
+    if (!b->is_while_block && break_node != nullptr) {
+      semantic_error("`break` statement can only occur in `while` "
+                     "loops.",
+                     break_node->linenum);
+      err_stack.push_back(false);
+    }
+  }
+
+  sym_table->current_scope--;
+}
+
+/**
+ * @brief decide which identifiers of a function are read as values and need
+ * a `get` instruction. walks the function once with an explicit stack
+ *
+ * @param function function declaration
+ */
+void SemanticAnalyzer::mark_getters(ASTNode *function) {
+  struct pending_t {
+    ASTNode *node;
+    getter_writers_t writers;
+    int depth;
+  };
+
+  std::vector<pending_t> stack{{function, getter_writers_t(), 0}};
+
+  while (!stack.empty()) {
+    auto [node, writers, depth] = stack.back();
+    stack.pop_back();
+
+    if (node->type == Node::id) {
+      auto *sym = node->symbol;
+      bool is_variable = sym != nullptr && sym->kind != "function";
+      int outermost = getter_writers_t::NONE;
+      bool getter = false;
+
+      if (writers.all < outermost) {
+        outermost = writers.all;
+        getter = writers.all_by_symbol && is_variable;
+      }
+      if (is_variable && writers.variables < outermost) {
+        outermost = writers.variables;
+        getter = true;
       }
+      if (writers.direct < outermost) {
+        getter = true;
+      }
+
+      node->can_generate_wasm_getter = getter;
+      continue;
+    }
+
+    getter_writers_t below = writers;
+    below.direct = getter_writers_t::NONE;
+    below.params = getter_writers_t::NONE;
 
-      sym_table->current_scope--;
+    switch (node->type) {
+    case Node::not_op:
+    case Node::eqeq_op:
+    case Node::noteq_op:
+    case Node::bin_or_op:
+    case Node::bin_and_op:
+    case Node::add_op:
+    case Node::sub_op:
+    case Node::mul_op:
+    case Node::div_op:
+    case Node::mod_op:
+    case Node::index_op:
+      below.variables = std::min(below.variables, depth);
+      break;
+    default:
       break;
     }
-    case Node::block: {
-      for (auto *c : node->children) {
-        switch (c->type) {
-        case Node::statement_expr: {
-          auto *expression = c->children[0];
-          if (expression->type == Node::function_call) {
-            auto *actual_params = expression->find_first(Node::actual_params);
-
-            auto *fun_name = expression->find_first(Node::id);
-            auto *fun_sym = sym_table->find_function(fun_name->value);
-
-            if (fun_name->value == "main") {
-              semantic_error("Cannot call `main()` function directly.",
-                             expression->linenum);
-              err_stack.push_back(false);
-              break;
-            }
 
-            if (actual_params->children.size() != fun_sym->params.size()) {
-              semantic_error(
-                  "Error: Mismatched number of actual parameters, expected: " +
-                      std::to_string(fun_sym->params.size()) + ", but got " +
-                      std::to_string(actual_params->children.size()),
-                  expression->linenum);
-              err_stack.push_back(false);
-              break;
-            }
-          } else if (expression->type == Node::eq_op) {
-            auto *id = expression->children[0];
-            if (sym_table->lookup(id->value, id->function_name) == nullptr) {
-              semantic_error("Undefined identifier `" + id->value + "`.",
-                             expression->linenum);
-              err_stack.push_back(false);
-              break;
+    // a call writes its actual parameters, when it matches the signature
+    ASTNode *written_params = nullptr;
+    if (node->type == Node::function_call) {
+      auto *fun_sym = node->find_first(Node::id)->function_symbol;
+      auto *actual_params = node->find_first(Node::actual_params);
+      if (fun_sym != nullptr &&
+          actual_params->children.size() == fun_sym->params.size()) {
+        written_params = actual_params;
+      }
+    }
+
+    for (std::size_t i = 0; i < node->children.size(); i++) {
+      auto *c = node->children[i];
+      getter_writers_t child = below;
+
+      switch (node->type) {
+      case Node::if_statement:
+      case Node::while_statement:
+      case Node::if_else_statement: {
+        // the condition
+        if (i == 0) {
+          if (c->is_bool_expr()) {
+            child.variables = std::min(child.variables, depth);
+          } else if (c->type == Node::id) {
+            child.direct = depth;
+          }
+        }
+        break;
+      }
+      case Node::return_statement: {
+        if (i == 0) {
+          if (c->type == Node::eq_op) {
+            if (child.all == getter_writers_t::NONE) {
+              child.all = depth;
+              child.all_by_symbol = true;
             }
+          } else {
+            child.direct = depth;
           }
         }
-        default:
-          break;
+        break;
+      }
+      case Node::eq_op: {
+        if (i == 1 && c->type == Node::id && c->children.empty()) {
+          child.direct = depth;
+        }
+        break;
+      }
+      case Node::function_call: {
+        if (c == written_params) {
+          child.params = depth;
+        }
+        break;
+      }
+      case Node::actual_params: {
+        if (writers.params != getter_writers_t::NONE) {
+          if (c->type == Node::id) {
+            child.direct = writers.params;
+          } else if (c->type == Node::eq_op &&
+                     child.all == getter_writers_t::NONE) {
+            child.all = writers.params;
+            child.all_by_symbol = false;
+          }
         }
+        break;
+      }
+      default:
+        break;
       }
 
-      sym_table->exit_scope();
-      break;
-    }
-    default:
-      break;
+      stack.push_back({c, child, depth + 1});
     }
   }
 }
 
 /**
- * @brief post-order callback function, used to perform type checking of
- * functions, identifiers, expressions, etc.
+ * @brief perform type checking of functions, identifiers, expressions, etc.
  *
- * @param node ast node returned from `#traverse`
- * @param err_stack error stack returned from `#traverse`
+ * @param node queued node
+ * @param err_stack error stack of the type checking
  */
-void SemanticAnalyzer::type_checking_post_order_pass_cb(
-    ASTNode *node, std::vector<bool> &err_stack) {
+void SemanticAnalyzer::type_check(ASTNode *node,
+                                  std::vector<bool> &err_stack) {
   switch (node->type) {
-  case Node::main_func_decl:
-  case Node::function_decl:
-    sym_table->current_scope--;
-    break;
   case Node::id: {
-    if (sym_table->lookup(node->value, node->function_name) == nullptr) {
+    if (node->symbol == nullptr) {
       semantic_error("Unknown identifier `" + node->value + "`.",
                      node->linenum);
       err_stack.push_back(false);
+    } else if (node->symbol->is_array() && array_ids.count(node) == 0) {
+      semantic_error("Array `" + node->value +
+                         "` can only be used with an index.",
+                     node->linenum);
+      err_stack.push_back(false);
+    } else if (!node->symbol->is_array() && array_ids.count(node) != 0) {
+      semantic_error("`" + node->value + "` is not an array.", node->linenum);
+      err_stack.push_back(false);
+    }
+    break;
+  }
+  case Node::index_op: {
+    auto index_type = value_type(node->children[1]);
+    if (index_type != Node::int_t) {
+      semantic_error("Array index must be `int`, found `" +
+                         get_str_for_type(index_type) + "`.",
+                     node->linenum);
+      err_stack.push_back(false);
     }
     break;
   }
   case Node::function_call: {
     auto *id = node->find_first(Node::id);
     auto *actual_params = node->find_first(Node::actual_params);
-    auto *fun_sym = sym_table->find_function(id->value);
+    auto *fun_sym = id->function_symbol;
 
     id->is_function_id = true;
 
     if (actual_params->children.size() == fun_sym->params.size()) {
-      auto children = actual_params->children;
+      auto &children = actual_params->children;
       bool found_mismatch = false;
       for (std::size_t i = 0; i < children.size(); i++) {
         auto *param_node = children[i];
-        auto expected_sym = fun_sym->params[i];
+        auto &expected_sym = fun_sym->params[i];
         Node found_type;
 
         if (param_node->type == Node::function_call) {
           // lookup function return type
           auto *id = param_node->find_first(Node::id);
-          auto *fun_sym = sym_table->find_function(id->value);
-          found_type = fun_sym->type;
-        } else if (param_node->type == Node::id) {
-          auto *sym =
-              sym_table->lookup(param_node->value, param_node->function_name);
-          found_type = sym->type;
-
-          param_node->can_generate_wasm_getter = true;
+          found_type = id->function_symbol->type;
+        } else if (param_node->type == Node::id ||
+                   param_node->type == Node::index_op) {
+          found_type = value_type(param_node);
         } else if (param_node->is_bool_expr()) {
           found_type = Node::boolean_t;
         } else if (param_node->is_num_expr()) {
           found_type = Node::int_t;
         } else if (param_node->type == Node::eq_op) {
-          auto ids = param_node->find_recursive(Node::id);
-          for (auto *id : ids) {
-            id->can_generate_wasm_getter = false;
-          }
-
           if (validate_expr(param_node,
                             expression_types.at(param_node->type))) {
             // lhs operand
             auto *res_id = param_node->next_child();
-            auto *sym = sym_table->lookup(res_id->value, res_id->function_name);
-            found_type = sym->type;
+            found_type = res_id->symbol->type;
           }
         } else {
           found_type = param_node->type;
@@ -486,22 +768,6 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
     }
     break;
   }
-  case Node::return_statement: {
-    if (!node->children.empty()) {
-      bool is_eq = node->next_child()->type == Node::eq_op;
-      if (is_eq) {
-        auto ids = node->find_recursive(Node::id);
-        for (auto *id : ids) {
-          auto *sym = sym_table->lookup(id->value, id->function_name);
-          id->can_generate_wasm_getter =
-              sym != nullptr && sym->kind != "function";
-        }
-      } else {
-        node->next_child()->can_generate_wasm_getter = true;
-      }
-    }
-    break;
-  }
   case Node::if_statement:
   case Node::while_statement:
   case Node::if_else_statement: {
@@ -518,39 +784,23 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
         break;
       }
 
-      auto ids = expr->find_recursive(Node::id);
-      for (auto *id : ids) {
-        auto sym = sym_table->lookup(id->value, id->function_name);
-        if (sym->kind != "function") {
-
-          id->can_generate_wasm_getter = true;
-        }
-      }
-
-      auto expected_types = expression_types.at(expr->type);
+      auto &expected_types = it->second;
 
       bool is_bool = true;
       if (expr->children.size() == 2) {
         // check binary expression
-
-        auto *l = expr->children[0];
-        auto *r = expr->children[1];
-
-        is_bool = validate_expr(l, expected_types) &&
-                  validate_expr(r, expected_types);
-
+        is_bool = is_valid_expr(expr);
       } else {
         // check unary expression
         auto *r = expr->children[0];
         auto r1 = expected_types[0];
         Node type;
 
-        if (r->type == Node::id) {
-          type = sym_table->lookup(r->value, r->function_name)->type;
+        if (r->type == Node::id || r->type == Node::index_op) {
+          type = value_type(r);
         } else if (r->type == Node::function_call) {
           auto *id = r->find_first(Node::id);
-          auto *fun_symbol = sym_table->find_function(id->value);
-          type = fun_symbol->type;
+          type = id->function_symbol->type;
         } else if (r->is_num_expr()) {
           type = r->expected_type;
         }
@@ -572,7 +822,7 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
         break;
       }
 
-      auto *fun_sym = sym_table->find_function(id->value);
+      auto *fun_sym = id->function_symbol;
       if (fun_sym->type != Node::boolean_t) {
         semantic_error(
             "Function must have `boolean` return type to be used in `" +
@@ -583,16 +833,16 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
         err_stack.push_back(false);
         break;
       }
-    } else if (expr->type == Node::id) {
+    } else if (expr->type == Node::id || expr->type == Node::index_op) {
       // just a var, look it up in symbol table and find its type
       // at this point it should exist
-      auto id_symbol = sym_table->lookup(expr->value, expr->function_name);
-      expr->can_generate_wasm_getter = true;
+      auto *id = expr->type == Node::id ? expr : expr->children[0];
+      auto type = value_type(expr);
 
-      if (id_symbol->type != Node::boolean_t) {
-        semantic_error("Identifier `" + expr->value +
+      if (type != Node::boolean_t) {
+        semantic_error("Identifier `" + id->value +
                            "` must have `boolean` type, found `" +
-                           get_str_for_type(id_symbol->type) + "`",
+                           get_str_for_type(type) + "`",
                        expr->linenum);
         err_stack.push_back(false);
         break;
@@ -609,8 +859,11 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
   }
   case Node::eq_op: {
     auto *id = node->children[0];
+    if (id->type == Node::index_op) {
+      id = id->children[0];
+    }
     auto *assigned = node->children[1];
-    auto *sym = sym_table->lookup(id->value, id->function_name);
+    auto *sym = id->symbol;
     Node found_type;
 
     bool types_match = true;
@@ -618,9 +871,7 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
     if (assigned->children.empty()) {
       // if it's just a single value OR an id
       if (assigned->type == Node::id) {
-        found_type =
-            sym_table->lookup(assigned->value, assigned->function_name)->type;
-        assigned->can_generate_wasm_getter = true;
+        found_type = assigned->symbol->type;
       } else {
         found_type = assigned->type;
       }
@@ -628,12 +879,12 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
       // if it's something else (expression or function call)
       if (assigned->type == Node::eq_op) {
         auto *id = assigned->next_child();
-        auto *sym = sym_table->lookup(id->value, id->function_name);
-        found_type = sym->type;
+        found_type = id->symbol->type;
       } else if (assigned->type == Node::function_call) {
         auto *id = assigned->find_first(Node::id);
-        auto *fun_sym = sym_table->find_function(id->value);
-        found_type = fun_sym->type;
+        found_type = id->function_symbol->type;
+      } else if (assigned->type == Node::index_op) {
+        found_type = value_type(assigned);
       } else if (assigned->is_num_expr()) {
         found_type = Node::int_t;
       } else if (assigned->is_bool_expr()) {
@@ -665,30 +916,7 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
   case Node::mul_op:
   case Node::div_op:
   case Node::mod_op: {
-    auto expected_types = expression_types.at(node->type);
-    bool is_valid_expr = true;
-    auto ids = node->find_recursive(Node::id);
-    for (auto *id : ids) {
-      auto sym = sym_table->lookup(id->value, id->function_name);
-      if (sym->kind != "function") {
-
-        id->can_generate_wasm_getter = true;
-      }
-    }
-
-    if (node->children.size() == 2) {
-      auto *left = node->children[0];
-      auto *right = node->children[1];
-
-      is_valid_expr = validate_expr(left, expected_types) &&
-                      validate_expr(right, expected_types);
-    } else {
-      // it's a unary expressio
-      auto *right = node->children[0];
-      is_valid_expr = validate_expr(right, expected_types);
-    }
-
-    if (!is_valid_expr) {
+    if (!is_valid_expr(node)) {
       semantic_error("Mismatched types in expression.", node->linenum);
       err_stack.push_back(false);
       break;
@@ -700,54 +928,6 @@ void SemanticAnalyzer::type_checking_post_order_pass_cb(
   }
 }
 
-/**
- * @brief pre-order callback function, used to determine block nesting level.
- *
- * @param node ast node returned from `#traverse`
- * @param err_stack error stack returned from `#traverse`
- */
-void SemanticAnalyzer::enter_scope_cb(ASTNode *node,
-                                      std::vector<bool> &err_stack) {
-  switch (node->type) {
-  case Node::main_func_decl:
-  case Node::function_decl:
-    sym_table->current_scope++;
-    break;
-  default:
-    break;
-  }
-}
-
-/**
- * @brief pre-order callback function, used to enter function scopes
- *
- * @param node ast node returned from `#traverse`
- * @param err_stack error stack returned from `#traverse`
- */
-void SemanticAnalyzer::build_scope_cb(ASTNode *node,
-                                      std::vector<bool> &err_stack) {
-  switch (node->type) {
-  case Node::main_func_decl:
-    sym_table->push_scope("main");
-    break;
-  case Node::block:
-    sym_table->enter_scope();
-    break;
-  default:
-    break;
-  }
-}
-
-/**
- * @brief check if declaration is allowed at current block level. the method
- * gets the current block level from the symbol table and verifies allowed
- * block leves. Allowed block levels can be global (1) or local (2). If it's
- * greater than 2, then return false
- *
- * @return true, if current block level allows to declare variables
- * @return false, if block is too deep, and therefore declaration is not
- * allowed
- */
 bool SemanticAnalyzer::is_declaration_allowed() {
   auto scope = sym_table->current_scope_level;
   // declaration allowed only at levels 1 and 2
@@ -763,42 +943,124 @@ bool SemanticAnalyzer::is_declaration_allowed() {
  * @return true if expression is valid
  * @return false otherwise
  */
-bool SemanticAnalyzer::validate_expr(ASTNode *l, expr_list_t expected_types) {
+bool SemanticAnalyzer::validate_expr(ASTNode *l,
+                                     const expr_list_t &expected_types) {
   Node l_type;
 
   if (l->type == Node::id) {
-    auto sym = sym_table->lookup(l->value, l->function_name);
-    l_type = sym->type;
+    if (l->symbol == nullptr) {
+      return false;
+    }
+    l_type = l->symbol->type;
     // @HACK: why was this here??!
     // l->can_generate_wasm_getter = true;
+  } else if (l->type == Node::index_op) {
+    if (l->children[0]->symbol == nullptr) {
+      return false;
+    }
+    l_type = value_type(l);
   } else if (l->type == Node::function_call) {
     auto id = l->find_first(Node::id);
-    auto sym = sym_table->find_function(id->value);
-    l_type = sym->type;
-  } else if (l->type == Node::eq_op) {
-    auto expected = expression_types.at(l->type);
-    return validate_expr(l->children[0], expected) &&
-           validate_expr(l->children[1], expected);
-  } else if (l->is_bool_expr() || l->is_num_expr()) {
-    auto expected = expression_types.at(l->type);
-    if (l->children.size() == 2) {
-      return validate_expr(l->children[0], expected) &&
-             validate_expr(l->children[1], expected);
-    } else {
-      return validate_expr(l->children[0], expected);
+    if (id->function_symbol == nullptr) {
+      return false;
     }
+    l_type = id->function_symbol->type;
+  } else if (is_checked_expr(l)) {
+    return is_valid_expr(l);
   } else {
     l_type = l->type;
   }
 
   if (expected_types.size() == 2) {
-    auto r1 = expected_types[0];
-    auto r2 = expected_types[1];
-    return l_type == r1[0] || l_type == r2[0];
+    return l_type == expected_types[0][0] || l_type == expected_types[1][0];
   } else {
-    auto r1 = expected_types[0];
-    return l_type == r1[0];
+    return l_type == expected_types[0][0];
+  }
+}
+
+/**
+ * @brief check the operands of an operator or assignment against the types
+ * the operator expects. the result only depends on the subtree, so it's
+ * computed once per node. nested operators are checked bottom up, so
+ * arbitrarily deep expressions don't grow the thread stack
+ *
+ * @param expr operator or assignment
+ * @return true if expression is valid
+ * @return false otherwise
+ */
+bool SemanticAnalyzer::is_valid_expr(ASTNode *expr) {
+  if (expr_validity[expr->index] != EXPR_UNKNOWN) {
+    return expr_validity[expr->index];
+  }
+
+  walk(
+      expr,
+      [this](ASTNode *node) {
+        // operands that aren't operators are checked by their parent
+        bool pending = is_checked_expr(node) &&
+                       expr_validity[node->index] == EXPR_UNKNOWN;
+        return pending ? Visit::next : Visit::skip_children;
+      },
+      [this](ASTNode *node) {
+        auto &validity = expr_validity[node->index];
+        if (!is_checked_expr(node) || validity != EXPR_UNKNOWN) {
+          return;
+        }
+
+        // operator operands are memoized by now, so this doesn't recurse
+        auto &expected = expression_types.at(node->type);
+        bool is_valid;
+        if (node->children.size() == 2) {
+          is_valid = validate_expr(node->children[0], expected) &&
+                     validate_expr(node->children[1], expected);
+        } else {
+          is_valid = validate_expr(node->children[0], expected);
+        }
+
+        validity = is_valid;
+      });
+
+  return expr_validity[expr->index];
+}
+
+/**
+ * @brief check if a node is an operator or assignment, validated by
+ * is_valid_expr
+ *
+ * @param node node to check
+ * @return true if the node is validated against expression_types
+ * @return false otherwise
+ */
+bool SemanticAnalyzer::is_checked_expr(const ASTNode *node) const {
+  return node->type == Node::eq_op || node->is_bool_expr() ||
+         node->is_num_expr();
+}
+
+/**
+ * @brief get the type of the value of an expression, as far as it can be
+ * told without checking the expression
+ *
+ * @param node expression
+ * @return Node int_t or boolean_t, or the type of the node if it's neither
+ */
+Node SemanticAnalyzer::value_type(ASTNode *node) {
+  if (node->type == Node::index_op) {
+    node = node->children[0];
+  } else if (node->type == Node::eq_op) {
+    return value_type(node->children[0]);
+  } else if (node->type == Node::function_call) {
+    auto *fun_sym = node->find_first(Node::id)->function_symbol;
+    return fun_sym != nullptr ? fun_sym->type : Node::void_t;
+  } else if (node->is_num_expr()) {
+    return Node::int_t;
+  } else if (node->is_bool_expr()) {
+    return Node::boolean_t;
+  }
+
+  if (node->type == Node::id) {
+    return node->symbol != nullptr ? node->symbol->type : Node::void_t;
   }
+  return node->type;
 }
 
 /**
@@ -0,0 +1,56 @@
+/**
+ * @file SideEffects.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Find the expressions that can't be reordered or skipped freely
+ */
+
+#include "SideEffects.hpp"
+#include "Visitor.hpp"
+
+namespace {
+
+/**
+ * @brief EffectFinder marks a node once all of its children are visited, so
+ * a node has side effects if it has them itself or one of its children does
+ */
+class EffectFinder : public Visitor<EffectFinder> {
+public:
+  explicit EffectFinder(std::unordered_set<ASTNode *> &effects)
+      : effects(effects) {}
+
+private:
+  std::unordered_set<ASTNode *> &effects;
+
+  friend class Visitor<EffectFinder>;
+
+  void leave(ASTNode *node) {
+    bool has_effects = node->type == Node::function_call ||
+                       node->type == Node::eq_op ||
+                       node->type == Node::div_op ||
+                       node->type == Node::mod_op ||
+                       node->type == Node::index_op;
+    for (auto *child : node->children) {
+      has_effects = has_effects || effects.count(child) != 0;
+    }
+    if (has_effects) {
+      effects.insert(node);
+    }
+  }
+};
+
+} // namespace
+
+/**
+ * @brief find the nodes of a tree that call a function, assign a variable or
+ * may trap (divide, index an array), or that contain such a node. The other
+ * expressions only read variables, so evaluating them early, late or not at
+ * all doesn't change what the program does
+ *
+ * @param root root of the tree
+ * @return std::unordered_set<ASTNode *> nodes with side effects
+ */
+std::unordered_set<ASTNode *> find_side_effects(ASTNode *root) {
+  std::unordered_set<ASTNode *> effects;
+  EffectFinder(effects).visit(root);
+  return effects;
+}
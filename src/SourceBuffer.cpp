@@ -0,0 +1,90 @@
+/**
+ * @file SourceBuffer.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Read-only source text, memory mapped straight from the file
+ */
+
+#include "SourceBuffer.hpp"
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+SourceBuffer::SourceBuffer(std::string text) : owned(std::move(text)) {
+  data = owned.data();
+  length = owned.size();
+}
+
+/**
+ * @brief map the file at `path` into memory, replacing the current text
+ *
+ * @param path path to the file
+ * @return true if the file was opened
+ * @return false if it can't be read or is larger than 4 GB
+ */
+bool SourceBuffer::open(std::string const &path) {
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    if (static_cast<std::uint64_t>(st.st_size) > UINT32_MAX) {
+      ::close(fd);
+      return false;
+    }
+
+    length = static_cast<std::size_t>(st.st_size);
+    void *region = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (region != MAP_FAILED) {
+      // the scanner reads the file once, front to back
+      madvise(region, length, MADV_SEQUENTIAL);
+      ::close(fd);
+      mapping = region;
+      data = static_cast<const char *>(region);
+      return true;
+    }
+    length = 0;
+  }
+
+  // not mappable, read the whole thing
+  char chunk[1 << 16];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    owned.append(chunk, static_cast<std::size_t>(n));
+  }
+  ::close(fd);
+
+  if (n < 0 || owned.size() > UINT32_MAX) {
+    owned.clear();
+    return false;
+  }
+
+  data = owned.data();
+  length = owned.size();
+  return true;
+}
+
+/**
+ * @brief unmap the file, leaving the buffer empty
+ */
+void SourceBuffer::close() {
+  if (mapping != nullptr) {
+    munmap(mapping, length);
+    mapping = nullptr;
+  }
+
+  owned.clear();
+  data = nullptr;
+  length = 0;
+}
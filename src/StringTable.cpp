@@ -19,6 +19,19 @@ void StringTable::define(std::string str) {
   offset_counter += str.length();
 }
 
+/**
+ * @brief leave room after the strings defined so far. it's a part of the
+ * memory the strings take, but no string is placed there
+ *
+ * @param bytes size of the room
+ * @return unsigned int offset of the room
+ */
+unsigned int StringTable::reserve(unsigned int bytes) {
+  auto offset = offset_counter;
+  offset_counter += bytes;
+  return offset;
+}
+
 /**
  * @brief lookup a string in a table
  *
@@ -28,13 +41,22 @@ void StringTable::define(std::string str) {
 entry_t StringTable::lookup(std::string str) { return table.at(str); }
 
 /**
- * @brief Generate WASM code with all the strings in the source code
+ * @brief check if a string is already in the table
  *
- * @return std::string generated WASM code
+ * @param str string to look for
+ * @return true if it was defined
  */
-std::string StringTable::build_wasm_code() {
-  std::string code = "";
+bool StringTable::contains(std::string const &str) const {
+  return table.count(str) != 0;
+}
 
+/**
+ * @brief get the strings in the order of their offsets
+ *
+ * @return std::vector<std::pair<std::string, entry_t>> strings and their
+ * entries
+ */
+std::vector<std::pair<std::string, entry_t>> StringTable::entries() const {
   // sort the strings by their offset value
   auto comporator = [](std::pair<std::string, entry_t> el1,
                        std::pair<std::string, entry_t> el2) {
@@ -44,7 +66,18 @@ std::string StringTable::build_wasm_code() {
   std::set<std::pair<std::string, entry_t>, comporator_t> sorted_map(
       table.begin(), table.end(), comporator);
 
-  for (auto const &[str, str_entry] : sorted_map) {
+  return {sorted_map.begin(), sorted_map.end()};
+}
+
+/**
+ * @brief Generate WASM code with all the strings in the source code
+ *
+ * @return std::string generated WASM code
+ */
+std::string StringTable::build_wasm_code() {
+  std::string code = "";
+
+  for (auto const &[str, str_entry] : entries()) {
     code += "  ";
     code += "(data 0 (i32.const " + std::to_string(str_entry.offset) + ") \"" +
             str + "\")";
@@ -4,6 +4,7 @@
  * @brief Implementation of Symbol table using variation of scope stack. Symbol
  * table stack is built using hash map with scope name as a key (either function
  * name or hardcoded globad/predefined) and symbol table hash map as its value.
+ * Both maps are flat open-addressing tables keyed on interned names.
  */
 #include "./include/SymTable.hpp"
 
@@ -19,13 +20,24 @@ SymTable::SymTable() {
  * @param symbol symbol to define
  * @param fun_name name of the function (scope for the symbol)
  */
-void SymTable::define(Symbol *symbol, std::string fun_name) {
-  if (scope_stack.find(fun_name) != scope_stack.end()) {
-    auto *symtable = &scope_stack.at(fun_name);
-    symtable->insert(std::pair<std::string, Symbol *>(symbol->name, symbol));
+void SymTable::define(Symbol *symbol, name_id_t fun_name) {
+  if (auto *symtable = scope_index.find(fun_name)) {
+    (*symtable)->insert(symbol->name, symbol);
   } else {
-    std::throw_with_nested(std::runtime_error("make sure scope for `" +
-                                              fun_name + "` is created"));
+    std::throw_with_nested(std::runtime_error(
+        "make sure scope for `" + name_str(fun_name) + "` is created"));
+  }
+}
+
+/**
+ * @brief remove a symbol from specified function scope
+ *
+ * @param name name of the symbol
+ * @param fun_name name of the function (scope of the symbol)
+ */
+void SymTable::remove(name_id_t name, name_id_t fun_name) {
+  if (auto *symtable = scope_index.find(fun_name)) {
+    (*symtable)->erase(name);
   }
 }
 
@@ -35,27 +47,13 @@ void SymTable::define(Symbol *symbol, std::string fun_name) {
  * @param name function name
  * @return FunctionSymbol*  resulting function symbol
  */
-FunctionSymbol *SymTable::find_function(std::string name) {
-  auto glob_symtable = scope_stack.find(GLOBAL_SCOPE_NAME)->second;
-  if (glob_symtable.find(name) != glob_symtable.end()) {
-    try {
-      return dynamic_cast<FunctionSymbol *>(glob_symtable.at(name));
-    } catch (const std::exception &err) {
-      std::cerr << "failed to lookup function `" << name << "`: " << err.what()
-                << std::endl;
-      return nullptr;
-    }
+FunctionSymbol *SymTable::find_function(name_id_t name) const {
+  if (auto *sym = global_table->find(name)) {
+    return dynamic_cast<FunctionSymbol *>(*sym);
   }
 
-  auto predefined_symtable = scope_stack.find(PREDEFINED_SCOPE_NAME)->second;
-  if (predefined_symtable.find(name) != predefined_symtable.end()) {
-    try {
-      return dynamic_cast<FunctionSymbol *>(predefined_symtable.at(name));
-    } catch (const std::exception &err) {
-      std::cerr << "failed to lookup function `" << name << "`: " << err.what()
-                << std::endl;
-      return nullptr;
-    }
+  if (auto *sym = predefined_table->find(name)) {
+    return dynamic_cast<FunctionSymbol *>(*sym);
   }
 
   return nullptr;
@@ -64,38 +62,23 @@ FunctionSymbol *SymTable::find_function(std::string name) {
 /**
  * @brief lookup a symbol of a given name inside specified function scope. if
  * a symbol doesn't exist in the specified function scope look in global and
- * predefined scopes before returning nullptr.
+ * predefined scopes before returning nullptr. never allocates.
  *
  * @param name symbol name to look for
  * @param fun scope of the symbol
  * @return Symbol* resulting symbol
  */
-Symbol *SymTable::lookup(std::string name, std::string fun) {
-  if (scope_stack.find(fun) != scope_stack.end()) {
-    auto local_table = scope_stack.at(fun);
-    auto it = local_table.find(name);
-    if (it != local_table.end()) {
-      return it->second;
-    }
+Symbol *SymTable::lookup(name_id_t name, name_id_t fun) const {
+  if (auto *sym = lookup_in_local(name, fun)) {
+    return sym;
   }
 
-  try {
-    auto global_table = scope_stack.at(GLOBAL_SCOPE_NAME);
-
-    auto g_find = global_table.find(name);
-    if (g_find != global_table.end()) {
-      return g_find->second;
-    }
+  if (auto *sym = global_table->find(name)) {
+    return *sym;
+  }
 
-    auto predefined_table = scope_stack.at(PREDEFINED_SCOPE_NAME);
-    auto p_find = predefined_table.find(name);
-    if (p_find != predefined_table.end()) {
-      return p_find->second;
-    }
-  } catch (const std::exception &err) {
-    std::cerr << "failed to lookup`" << name << "` at `" << fun
-              << "`: " << err.what() << std::endl;
-    return nullptr;
+  if (auto *sym = predefined_table->find(name)) {
+    return *sym;
   }
 
   return nullptr;
@@ -109,12 +92,10 @@ Symbol *SymTable::lookup(std::string name, std::string fun) {
  * @param fun scope of the symbol
  * @return Symbol* resulting symbol
  */
-Symbol *SymTable::lookup_in_local(std::string name, std::string fun) {
-  if (scope_stack.find(fun) != scope_stack.end()) {
-    auto local_table = scope_stack.at(fun);
-    auto it = local_table.find(name);
-    if (it != local_table.end()) {
-      return it->second;
+Symbol *SymTable::lookup_in_local(name_id_t name, name_id_t fun) const {
+  if (auto *local_table = scope_index.find(fun)) {
+    if (auto *sym = (*local_table)->find(name)) {
+      return *sym;
     }
   }
 
@@ -128,34 +109,23 @@ void SymTable::add_predefined_symbols() {
   using namespace std;
 
   // built-in functions
-  auto *getchar_fun_sym =
-      new FunctionSymbol("getchar", {}, Node::int_t, PREDEFINED_SCOPE, 0);
-  auto *halt_fun_sym =
-      new FunctionSymbol("halt", {}, Node::void_t, PREDEFINED_SCOPE, 0);
+  auto *getchar_fun_sym = new FunctionSymbol(intern("getchar"), {},
+                                             Node::int_t, PREDEFINED_SCOPE, 0);
+  auto *halt_fun_sym = new FunctionSymbol(intern("halt"), {}, Node::void_t,
+                                          PREDEFINED_SCOPE, 0);
   auto *printb_fun_sym = new FunctionSymbol(
-      "printb", {Symbol("b", "parameter", Node::boolean_t, 0, 0)}, Node::void_t,
+      intern("printb"),
+      {Symbol(intern("b"), "parameter", Node::boolean_t, 0, 0)}, Node::void_t,
       PREDEFINED_SCOPE, 0);
   auto *printc_fun_sym = new FunctionSymbol(
-      "printc", {Symbol("c", "parameter", Node::int_t, 0, 0)}, Node::void_t,
-      PREDEFINED_SCOPE, 0);
+      intern("printc"), {Symbol(intern("c"), "parameter", Node::int_t, 0, 0)},
+      Node::void_t, PREDEFINED_SCOPE, 0);
   auto *printi_fun_sym = new FunctionSymbol(
-      "printi", {Symbol("i", "parameter", Node::int_t, 0, 0)}, Node::void_t,
-      PREDEFINED_SCOPE, 0);
+      intern("printi"), {Symbol(intern("i"), "parameter", Node::int_t, 0, 0)},
+      Node::void_t, PREDEFINED_SCOPE, 0);
   auto *prints_fun_sym = new FunctionSymbol(
-      "prints", {Symbol("s", "parameter", Node::string, 0, 0)}, Node::void_t,
-      PREDEFINED_SCOPE, 0);
-
-  // boolean operation functions
-  auto *and_op_fun_sym =
-      new FunctionSymbol("__and_op",
-                         {Symbol("lhs", "parameter", Node::boolean_t, 0, 0),
-                          Symbol("rhs", "parameter", Node::boolean_t, 0, 0)},
-                         Node::boolean_t, PREDEFINED_SCOPE, 0);
-  auto *or_op_fun_sym =
-      new FunctionSymbol("__or_op",
-                         {Symbol("lhs", "parameter", Node::boolean_t, 0, 0),
-                          Symbol("rhs", "parameter", Node::boolean_t, 0, 0)},
-                         Node::boolean_t, PREDEFINED_SCOPE, 0);
+      intern("prints"), {Symbol(intern("s"), "parameter", Node::string, 0, 0)},
+      Node::void_t, PREDEFINED_SCOPE, 0);
 
   push_scope(PREDEFINED_SCOPE_NAME);
 
@@ -165,8 +135,6 @@ void SymTable::add_predefined_symbols() {
   define(printc_fun_sym, PREDEFINED_SCOPE_NAME);
   define(printi_fun_sym, PREDEFINED_SCOPE_NAME);
   define(prints_fun_sym, PREDEFINED_SCOPE_NAME);
-  define(and_op_fun_sym, PREDEFINED_SCOPE_NAME);
-  define(or_op_fun_sym, PREDEFINED_SCOPE_NAME);
 }
 
 /**
@@ -174,15 +142,47 @@ void SymTable::add_predefined_symbols() {
  *
  * @param fun_name name of the function to define a scope
  */
-void SymTable::push_scope(std::string fun_name) {
-  if (!fun_name.empty()) {
-    scope_stack.insert(std::pair<std::string, symbol_table_t>(fun_name, {}));
+void SymTable::push_scope(name_id_t fun_name) {
+  if (fun_name != NO_NAME && !scope_index.contains(fun_name)) {
+    scope_stack.emplace_back();
+    scope_names.push_back(fun_name);
+    scope_index.insert(fun_name, &scope_stack.back());
+
+    if (fun_name == PREDEFINED_SCOPE_NAME) {
+      predefined_table = &scope_stack.back();
+    } else if (fun_name == GLOBAL_SCOPE_NAME) {
+      global_table = &scope_stack.back();
+    }
   }
   current_scope++;
 }
 
-symbol_table_t SymTable::get_scope(std::string scope_name) {
-  return scope_stack.at(scope_name);
+/**
+ * @brief get the table of a scope. the reference stays valid for the
+ * lifetime of the symbol table
+ *
+ * @param scope_name name of the scope (function name or global/predefined)
+ * @return const symbol_table_t& symbols defined in the scope
+ */
+const symbol_table_t &SymTable::get_scope(name_id_t scope_name) const {
+  if (auto *symtable = find_scope(scope_name)) {
+    return *symtable;
+  }
+
+  throw std::out_of_range("scope `" + name_str(scope_name) +
+                          "` doesn't exist");
+}
+
+/**
+ * @brief get a handle to the table of a scope
+ *
+ * @param scope_name name of the scope (function name or global/predefined)
+ * @return const symbol_table_t* symbols defined in the scope, nullptr if the
+ * scope doesn't exist
+ */
+const symbol_table_t *SymTable::find_scope(name_id_t scope_name) const {
+  auto *symtable = scope_index.find(scope_name);
+  return symtable != nullptr ? *symtable : nullptr;
 }
 
 /**
@@ -196,11 +196,12 @@ void SymTable::enter_scope() { current_scope_level++; }
 void SymTable::exit_scope() { current_scope_level--; }
 
 std::ostream &operator<<(std::ostream &os, const SymTable &sym_table) {
-  for (auto const &[fun, symtable] : sym_table.scope_stack) {
-    os << "scope: " << fun << std::endl;
+  for (std::size_t i = 0; i < sym_table.scope_stack.size(); i++) {
+    auto const &symtable = sym_table.scope_stack[i];
+    os << "scope: " << name_str(sym_table.scope_names[i]) << std::endl;
     os << "----------------------------------" << std::endl;
     for (auto const &[name, symbol] : symtable) {
-      os << name << std::setw(10) << *symbol << std::endl;
+      os << name_str(name) << std::setw(10) << *symbol << std::endl;
     }
     os << "----------------------------------" << std::endl;
   }
@@ -0,0 +1,354 @@
+/**
+ * @file VM.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Virtual machine that runs register bytecode
+ */
+
+#include "VM.hpp"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <memory>
+#include <vector>
+
+namespace vm {
+
+namespace {
+
+// registers of all the frames, and frames that can be active
+const std::size_t STACK_SIZE = 1 << 20;
+const std::size_t MAX_CALL_DEPTH = 1 << 16;
+
+// output is written to the stream in chunks of about this size
+const std::size_t BUFFER_SIZE = 1 << 16;
+
+std::int32_t wrap(std::uint32_t value) {
+  return static_cast<std::int32_t>(value);
+}
+
+} // namespace
+
+/**
+ * @brief run the program from its main function
+ *
+ * @param in stream `getchar` reads from
+ * @param out stream the program prints to
+ * @throws Trap if the program traps
+ */
+void VM::run(std::istream &in, std::ostream &out) {
+  struct frame_t {
+    const instr_t *ip;
+    std::int32_t *regs;
+  };
+
+  // registers are left uninitialized, locals are zeroed on every call
+  std::unique_ptr<std::int32_t[]> stack(new std::int32_t[STACK_SIZE]);
+  std::unique_ptr<frame_t[]> frames(new frame_t[MAX_CALL_DEPTH]);
+  std::int32_t *const stack_end = stack.get() + STACK_SIZE;
+  frame_t *const frames_end = frames.get() + MAX_CALL_DEPTH;
+  std::vector<std::int32_t> globals(program.globals);
+
+  std::string buffer;
+  auto flush = [&]() {
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+  };
+  auto trap = [&](const char *message) {
+    flush();
+    throw Trap(message);
+  };
+
+  const instr_t *const code = program.code.data();
+  const function_t *const functions = program.functions.data();
+  function_t const &main = functions[program.main];
+  if (main.registers > STACK_SIZE) {
+    trap("call stack exhausted");
+  }
+
+  frame_t *fp = frames.get();
+  std::int32_t *r = stack.get();
+  std::fill(r, r + main.params + main.locals, 0);
+  const instr_t *ip = code + main.entry;
+
+#define R(field) r[ip->field]
+
+#if defined(__GNUC__)
+  // computed goto: every handler jumps straight to the next one
+  static const void *const labels[] = {
+#define VM_LABEL(name, operands) &&op_##name,
+      BYTECODE_OPS(VM_LABEL)
+#undef VM_LABEL
+  };
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *labels[static_cast<int>(ip->op)]
+  VM_DISPATCH();
+  {
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_DISPATCH() goto dispatch
+dispatch:
+  switch (ip->op) {
+#endif
+#define VM_NEXT()                                                              \
+  ++ip;                                                                        \
+  VM_DISPATCH()
+
+    VM_CASE(mov) {
+      R(a) = R(b);
+      VM_NEXT();
+    }
+    VM_CASE(movi) {
+      R(a) = ip->b;
+      VM_NEXT();
+    }
+    VM_CASE(getg) {
+      R(a) = globals[ip->b];
+      VM_NEXT();
+    }
+    VM_CASE(setg) {
+      globals[ip->b] = R(a);
+      VM_NEXT();
+    }
+    VM_CASE(getgx) {
+      R(a) = globals[std::size_t(ip->b) + std::uint32_t(R(c))];
+      VM_NEXT();
+    }
+    VM_CASE(setgx) {
+      globals[std::size_t(ip->b) + std::uint32_t(R(c))] = R(a);
+      VM_NEXT();
+    }
+    VM_CASE(getx) {
+      R(a) = r[std::size_t(ip->b) + std::uint32_t(R(c))];
+      VM_NEXT();
+    }
+    VM_CASE(setx) {
+      r[std::size_t(ip->b) + std::uint32_t(R(c))] = R(a);
+      VM_NEXT();
+    }
+    VM_CASE(bound) {
+      // a negative index is a large unsigned one
+      if (std::uint32_t(R(a)) >= std::uint32_t(ip->b)) {
+        trap("index out of bounds");
+      }
+      VM_NEXT();
+    }
+    VM_CASE(add) {
+      R(a) = wrap(std::uint32_t(R(b)) + std::uint32_t(R(c)));
+      VM_NEXT();
+    }
+    VM_CASE(addi) {
+      R(a) = wrap(std::uint32_t(R(b)) + std::uint32_t(ip->c));
+      VM_NEXT();
+    }
+    VM_CASE(sub) {
+      R(a) = wrap(std::uint32_t(R(b)) - std::uint32_t(R(c)));
+      VM_NEXT();
+    }
+    VM_CASE(mul) {
+      R(a) = wrap(std::uint32_t(R(b)) * std::uint32_t(R(c)));
+      VM_NEXT();
+    }
+    VM_CASE(div) {
+      std::int32_t right = R(c);
+      if (right == 0) {
+        trap("integer divide by zero");
+      }
+      if (right == -1 && R(b) == INT32_MIN) {
+        trap("integer overflow");
+      }
+      R(a) = R(b) / right;
+      VM_NEXT();
+    }
+    VM_CASE(mod) {
+      std::int32_t right = R(c);
+      if (right == 0) {
+        trap("integer divide by zero");
+      }
+      // INT32_MIN % -1 overflows in C++, it's 0 in J--
+      R(a) = right == -1 ? 0 : R(b) % right;
+      VM_NEXT();
+    }
+    VM_CASE(neg) {
+      R(a) = wrap(0u - std::uint32_t(R(b)));
+      VM_NEXT();
+    }
+    VM_CASE(not_) {
+      R(a) = R(b) ^ 1;
+      VM_NEXT();
+    }
+    VM_CASE(and_) {
+      R(a) = R(b) != 0 && R(c) != 0;
+      VM_NEXT();
+    }
+    VM_CASE(or_) {
+      R(a) = R(b) != 0 || R(c) != 0;
+      VM_NEXT();
+    }
+    VM_CASE(eq) {
+      R(a) = R(b) == R(c);
+      VM_NEXT();
+    }
+    VM_CASE(ne) {
+      R(a) = R(b) != R(c);
+      VM_NEXT();
+    }
+    VM_CASE(lt) {
+      R(a) = R(b) < R(c);
+      VM_NEXT();
+    }
+    VM_CASE(le) {
+      R(a) = R(b) <= R(c);
+      VM_NEXT();
+    }
+    VM_CASE(gt) {
+      R(a) = R(b) > R(c);
+      VM_NEXT();
+    }
+    VM_CASE(ge) {
+      R(a) = R(b) >= R(c);
+      VM_NEXT();
+    }
+    VM_CASE(jmp) {
+      ip = code + ip->b;
+      VM_DISPATCH();
+    }
+    VM_CASE(jz) {
+      ip = R(a) == 0 ? code + ip->b : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jnz) {
+      ip = R(a) != 0 ? code + ip->b : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jeq) {
+      ip = R(a) == R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jne) {
+      ip = R(a) != R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jlt) {
+      ip = R(a) < R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jle) {
+      ip = R(a) <= R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jgt) {
+      ip = R(a) > R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jge) {
+      ip = R(a) >= R(b) ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jeqi) {
+      ip = R(a) == ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jnei) {
+      ip = R(a) != ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jlti) {
+      ip = R(a) < ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jlei) {
+      ip = R(a) <= ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jgti) {
+      ip = R(a) > ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(jgei) {
+      ip = R(a) >= ip->b ? code + ip->c : ip + 1;
+      VM_DISPATCH();
+    }
+    VM_CASE(call) {
+      function_t const &callee = functions[ip->b];
+      // the arguments are already in the first registers of the callee
+      std::int32_t *base = r + ip->a;
+      if (fp == frames_end ||
+          callee.registers > static_cast<std::size_t>(stack_end - base)) {
+        trap("call stack exhausted");
+      }
+      *fp++ = {ip + 1, r};
+      std::fill(base + callee.params, base + callee.params + callee.locals, 0);
+      r = base;
+      ip = code + callee.entry;
+      VM_DISPATCH();
+    }
+    VM_CASE(ret) {
+      // the result goes in the register the callee's frame starts at
+      r[0] = R(a);
+      goto leave;
+    }
+    VM_CASE(reti) {
+      r[0] = ip->b;
+      goto leave;
+    }
+    VM_CASE(ret0) { goto leave; }
+    VM_CASE(printi) {
+      char digits[16];
+      auto result = std::to_chars(digits, digits + sizeof(digits), R(a));
+      buffer.append(digits, result.ptr);
+      if (buffer.size() >= BUFFER_SIZE) {
+        flush();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(printc) {
+      buffer.push_back(static_cast<char>(R(a)));
+      if (buffer.size() >= BUFFER_SIZE) {
+        flush();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(printb) {
+      buffer += R(a) > 0 ? "true" : "false";
+      if (buffer.size() >= BUFFER_SIZE) {
+        flush();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(prints) {
+      buffer += program.strings[ip->b];
+      if (buffer.size() >= BUFFER_SIZE) {
+        flush();
+      }
+      VM_NEXT();
+    }
+    VM_CASE(getchar) {
+      // whatever was printed before has to show up before the program waits
+      flush();
+      R(a) = in.get();
+      VM_NEXT();
+    }
+    VM_CASE(halt) {
+      flush();
+      return;
+    }
+    VM_CASE(trap) { trap("function ended without returning a value"); }
+
+  leave:
+    if (fp == frames.get()) {
+      flush();
+      return;
+    }
+    --fp;
+    ip = fp->ip;
+    r = fp->regs;
+    VM_DISPATCH();
+  }
+
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef R
+}
+
+} // namespace vm
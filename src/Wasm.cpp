@@ -0,0 +1,602 @@
+/**
+ * @file Wasm.cpp
+ * @author Artem Golovin (30018900)
+ * @brief In-memory WebAssembly module and its binary encoding
+ */
+
+#include "Wasm.hpp"
+#include <stdexcept>
+
+namespace wasm {
+
+namespace {
+
+const std::uint8_t I32 = 0x7f;
+const std::uint8_t EMPTY_BLOCK = 0x40;
+const std::uint8_t FUNC_TYPE = 0x60;
+const std::uint8_t EXTERNAL_FUNC = 0x00;
+const std::uint8_t MUTABLE = 0x01;
+
+enum section_id : std::uint8_t {
+  TYPE = 1,
+  IMPORT = 2,
+  FUNCTION = 3,
+  MEMORY = 5,
+  GLOBAL = 6,
+  EXPORT = 7,
+  START = 8,
+  CODE = 10,
+  DATA = 11,
+};
+
+struct op_info_t {
+  const char *name;
+  Imm imm;
+};
+
+/**
+ * @brief opcode table, indexed by the opcode byte
+ */
+struct op_table_t {
+  op_info_t info[256] = {};
+  std::unordered_map<std::string_view, Op> by_name;
+
+  op_table_t() {
+#define WASM_OP_INFO(op, text, code, kind)                                     \
+  info[code] = {text, Imm::kind};                                              \
+  by_name[text] = Op::op;
+    WASM_OPCODES(WASM_OP_INFO)
+#undef WASM_OP_INFO
+  }
+};
+
+const op_table_t &op_table() {
+  static const op_table_t table;
+  return table;
+}
+
+void write_name(std::string &out, std::string const &name) {
+  write_u32(out, static_cast<std::uint32_t>(name.size()));
+  out += name;
+}
+
+void write_signature(std::string &out, Signature const &signature) {
+  out += static_cast<char>(FUNC_TYPE);
+  write_u32(out, signature.params);
+  out.append(signature.params, static_cast<char>(I32));
+  write_u32(out, signature.has_result ? 1 : 0);
+  if (signature.has_result) {
+    out += static_cast<char>(I32);
+  }
+}
+
+/**
+ * @brief append a section with its id and size, skipping empty sections
+ */
+void write_section(std::string &out, std::uint8_t id,
+                   std::string const &content, std::uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  std::string counted;
+  write_u32(counted, count);
+  out += static_cast<char>(id);
+  write_u32(out, static_cast<std::uint32_t>(counted.size() + content.size()));
+  out += counted;
+  out += content;
+}
+
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+} // namespace
+
+/**
+ * @brief get the WAT mnemonic of an opcode
+ */
+const char *op_name(Op op) {
+  return op_table().info[static_cast<std::uint8_t>(op)].name;
+}
+
+/**
+ * @brief get the kind of immediate an opcode takes
+ */
+Imm op_imm(Op op) { return op_table().info[static_cast<std::uint8_t>(op)].imm; }
+
+/**
+ * @brief get the natural alignment of a memory access, as log2 of the
+ * number of bytes it reads or writes
+ */
+std::uint32_t op_alignment(Op op) {
+  switch (op) {
+  case Op::i32_load8_s:
+  case Op::i32_load8_u:
+  case Op::i32_store8:
+    return 0;
+  case Op::i32_load16_u:
+  case Op::i32_store16:
+    return 1;
+  default:
+    return 2;
+  }
+}
+
+/**
+ * @brief find an opcode by its WAT mnemonic
+ *
+ * @param name mnemonic, such as `i32.add`
+ * @param op set to the opcode, if the mnemonic is known
+ * @return true if the mnemonic is known
+ */
+bool op_from_name(std::string_view name, Op &op) {
+  auto const &by_name = op_table().by_name;
+  auto iter = by_name.find(name);
+  if (iter == by_name.end()) {
+    return false;
+  }
+
+  op = iter->second;
+  return true;
+}
+
+/**
+ * @brief append an unsigned LEB128 number
+ */
+void write_u32(std::string &out, std::uint32_t value) {
+  do {
+    std::uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    out += static_cast<char>(byte);
+  } while (value != 0);
+}
+
+/**
+ * @brief append a signed LEB128 number
+ */
+void write_i32(std::string &out, std::int32_t value) {
+  bool more = true;
+  while (more) {
+    std::uint8_t byte = value & 0x7f;
+    // arithmetic shift, the sign is kept
+    value >>= 7;
+    bool sign_bit = (byte & 0x40) != 0;
+    if ((value == 0 && !sign_bit) || (value == -1 && sign_bit)) {
+      more = false;
+    } else {
+      byte |= 0x80;
+    }
+    out += static_cast<char>(byte);
+  }
+}
+
+/**
+ * @brief decode the escapes of a WAT string literal (without the quotes).
+ * besides the WAT escapes, `\b` and `\f` of J-- strings are understood, and
+ * a backslash that doesn't start an escape is kept as is
+ *
+ * @param text text between the quotes
+ * @return std::string bytes of the string
+ */
+std::string unescape(std::string_view text) {
+  std::string bytes;
+  bytes.reserve(text.size());
+
+  for (std::size_t i = 0; i < text.size(); i++) {
+    if (text[i] != '\\' || i + 1 == text.size()) {
+      bytes += text[i];
+      continue;
+    }
+
+    char c = text[i + 1];
+    int high = hex_digit(c);
+    int low = i + 2 < text.size() ? hex_digit(text[i + 2]) : -1;
+    if (high >= 0 && low >= 0) {
+      bytes += static_cast<char>(high * 16 + low);
+      i += 2;
+      continue;
+    }
+
+    switch (c) {
+    case 't':
+      bytes += '\t';
+      break;
+    case 'n':
+      bytes += '\n';
+      break;
+    case 'r':
+      bytes += '\r';
+      break;
+    case 'b':
+      bytes += '\b';
+      break;
+    case 'f':
+      bytes += '\f';
+      break;
+    case '"':
+    case '\'':
+    case '\\':
+      bytes += c;
+      break;
+    default:
+      bytes += '\\';
+      continue;
+    }
+    i++;
+  }
+
+  return bytes;
+}
+
+Function::Function(Module &module, name_id_t name,
+                   std::vector<name_id_t> params, bool has_result)
+    : name(name), module(module) {
+  signature.params = static_cast<std::uint32_t>(params.size());
+  signature.has_result = has_result;
+  for (auto param : params) {
+    local(param);
+  }
+}
+
+/**
+ * @brief declare a local variable, after the parameters
+ */
+void Function::local(name_id_t local_name) {
+  local_index.emplace(local_name, static_cast<std::uint32_t>(locals.size()));
+  locals.push_back(local_name);
+}
+
+/**
+ * @brief emit an instruction without immediates
+ */
+void Function::op(Op op) { body += static_cast<char>(op); }
+
+/**
+ * @brief emit `i32.const`
+ */
+void Function::i32_const(std::int32_t value) {
+  op(Op::i32_const);
+  write_i32(body, value);
+}
+
+/**
+ * @brief emit local.get/set/tee of a local or a parameter
+ */
+void Function::local_op(Op op, name_id_t local_name) {
+  auto iter = local_index.find(local_name);
+  if (iter == local_index.end()) {
+    throw std::runtime_error("unknown local `" + name_str(local_name) +
+                             "` in function `" + name_str(name) + "`");
+  }
+
+  this->op(op);
+  write_u32(body, iter->second);
+}
+
+/**
+ * @brief emit global.get/set
+ */
+void Function::global_op(Op op, name_id_t global_name) {
+  this->op(op);
+  write_u32(body, module.global_index(global_name));
+}
+
+/**
+ * @brief emit a call, the callee index is filled in by Module::encode
+ */
+void Function::call(name_id_t callee) {
+  op(Op::call);
+  calls.emplace_back(body.size(), callee);
+}
+
+/**
+ * @brief emit a load or a store
+ *
+ * @param align log2 of the alignment
+ * @param offset constant offset of the address
+ */
+void Function::memory_op(Op op, std::uint32_t align, std::uint32_t offset) {
+  this->op(op);
+  write_u32(body, align);
+  write_u32(body, offset);
+}
+
+/**
+ * @brief open a block, loop or if
+ *
+ * @param label label the branches refer to, NO_NAME if there's none
+ * @param has_result true if the construct leaves an i32
+ */
+void Function::begin(Op op, name_id_t label, bool has_result) {
+  this->op(op);
+  body += static_cast<char>(has_result ? I32 : EMPTY_BLOCK);
+  labels.push_back(label);
+}
+
+/**
+ * @brief switch an open if to its else branch
+ */
+void Function::else_() { op(Op::else_); }
+
+/**
+ * @brief close the innermost block, loop or if
+ */
+void Function::end() {
+  if (labels.empty()) {
+    throw std::runtime_error("unbalanced `end` in function `" +
+                             name_str(name) + "`");
+  }
+
+  labels.pop_back();
+  op(Op::end);
+}
+
+/**
+ * @brief emit br or br_if to a label of an enclosing block
+ *
+ * @throws std::runtime_error if no enclosing block has the label
+ */
+void Function::branch(Op op, name_id_t label) {
+  branch_depth(op, label_depth(label));
+}
+
+/**
+ * @brief emit br or br_if by relative depth, 0 is the innermost block
+ */
+void Function::branch_depth(Op op, std::uint32_t depth) {
+  this->op(op);
+  write_u32(body, depth);
+}
+
+/**
+ * @brief emit br_table, which branches to the label at the index on the
+ * stack, or to the last one if the index is out of range
+ *
+ * @param depths relative depths of the targets, the default last
+ */
+void Function::branch_table(std::vector<std::uint32_t> const &depths) {
+  if (depths.empty()) {
+    throw std::runtime_error("br_table without a default label in function `" +
+                             name_str(name) + "`");
+  }
+
+  op(Op::br_table);
+  write_u32(body, static_cast<std::uint32_t>(depths.size() - 1));
+  for (auto depth : depths) {
+    write_u32(body, depth);
+  }
+}
+
+/**
+ * @brief get the relative depth of an enclosing block
+ *
+ * @throws std::runtime_error if no enclosing block has the label
+ */
+std::uint32_t Function::label_depth(name_id_t label) const {
+  for (std::size_t depth = 0; depth < labels.size(); depth++) {
+    if (labels[labels.size() - 1 - depth] == label) {
+      return static_cast<std::uint32_t>(depth);
+    }
+  }
+
+  throw std::runtime_error("unknown label `" + name_str(label) +
+                           "` in function `" + name_str(name) + "`");
+}
+
+/**
+ * @brief close the body of the function
+ */
+void Function::finish() {
+  if (!labels.empty()) {
+    throw std::runtime_error("unclosed block in function `" + name_str(name) +
+                             "`");
+  }
+
+  op(Op::end);
+}
+
+/**
+ * @brief import a host function
+ */
+void Module::import(std::string module_name, std::string field,
+                    name_id_t name, Signature signature) {
+  imports.push_back({module_name, field, name, signature});
+}
+
+/**
+ * @brief define a function. the reference stays valid until the module is
+ * destroyed
+ */
+Function &Module::function(name_id_t name, std::vector<name_id_t> params,
+                           bool has_result) {
+  functions.push_back(
+      std::make_unique<Function>(*this, name, params, has_result));
+  return *functions.back();
+}
+
+/**
+ * @brief define a mutable i32 global
+ */
+void Module::global(name_id_t name, std::int32_t value) {
+  global_indices.emplace(name, static_cast<std::uint32_t>(globals.size()));
+  globals.push_back(value);
+}
+
+/**
+ * @brief get the index of a global
+ *
+ * @throws std::runtime_error if there's no such global
+ */
+std::uint32_t Module::global_index(name_id_t name) const {
+  auto iter = global_indices.find(name);
+  if (iter == global_indices.end()) {
+    throw std::runtime_error("unknown global `" + name_str(name) + "`");
+  }
+  return iter->second;
+}
+
+/**
+ * @brief export a function under `field`
+ */
+void Module::export_function(std::string field, name_id_t name) {
+  exports.emplace_back(field, name);
+}
+
+/**
+ * @brief place bytes in the memory at `offset` when the module is loaded
+ */
+void Module::data(std::uint32_t offset, std::string bytes) {
+  segments.push_back({offset, bytes});
+}
+
+/**
+ * @brief encode the module in the binary format
+ *
+ * @throws std::runtime_error if a call or an export names an unknown
+ * function
+ */
+std::string Module::encode() const {
+  // function index space: imports first, then the defined functions
+  std::unordered_map<name_id_t, std::uint32_t> function_indices;
+  std::vector<Signature> types;
+  std::vector<std::uint32_t> type_of;
+
+  auto type_index = [&](Signature const &signature) {
+    for (std::size_t i = 0; i < types.size(); i++) {
+      if (types[i] == signature) {
+        return static_cast<std::uint32_t>(i);
+      }
+    }
+    types.push_back(signature);
+    return static_cast<std::uint32_t>(types.size() - 1);
+  };
+
+  auto function_index = [&](name_id_t name) {
+    auto iter = function_indices.find(name);
+    if (iter == function_indices.end()) {
+      throw std::runtime_error("unknown function `" + name_str(name) + "`");
+    }
+    return iter->second;
+  };
+
+  for (auto const &import : imports) {
+    function_indices.emplace(
+        import.name, static_cast<std::uint32_t>(function_indices.size()));
+    type_of.push_back(type_index(import.signature));
+  }
+  for (auto const &function : functions) {
+    function_indices.emplace(
+        function->name, static_cast<std::uint32_t>(type_of.size()));
+    type_of.push_back(type_index(function->signature));
+  }
+
+  std::string module("\0asm\1\0\0\0", 8);
+  std::string section;
+
+  for (auto const &type : types) {
+    write_signature(section, type);
+  }
+  write_section(module, TYPE, section, types.size());
+
+  section.clear();
+  for (std::size_t i = 0; i < imports.size(); i++) {
+    write_name(section, imports[i].module_name);
+    write_name(section, imports[i].field);
+    section += static_cast<char>(EXTERNAL_FUNC);
+    write_u32(section, type_of[i]);
+  }
+  write_section(module, IMPORT, section, imports.size());
+
+  section.clear();
+  for (std::size_t i = imports.size(); i < type_of.size(); i++) {
+    write_u32(section, type_of[i]);
+  }
+  write_section(module, FUNCTION, section, functions.size());
+
+  section.clear();
+  if (memory_pages > 0) {
+    // limits without a maximum
+    section += '\0';
+    write_u32(section, memory_pages);
+  }
+  write_section(module, MEMORY, section, memory_pages > 0 ? 1 : 0);
+
+  section.clear();
+  for (auto value : globals) {
+    section += static_cast<char>(I32);
+    section += static_cast<char>(MUTABLE);
+    section += static_cast<char>(Op::i32_const);
+    write_i32(section, value);
+    section += static_cast<char>(Op::end);
+  }
+  write_section(module, GLOBAL, section, globals.size());
+
+  section.clear();
+  for (auto const &[field, name] : exports) {
+    write_name(section, field);
+    section += static_cast<char>(EXTERNAL_FUNC);
+    write_u32(section, function_index(name));
+  }
+  write_section(module, EXPORT, section, exports.size());
+
+  if (start != NO_NAME) {
+    section.clear();
+    write_u32(section, function_index(start));
+    module += static_cast<char>(START);
+    write_u32(module, static_cast<std::uint32_t>(section.size()));
+    module += section;
+  }
+
+  section.clear();
+  std::string code;
+  for (auto const &function : functions) {
+    code.clear();
+    if (function->local_count() > 0) {
+      // every local is an i32, so they all go in one group
+      write_u32(code, 1);
+      write_u32(code, function->local_count());
+      code += static_cast<char>(I32);
+    } else {
+      write_u32(code, 0);
+    }
+
+    std::size_t copied = 0;
+    for (auto const &[offset, callee] : function->calls) {
+      code.append(function->body, copied, offset - copied);
+      write_u32(code, function_index(callee));
+      copied = offset;
+    }
+    code.append(function->body, copied, std::string::npos);
+
+    write_u32(section, static_cast<std::uint32_t>(code.size()));
+    section += code;
+  }
+  write_section(module, CODE, section, functions.size());
+
+  section.clear();
+  for (auto const &segment : segments) {
+    // active segment of memory 0
+    section += '\0';
+    section += static_cast<char>(Op::i32_const);
+    write_i32(section, static_cast<std::int32_t>(segment.offset));
+    section += static_cast<char>(Op::end);
+    write_u32(section, static_cast<std::uint32_t>(segment.bytes.size()));
+    section += segment.bytes;
+  }
+  write_section(module, DATA, section, segments.size());
+
+  return module;
+}
+
+} // namespace wasm
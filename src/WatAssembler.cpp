@@ -0,0 +1,629 @@
+/**
+ * @file WatAssembler.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Assembler for the subset of the WebAssembly text format that the
+ * compiler and its runtime use
+ */
+
+#include "WatAssembler.hpp"
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+
+using wasm::Op;
+
+/**
+ * @brief assemble WAT text into the module
+ *
+ * @param wat text to assemble
+ * @throws std::runtime_error on anything outside the supported subset,
+ * with the line it's on
+ */
+void WatAssembler::assemble(std::string_view wat) {
+  tokenize(wat);
+  pos = 0;
+
+  if (at_field("module")) {
+    next();
+    next();
+    while (peek().kind != Kind::rparen) {
+      field();
+    }
+    next();
+  }
+
+  while (peek().kind != Kind::eof) {
+    field();
+  }
+}
+
+void WatAssembler::tokenize(std::string_view wat) {
+  tokens.clear();
+  int line = 1;
+  std::size_t i = 0;
+
+  auto is_atom_char = [](char c) {
+    return c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '(' &&
+           c != ')' && c != '"' && c != ';';
+  };
+
+  while (i < wat.size()) {
+    char c = wat[i];
+
+    if (c == '\n') {
+      line++;
+      i++;
+    } else if (c == ' ' || c == '\t' || c == '\r') {
+      i++;
+    } else if (c == ';' && i + 1 < wat.size() && wat[i + 1] == ';') {
+      while (i < wat.size() && wat[i] != '\n') {
+        i++;
+      }
+    } else if (c == '(' && i + 1 < wat.size() && wat[i + 1] == ';') {
+      // block comment
+      std::size_t close = wat.find(";)", i + 2);
+      if (close == std::string_view::npos) {
+        close = wat.size();
+      }
+      for (; i < close && i < wat.size(); i++) {
+        line += wat[i] == '\n';
+      }
+      i = close + 2;
+    } else if (c == '(') {
+      tokens.push_back({Kind::lparen, wat.substr(i, 1), line});
+      i++;
+    } else if (c == ')') {
+      tokens.push_back({Kind::rparen, wat.substr(i, 1), line});
+      i++;
+    } else if (c == '"') {
+      std::size_t start = ++i;
+      while (i < wat.size() && wat[i] != '"') {
+        // the escaped character can't end the string
+        i += wat[i] == '\\' ? 2 : 1;
+      }
+      if (i >= wat.size()) {
+        tokens.push_back({Kind::eof, "", line});
+        error("unterminated string");
+      }
+      tokens.push_back({Kind::string, wat.substr(start, i - start), line});
+      i++;
+    } else {
+      std::size_t start = i;
+      while (i < wat.size() && is_atom_char(wat[i])) {
+        i++;
+      }
+      if (i == start) {
+        // a lone `;`
+        i++;
+      }
+      tokens.push_back({Kind::atom, wat.substr(start, i - start), line});
+    }
+  }
+
+  tokens.push_back({Kind::eof, "", line});
+}
+
+const WatAssembler::token_t &WatAssembler::peek(std::size_t ahead) const {
+  std::size_t index = pos + ahead;
+  return tokens[index < tokens.size() ? index : tokens.size() - 1];
+}
+
+const WatAssembler::token_t &WatAssembler::next() {
+  const token_t &token = peek();
+  if (pos < tokens.size() - 1) {
+    pos++;
+  }
+  return token;
+}
+
+/**
+ * @brief check if the next tokens are `(` and the keyword
+ */
+bool WatAssembler::at_field(std::string_view keyword) const {
+  return peek().kind == Kind::lparen && peek(1).kind == Kind::atom &&
+         peek(1).text == keyword;
+}
+
+void WatAssembler::expect(Kind kind, std::string_view what) {
+  if (peek().kind != kind) {
+    error("expected " + std::string(what));
+  }
+  next();
+}
+
+std::string_view WatAssembler::expect_atom(std::string_view what) {
+  if (peek().kind != Kind::atom) {
+    error("expected " + std::string(what));
+  }
+  return next().text;
+}
+
+std::string_view WatAssembler::expect_string(std::string_view what) {
+  if (peek().kind != Kind::string) {
+    error("expected " + std::string(what));
+  }
+  return next().text;
+}
+
+/**
+ * @brief read a `$name` and intern it without the `$`
+ */
+name_id_t WatAssembler::expect_name(std::string_view what) {
+  auto text = expect_atom(what);
+  if (text.size() < 2 || text[0] != '$') {
+    pos--;
+    error("expected " + std::string(what) + ", got `" + std::string(text) +
+          "`");
+  }
+  return intern(text.substr(1));
+}
+
+std::int32_t WatAssembler::expect_i32() {
+  auto text = std::string(expect_atom("a number"));
+  try {
+    std::size_t used = 0;
+    long long value = std::stoll(text, &used, 0);
+    if (used != text.size() || value < INT32_MIN || value > UINT32_MAX) {
+      throw std::out_of_range(text);
+    }
+    return static_cast<std::int32_t>(value);
+  } catch (std::logic_error const &) {
+    pos--;
+    error("invalid i32 `" + text + "`");
+  }
+}
+
+void WatAssembler::error(std::string const &message) const {
+  throw std::runtime_error("line " + std::to_string(peek().line) + ": " +
+                           message);
+}
+
+void WatAssembler::field() {
+  if (peek().kind != Kind::lparen || peek(1).kind != Kind::atom) {
+    error("expected a module field");
+  }
+
+  auto keyword = peek(1).text;
+  if (keyword == "import") {
+    import();
+  } else if (keyword == "memory") {
+    memory();
+  } else if (keyword == "global") {
+    global();
+  } else if (keyword == "func") {
+    func();
+  } else if (keyword == "data") {
+    data();
+  } else if (keyword == "start") {
+    start();
+  } else if (keyword == "export") {
+    export_();
+  } else {
+    next();
+    error("unsupported module field `" + std::string(keyword) + "`");
+  }
+}
+
+// (import "module" "field" (func $name (param i32)* (result i32)?))
+void WatAssembler::import() {
+  next();
+  next();
+  std::string module_name(expect_string("a module name"));
+  std::string field(expect_string("a field name"));
+
+  if (!at_field("func")) {
+    error("only functions can be imported");
+  }
+  next();
+  next();
+
+  name_id_t name = expect_name("a function name");
+  std::vector<name_id_t> params;
+  bool has_result = signature(params);
+  expect(Kind::rparen, "`)`");
+  expect(Kind::rparen, "`)`");
+
+  module.import(module_name, field, name,
+                {static_cast<std::uint32_t>(params.size()), has_result});
+}
+
+// (memory pages)
+void WatAssembler::memory() {
+  next();
+  next();
+  if (peek().kind == Kind::atom && peek().text[0] == '$') {
+    next();
+  }
+  module.set_memory(static_cast<std::uint32_t>(expect_i32()));
+  if (peek().kind == Kind::atom) {
+    // the maximum isn't kept
+    expect_i32();
+  }
+  expect(Kind::rparen, "`)`");
+}
+
+// (global $name (mut i32) (i32.const value))
+void WatAssembler::global() {
+  next();
+  next();
+  name_id_t name = expect_name("a global name");
+
+  if (at_field("mut")) {
+    next();
+    next();
+    if (expect_atom("a type") != "i32") {
+      error("only i32 globals are supported");
+    }
+    expect(Kind::rparen, "`)`");
+  } else if (expect_atom("a type") != "i32") {
+    error("only i32 globals are supported");
+  }
+
+  if (!at_field("i32.const")) {
+    error("expected an i32.const initializer");
+  }
+  next();
+  next();
+  std::int32_t value = expect_i32();
+  expect(Kind::rparen, "`)`");
+  expect(Kind::rparen, "`)`");
+
+  module.global(name, value);
+}
+
+// (func $name (export "field")* (param ...)* (result ...)? (local ...)* ...)
+void WatAssembler::func() {
+  next();
+  next();
+  name_id_t name = expect_name("a function name");
+
+  std::vector<std::string> exports;
+  while (at_field("export")) {
+    next();
+    next();
+    exports.emplace_back(expect_string("an export name"));
+    expect(Kind::rparen, "`)`");
+  }
+
+  std::vector<name_id_t> params;
+  bool has_result = signature(params);
+  auto &function = module.function(name, params, has_result);
+  for (auto const &field : exports) {
+    module.export_function(field, name);
+  }
+
+  while (at_field("local")) {
+    next();
+    next();
+    if (peek().kind == Kind::atom && peek().text[0] == '$') {
+      function.local(expect_name("a local name"));
+      if (expect_atom("a type") != "i32") {
+        error("only i32 locals are supported");
+      }
+    } else {
+      while (peek().kind == Kind::atom) {
+        if (next().text != "i32") {
+          error("only i32 locals are supported");
+        }
+        function.local(NO_NAME);
+      }
+    }
+    expect(Kind::rparen, "`)`");
+  }
+
+  instructions(function);
+  expect(Kind::rparen, "`)`");
+  function.finish();
+}
+
+// (data 0? (i32.const offset) "bytes"*)
+void WatAssembler::data() {
+  next();
+  next();
+  if (peek().kind == Kind::atom) {
+    // memory index, there's only one memory
+    next();
+  }
+
+  if (!at_field("i32.const")) {
+    error("expected an i32.const offset");
+  }
+  next();
+  next();
+  std::int32_t offset = expect_i32();
+  expect(Kind::rparen, "`)`");
+
+  std::string bytes;
+  while (peek().kind == Kind::string) {
+    bytes += wasm::unescape(next().text);
+  }
+  expect(Kind::rparen, "`)`");
+
+  module.data(static_cast<std::uint32_t>(offset), bytes);
+}
+
+// (start $name)
+void WatAssembler::start() {
+  next();
+  next();
+  module.set_start(expect_name("a function name"));
+  expect(Kind::rparen, "`)`");
+}
+
+// (export "field" (func $name))
+void WatAssembler::export_() {
+  next();
+  next();
+  std::string field(expect_string("an export name"));
+  if (!at_field("func")) {
+    error("only functions can be exported");
+  }
+  next();
+  next();
+  module.export_function(field, expect_name("a function name"));
+  expect(Kind::rparen, "`)`");
+  expect(Kind::rparen, "`)`");
+}
+
+/**
+ * @brief read `(param ...)` and `(result ...)` of a function type
+ *
+ * @param params names of the parameters, NO_NAME for unnamed ones
+ * @return true if the function has a result
+ */
+bool WatAssembler::signature(std::vector<name_id_t> &params) {
+  while (at_field("param")) {
+    next();
+    next();
+    if (peek().kind == Kind::atom && peek().text[0] == '$') {
+      params.push_back(expect_name("a parameter name"));
+      if (expect_atom("a type") != "i32") {
+        error("only i32 parameters are supported");
+      }
+    } else {
+      while (peek().kind == Kind::atom) {
+        if (next().text != "i32") {
+          error("only i32 parameters are supported");
+        }
+        params.push_back(NO_NAME);
+      }
+    }
+    expect(Kind::rparen, "`)`");
+  }
+
+  return block_result();
+}
+
+/**
+ * @brief read a block type, `(result i32)` if there's one
+ */
+bool WatAssembler::block_result() {
+  if (!at_field("result")) {
+    return false;
+  }
+
+  next();
+  next();
+  if (expect_atom("a type") != "i32") {
+    error("only i32 results are supported");
+  }
+  expect(Kind::rparen, "`)`");
+  return true;
+}
+
+/**
+ * @brief read instructions until the closing parenthesis of the enclosing
+ * field, or a plain `end` / `else` when `plain_block` is set
+ */
+void WatAssembler::instructions(wasm::Function &function, bool plain_block) {
+  while (true) {
+    auto const &token = peek();
+
+    if (token.kind == Kind::lparen) {
+      folded(function);
+      continue;
+    }
+
+    if (token.kind != Kind::atom) {
+      if (plain_block) {
+        error("expected `end`");
+      }
+      return;
+    }
+
+    if (plain_block && (token.text == "end" || token.text == "else")) {
+      return;
+    }
+
+    Op op;
+    if (!wasm::op_from_name(token.text, op) || op == Op::end ||
+        op == Op::else_) {
+      error("unsupported instruction `" + std::string(token.text) + "`");
+    }
+    next();
+    plain(function, op);
+  }
+}
+
+void WatAssembler::plain(wasm::Function &function, Op op) {
+  if (op != Op::block && op != Op::loop && op != Op::if_) {
+    immediate(function, op);
+    return;
+  }
+
+  name_id_t label = NO_NAME;
+  if (peek().kind == Kind::atom && peek().text[0] == '$') {
+    label = expect_name("a label");
+  }
+  function.begin(op, label, block_result());
+
+  instructions(function, true);
+  if (op == Op::if_ && peek().text == "else") {
+    next();
+    if (peek().kind == Kind::atom && peek().text[0] == '$') {
+      next();
+    }
+    function.else_();
+    instructions(function, true);
+  }
+
+  if (expect_atom("`end`") != "end") {
+    pos--;
+    error("expected `end`");
+  }
+  if (peek().kind == Kind::atom && peek().text[0] == '$') {
+    next();
+  }
+  function.end();
+}
+
+void WatAssembler::folded(wasm::Function &function) {
+  next();
+  auto text = expect_atom("an instruction");
+
+  Op op;
+  if (!wasm::op_from_name(text, op) || op == Op::end || op == Op::else_) {
+    pos--;
+    error("unsupported instruction `" + std::string(text) + "`");
+  }
+
+  if (op == Op::block || op == Op::loop) {
+    name_id_t label = NO_NAME;
+    if (peek().kind == Kind::atom && peek().text[0] == '$') {
+      label = expect_name("a label");
+    }
+    function.begin(op, label, block_result());
+    instructions(function);
+    expect(Kind::rparen, "`)`");
+    function.end();
+    return;
+  }
+
+  if (op == Op::if_) {
+    name_id_t label = NO_NAME;
+    if (peek().kind == Kind::atom && peek().text[0] == '$') {
+      label = expect_name("a label");
+    }
+    bool has_result = block_result();
+
+    // the condition comes before `(then ...)`
+    while (peek().kind == Kind::lparen && !at_field("then")) {
+      folded(function);
+    }
+    if (!at_field("then")) {
+      error("expected `(then ...)`");
+    }
+    next();
+    next();
+    function.begin(op, label, has_result);
+    instructions(function);
+    expect(Kind::rparen, "`)`");
+
+    if (at_field("else")) {
+      next();
+      next();
+      function.else_();
+      instructions(function);
+      expect(Kind::rparen, "`)`");
+    }
+
+    expect(Kind::rparen, "`)`");
+    function.end();
+    return;
+  }
+
+  // immediates first, then the operands, then the instruction itself
+  std::size_t immediates = pos;
+  while (peek().kind == Kind::atom) {
+    next();
+  }
+  std::size_t operands = pos;
+
+  while (peek().kind == Kind::lparen) {
+    folded(function);
+  }
+  std::size_t after = pos;
+
+  pos = immediates;
+  immediate(function, op);
+  if (pos != operands) {
+    error("unexpected immediate");
+  }
+  pos = after;
+  expect(Kind::rparen, "`)`");
+}
+
+void WatAssembler::immediate(wasm::Function &function, Op op) {
+  switch (wasm::op_imm(op)) {
+  case wasm::Imm::none:
+    function.op(op);
+    break;
+  case wasm::Imm::i32:
+    function.i32_const(expect_i32());
+    break;
+  case wasm::Imm::local:
+    function.local_op(op, expect_name("a local name"));
+    break;
+  case wasm::Imm::global:
+    function.global_op(op, expect_name("a global name"));
+    break;
+  case wasm::Imm::func:
+    function.call(expect_name("a function name"));
+    break;
+  case wasm::Imm::label:
+    if (peek().kind == Kind::atom && peek().text[0] != '$') {
+      function.branch_depth(op, static_cast<std::uint32_t>(expect_i32()));
+    } else {
+      function.branch(op, expect_name("a label"));
+    }
+    break;
+  case wasm::Imm::table: {
+    // the next instruction can follow on the same line, so only labels and
+    // depths are read
+    auto is_label = [this]() {
+      auto const &token = peek();
+      return token.kind == Kind::atom &&
+             (token.text[0] == '$' ||
+              std::isdigit(static_cast<unsigned char>(token.text[0])));
+    };
+
+    std::vector<std::uint32_t> depths;
+    while (is_label()) {
+      if (peek().text[0] != '$') {
+        depths.push_back(static_cast<std::uint32_t>(expect_i32()));
+      } else {
+        depths.push_back(function.label_depth(expect_name("a label")));
+      }
+    }
+    if (depths.empty()) {
+      error("expected a label");
+    }
+    function.branch_table(depths);
+    break;
+  }
+  case wasm::Imm::memarg: {
+    std::uint32_t align = wasm::op_alignment(op);
+    std::uint32_t offset = 0;
+    while (peek().kind == Kind::atom) {
+      auto text = peek().text;
+      if (text.rfind("offset=", 0) == 0) {
+        offset = static_cast<std::uint32_t>(std::stoul(
+            std::string(text.substr(std::string_view("offset=").size()))));
+      } else if (text.rfind("align=", 0) == 0) {
+        std::uint32_t bytes = static_cast<std::uint32_t>(std::stoul(
+            std::string(text.substr(std::string_view("align=").size()))));
+        for (align = 0; (1u << align) < bytes; align++) {
+        }
+      } else {
+        break;
+      }
+      next();
+    }
+    function.memory_op(op, align, offset);
+    break;
+  }
+  case wasm::Imm::block:
+    // block, loop and if are handled by plain() and folded()
+    break;
+  }
+}
@@ -0,0 +1,1367 @@
+/**
+ * @file X86Generator.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Generate x86-64 assembly (GNU as, AT&T syntax) for J-- code
+ */
+
+#include "X86Generator.hpp"
+#include "SideEffects.hpp"
+#include "Wasm.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+/**
+ * @brief callee-saved registers variables are allocated to, so they survive
+ * calls without being saved around them
+ */
+struct register_name_t {
+  const char *name;
+  const char *name64;
+};
+
+const register_name_t REGISTERS[] = {
+    {"%ebx", "%rbx"},   {"%r12d", "%r12"}, {"%r13d", "%r13"},
+    {"%r14d", "%r14"},  {"%r15d", "%r15"},
+};
+const int REGISTER_COUNT = sizeof(REGISTERS) / sizeof(REGISTERS[0]);
+
+std::string function_label(name_id_t name) {
+  return "jay_fn_" + name_str(name);
+}
+
+std::string global_operand(name_id_t name) {
+  return "jay_gv_" + name_str(name) + "(%rip)";
+}
+
+bool is_memory(std::string const &operand) {
+  return operand.find('(') != std::string::npos;
+}
+
+/**
+ * @brief get the 64-bit name of a register
+ */
+std::string name64(std::string const &reg) {
+  if (reg == "%eax" || reg == "%ecx" || reg == "%edx" || reg == "%edi") {
+    return "%r" + reg.substr(2);
+  }
+  for (auto const &r : REGISTERS) {
+    if (reg == r.name) {
+      return r.name64;
+    }
+  }
+  return reg;
+}
+
+/**
+ * @brief get the low byte of %eax, %ecx, %edx or %edi
+ */
+std::string low_byte(std::string const &reg) {
+  if (reg == "%edi") {
+    return "%dil";
+  }
+  return "%" + reg.substr(2, 1) + "l";
+}
+
+/**
+ * @brief get the condition code that holds when `cc` doesn't
+ */
+std::string negate(std::string const &cc) {
+  if (cc == "e") {
+    return "ne";
+  } else if (cc == "ne") {
+    return "e";
+  } else if (cc == "l") {
+    return "ge";
+  } else if (cc == "le") {
+    return "g";
+  } else if (cc == "g") {
+    return "le";
+  }
+  return "l";
+}
+
+/**
+ * @brief get the condition code with the operands of the comparison swapped
+ */
+std::string mirror(std::string const &cc) {
+  if (cc == "l") {
+    return "g";
+  } else if (cc == "le") {
+    return "ge";
+  } else if (cc == "g") {
+    return "l";
+  } else if (cc == "ge") {
+    return "le";
+  }
+  return cc;
+}
+
+bool holds(std::string const &cc, std::int32_t left, std::int32_t right) {
+  if (cc == "e") {
+    return left == right;
+  } else if (cc == "ne") {
+    return left != right;
+  } else if (cc == "l") {
+    return left < right;
+  } else if (cc == "le") {
+    return left <= right;
+  } else if (cc == "g") {
+    return left > right;
+  }
+  return left >= right;
+}
+
+/**
+ * @brief write a string literal as the operand of `.ascii`
+ */
+std::string ascii(std::string const &text) {
+  std::string quoted = "\"";
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += static_cast<char>(c);
+    } else if (c >= 32 && c < 127) {
+      quoted += static_cast<char>(c);
+    } else {
+      char escape[8];
+      std::snprintf(escape, sizeof(escape), "\\%03o", c);
+      quoted += escape;
+    }
+  }
+  return quoted + "\"";
+}
+
+/**
+ * @brief live range of a parameter or local, in pre-order positions of the
+ * function body
+ */
+struct interval_t {
+  name_id_t name;
+  int start = -1;
+  int end = -1;
+  bool is_param = false;
+  // read before it's certainly assigned, so it's zeroed on entry
+  bool needs_zero = true;
+  // top-level statement the variable first appears in
+  int first_statement = -1;
+  // register, or -1 for a frame slot
+  int reg = -1;
+};
+
+/**
+ * @brief IntervalBuilder finds the live interval of every parameter and
+ * local of a function. A variable is live from its first to its last use,
+ * and over every loop it's used in, since its value may be carried to the
+ * next iteration. One that isn't first assigned by a top-level statement is
+ * live from the start of the function, because it reads as zero until then.
+ */
+class IntervalBuilder : public Visitor<IntervalBuilder> {
+public:
+  IntervalBuilder(std::vector<interval_t> &intervals,
+                  IdMap<std::int32_t> const &index)
+      : intervals(intervals), index(index) {}
+
+  std::vector<std::pair<int, int>> loops;
+  // an assignment is used as a value
+  bool nested_assignment = false;
+
+private:
+  std::vector<interval_t> &intervals;
+  IdMap<std::int32_t> const &index;
+  std::vector<ASTNode *> path;
+  std::vector<int> loop_starts;
+  int pos = 0;
+  int statement = -1;
+
+  friend class Visitor<IntervalBuilder>;
+
+  Visit enter(ASTNode *node) {
+    pos++;
+    if (path.size() == 1) {
+      statement = pos;
+    }
+    auto *parent = path.empty() ? nullptr : path.back();
+    path.push_back(node);
+
+    switch (node->type) {
+    case Node::variable_decl:
+      return Visit::skip_children;
+    case Node::while_statement:
+      loop_starts.push_back(pos);
+      break;
+    case Node::eq_op:
+      if (parent == nullptr || parent->type != Node::statement_expr) {
+        nested_assignment = true;
+      }
+      break;
+    case Node::id: {
+      auto *sym = node->symbol;
+      auto *i = sym != nullptr && !sym->is_global() ? index.find(sym->name)
+                                                     : nullptr;
+      if (i == nullptr) {
+        break;
+      }
+
+      auto &interval = intervals[*i];
+      if (interval.start < 0) {
+        interval.start = pos;
+        interval.first_statement = statement;
+        // `x = ...;` at the top level of the body
+        interval.needs_zero = !(path.size() == 4 &&
+                                parent->type == Node::eq_op &&
+                                parent->children[0] == node);
+      } else if (statement == interval.first_statement) {
+        // `x = x + 1;` reads x before assigning it
+        interval.needs_zero = true;
+      }
+      interval.end = pos;
+      break;
+    }
+    default:
+      break;
+    }
+    return Visit::next;
+  }
+
+  void leave(ASTNode *node) {
+    path.pop_back();
+    if (node->type == Node::while_statement) {
+      loops.push_back({loop_starts.back(), pos});
+      loop_starts.pop_back();
+    }
+  }
+};
+
+} // namespace
+
+/**
+ * @brief generate the assembly file and write it to the out stream
+ */
+void X86Generator::generate() {
+  effects = find_side_effects(ast.get());
+  for (auto *node : ast->children) {
+    if (node->type == Node::function_decl ||
+        node->type == Node::main_func_decl) {
+      functions.insert(node->find_first(Node::id)->function_symbol);
+    }
+  }
+
+  out << "\t.text\n";
+  visit(ast.get());
+
+  std::vector<Symbol *> globals;
+  for (auto const &[name, sym] :
+       sym_table->get_scope(sym_table->global_scope())) {
+    if (sym->kind == "variable") {
+      globals.push_back(sym);
+    }
+  }
+  std::sort(globals.begin(), globals.end(), [](Symbol *a, Symbol *b) {
+    return name_str(a->name) < name_str(b->name);
+  });
+  if (!globals.empty()) {
+    out << "\n\t.bss\n\t.align 4\n";
+    for (auto *sym : globals) {
+      // array elements are 4 bytes, booleans included
+      out << "jay_gv_" << name_str(sym->name) << ":\n\t.zero "
+          << 4 * std::uint64_t(sym->is_array() ? sym->length : 1) << "\n";
+    }
+  }
+
+  if (!strings.empty()) {
+    out << "\n\t.section .rodata\n";
+    for (std::size_t i = 0; i < strings.size(); i++) {
+      out << string_label(static_cast<std::int32_t>(i)) << ":\n\t.ascii "
+          << ascii(strings[i]) << "\n";
+    }
+  }
+
+  out << "\n\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+/**
+ * @brief pre-order step, opens functions and statements
+ */
+Visit X86Generator::enter(ASTNode *node) {
+  path.push_back(node);
+
+  switch (node->type) {
+  case Node::global_var_decl:
+  case Node::variable_decl:
+  case Node::formal_params:
+    return Visit::skip_children;
+  case Node::main_func_decl:
+  case Node::function_decl:
+    begin_function(node);
+    break;
+  case Node::function_call:
+    // the call clobbers %eax, and the arguments go on top of the stack
+    save_acc();
+    break;
+  case Node::if_statement:
+  case Node::if_else_statement: {
+    control_t control{node};
+    control.false_label = label();
+    control.end_label = label();
+    controls.push_back(control);
+    break;
+  }
+  case Node::while_statement: {
+    // the condition is moved below the body, so an iteration takes a single
+    // jump:
+    //   jmp cond; body: ...; cond: ...; jcc body; end:
+    control_t control{node};
+    control.false_label = label();
+    control.end_label = label();
+    control.body_label = label();
+    emit("jmp " + control.false_label);
+    control.cond_start = lines.size();
+    controls.push_back(control);
+    break;
+  }
+  default:
+    break;
+  }
+
+  return Visit::next;
+}
+
+/**
+ * @brief post-order step, emits the instructions of a node once its
+ * operands are generated
+ */
+void X86Generator::leave(ASTNode *node) {
+  path.pop_back();
+
+  switch (node->type) {
+  case Node::main_func_decl:
+  case Node::function_decl:
+    end_function(node);
+    break;
+  case Node::int_t:
+  case Node::boolean_t:
+    if (node->is_const()) {
+      push({operand_t::imm, node->type == Node::boolean_t
+                                ? node->value == "true"
+                                : std::stoi(node->value)});
+    }
+    break;
+  case Node::string: {
+    auto text = wasm::unescape(node->value);
+    auto iter = string_index.find(text);
+    if (iter == string_index.end()) {
+      iter = string_index
+                 .emplace(text, static_cast<std::int32_t>(strings.size()))
+                 .first;
+      strings.push_back(text);
+    }
+    push({operand_t::imm, iter->second});
+    break;
+  }
+  case Node::id: {
+    auto *parent = path.back();
+    // names of functions, arrays and targets of assignments aren't read
+    if (parent->type == Node::function_decl ||
+        parent->type == Node::main_func_decl ||
+        ((parent->type == Node::eq_op ||
+          parent->type == Node::function_call ||
+          parent->type == Node::index_op) &&
+         parent->children[0] == node)) {
+      break;
+    }
+
+    auto *sym = node->symbol;
+    if (sym->is_global() || eager_locals) {
+      // globals can change in a call made before the value is used
+      save_acc();
+      emit("movl " +
+           (sym->is_global() ? global_operand(sym->name)
+                             : locations[*location_index.find(sym->name)]) +
+           ", %eax");
+      push({operand_t::acc});
+    } else {
+      operand_t operand{operand_t::loc};
+      operand.where = locations[*location_index.find(sym->name)];
+      push(operand);
+    }
+    break;
+  }
+  case Node::index_op:
+    element(node);
+    break;
+  case Node::eq_op:
+    assign(node);
+    break;
+  case Node::sub_op:
+    if (node->children.size() == 1) {
+      auto value = pop_value();
+      save_acc();
+      load(value, "%eax");
+      emit("negl %eax");
+      push({operand_t::acc});
+      break;
+    }
+    arithmetic(node);
+    break;
+  case Node::bin_and_op:
+  case Node::bin_or_op:
+    if (effects.count(node->children[1]) != 0) {
+      // the left side is in %eax already, unless it was jumped over
+      load(pop_value(), "%eax");
+      place(short_circuits.back());
+      short_circuits.pop_back();
+      push({operand_t::acc});
+      break;
+    }
+    arithmetic(node);
+    break;
+  case Node::add_op:
+  case Node::mul_op:
+    arithmetic(node);
+    break;
+  case Node::div_op:
+  case Node::mod_op:
+    divide(node);
+    break;
+  case Node::eqeq_op:
+  case Node::noteq_op:
+  case Node::lt_op:
+  case Node::lteq_op:
+  case Node::gt_op:
+  case Node::gteq_op:
+    compare(node);
+    break;
+  case Node::not_op: {
+    auto value = pop();
+    if (value.kind == operand_t::cmp) {
+      value.cc = negate(value.cc);
+      push(value);
+    } else if (value.kind == operand_t::imm) {
+      push({operand_t::imm, value.value ^ 1});
+    } else {
+      save_acc();
+      load(value, "%eax");
+      emit("xorl $1, %eax");
+      push({operand_t::acc});
+    }
+    break;
+  }
+  case Node::function_call:
+    call(node);
+    break;
+  case Node::statement_expr:
+    if (!node->children.empty() && pop().kind == operand_t::stacked) {
+      emit("addq $8, %rsp");
+    }
+    break;
+  case Node::return_statement:
+    if (!node->children.empty()) {
+      load(pop(), "%eax");
+    }
+    emit("jmp " + return_label);
+    break;
+  case Node::break_statement:
+    for (auto control = controls.rbegin(); control != controls.rend();
+         ++control) {
+      if (control->node->type == Node::while_statement) {
+        emit("jmp " + control->end_label);
+        break;
+      }
+    }
+    break;
+  case Node::if_statement:
+    place(controls.back().false_label);
+    controls.pop_back();
+    break;
+  case Node::if_else_statement:
+    place(controls.back().end_label);
+    controls.pop_back();
+    break;
+  case Node::while_statement: {
+    auto control = std::move(controls.back());
+    controls.pop_back();
+
+    std::vector<std::string> cond(lines.begin() + control.cond_start,
+                                  lines.begin() + control.cond_end);
+    lines.erase(lines.begin() + control.cond_start,
+                lines.begin() + control.cond_end);
+    place(control.false_label);
+    lines.insert(lines.end(), cond.begin(), cond.end());
+    branch(control.cond, true, control.body_label);
+    place(control.end_label);
+    break;
+  }
+  default:
+    break;
+  }
+
+  if (!path.empty()) {
+    after_child(path.back(), node);
+  }
+}
+
+/**
+ * @brief a child of an if, while, call, && or || is generated, emit what
+ * follows it
+ */
+void X86Generator::after_child(ASTNode *parent, ASTNode *child) {
+  switch (parent->type) {
+  case Node::if_statement:
+  case Node::if_else_statement: {
+    auto &control = controls.back();
+    if (child == parent->children[0]) {
+      branch(pop(), false, control.false_label);
+    } else if (parent->type == Node::if_else_statement &&
+               child == parent->children[1]) {
+      emit("jmp " + control.end_label);
+      place(control.false_label);
+    }
+    break;
+  }
+  case Node::while_statement:
+    if (child == parent->children[0]) {
+      auto &control = controls.back();
+      control.cond = pop();
+      control.cond_end = lines.size();
+      place(control.body_label);
+    }
+    break;
+  case Node::bin_and_op:
+  case Node::bin_or_op:
+    // the right side isn't evaluated when the left one decides the result
+    if (child == parent->children[0] &&
+        effects.count(parent->children[1]) != 0) {
+      auto left = pop_value();
+      save_acc();
+      load(left, "%eax");
+      short_circuits.push_back(label());
+      emit("testl %eax, %eax");
+      emit(std::string(parent->type == Node::bin_and_op ? "je " : "jne ") +
+           short_circuits.back());
+    }
+    break;
+  case Node::actual_params: {
+    auto *call = path[path.size() - 2];
+    if (functions.count(call->children[0]->function_symbol) == 0) {
+      // builtins take their argument in %edi
+      break;
+    }
+
+    // arguments of a call are pushed as soon as they are computed
+    auto arg = pop();
+    switch (arg.kind) {
+    case operand_t::imm:
+      emit("pushq $" + std::to_string(arg.value));
+      break;
+    case operand_t::loc:
+      if (is_memory(arg.where)) {
+        emit("movl " + arg.where + ", %eax");
+        emit("pushq %rax");
+      } else {
+        emit("pushq " + name64(arg.where));
+      }
+      break;
+    case operand_t::stacked:
+      // already where it should be
+      break;
+    default:
+      load(arg, "%eax");
+      emit("pushq %rax");
+      break;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void X86Generator::begin_function(ASTNode *node) {
+  lines.clear();
+  cold.clear();
+  operands.clear();
+  return_label = label();
+
+  auto *id = node->find_first(Node::id);
+  if (node->type == Node::main_func_decl) {
+    lines.push_back("\t.globl jay_main");
+    lines.push_back("jay_main:");
+  }
+  lines.push_back(function_label(id->name) + ":");
+
+  allocate(node);
+}
+
+void X86Generator::end_function(ASTNode *node) {
+  auto *fun_sym = node->find_first(Node::id)->function_symbol;
+
+  if (!lines.empty() && lines.back() == "\tjmp " + return_label) {
+    lines.pop_back();
+  } else if (node->type != Node::main_func_decl &&
+             fun_sym->type != Node::void_t) {
+    // fell off the end of a function that returns a value
+    emit("call jay_unreachable");
+  }
+
+  place(return_label);
+  if (saved_registers.empty()) {
+    emit("leave");
+  } else {
+    if (frame_size > 0) {
+      emit("leaq -" + std::to_string(8 * saved_registers.size()) +
+           "(%rbp), %rsp");
+    }
+    for (auto reg = saved_registers.rbegin(); reg != saved_registers.rend();
+         ++reg) {
+      emit("popq " + *reg);
+    }
+    emit("popq %rbp");
+  }
+  emit("ret");
+  lines.insert(lines.end(), cold.begin(), cold.end());
+
+  out << "\n";
+  for (auto const &line : lines) {
+    out << line << "\n";
+  }
+}
+
+/**
+ * @brief assign a register or a frame slot to every parameter and local
+ * of a function, with a linear scan over their live intervals
+ */
+void X86Generator::allocate(ASTNode *node) {
+  auto *id = node->find_first(Node::id);
+  auto &formals = node->find_first(Node::formal_params)->children;
+
+  std::vector<interval_t> intervals;
+  IdMap<std::int32_t> index;
+  for (auto *formal : formals) {
+    interval_t interval;
+    interval.name = formal->children[1]->name;
+    interval.is_param = true;
+    index.insert(interval.name, static_cast<std::int32_t>(intervals.size()));
+    intervals.push_back(interval);
+  }
+  std::vector<Symbol *> arrays;
+  for (auto const &[name, sym] : sym_table->get_scope(id->name)) {
+    if (sym->kind == "variable" && sym->is_array()) {
+      arrays.push_back(sym);
+    } else if (sym->kind == "variable") {
+      interval_t interval;
+      interval.name = name;
+      index.insert(name, static_cast<std::int32_t>(intervals.size()));
+      intervals.push_back(interval);
+    }
+  }
+
+  IntervalBuilder builder(intervals, index);
+  builder.visit(node->find_first(Node::block));
+  eager_locals = builder.nested_assignment;
+
+  std::vector<interval_t *> live;
+  for (auto &interval : intervals) {
+    if (interval.start < 0) {
+      // never used
+      continue;
+    }
+    if (interval.is_param || interval.needs_zero) {
+      interval.start = 0;
+    }
+    live.push_back(&interval);
+  }
+
+  // a variable used in a loop lives through all of it
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto [start, end] : builder.loops) {
+      for (auto *interval : live) {
+        if (interval->start <= end && interval->end >= start &&
+            (interval->start > start || interval->end < end)) {
+          interval->start = std::min(interval->start, start);
+          interval->end = std::max(interval->end, end);
+          changed = true;
+        }
+      }
+    }
+  }
+
+  std::stable_sort(live.begin(), live.end(),
+                   [](interval_t *a, interval_t *b) {
+                     return a->start < b->start;
+                   });
+
+  std::vector<interval_t *> active;
+  std::vector<int> free_registers;
+  for (int reg = REGISTER_COUNT - 1; reg >= 0; reg--) {
+    free_registers.push_back(reg);
+  }
+  for (auto *interval : live) {
+    // expire the intervals that ended before this one starts
+    for (auto i = active.begin(); i != active.end();) {
+      if ((*i)->end < interval->start) {
+        free_registers.push_back((*i)->reg);
+        i = active.erase(i);
+      } else {
+        ++i;
+      }
+    }
+
+    if (!free_registers.empty()) {
+      interval->reg = free_registers.back();
+      free_registers.pop_back();
+      active.push_back(interval);
+      continue;
+    }
+
+    // spill whichever lives longest
+    auto longest = std::max_element(
+        active.begin(), active.end(),
+        [](interval_t *a, interval_t *b) { return a->end < b->end; });
+    if ((*longest)->end > interval->end) {
+      interval->reg = (*longest)->reg;
+      (*longest)->reg = -1;
+      *longest = interval;
+    }
+  }
+
+  // registers used by the function are saved in order, so the frame layout
+  // doesn't depend on which intervals got which
+  bool used[REGISTER_COUNT] = {};
+  for (auto *interval : live) {
+    if (interval->reg >= 0) {
+      used[interval->reg] = true;
+    }
+  }
+  saved_registers.clear();
+  for (int reg = 0; reg < REGISTER_COUNT; reg++) {
+    if (used[reg]) {
+      saved_registers.push_back(REGISTERS[reg].name64);
+    }
+  }
+
+  location_index = IdMap<std::int32_t>();
+  locations.clear();
+  std::vector<std::string> init;
+  int slots = 0;
+  int params = static_cast<int>(formals.size());
+  for (int i = 0; i < static_cast<int>(intervals.size()); i++) {
+    auto const &interval = intervals[i];
+    if (interval.start < 0) {
+      continue;
+    }
+
+    // arguments are pushed left to right, above the return address
+    std::string arg = std::to_string(16 + 8 * (params - 1 - i)) + "(%rbp)";
+    std::string where;
+    if (interval.reg >= 0) {
+      where = REGISTERS[interval.reg].name;
+      if (interval.is_param) {
+        init.push_back("movl " + arg + ", " + where);
+      } else if (interval.needs_zero) {
+        init.push_back("xorl " + where + ", " + where);
+      }
+    } else if (interval.is_param) {
+      where = arg;
+    } else {
+      slots++;
+      where = "-" +
+              std::to_string(8 * saved_registers.size() + 4 * slots) +
+              "(%rbp)";
+      if (interval.needs_zero) {
+        init.push_back("movl $0, " + where);
+      }
+    }
+    location_index.insert(interval.name,
+                          static_cast<std::int32_t>(locations.size()));
+    locations.push_back(where);
+  }
+
+  // arrays go below the variables, and are zeroed on every call
+  std::sort(arrays.begin(), arrays.end(), [](Symbol *a, Symbol *b) {
+    return name_str(a->name) < name_str(b->name);
+  });
+  array_location = IdMap<std::int64_t>();
+  std::int64_t array_words = 0;
+  for (auto *sym : arrays) {
+    array_words += sym->length;
+    array_location.insert(sym->name,
+                          -(8 * std::int64_t(saved_registers.size()) +
+                            4 * (slots + array_words)));
+  }
+  if (array_words != 0) {
+    init.push_back("leaq " +
+                   std::to_string(-(8 * std::int64_t(saved_registers.size()) +
+                                    4 * (slots + array_words))) +
+                   "(%rbp), %rdi");
+    init.push_back("movl $" + std::to_string(array_words) + ", %ecx");
+    init.push_back("xorl %eax, %eax");
+    init.push_back("rep stosl");
+  }
+  frame_size = (4 * (slots + array_words) + 7) / 8 * 8;
+
+  emit("pushq %rbp");
+  emit("movq %rsp, %rbp");
+  for (auto const &reg : saved_registers) {
+    emit("pushq " + reg);
+  }
+  if (frame_size > 0) {
+    emit("subq $" + std::to_string(frame_size) + ", %rsp");
+  }
+  for (auto const &line : init) {
+    emit(line);
+  }
+}
+
+void X86Generator::call(ASTNode *node) {
+  static const name_id_t getchar_name = intern("getchar");
+  static const name_id_t halt_name = intern("halt");
+  static const name_id_t printb_name = intern("printb");
+  static const name_id_t printc_name = intern("printc");
+  static const name_id_t prints_name = intern("prints");
+
+  auto *fun_sym = node->children[0]->function_symbol;
+  if (functions.count(fun_sym) != 0) {
+    auto *actuals = node->find_first(Node::actual_params);
+    std::size_t count = actuals != nullptr ? actuals->children.size() : 0;
+
+    emit("call " + function_label(fun_sym->name));
+    if (count > 0) {
+      emit("addq $" + std::to_string(8 * count) + ", %rsp");
+    }
+    push(fun_sym->type == Node::void_t ? operand_t{operand_t::imm}
+                                       : operand_t{operand_t::acc});
+    return;
+  }
+
+  if (fun_sym->name == getchar_name) {
+    emit("call jay_getchar");
+    push({operand_t::acc});
+    return;
+  }
+
+  if (fun_sym->name == halt_name) {
+    emit("call jay_halt");
+  } else if (fun_sym->name == prints_name) {
+    auto index = pop().value;
+    emit("leaq " + string_label(index) + "(%rip), %rdi");
+    emit("movl $" + std::to_string(strings[index].size()) + ", %esi");
+    emit("call jay_prints");
+  } else {
+    load(pop(), "%edi");
+    emit(std::string("call ") +
+         (fun_sym->name == printb_name   ? "jay_printb"
+          : fun_sym->name == printc_name ? "jay_printc"
+                                         : "jay_printi"));
+  }
+  push({operand_t::imm});
+}
+
+void X86Generator::arithmetic(ASTNode *node) {
+  auto right = pop_value();
+  auto left = pop_value();
+
+  std::string source;
+  switch (right.kind) {
+  case operand_t::imm:
+    source = "$" + std::to_string(right.value);
+    break;
+  case operand_t::loc:
+    source = right.where;
+    break;
+  case operand_t::acc:
+    emit("movl %eax, %ecx");
+    source = "%ecx";
+    break;
+  default:
+    emit("popq %rcx");
+    source = "%ecx";
+    break;
+  }
+
+  save_acc();
+  load(left, "%eax");
+
+  switch (node->type) {
+  case Node::add_op:
+    emit("addl " + source + ", %eax");
+    break;
+  case Node::sub_op:
+    emit("subl " + source + ", %eax");
+    break;
+  case Node::mul_op:
+    emit("imull " + source + ", %eax");
+    break;
+  case Node::bin_and_op:
+    emit("andl " + source + ", %eax");
+    break;
+  default:
+    emit("orl " + source + ", %eax");
+    break;
+  }
+  push({operand_t::acc});
+}
+
+void X86Generator::divide(ASTNode *node) {
+  bool is_mod = node->type == Node::mod_op;
+  auto right = pop_value();
+  auto left = pop_value();
+
+  if (right.kind == operand_t::imm) {
+    save_acc();
+    load(left, "%eax");
+    if (right.value == 0) {
+      emit("call jay_div_zero");
+    } else if (right.value == -1) {
+      // idiv faults on INT_MIN / -1
+      emit(is_mod ? "xorl %eax, %eax" : "negl %eax");
+      if (!is_mod) {
+        emit("jo jay_overflow");
+      }
+    } else {
+      emit("movl $" + std::to_string(right.value) + ", %ecx");
+      emit("cltd");
+      emit("idivl %ecx");
+      if (is_mod) {
+        emit("movl %edx, %eax");
+      }
+    }
+    push({operand_t::acc});
+    return;
+  }
+
+  std::string divisor;
+  switch (right.kind) {
+  case operand_t::loc:
+    divisor = right.where;
+    break;
+  case operand_t::acc:
+    emit("movl %eax, %ecx");
+    divisor = "%ecx";
+    break;
+  default:
+    emit("popq %rcx");
+    divisor = "%ecx";
+    break;
+  }
+
+  save_acc();
+  load(left, "%eax");
+  if (is_memory(divisor)) {
+    emit("cmpl $0, " + divisor);
+  } else {
+    emit("testl " + divisor + ", " + divisor);
+  }
+  emit("je jay_div_zero");
+
+  // idiv faults on INT_MIN / -1, dividing by -1 is handled out of line
+  auto minus_one = label();
+  auto done = label();
+  emit("cmpl $-1, " + divisor);
+  emit("je " + minus_one);
+  emit("cltd");
+  emit("idivl " + divisor);
+  if (is_mod) {
+    emit("movl %edx, %eax");
+  }
+  place(done);
+
+  cold.push_back(minus_one + ":");
+  if (is_mod) {
+    cold.push_back("\txorl %eax, %eax");
+  } else {
+    cold.push_back("\tnegl %eax");
+    cold.push_back("\tjo jay_overflow");
+  }
+  cold.push_back("\tjmp " + done);
+
+  push({operand_t::acc});
+}
+
+void X86Generator::compare(ASTNode *node) {
+  auto right = pop_value();
+  auto left = pop_value();
+
+  std::string cc = "e";
+  switch (node->type) {
+  case Node::noteq_op:
+    cc = "ne";
+    break;
+  case Node::lt_op:
+    cc = "l";
+    break;
+  case Node::lteq_op:
+    cc = "le";
+    break;
+  case Node::gt_op:
+    cc = "g";
+    break;
+  case Node::gteq_op:
+    cc = "ge";
+    break;
+  default:
+    break;
+  }
+
+  if (left.kind == operand_t::imm && right.kind == operand_t::imm) {
+    push({operand_t::imm, holds(cc, left.value, right.value)});
+    return;
+  }
+  if (left.kind == operand_t::imm) {
+    std::swap(left, right);
+    cc = mirror(cc);
+  }
+
+  // the comparison is emitted once it's known if it's a value or a jump
+  operand_t result{operand_t::cmp};
+  result.cc = cc;
+  switch (right.kind) {
+  case operand_t::imm:
+    result.right = "$" + std::to_string(right.value);
+    break;
+  case operand_t::loc:
+    result.right = right.where;
+    break;
+  case operand_t::acc:
+    if (left.kind == operand_t::stacked) {
+      emit("movl %eax, %ecx");
+      result.right = "%ecx";
+    } else {
+      result.right = "%eax";
+    }
+    break;
+  default:
+    emit("popq %rcx");
+    result.right = "%ecx";
+    break;
+  }
+
+  switch (left.kind) {
+  case operand_t::loc:
+    if (is_memory(left.where) && is_memory(result.right)) {
+      save_acc();
+      load(left, "%eax");
+      result.where = "%eax";
+    } else {
+      result.where = left.where;
+    }
+    break;
+  case operand_t::stacked:
+    emit("popq %rax");
+    result.where = "%eax";
+    break;
+  default:
+    result.where = "%eax";
+    break;
+  }
+  push(result);
+}
+
+/**
+ * @brief check the index of an element access, and load the element unless
+ * it is assigned to
+ */
+void X86Generator::element(ASTNode *node) {
+  auto *sym = node->children[0]->symbol;
+  auto index = pop_value();
+  bool is_target = path.back()->type == Node::eq_op &&
+                   path.back()->children[0] == node;
+
+  if (index.kind == operand_t::imm && index.value >= 0 &&
+      static_cast<std::uint32_t>(index.value) < sym->length) {
+    // a constant index that is in bounds doesn't need a check
+    if (is_target) {
+      push(index);
+    } else if (sym->is_global()) {
+      // the element can change in a call made before the value is used
+      save_acc();
+      emit("movl " + element_operand(sym, index.value, "") + ", %eax");
+      push({operand_t::acc});
+    } else {
+      operand_t operand{operand_t::loc};
+      operand.where = element_operand(sym, index.value, "");
+      push(operand);
+    }
+    return;
+  }
+
+  save_acc();
+  load(index, "%eax");
+  // a negative index is a large unsigned one
+  emit("cmpl $" + std::to_string(sym->length) + ", %eax");
+  emit("jae jay_out_of_bounds");
+  if (is_target) {
+    push({operand_t::acc});
+    return;
+  }
+
+  if (sym->is_global()) {
+    emit("leaq " + global_operand(sym->name) + ", %rcx");
+  }
+  emit("movl " + element_operand(sym, 0, "%rax") + ", %eax");
+  push({operand_t::acc});
+}
+
+/**
+ * @brief memory operand of an array element
+ *
+ * @param sym array
+ * @param index constant index, added to the one in `index_reg`
+ * @param index_reg 64-bit register with the index, or empty. the address of
+ * a global array has to be in %rcx then
+ */
+std::string X86Generator::element_operand(Symbol *sym, std::int32_t index,
+                                          std::string const &index_reg) const {
+  if (sym->is_global()) {
+    if (index_reg.empty()) {
+      return "jay_gv_" + name_str(sym->name) + "+" +
+             std::to_string(4 * std::int64_t(index)) + "(%rip)";
+    }
+    return "(%rcx," + index_reg + ",4)";
+  }
+
+  auto offset = std::to_string(*array_location.find(sym->name) +
+                               4 * std::int64_t(index));
+  if (index_reg.empty()) {
+    return offset + "(%rbp)";
+  }
+  return offset + "(%rbp," + index_reg + ",4)";
+}
+
+/**
+ * @brief store the value of an assignment to an array element, the index
+ * was checked before the value was computed
+ */
+void X86Generator::store_element(ASTNode *node) {
+  auto *sym = node->children[0]->children[0]->symbol;
+  auto value = pop_value();
+  auto index = pop();
+
+  std::string source;
+  if (value.kind == operand_t::imm) {
+    source = "$" + std::to_string(value.value);
+  } else if (value.kind == operand_t::loc && !is_memory(value.where)) {
+    source = value.where;
+  } else {
+    // the value is above the index if both are on the machine stack
+    load(value, "%edx");
+    source = "%edx";
+  }
+
+  if (index.kind == operand_t::imm) {
+    emit("movl " + source + ", " + element_operand(sym, index.value, ""));
+  } else {
+    load(index, "%eax");
+    if (sym->is_global()) {
+      emit("leaq " + global_operand(sym->name) + ", %rcx");
+    }
+    emit("movl " + source + ", " + element_operand(sym, 0, "%rax"));
+  }
+  push({operand_t::imm});
+}
+
+void X86Generator::assign(ASTNode *node) {
+  if (node->children[0]->type == Node::index_op) {
+    store_element(node);
+    return;
+  }
+
+  auto value = pop_value();
+  auto *sym = node->children[0]->symbol;
+  auto target = sym->is_global() ? global_operand(sym->name)
+                                 : locations[*location_index.find(sym->name)];
+  bool is_statement = path.back()->type == Node::statement_expr;
+
+  switch (value.kind) {
+  case operand_t::imm:
+    emit("movl $" + std::to_string(value.value) + ", " + target);
+    break;
+  case operand_t::loc:
+    if (is_memory(value.where) && is_memory(target)) {
+      save_acc();
+      load(value, "%eax");
+      value = {operand_t::acc};
+      emit("movl %eax, " + target);
+    } else if (value.where != target) {
+      emit("movl " + value.where + ", " + target);
+    }
+    break;
+  case operand_t::acc: {
+    // `x = x + k` computes x in place
+    static const char *const in_place[] = {"addl ", "subl ", "andl ",
+                                           "orl ", "imull "};
+    if (is_statement && lines.size() >= 2 &&
+        lines[lines.size() - 2] == "\tmovl " + target + ", %eax") {
+      auto &last = lines.back();
+      for (auto const *op : in_place) {
+        auto prefix = "\t" + std::string(op);
+        auto suffix = std::string(", %eax");
+        if (last.rfind(prefix, 0) != 0 ||
+            last.compare(last.size() - suffix.size(), suffix.size(),
+                         suffix) != 0) {
+          continue;
+        }
+
+        auto source = last.substr(prefix.size(), last.size() - prefix.size() -
+                                                     suffix.size());
+        bool imul = std::string(op) == "imull ";
+        if (source != "%eax" && source != "%ecx" &&
+            !(is_memory(target) && (imul || is_memory(source)))) {
+          lines.pop_back();
+          lines.back() = prefix + source + ", " + target;
+          push({operand_t::imm});
+          return;
+        }
+      }
+    }
+    emit("movl %eax, " + target);
+    break;
+  }
+  default:
+    emit("popq %rax");
+    value = {operand_t::acc};
+    emit("movl %eax, " + target);
+    break;
+  }
+
+  if (is_statement) {
+    push({operand_t::imm});
+  } else if (value.kind == operand_t::acc) {
+    push(value);
+  } else {
+    save_acc();
+    emit("movl " + target + ", %eax");
+    push({operand_t::acc});
+  }
+}
+
+void X86Generator::emit(std::string line) {
+  // a value stored to a variable is still in %eax
+  if (!lines.empty() && line.rfind("movl ", 0) == 0 &&
+      line.size() > 11 && line.compare(line.size() - 6, 6, ", %eax") == 0 &&
+      lines.back() == "\tmovl %eax, " + line.substr(5, line.size() - 11)) {
+    return;
+  }
+  lines.push_back("\t" + line);
+}
+
+std::string X86Generator::label() {
+  return ".L" + std::to_string(next_label++);
+}
+
+void X86Generator::place(std::string const &label) {
+  lines.push_back(label + ":");
+}
+
+void X86Generator::push(operand_t operand) { operands.push_back(operand); }
+
+X86Generator::operand_t X86Generator::pop() {
+  auto operand = operands.back();
+  operands.pop_back();
+  return operand;
+}
+
+/**
+ * @brief pop an operand, computing a pending comparison into %eax
+ */
+X86Generator::operand_t X86Generator::pop_value() {
+  auto operand = pop();
+  if (operand.kind == operand_t::cmp) {
+    save_acc();
+    load(operand, "%eax");
+    operand = {operand_t::acc};
+  }
+  return operand;
+}
+
+/**
+ * @brief push whatever is in %eax on the machine stack, so %eax can be
+ * written. pending comparisons are computed and pushed as well, since they
+ * need %eax once they are used
+ */
+void X86Generator::save_acc() {
+  for (auto &operand : operands) {
+    if (operand.kind == operand_t::acc || operand.kind == operand_t::cmp) {
+      load(operand, "%eax");
+      emit("pushq %rax");
+      operand = {operand_t::stacked};
+    }
+  }
+}
+
+/**
+ * @brief get an operand into a register
+ *
+ * @param operand operand to load, not stacked unless it's on top of the
+ * machine stack
+ * @param reg 32-bit register to load it into
+ */
+void X86Generator::load(operand_t const &operand, std::string const &reg) {
+  switch (operand.kind) {
+  case operand_t::imm:
+    if (operand.value == 0) {
+      emit("xorl " + reg + ", " + reg);
+    } else {
+      emit("movl $" + std::to_string(operand.value) + ", " + reg);
+    }
+    break;
+  case operand_t::loc:
+    emit("movl " + operand.where + ", " + reg);
+    break;
+  case operand_t::acc:
+    if (reg != "%eax") {
+      emit("movl %eax, " + reg);
+    }
+    break;
+  case operand_t::stacked:
+    emit("popq " + name64(reg));
+    break;
+  case operand_t::cmp:
+    emit("cmpl " + operand.right + ", " + operand.where);
+    emit("set" + operand.cc + " " + low_byte(reg));
+    emit("movzbl " + low_byte(reg) + ", " + reg);
+    break;
+  }
+}
+
+/**
+ * @brief emit a jump to `target` taken when the truth of `cond` is `when`
+ */
+void X86Generator::branch(operand_t const &cond, bool when,
+                          std::string const &target) {
+  auto jump = std::string(when ? "jne " : "je ") + target;
+  switch (cond.kind) {
+  case operand_t::imm:
+    if ((cond.value != 0) == when) {
+      emit("jmp " + target);
+    }
+    break;
+  case operand_t::loc:
+    if (is_memory(cond.where)) {
+      emit("cmpl $0, " + cond.where);
+    } else {
+      emit("testl " + cond.where + ", " + cond.where);
+    }
+    emit(jump);
+    break;
+  case operand_t::cmp:
+    // compare and jump, without the value ever being computed
+    emit("cmpl " + cond.right + ", " + cond.where);
+    emit("j" + (when ? cond.cc : negate(cond.cc)) + " " + target);
+    break;
+  default:
+    load(cond, "%eax");
+    emit("testl %eax, %eax");
+    emit(jump);
+    break;
+  }
+}
+
+/**
+ * @brief assembler name of a string literal
+ */
+std::string X86Generator::string_label(std::int32_t index) const {
+  return ".LS" + std::to_string(index);
+}
@@ -1,12 +1,19 @@
 #ifndef AST_H
 #define AST_H
 
+#include "Interner.hpp"
+#include "NodeArena.hpp"
+#include "Traversal.hpp"
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
 
+class Symbol;
+class FunctionSymbol;
+
 namespace yy {
 
 /**
@@ -51,10 +58,15 @@ enum class Node {
   gteq_op,
   bin_and_op,
   bin_or_op,
+  // element of an array: the id of the array, then the index
+  index_op,
 
   int_t,
   boolean_t,
   void_t,
+  // type of an array declaration, the value is the length and the child is
+  // the type of the elements
+  array_t,
   number,
   string,
 };
@@ -73,8 +85,11 @@ public:
   std::string value;
   int linenum;
 
-  // ast children
-  std::vector<ASTNode *> children;
+  // ast children, allocated in the NodeArena that owns this node
+  NodeList children;
+
+  // interned identifier, set for Node::id
+  name_id_t name = NO_NAME;
 
   bool is_while_block = false;
   bool is_return_block = false;
@@ -83,12 +98,39 @@ public:
 
   bool can_generate_wasm_getter = false;
 
-  std::string function_name;
+  // function the identifier belongs to
+  name_id_t function_name = NO_NAME;
+
+  // symbol the identifier is bound to, resolved once by the semantic analyzer
+  Symbol *symbol = nullptr;
+  // function named by the id of a function call or declaration
+  FunctionSymbol *function_symbol = nullptr;
   Node expected_type;
 
+  // position of the node in the FlatAST it was flattened into
+  std::uint32_t index = 0;
+
+  /**
+   * @brief visit every node of the subtree depth-first. runs in constant
+   * thread stack space, see yy::walk
+   *
+   * @param pre callback called before the children of a node
+   * @param post callback called after the children of a node
+   */
   void traverse(std::function<void(ASTNode *n)> &pre,
                 std::function<void(ASTNode *n)> &post) {
-    _traverse(this, pre, post);
+    walk(
+        this,
+        [&pre](ASTNode *n) {
+          if (pre != nullptr) {
+            pre(n);
+          }
+        },
+        [&post](ASTNode *n) {
+          if (post != nullptr) {
+            post(n);
+          }
+        });
   }
 
   /**
@@ -133,7 +175,13 @@ public:
    */
   std::vector<ASTNode *> find_recursive(Node node_type) {
     auto res = std::vector<ASTNode *>();
-    _find_recursive(this, node_type, res);
+    // matches are collected once all children of a node are visited, so
+    // nodes deeper in the tree come first
+    walk(this, nullptr, [&res, node_type](ASTNode *node) {
+      std::copy_if(node->children.begin(), node->children.end(),
+                   std::back_inserter(res),
+                   [node_type](ASTNode *n) { return n->type == node_type; });
+    });
     return res;
   }
 
@@ -189,40 +237,41 @@ public:
    * @param depth value that specifies how deep down the tree should it go
    */
   void print_ast_node(std::ostream &os, const ASTNode &node, int depth) const {
-    for (int i = 0; i < depth; i++) {
-      os << "."
-         << "  ";
-    }
+    auto pre = [&](const ASTNode *n) {
+      for (int i = 0; i < depth; i++) {
+        os << "."
+           << "  ";
+      }
+      depth++;
 
-    os << node.type_to_str();
-    os << " { ";
+      os << n->type_to_str();
+      os << " { ";
 
-    if (node.has_value()) {
-      os << "value: '" << node.value << "'";
-    }
+      if (n->has_value()) {
+        os << "value: '" << n->value << "'";
+      }
 
-    if (node.type == Node::block) {
-      os << std::boolalpha << "is_while_block: " << node.is_while_block
-         << " is_return_block: " << node.is_return_block;
-    }
+      if (n->type == Node::block) {
+        os << std::boolalpha << "is_while_block: " << n->is_while_block
+           << " is_return_block: " << n->is_return_block;
+      }
 
-    if (node.is_num_expr()) {
-      os << " expected_type: " << type_to_str(expected_type);
-    }
+      if (n->is_num_expr()) {
+        os << " expected_type: " << type_to_str(expected_type);
+      }
 
-    if (node.type == Node::id) {
-      os << " function_name: " << node.function_name;
-    }
+      if (n->type == Node::id) {
+        os << " function_name: " << name_str(n->function_name);
+      }
 
-    if (node.linenum != 0) {
-      os << " line: " << node.linenum;
-    }
+      if (n->linenum != 0) {
+        os << " line: " << n->linenum;
+      }
 
-    os << " }" << std::endl;
+      os << " }" << std::endl;
+    };
 
-    for (auto *n : node.children) {
-      print_ast_node(os, *n, depth + 1);
-    }
+    walk(&node, pre, [&depth](const ASTNode *) { depth--; });
   }
 
   friend std::ostream &operator<<(std::ostream &os, const yy::ASTNode &node) {
@@ -231,40 +280,6 @@ public:
   }
 
 private:
-  /**
-   * @brief helper method for recursive node finder. starts searching from given
-   * node and writes results to specified vector
-   *
-   * @param node node to start search from
-   * @param node_type desired node type
-   * @param res resulting vector with all found nodes
-   */
-  void _find_recursive(ASTNode *node, Node node_type,
-                       std::vector<ASTNode *> &res) {
-    for (auto *next : node->children) {
-      _find_recursive(next, node_type, res);
-    }
-
-    std::copy_if(node->children.begin(), node->children.end(),
-                 std::back_inserter(res),
-                 [&node_type](ASTNode *n) { return n->type == node_type; });
-  }
-
-  void _traverse(ASTNode *node, std::function<void(ASTNode *n)> &pre,
-                 std::function<void(ASTNode *n)> &post) {
-    if (pre != nullptr) {
-      pre(node);
-    }
-
-    for (auto *next : node->children) {
-      _traverse(next, pre, post);
-    }
-
-    if (post != nullptr) {
-      post(node);
-    }
-  }
-
   std::string type_to_str(Node type) const {
     switch (type) {
     case Node::program:
@@ -335,6 +350,8 @@ private:
       return "&&";
     case Node::bin_or_op:
       return "||";
+    case Node::index_op:
+      return "[]";
     case Node::int_t:
       return "int";
     case Node::number:
@@ -345,6 +362,8 @@ private:
       return "boolean";
     case Node::void_t:
       return "void";
+    case Node::array_t:
+      return "array";
     default:
       return "";
     }
@@ -423,6 +442,8 @@ inline std::string get_str_for_type(yy::Node type) {
     return "&&";
   case yy::Node::bin_or_op:
     return "||";
+  case yy::Node::index_op:
+    return "[]";
   case yy::Node::int_t:
     return "int";
   case yy::Node::number:
@@ -433,6 +454,8 @@ inline std::string get_str_for_type(yy::Node type) {
     return "boolean";
   case yy::Node::void_t:
     return "void";
+  case yy::Node::array_t:
+    return "array";
   default:
     return "";
   }
@@ -0,0 +1,135 @@
+/**
+ * @file Bytecode.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Register bytecode that the VM executes
+ */
+
+#ifndef BYTECODE_HPP
+#define BYTECODE_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// name and operands of every instruction, for the disassembler. operands are
+// `r` register, `i` immediate, `g` global, `f` function, `s` string and `t`
+// jump target, stored in `a`, `b` and `c` in that order. `a` only ever holds
+// a register. `_` marks an unused field. `getgx`/`setgx` and `getx`/`setx`
+// access the element of an array at register `c`, starting at global or
+// register `b`, once `bound` checked the index
+#define BYTECODE_OPS(X)                                                        \
+  X(mov, "rr")                                                                 \
+  X(movi, "ri")                                                                \
+  X(getg, "rg")                                                                \
+  X(setg, "rg")                                                                \
+  X(getgx, "rgr")                                                              \
+  X(setgx, "rgr")                                                              \
+  X(getx, "rrr")                                                               \
+  X(setx, "rrr")                                                               \
+  X(bound, "ri")                                                               \
+  X(add, "rrr")                                                                \
+  X(addi, "rri")                                                               \
+  X(sub, "rrr")                                                                \
+  X(mul, "rrr")                                                                \
+  X(div, "rrr")                                                                \
+  X(mod, "rrr")                                                                \
+  X(neg, "rr")                                                                 \
+  X(not_, "rr")                                                                \
+  X(and_, "rrr")                                                               \
+  X(or_, "rrr")                                                                \
+  X(eq, "rrr")                                                                 \
+  X(ne, "rrr")                                                                 \
+  X(lt, "rrr")                                                                 \
+  X(le, "rrr")                                                                 \
+  X(gt, "rrr")                                                                 \
+  X(ge, "rrr")                                                                 \
+  X(jmp, "_t")                                                                 \
+  X(jz, "rt")                                                                  \
+  X(jnz, "rt")                                                                 \
+  X(jeq, "rrt")                                                                \
+  X(jne, "rrt")                                                                \
+  X(jlt, "rrt")                                                                \
+  X(jle, "rrt")                                                                \
+  X(jgt, "rrt")                                                                \
+  X(jge, "rrt")                                                                \
+  X(jeqi, "rit")                                                               \
+  X(jnei, "rit")                                                               \
+  X(jlti, "rit")                                                               \
+  X(jlei, "rit")                                                               \
+  X(jgti, "rit")                                                               \
+  X(jgei, "rit")                                                               \
+  X(call, "rf")                                                                \
+  X(ret, "r")                                                                  \
+  X(reti, "_i")                                                                \
+  X(ret0, "")                                                                  \
+  X(printi, "r")                                                               \
+  X(printc, "r")                                                               \
+  X(printb, "r")                                                               \
+  X(prints, "_s")                                                              \
+  X(getchar, "r")                                                              \
+  X(halt, "")                                                                  \
+  X(trap, "")
+
+enum class Op : std::uint16_t {
+#define BYTECODE_OP_ENUM(name, operands) name,
+  BYTECODE_OPS(BYTECODE_OP_ENUM)
+#undef BYTECODE_OP_ENUM
+};
+
+/**
+ * @brief get the mnemonic of an instruction
+ */
+const char *op_name(Op op);
+
+/**
+ * @brief fixed-width instruction. `a` is the register the instruction
+ * writes, or its first register operand; `b` and `c` are registers,
+ * immediates or indices, as listed in BYTECODE_OPS
+ */
+struct instr_t {
+  Op op;
+  std::uint16_t a;
+  std::int32_t b;
+  std::int32_t c;
+};
+
+struct function_t {
+  std::string name;
+  std::uint32_t params = 0;
+  // locals besides the parameters, and the elements of local arrays, zeroed
+  // on every call
+  std::uint32_t locals = 0;
+  // registers of a frame: parameters, locals and temporaries
+  std::uint32_t registers = 0;
+  std::uint32_t entry = 0;
+};
+
+/**
+ * @brief Program is a compiled J-- program. the code of every function is
+ * in one array, calls and jumps refer to it by index
+ */
+struct Program {
+  std::vector<instr_t> code;
+  std::vector<function_t> functions;
+  // string literals, escapes already decoded
+  std::vector<std::string> strings;
+  // global variables and the elements of global arrays
+  std::uint32_t globals = 0;
+  // function the program starts with
+  std::uint32_t main = 0;
+};
+
+/**
+ * @brief write a readable listing of a program
+ *
+ * @param program program to list
+ * @param os output stream
+ */
+void disassemble(Program const &program, std::ostream &os);
+
+} // namespace vm
+
+#endif /* BYTECODE_HPP */
@@ -0,0 +1,206 @@
+/**
+ * @file BytecodeCompiler.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Lower a checked J-- AST to register bytecode for the VM
+ */
+
+#ifndef BYTECODE_COMPILER_HPP
+#define BYTECODE_COMPILER_HPP
+
+#include "ASTNode.hpp"
+#include "Bytecode.hpp"
+#include "IdMap.hpp"
+#include "SymTable.hpp"
+#include "Visitor.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace yy;
+
+/**
+ * @brief BytecodeCompiler lowers the AST to register bytecode in one
+ * traversal. Parameters and locals of a function get the first registers of
+ * its frame, temporaries are allocated above them as a stack, one register
+ * per pending operand. Operands that are locals or constants are used in
+ * place, so `x = x + 1` becomes a single `addi`, and comparisons are kept
+ * pending until it's known whether their value or a jump on them is needed,
+ * which fuses them with the branch of an `if` or `while`.
+ *
+ * Global arrays are consecutive globals, local arrays consecutive registers
+ * after the locals. The temporaries are above them: a callee's frame starts
+ * at the arguments, so anything after those would be overwritten.
+ */
+class BytecodeCompiler : public Visitor<BytecodeCompiler> {
+public:
+  BytecodeCompiler(std::shared_ptr<ASTNode> ast,
+                   std::shared_ptr<SymTable> sym_table)
+      : ast(ast), sym_table(sym_table) {}
+
+  /**
+   * @brief compile the program
+   *
+   * @return vm::Program compiled program
+   * @throws std::runtime_error if a function needs more registers than an
+   * instruction can address
+   */
+  vm::Program compile();
+
+private:
+  /**
+   * @brief where the value of an expression is
+   */
+  struct operand_t {
+    enum Kind { reg, imm, cmp } kind;
+    // register, constant, or the left register of a comparison
+    std::int32_t value;
+    // comparison that hasn't been emitted yet (vm::Op::eq ... vm::Op::ge)
+    vm::Op op = vm::Op::eq;
+    // right operand of a comparison, a register or a constant
+    std::int32_t right = 0;
+    bool right_imm = false;
+  };
+
+  /**
+   * @brief if or while statement being compiled
+   */
+  struct control_t {
+    ASTNode *node;
+    // while: the condition and the first instruction of the loop body
+    std::uint32_t cond_start = 0;
+    std::uint32_t cond_end = 0;
+    std::uint32_t body_start = 0;
+    operand_t cond{operand_t::imm, 1};
+    // jumps taken when the condition is false
+    std::vector<std::uint32_t> false_jumps;
+    // jumps to the end of the statement, breaks of a while
+    std::vector<std::uint32_t> exits;
+  };
+
+  std::shared_ptr<ASTNode> ast;
+  std::shared_ptr<SymTable> sym_table;
+  vm::Program program;
+
+  std::unordered_map<FunctionSymbol *, std::uint32_t> function_index;
+  IdMap<std::int32_t> global_index;
+  std::unordered_map<std::string, std::int32_t> string_index;
+
+  // nodes from the root to the one being visited
+  std::vector<ASTNode *> path;
+  std::vector<control_t> controls;
+  // expressions that call, assign or may trap, && and || jump over them
+  std::unordered_set<ASTNode *> effects;
+  // jumps over the right side of every && and || being compiled
+  std::vector<std::vector<std::uint32_t>> short_circuits;
+
+  // state of the function being compiled
+  IdMap<std::int32_t> local_register;
+  // first register of every local array
+  IdMap<std::int32_t> array_register;
+  std::int32_t frame_base = 0;
+  std::int32_t max_register = 0;
+  std::vector<operand_t> operands;
+  // last position that is the target of a jump, control may arrive there
+  // from somewhere else than the instruction before it
+  std::uint32_t label = UINT32_MAX;
+
+  friend class Visitor<BytecodeCompiler>;
+
+  /**
+   * @brief pre-order step, opens functions and statements
+   */
+  Visit enter(ASTNode *node);
+
+  /**
+   * @brief post-order step, emits the instructions of a node once its
+   * operands are compiled
+   */
+  void leave(ASTNode *node);
+
+  /**
+   * @brief a child of an if, while, && or || is compiled, emit the jumps
+   * that follow it
+   */
+  void after_child(ASTNode *parent, ASTNode *child);
+
+  void begin_function(ASTNode *node);
+  void end_function(ASTNode *node);
+  void call(ASTNode *node);
+
+  /**
+   * @brief check the index of an element access, and load the element
+   * unless it is assigned to
+   */
+  void element(ASTNode *node);
+
+  /**
+   * @brief emit a load or store of an array element
+   *
+   * @param sym array
+   * @param reg register loaded or stored
+   * @param index index, already checked
+   * @param store true for a store, false for a load
+   */
+  void access(Symbol *sym, std::int32_t reg, operand_t const &index,
+              bool store);
+
+  std::uint32_t pc() const {
+    return static_cast<std::uint32_t>(program.code.size());
+  }
+  void emit(vm::Op op, std::int32_t a = 0, std::int32_t b = 0,
+            std::int32_t c = 0);
+
+  /**
+   * @brief register of the temporary at a position of the operand stack
+   */
+  std::int32_t slot(std::size_t position);
+
+  /**
+   * @brief register of the next temporary. a pending comparison on top of
+   * the operand stack is emitted first, so it can't be overwritten
+   */
+  std::int32_t next_slot();
+
+  void push(operand_t operand);
+  operand_t pop();
+
+  /**
+   * @brief get an operand into a register
+   *
+   * @param operand operand to load
+   * @param target register to use if the operand isn't in one already
+   * @return std::int32_t register that holds the operand
+   */
+  std::int32_t in_register(operand_t const &operand, std::int32_t target);
+
+  /**
+   * @brief copy the pending operands that read a local into their own
+   * temporaries, before the local is assigned
+   */
+  void detach(std::int32_t reg);
+
+  /**
+   * @brief emit a jump taken when the truth of `cond` is `when`
+   *
+   * @param jumps gets the jumps whose target has to be set
+   */
+  void branch(operand_t const &cond, bool when,
+              std::vector<std::uint32_t> &jumps);
+
+  /**
+   * @brief set the target of jumps to the current position
+   */
+  void bind(std::vector<std::uint32_t> const &jumps);
+  void set_target(std::uint32_t jump, std::uint32_t target);
+
+  /**
+   * @brief check if the last instruction never falls through to the current
+   * position
+   */
+  bool is_unreachable() const;
+};
+
+#endif /* BYTECODE_COMPILER_HPP */
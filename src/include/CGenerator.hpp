@@ -0,0 +1,126 @@
+/**
+ * @file CGenerator.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Generate a self-contained C file for J-- code
+ */
+
+#ifndef C_GENERATOR_HPP
+#define C_GENERATOR_HPP
+
+#include "ASTNode.hpp"
+#include "StringTable.hpp"
+#include "SymTable.hpp"
+#include "Visitor.hpp"
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace yy;
+
+/**
+ * @brief CGenerator translates a checked program into a single C file that
+ * only needs the C standard library, so it can be built with `cc -O2`.
+ *
+ * Every value is an int32_t. Arithmetic wraps around and division traps the
+ * same way i32.div_s and i32.rem_s do, through small helpers at the top of
+ * the file, and so does an array index out of bounds. Globals and global
+ * arrays become statics, string literals are laid out in one constant byte
+ * array like the data segment of the wasm module, and output is buffered by
+ * the builtins until the program exits, halts or reads.
+ *
+ * C leaves the order operands and arguments are evaluated in unspecified, so
+ * an operand that is followed by a call, an assignment or a division is
+ * stored in a temporary first. That keeps J--'s left to right order.
+ */
+class CGenerator : public Visitor<CGenerator> {
+public:
+  CGenerator(std::shared_ptr<ASTNode> ast,
+             std::shared_ptr<SymTable> sym_table, std::ostream &out)
+      : ast(ast), sym_table(sym_table), out(out) {}
+
+  /**
+   * @brief generate the C file and write it to the out stream
+   */
+  void generate();
+
+private:
+  /**
+   * @brief C expression computing the value of a J-- expression
+   */
+  struct operand_t {
+    std::string text;
+    // no need to store it in a temporary, it can't change
+    bool constant = false;
+  };
+
+  std::shared_ptr<ASTNode> ast;
+  std::shared_ptr<SymTable> sym_table;
+  std::ostream &out;
+
+  StringTable str_table;
+  std::unordered_set<FunctionSymbol *> functions;
+  // expressions that call, assign or may trap
+  std::unordered_set<ASTNode *> effects;
+
+  // nodes from the root to the one being visited
+  std::vector<ASTNode *> path;
+  std::vector<operand_t> operands;
+  // state of the function being generated
+  std::vector<std::string> lines;
+  // first line of every while loop being generated
+  std::vector<std::size_t> loops;
+  int depth = 0;
+  int next_temp = 0;
+
+  friend class Visitor<CGenerator>;
+
+  /**
+   * @brief pre-order step, opens functions and loops
+   */
+  Visit enter(ASTNode *node);
+
+  /**
+   * @brief post-order step, builds the expression or emits the statement of
+   * a node once its children are generated
+   */
+  void leave(ASTNode *node);
+
+  /**
+   * @brief a child of a statement, operator or call is generated, emit what
+   * follows it
+   */
+  void after_child(ASTNode *parent, ASTNode *child);
+
+  void begin_function(ASTNode *node);
+  void end_function(ASTNode *node);
+  void call(ASTNode *node);
+
+  /**
+   * @brief access an element of an array. the index is checked where the
+   * element is used, or before the value is computed if it's assigned
+   */
+  void element(ASTNode *node);
+
+  /**
+   * @brief store the operand on top of the stack in a temporary if one of
+   * the siblings evaluated after it could change it or depends on it
+   *
+   * @param siblings operands of the same operator or call
+   * @param index position of the operand among them
+   */
+  void sequence(NodeList const &siblings, std::size_t index);
+
+  void emit(std::string line);
+  void push(operand_t operand);
+  operand_t pop();
+
+  /**
+   * @brief C declaration of a J-- function
+   */
+  std::string signature(ASTNode *node) const;
+};
+
+#endif /* C_GENERATOR_HPP */
@@ -1,18 +1,21 @@
 /**
  * @file CodeGenerator.hpp
  * @author Artem Golovin (30018900)
- * @brief Generate WebAssembly text format for J-- code
+ * @brief Generate WebAssembly for J-- code, as text or in the binary format
  */
 
 #ifndef CODE_GENERATOR_HPP
 #define CODE_GENERATOR_HPP
 
 #include "ASTNode.hpp"
+#include "Emitter.hpp"
+#include "FlatAST.hpp"
+#include "Interner.hpp"
 #include "StringTable.hpp"
 #include "SymTable.hpp"
 #include "Symbol.hpp"
+#include "Visitor.hpp"
 #include <fstream>
-#include <functional>
 #include <iostream>
 #include <memory>
 #include <ostream>
@@ -20,171 +23,220 @@
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using namespace yy;
 
 /**
- * @brief Insert specified amount of tabs for depth
- *
- * @param depth nesting level
- * @param os output stream
- * @param tabsize size of the tabs (2 by default)
+ * @brief Generate WASM code for J--, as WAT text or a binary module
  */
-inline void insert_tabs(int depth, std::ostream &os, int tabsize = 2) {
-  for (int i = 0; i < depth; ++i) {
-    os << std::string(tabsize, ' ');
-  }
-}
-
-/**
- * @brief decorator that allows to specify pre/post hooks for pretty printing
- *
- * Note: taken from Niran Pon's codegen example
- */
-struct PrintDecorator {
-  std::function<void(ASTNode *)> pre;
-  std::function<void(ASTNode *)> post;
-};
-
-/**
- * @brief pretty printer helper
- *
- * Note: taken from Niran Pon's codegen example (with slight modifications)
- */
-struct PrettyPrinter {
-  struct tc_impl {
-    friend std::ostream &operator<<(std::ostream &os,
-                                    PrettyPrinter::tc_impl const &gen) {
-      return os;
-    }
-  };
-
-  struct line_impl {
-    int tab_depth;
-    std::string message;
-
-    friend std::ostream &operator<<(std::ostream &os,
-                                    PrettyPrinter::line_impl const &gen) {
-      os << "\n";
-      insert_tabs(gen.tab_depth, os);
-      return os << gen.message;
-    }
-  };
-
-  struct add_impl {
-    std::string message;
-
-    friend std::ostream &operator<<(std::ostream &os,
-                                    PrettyPrinter::add_impl const &gen) {
-      return os << gen.message;
-    }
-  };
-
-  int tab_depth = 0;
-  std::unordered_map<ASTNode *, PrintDecorator> decorations;
-
-  add_impl add(std::string const &message, bool first_space = true) {
-    if (first_space) {
-      return add_impl{" " + message};
-    }
-
-    return add_impl{message};
-  }
-
-  add_impl add_name(std::string const &name) { return add("$" + name); }
-
-  add_impl add_int_const(int val) {
-    std::stringstream ss;
-    ss << val;
-    return add(ss.str());
-  }
-
-  add_impl add_bool_const(bool val) {
-    std::stringstream ss;
-    ss << val;
-    return add(ss.str());
-  }
-
-  add_impl add_param(std::string const &name) {
-    std::stringstream ss;
-    ss << "(param $" << name << " i32)";
-    return add(ss.str());
-  }
-
-  add_impl add_local(std::string const &name) {
-    std::stringstream ss;
-    ss << "(local $" << name << " i32)";
-    return add(ss.str());
-  }
-
-  tc_impl indent() {
-    ++tab_depth;
-    return {};
-  }
-
-  tc_impl dedent() {
-    --tab_depth;
-    return {};
-  }
-
-  // generates a new line tabbed in
-  line_impl line(std::string const &content) { return {tab_depth, content}; }
-};
-
-/**
- * @brief Generate WAT code for J--
- */
-class CodeGenerator {
+class CodeGenerator : public Visitor<CodeGenerator> {
 public:
   CodeGenerator(std::shared_ptr<ASTNode> ast,
-                std::shared_ptr<SymTable> sym_table, std::ostream &out)
-      : ast(ast), sym_table(sym_table), out(out) {
+                std::shared_ptr<FlatAST> flat_ast,
+                std::shared_ptr<SymTable> sym_table, std::ostream &out,
+                OutputFormat format = OutputFormat::wat,
+                RuntimeMode runtime_mode = RuntimeMode::unbuffered)
+      : ast(ast), flat_ast(flat_ast), sym_table(sym_table),
+        runtime_mode(runtime_mode) {
+    if (this->flat_ast == nullptr) {
+      this->flat_ast = std::make_shared<FlatAST>(ast.get());
+    }
+
     str_table = std::unique_ptr<StringTable>(new StringTable());
-    printer = std::shared_ptr<PrettyPrinter>(new PrettyPrinter);
+    emitter = make_emitter(format, out);
     while_block_state = 0;
   };
 
   /**
    * @brief Generate wasm code and output it to out stream (by default it goes
    * to stdout)
+   *
+   * @throws std::runtime_error if the binary module can't be built, e.g. the
+   * runtime doesn't assemble
    */
   void generate_wasm();
 
 private:
   std::shared_ptr<ASTNode> ast;
+  std::shared_ptr<FlatAST> flat_ast;
   std::shared_ptr<SymTable> sym_table;
   std::unique_ptr<StringTable> str_table;
-  std::ostream &out;
-  std::shared_ptr<PrettyPrinter> printer;
+  std::unique_ptr<Emitter> emitter;
+  RuntimeMode runtime_mode;
+  // expressions that call, assign or may trap, they can't be evaluated when
+  // && and || skip them
+  std::unordered_set<ASTNode *> effects;
+
+  /**
+   * @brief kind of a construct whose children are generated inside blocks
+   */
+  enum class Construct {
+    // if and if/else: condition, then and else arms
+    if_,
+    // && and || whose right side can't be evaluated unconditionally
+    and_,
+    or_,
+    // while: the condition leaves the loop when it is false
+    while_,
+    // if of an if/else-if chain compiled into a jump
+    switch_case
+  };
+
+  /**
+   * @brief construct whose children are being generated. the code around
+   * each child is emitted when the traversal enters and leaves it, the
+   * innermost construct is the only one whose children can be entered next
+   */
+  struct construct_t {
+    ASTNode *node;
+    Construct kind;
+    // for a case of a chain, the prefix of the labels of its blocks, whether
+    // it is the first if of the chain and how many cases follow it
+    std::string label;
+    bool first = false;
+    std::size_t remaining = 0;
+  };
+
+  std::vector<construct_t> constructs;
+  int switch_count = 0;
+  // address of a global array, offset in the frame of a local one
+  std::unordered_map<Symbol *, std::uint32_t> array_offsets;
+  // bytes taken by the local arrays of a function, if it has any
+  std::unordered_map<name_id_t, std::uint32_t> frame_sizes;
+  // functions that index an array, they need a local for the index
+  std::unordered_set<name_id_t> indexing_functions;
+  // element accesses that are assigned to, they are stored once the value is
+  // generated instead of loaded
+  std::unordered_set<ASTNode *> stores;
+  std::uint32_t memory_pages = 1;
+  // local arrays live on a stack that starts after the global ones
+  std::uint32_t stack_base = 0;
+  // address of the output buffer of a buffered runtime, it comes right
+  // after the strings
+  std::uint32_t output_buffer = 0;
+  name_id_t current_function = NO_NAME;
   int while_block_state;
-  std::string start_func_name;
+  name_id_t start_func_name;
   std::string stack_dummy_var;
 
   /**
-   * @brief YATM (Yet Another Traversal Method). Method to traverse AST
-   * TODO: make this *actually* generic
+   * @brief Get the variables of a scope (function or global), sorted by name
    *
-   * @param node AST node
-   * @param pre pre traversal hook/callback
-   * @param post  post traversal hook/callback
-   * @param out output stream
+   * @param scope_name name of the scope
+   * @return std::vector<name_id_t> names of the variables
    */
-  void traverse(ASTNode *node,
-                std::function<void(ASTNode *n, std::ostream &out)> pre,
-                std::function<void(ASTNode *n, std::ostream &out)> post,
-                std::ostream &out);
+  std::vector<name_id_t> scope_vars(name_id_t scope_name);
 
   /**
-   * @brief Generate variables for given scope (function or global)
+   * @brief Get the variables and arrays of a scope, sorted by name
    *
    * @param scope_name name of the scope
+   * @return std::vector<Symbol *> symbols of the variables
+   */
+  std::vector<Symbol *> scope_symbols(name_id_t scope_name);
+
+  /**
+   * @brief place the output buffer of a buffered runtime and the global
+   * arrays after the strings and the local arrays of every function in its
+   * frame, and size the memory to fit them and the stack the frames are
+   * allocated on
+   *
+   * @throws std::runtime_error if the arrays don't fit in 4 GiB
+   */
+  void layout_memory();
+
+  /**
+   * @brief allocate the frame of the current function on the stack and zero
+   * it
    */
-  void generate_vars(std::string scope_name);
+  void push_frame();
 
   /**
-   * @brief Read runtime functions specified in PROJECT_ROOT/src/lib/runtime.wat
-   * and inject them to generated WAT code
+   * @brief free the frame of the current function, if it has one
+   */
+  void pop_frame();
+
+  /**
+   * @brief emit the address of an element once its index is on the stack,
+   * trapping if the index is out of bounds, then load the element unless it
+   * is assigned to
+   *
+   * @param node index_op
+   */
+  void element(ASTNode *node);
+
+  /**
+   * @brief emit local.get/set or global.get/set of a variable
+   *
+   * @param sym symbol of the variable
+   * @param set true for a set, false for a get
+   */
+  void variable(Symbol *sym, bool set);
+
+  /**
+   * @brief comparison of an if/else-if chain, the variable is equal to
+   * `value` in the case at `index` of the chain
+   */
+  struct case_t {
+    std::int32_t value;
+    std::size_t index;
+  };
+
+  /**
+   * @brief compile an if/else-if chain that compares the same variable with
+   * constants into blocks, one per case, and a single dispatch to them. dense
+   * constants use br_table, sparse ones a binary search
+   *
+   * @param node first if of the chain
+   * @return true if the chain is long enough and the dispatch is emitted
+   */
+  bool switch_chain(ASTNode *node);
+
+  /**
+   * @brief emit a binary search over sorted cases, branching to the block of
+   * the matching case or to the default one
+   *
+   * @param sym compared variable
+   * @param cases cases sorted by value
+   * @param lo first case to search
+   * @param hi one past the last case to search
+   * @param label prefix of the block labels
+   */
+  void binary_search(Symbol *sym, std::vector<case_t> const &cases,
+                     std::size_t lo, std::size_t hi, std::string const &label);
+
+  /**
+   * @brief find which child of the innermost construct a node is
+   *
+   * @param node visited node
+   * @return std::size_t index of the child, NO_ARM if it isn't one
+   */
+  std::size_t arm_of(ASTNode *node) const;
+
+  /**
+   * @brief open the block a child of the innermost construct is generated
+   * in, before the child
+   *
+   * @param node visited node
+   * @param arm index of the node in the construct
+   * @return Visit::skip_children for the comparisons of a compiled chain
+   */
+  Visit begin_arm(ASTNode *node, std::size_t arm);
+
+  /**
+   * @brief close the block a child of the innermost construct is generated
+   * in, after the child
+   *
+   * @param arm index of the node in the construct
+   */
+  void end_arm(std::size_t arm);
+
+  /**
+   * @brief add the functions of the embedded runtime the program needs: the
+   * builtins it calls, the runtime functions they call and halt, which ends
+   * main. A buffered runtime gets the globals of its buffer first
    */
   void inject_runtime();
 
@@ -193,16 +245,32 @@ private:
   void next_block_state() { while_block_state++; }
   void prev_block_state() { while_block_state--; }
 
-  void codegen_pre_traversal_cb(ASTNode *node, std::ostream &out);
-  void codegen_post_traversal_cb(ASTNode *node, std::ostream &out);
+  friend class Visitor<CodeGenerator>;
 
   /**
-   * @brief Generate a string table that will be inserted in the generated WASM
-   * code
+   * @brief pre-order step of the code generation, opens the WAT construct of
+   * the node
    *
-   * @param node AST node
+   * @param node visited node
+   * @return Visit::skip_children for the comparisons of a compiled chain
+   */
+  Visit enter(ASTNode *node);
+
+  /**
+   * @brief post-order step of the code generation, emits the instructions of
+   * the node once its operands are generated and closes its WAT construct
+   *
+   * @param node visited node
+   */
+  void leave(ASTNode *node);
+
+  /**
+   * @brief Generate a string table that will be inserted in the generated WASM
+   * code. strings are leaves, so a linear scan over the flat ast visits them in
+   * the same order as a full traversal would. a program that calls printi
+   * gets the digit pairs and the scratch space it uses first
    */
-  void build_string_table_post_traversal_cb(ASTNode *node, std::ostream &out);
+  void build_string_table();
 };
 
 #endif /* CODE_GENERATOR_HPP */
\ No newline at end of file
@@ -0,0 +1,29 @@
+/**
+ * @file ConstantFolding.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Fold constant expressions and conditions of a checked program
+ */
+
+#ifndef CONSTANT_FOLDING_HPP
+#define CONSTANT_FOLDING_HPP
+
+#include "ASTNode.hpp"
+
+using namespace yy;
+
+/**
+ * @brief evaluate the expressions of a checked program whose operands are
+ * constants, with the i32 semantics of the generated code, and drop the
+ * operations that don't change their operand (x * 1, x + 0, !!b). An `if` or
+ * `while` with a constant condition is replaced by the branch that is taken.
+ * A division that would trap is left for the program to run.
+ *
+ * the tree is rewritten in place, a FlatAST built from it before has to be
+ * built again
+ *
+ * @param root root of the program
+ * @return std::size_t number of nodes folded or dropped
+ */
+std::size_t fold_constants(ASTNode *root);
+
+#endif /* CONSTANT_FOLDING_HPP */
@@ -0,0 +1,47 @@
+/**
+ * @file DeadCode.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Remove the code of a checked program that never runs
+ */
+
+#ifndef DEAD_CODE_HPP
+#define DEAD_CODE_HPP
+
+#include "ASTNode.hpp"
+#include "SymTable.hpp"
+#include <cstddef>
+
+using namespace yy;
+
+/**
+ * @brief how much of a program eliminate_dead_code removed
+ */
+struct removed_code_t {
+  // statements after a return, break or halt()
+  std::size_t statements = 0;
+  // functions that main never calls, directly or through other functions
+  std::size_t functions = 0;
+  // global variables that none of the remaining functions use
+  std::size_t globals = 0;
+  // nodes removed with all of them, out of the `total` the program had
+  std::size_t nodes = 0;
+  std::size_t total = 0;
+};
+
+/**
+ * @brief remove the statements of a checked program that follow a return,
+ * break or halt() in the same block, then build the call graph from main and
+ * remove the functions it doesn't reach and the globals they don't use. The
+ * removed functions and globals are taken out of the global scope of the
+ * symbol table too, so no backend emits them
+ *
+ * the tree is rewritten in place, a FlatAST built from it before has to be
+ * built again
+ *
+ * @param root root of the program
+ * @param sym_table symbol table built by semantic analysis
+ * @return removed_code_t what was removed
+ */
+removed_code_t eliminate_dead_code(ASTNode *root, SymTable &sym_table);
+
+#endif /* DEAD_CODE_HPP */
@@ -0,0 +1,233 @@
+/**
+ * @file Emitter.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Output formats of the code generator: WebAssembly text (WAT) and
+ * the binary format
+ */
+
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include "Interner.hpp"
+#include "Runtime.hpp"
+#include "StringTable.hpp"
+#include "TextBuffer.hpp"
+#include "Wasm.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief output format of the code generator
+ */
+enum class OutputFormat { wat, wasm };
+
+/**
+ * @brief Emitter is what the code generator writes the module to. The
+ * generator decides what goes in the module, the emitter how it's written.
+ * Structured control flow is opened with one of the `begin_` methods and
+ * closed with end(). An if is opened with begin_if(), followed by its
+ * condition, its then branch and optionally its else branch, each opened
+ * with its own `begin_` method and closed with end(), and closed with end().
+ */
+class Emitter {
+public:
+  virtual ~Emitter() = default;
+
+  /**
+   * @brief open the module: host imports and memory
+   *
+   * @param pages size of the memory in 64 KiB pages
+   * @param mode how the runtime prints, a buffered one imports `write`
+   * instead of `putchar`
+   */
+  virtual void begin_module(std::uint32_t pages, RuntimeMode mode) = 0;
+
+  /**
+   * @brief add the runtime functions
+   *
+   * @param wat text of the runtime, a list of WAT functions
+   */
+  virtual void runtime(std::string const &wat) = 0;
+
+  /**
+   * @brief define a mutable i32 global
+   *
+   * @param value initial value
+   */
+  virtual void global(name_id_t name, std::int32_t value) = 0;
+
+  /**
+   * @brief open a function
+   *
+   * @param name name of the function
+   * @param params names of the parameters
+   * @param has_result true if the function returns an i32
+   * @param locals names of the local variables
+   */
+  virtual void begin_func(name_id_t name, std::vector<name_id_t> const &params,
+                          bool has_result,
+                          std::vector<name_id_t> const &locals) = 0;
+
+  virtual void end_func() = 0;
+
+  /**
+   * @brief close the module with the string data and the start function
+   */
+  virtual void end_module(StringTable &strings, name_id_t start) = 0;
+
+  /**
+   * @brief emit an instruction without immediates
+   */
+  virtual void op(wasm::Op op) = 0;
+
+  virtual void i32_const(std::int32_t value) = 0;
+
+  /**
+   * @brief emit local.get/set or global.get/set of a variable
+   */
+  virtual void variable(wasm::Op op, name_id_t name) = 0;
+
+  /**
+   * @brief emit a naturally aligned load or store
+   *
+   * @param offset constant added to the address on the stack
+   */
+  virtual void memory(wasm::Op op, std::uint32_t offset) = 0;
+
+  virtual void call(name_id_t name) = 0;
+
+  /**
+   * @brief emit br or br_if to the label of an enclosing block
+   */
+  virtual void branch(wasm::Op op, std::string const &label) = 0;
+
+  /**
+   * @brief emit br_table to labels of enclosing blocks
+   *
+   * @param labels target of every index, then the default target
+   */
+  virtual void branch_table(std::vector<std::string> const &labels) = 0;
+
+  virtual void begin_block(std::string const &label) = 0;
+  virtual void begin_loop(std::string const &label) = 0;
+
+  /**
+   * @brief open an if
+   *
+   * @param has_result true if both branches leave an i32, which is left by
+   * the if
+   */
+  virtual void begin_if(bool has_result) = 0;
+
+  /**
+   * @brief open the condition of an if, a block that leaves an i32
+   */
+  virtual void begin_condition() = 0;
+  virtual void begin_then() = 0;
+  virtual void begin_else() = 0;
+
+  /**
+   * @brief close the innermost construct
+   */
+  virtual void end() = 0;
+};
+
+/**
+ * @brief create the emitter of a format
+ *
+ * @param format output format
+ * @param out stream the module is written to
+ */
+std::unique_ptr<Emitter> make_emitter(OutputFormat format, std::ostream &out);
+
+/**
+ * @brief Emitter of the WebAssembly text format, indented two spaces a level.
+ * The module is built up in a TextBuffer and written out by end_module()
+ */
+class WatEmitter : public Emitter {
+public:
+  explicit WatEmitter(std::ostream &out) : out(out) {}
+
+  void begin_module(std::uint32_t pages, RuntimeMode mode) override;
+  void runtime(std::string const &wat) override;
+  void global(name_id_t name, std::int32_t value) override;
+  void begin_func(name_id_t name, std::vector<name_id_t> const &params,
+                  bool has_result,
+                  std::vector<name_id_t> const &locals) override;
+  void end_func() override;
+  void end_module(StringTable &strings, name_id_t start) override;
+
+  void op(wasm::Op op) override;
+  void i32_const(std::int32_t value) override;
+  void variable(wasm::Op op, name_id_t name) override;
+  void memory(wasm::Op op, std::uint32_t offset) override;
+  void call(name_id_t name) override;
+  void branch(wasm::Op op, std::string const &label) override;
+  void branch_table(std::vector<std::string> const &labels) override;
+
+  void begin_block(std::string const &label) override;
+  void begin_loop(std::string const &label) override;
+  void begin_if(bool has_result) override;
+  void begin_condition() override;
+  void begin_then() override;
+  void begin_else() override;
+  void end() override;
+
+private:
+  std::ostream &out;
+  TextBuffer text;
+
+  /**
+   * @brief append the `$name` of an identifier to the current line
+   */
+  void add_name(name_id_t name);
+};
+
+/**
+ * @brief Emitter of the binary format. The module is built in memory and
+ * written out by end_module(); the runtime goes through the WatAssembler.
+ */
+class WasmEmitter : public Emitter {
+public:
+  explicit WasmEmitter(std::ostream &out) : out(out) {}
+
+  void begin_module(std::uint32_t pages, RuntimeMode mode) override;
+  void runtime(std::string const &wat) override;
+  void global(name_id_t name, std::int32_t value) override;
+  void begin_func(name_id_t name, std::vector<name_id_t> const &params,
+                  bool has_result,
+                  std::vector<name_id_t> const &locals) override;
+  void end_func() override;
+  void end_module(StringTable &strings, name_id_t start) override;
+
+  void op(wasm::Op op) override;
+  void i32_const(std::int32_t value) override;
+  void variable(wasm::Op op, name_id_t name) override;
+  void memory(wasm::Op op, std::uint32_t offset) override;
+  void call(name_id_t name) override;
+  void branch(wasm::Op op, std::string const &label) override;
+  void branch_table(std::vector<std::string> const &labels) override;
+
+  void begin_block(std::string const &label) override;
+  void begin_loop(std::string const &label) override;
+  void begin_if(bool has_result) override;
+  void begin_condition() override;
+  void begin_then() override;
+  void begin_else() override;
+  void end() override;
+
+private:
+  // constructs that end() can close. `then` and `else` have no end of their
+  // own in the binary format, the if they belong to is closed after them
+  enum class Construct { block, condition, if_, if_result, then, else_ };
+
+  std::ostream &out;
+  wasm::Module module;
+  wasm::Function *function = nullptr;
+  std::vector<Construct> open;
+};
+
+#endif /* EMITTER_HPP */
@@ -0,0 +1,197 @@
+/**
+ * @file FlatAST.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Compact struct-of-arrays representation of the AST
+ */
+
+#ifndef FLAT_AST_HPP
+#define FLAT_AST_HPP
+
+#include "ASTNode.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace yy {
+
+class FlatAST;
+
+/**
+ * @brief lightweight handle to a node stored in a FlatAST. mirrors the read
+ * only part of the ASTNode api (find_all/find_first/find_recursive/traverse)
+ */
+class FlatNode {
+public:
+  FlatNode(const FlatAST *ast, std::uint32_t index) : ast(ast), index(index) {}
+
+  bool valid() const;
+  std::uint32_t id() const { return index; }
+
+  Node type() const;
+  int linenum() const;
+  std::string_view value() const;
+  bool has_value() const { return !value().empty(); }
+
+  /**
+   * @brief get the pointer-based node this entry was built from
+   *
+   * @return ASTNode* original node
+   */
+  ASTNode *node() const;
+
+  FlatNode first_child() const;
+  FlatNode next_sibling() const;
+
+  /**
+   * @brief find all direct children of specified type
+   *
+   * @param node_type type of node to be found
+   * @return std::vector<FlatNode> all nodes of specified type
+   */
+  std::vector<FlatNode> find_all(Node node_type) const;
+
+  /**
+   * @brief find the first direct child of specified type
+   *
+   * @param node_type type of node to be found
+   * @return FlatNode node, if it exists, invalid handle otherwise
+   */
+  FlatNode find_first(Node node_type) const;
+
+  /**
+   * @brief find all descendants of specified type. this is a linear scan over
+   * the subtree range, so results come in pre-order (source) order
+   *
+   * @param node_type type of node to be found
+   * @return std::vector<FlatNode> all descendants of specified type
+   */
+  std::vector<FlatNode> find_recursive(Node node_type) const;
+
+  /**
+   * @brief call `fn` for every descendant of specified type, in pre-order
+   *
+   * @param node_type type of node to be found
+   * @param fn callback, takes the matching FlatNode
+   */
+  template <typename Fn> void for_each(Node node_type, Fn &&fn) const;
+
+  /**
+   * @brief walk the subtree in a single linear pass over the node arrays,
+   * calling `pre` before and `post` after the children of every node
+   *
+   * @param pre pre-order callback, takes a FlatNode
+   * @param post post-order callback, takes a FlatNode
+   */
+  template <typename Pre, typename Post>
+  void traverse(Pre &&pre, Post &&post) const;
+
+private:
+  const FlatAST *ast;
+  std::uint32_t index;
+};
+
+/**
+ * @brief FlatAST stores the tree as parallel arrays in pre-order. Each node is
+ * addressed by a 32-bit index; children are linked through first-child and
+ * next-sibling indices and every subtree occupies the contiguous index range
+ * [index, subtree_end). Node values are offsets into one shared text buffer,
+ * captured when the tree is flattened.
+ */
+class FlatAST {
+public:
+  static constexpr std::uint32_t NONE = UINT32_MAX;
+
+  /**
+   * @brief flatten the tree starting at `root`. also records each node's
+   * position in `ASTNode::index`
+   *
+   * @param root root of the pointer-based ast
+   */
+  explicit FlatAST(ASTNode *root);
+
+  FlatNode root() const { return FlatNode(this, kinds.empty() ? NONE : 0); }
+
+  /**
+   * @brief get the handle for a node that was flattened into this tree
+   *
+   * @param node pointer-based node
+   * @return FlatNode handle of the node
+   */
+  FlatNode at(const ASTNode *node) const { return FlatNode(this, node->index); }
+
+  std::size_t size() const { return kinds.size(); }
+
+  /**
+   * @brief approximate amount of memory used per node, including the shared
+   * text buffer
+   */
+  std::size_t bytes_per_node() const;
+
+  std::vector<Node> kinds;
+  std::vector<int> lines;
+  std::vector<std::uint32_t> first_child;
+  std::vector<std::uint32_t> next_sibling;
+  std::vector<std::uint32_t> subtree_end;
+  std::vector<std::uint32_t> value_offset;
+  std::vector<std::uint32_t> value_length;
+  std::vector<ASTNode *> nodes;
+  std::string text;
+};
+
+inline bool FlatNode::valid() const { return index != FlatAST::NONE; }
+
+inline Node FlatNode::type() const { return ast->kinds[index]; }
+
+inline int FlatNode::linenum() const { return ast->lines[index]; }
+
+inline std::string_view FlatNode::value() const {
+  return std::string_view(ast->text).substr(ast->value_offset[index],
+                                            ast->value_length[index]);
+}
+
+inline ASTNode *FlatNode::node() const { return ast->nodes[index]; }
+
+inline FlatNode FlatNode::first_child() const {
+  return FlatNode(ast, ast->first_child[index]);
+}
+
+inline FlatNode FlatNode::next_sibling() const {
+  return FlatNode(ast, ast->next_sibling[index]);
+}
+
+template <typename Fn> void FlatNode::for_each(Node node_type, Fn &&fn) const {
+  const Node *kinds = ast->kinds.data();
+  std::uint32_t end = ast->subtree_end[index];
+  for (std::uint32_t i = index + 1; i < end; i++) {
+    if (kinds[i] == node_type) {
+      fn(FlatNode(ast, i));
+    }
+  }
+}
+
+template <typename Pre, typename Post>
+void FlatNode::traverse(Pre &&pre, Post &&post) const {
+  // open nodes whose post-order callback is still pending
+  std::vector<std::uint32_t> open;
+  std::uint32_t end = ast->subtree_end[index];
+
+  for (std::uint32_t i = index; i < end; i++) {
+    while (!open.empty() && ast->subtree_end[open.back()] <= i) {
+      post(FlatNode(ast, open.back()));
+      open.pop_back();
+    }
+
+    pre(FlatNode(ast, i));
+    open.push_back(i);
+  }
+
+  while (!open.empty()) {
+    post(FlatNode(ast, open.back()));
+    open.pop_back();
+  }
+}
+
+} // namespace yy
+
+#endif /* FLAT_AST_HPP */
@@ -9,7 +9,7 @@ using namespace yy;
 
 class FunctionSymbol : public Symbol {
 public:
-  FunctionSymbol(std::string name, std::vector<Symbol> params, Node type,
+  FunctionSymbol(name_id_t name, std::vector<Symbol> params, Node type,
                  int scope_level, int block_scope)
       : Symbol(name, "function", type, scope_level, block_scope),
         params(params){};
@@ -17,8 +17,8 @@ public:
   std::vector<Symbol> params;
 
   void print(std::ostream &os) const {
-    os << "<" << kind << ": " << get_str_for_type(type) << ", " << name
-       << ", params: ";
+    os << "<" << kind << ": " << get_str_for_type(type) << ", "
+       << name_str(name) << ", params: ";
     for (auto p : params) {
       os << p << " ";
     }
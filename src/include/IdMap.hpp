@@ -0,0 +1,183 @@
+/**
+ * @file IdMap.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Flat open-addressing hash map keyed on interned identifiers
+ */
+
+#ifndef ID_MAP_HPP
+#define ID_MAP_HPP
+
+#include "Interner.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief IdMap is a flat hash map from name_id_t to a small value. Entries
+ * live in one contiguous array with linear probing, so lookups are a couple
+ * of integer compares and never allocate. NO_NAME marks an empty slot and
+ * can't be used as a key.
+ *
+ * @tparam V value type, cheap to copy (a pointer or an index)
+ */
+template <typename V> class IdMap {
+public:
+  struct slot_t {
+    name_id_t key;
+    V value;
+  };
+
+  /**
+   * @brief iterator over occupied slots. slots can be unpacked with
+   * structured bindings: `for (auto const &[key, value] : map)`
+   */
+  class const_iterator {
+  public:
+    const_iterator(const slot_t *pos, const slot_t *end) : pos(pos), end(end) {
+      skip_empty();
+    }
+
+    const slot_t &operator*() const { return *pos; }
+    const slot_t *operator->() const { return pos; }
+
+    const_iterator &operator++() {
+      ++pos;
+      skip_empty();
+      return *this;
+    }
+
+    bool operator!=(const_iterator const &other) const {
+      return pos != other.pos;
+    }
+    bool operator==(const_iterator const &other) const {
+      return pos == other.pos;
+    }
+
+  private:
+    const slot_t *pos;
+    const slot_t *end;
+
+    void skip_empty() {
+      while (pos != end && pos->key == NO_NAME) {
+        ++pos;
+      }
+    }
+  };
+
+  IdMap() : slots(MIN_CAPACITY, slot_t{NO_NAME, V{}}) {}
+
+  /**
+   * @brief insert a value, unless the key is already present
+   *
+   * @param key key of the entry
+   * @param value value of the entry
+   * @return true if the entry was inserted
+   */
+  bool insert(name_id_t key, V value) {
+    if ((count + 1) * 4 > slots.size() * 3) {
+      grow();
+    }
+
+    std::size_t i = probe(key);
+    if (slots[i].key == key) {
+      return false;
+    }
+
+    slots[i] = slot_t{key, value};
+    count++;
+    return true;
+  }
+
+  /**
+   * @brief find the value stored under `key`
+   *
+   * @param key key to look for
+   * @return const V* pointer to the value, nullptr if the key is absent
+   */
+  const V *find(name_id_t key) const {
+    const slot_t &s = slots[probe(key)];
+    return s.key == key && key != NO_NAME ? &s.value : nullptr;
+  }
+
+  V *find(name_id_t key) {
+    slot_t &s = slots[probe(key)];
+    return s.key == key && key != NO_NAME ? &s.value : nullptr;
+  }
+
+  bool contains(name_id_t key) const { return find(key) != nullptr; }
+
+  /**
+   * @brief remove the entry stored under `key`. the entries probed past it
+   * are moved back into the gap, so every entry stays reachable from its home
+   * slot without tombstones
+   *
+   * @param key key of the entry
+   * @return true if the entry was removed
+   */
+  bool erase(name_id_t key) {
+    std::size_t i = probe(key);
+    if (slots[i].key != key || key == NO_NAME) {
+      return false;
+    }
+
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t j = (i + 1) & mask; slots[j].key != NO_NAME;
+         j = (j + 1) & mask) {
+      // an entry can fill the gap if the gap is between its home and it
+      if (((j - home(slots[j].key)) & mask) >= ((j - i) & mask)) {
+        slots[i] = slots[j];
+        i = j;
+      }
+    }
+
+    slots[i] = slot_t{NO_NAME, V{}};
+    count--;
+    return true;
+  }
+
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  const_iterator begin() const {
+    return const_iterator(slots.data(), slots.data() + slots.size());
+  }
+  const_iterator end() const {
+    return const_iterator(slots.data() + slots.size(),
+                          slots.data() + slots.size());
+  }
+
+private:
+  static constexpr std::size_t MIN_CAPACITY = 8;
+
+  std::vector<slot_t> slots;
+  std::size_t count = 0;
+
+  /**
+   * @brief find the slot holding `key`, or the empty slot where it would go.
+   * multiplying by an odd constant permutes the low bits, so consecutive ids
+   * land in distinct slots
+   */
+  std::size_t probe(name_id_t key) const {
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = home(key);
+    while (slots[i].key != NO_NAME && slots[i].key != key) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  std::size_t home(name_id_t key) const {
+    return (key * 2654435769u) & (slots.size() - 1);
+  }
+
+  void grow() {
+    std::vector<slot_t> old(slots.size() * 2, slot_t{NO_NAME, V{}});
+    old.swap(slots);
+    for (auto const &s : old) {
+      if (s.key != NO_NAME) {
+        slots[probe(s.key)] = s;
+      }
+    }
+  }
+};
+
+#endif /* ID_MAP_HPP */
@@ -0,0 +1,80 @@
+/**
+ * @file Interner.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Global identifier interner, maps every identifier to a dense id
+ */
+
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @brief dense id of an interned identifier. 0 is reserved for "no name"
+ */
+typedef std::uint32_t name_id_t;
+
+const name_id_t NO_NAME = 0;
+
+/**
+ * @brief Interner assigns every distinct identifier a dense 32-bit id the
+ * first time it is seen (by the scanner) and keeps a single copy of its text,
+ * together with its `$name` form used in generated WAT. Everything after the
+ * scanner compares and hashes ids instead of strings.
+ */
+class Interner {
+public:
+  Interner();
+  Interner(Interner const &) = delete;
+
+  /**
+   * @brief get the interner shared by the whole compiler
+   */
+  static Interner &global();
+
+  /**
+   * @brief get the id of an identifier, assigning a new one if needed
+   *
+   * @param name identifier text
+   * @return name_id_t id of the identifier
+   */
+  name_id_t intern(std::string_view name);
+
+  /**
+   * @brief get the text of an interned identifier
+   */
+  const std::string &str(name_id_t id) const { return names[id]; }
+
+  /**
+   * @brief get the `$name` form of an interned identifier
+   */
+  const std::string &wasm_name(name_id_t id) const { return wasm_names[id]; }
+
+  std::size_t size() const { return names.size(); }
+
+private:
+  // deques never move their elements, so the keys can view into `names`
+  std::deque<std::string> names;
+  std::deque<std::string> wasm_names;
+  std::unordered_map<std::string_view, name_id_t> ids;
+};
+
+/**
+ * @brief shorthand for `Interner::global().intern(name)`
+ */
+inline name_id_t intern(std::string_view name) {
+  return Interner::global().intern(name);
+}
+
+/**
+ * @brief shorthand for `Interner::global().str(id)`
+ */
+inline const std::string &name_str(name_id_t id) {
+  return Interner::global().str(id);
+}
+
+#endif /* INTERNER_HPP */
@@ -0,0 +1,127 @@
+/**
+ * @file Interpreter.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Interpreter for the WebAssembly modules the compiler generates
+ */
+
+#ifndef INTERPRETER_HPP
+#define INTERPRETER_HPP
+
+#include "Wasm.hpp"
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wasm {
+
+/**
+ * @brief Trap is thrown when the running module traps: unreachable, division
+ * by zero, out of bounds memory access or call stack exhaustion
+ */
+class Trap : public std::runtime_error {
+public:
+  explicit Trap(std::string const &message)
+      : std::runtime_error("trap: " + message) {}
+};
+
+/**
+ * @brief Interpreter runs a binary module in process. The module is decoded
+ * once into a flat instruction stream, with the targets of the branches and
+ * the stack heights they unwind to computed up front. Locals and operands of
+ * every frame live on one value stack. The host functions `exit`, `putchar`,
+ * `write` and `getchar` of the `host` module are implemented natively;
+ * `write(ptr, len)` writes `len` bytes of the memory at once.
+ */
+class Interpreter {
+public:
+  /**
+   * @brief decode a module
+   *
+   * @param binary module in the binary format
+   * @throws std::runtime_error if the module is malformed or uses something
+   * outside the i32 subset the compiler generates
+   */
+  explicit Interpreter(std::string_view binary);
+
+  /**
+   * @brief instantiate the module and run its start function
+   *
+   * @param in stream `getchar` reads from
+   * @param out stream `putchar` and `write` write to
+   * @throws Trap if the module traps
+   */
+  void run(std::istream &in, std::ostream &out);
+
+  /**
+   * @brief run the module like run() does and count the instructions it
+   * executes. block, loop and end only mark the branch targets, they aren't
+   * executed and aren't counted
+   *
+   * @return std::uint64_t number of instructions executed
+   * @throws Trap if the module traps
+   */
+  std::uint64_t count(std::istream &in, std::ostream &out);
+
+private:
+  enum class Host : std::uint8_t { exit, putchar, write, getchar };
+
+  /**
+   * @brief decoded instruction
+   */
+  struct instr_t {
+    Op op;
+    // br, br_if and return: 1 if the branch carries a value
+    std::uint8_t keep;
+    // constant, index, memory offset, target of a branch, or the number of
+    // labels of br_table besides the default
+    std::uint32_t a;
+    // br and br_if: height of the value stack at the target, relative to the
+    // frame
+    std::uint32_t b;
+  };
+
+  struct function_t {
+    Signature signature;
+    // declared locals, besides the parameters
+    std::uint32_t locals = 0;
+    // most values the function has on the stack at once, locals included
+    std::uint32_t frame_size = 0;
+    std::uint32_t entry = 0;
+  };
+
+  struct segment_t {
+    std::uint32_t offset;
+    std::string bytes;
+  };
+
+  std::vector<Signature> types;
+  std::vector<Host> imports;
+  std::vector<function_t> functions;
+  std::vector<std::int32_t> initial_globals;
+  std::vector<segment_t> segments;
+  std::uint32_t memory_pages = 0;
+  std::uint32_t start = UINT32_MAX;
+  std::vector<instr_t> code;
+
+  /**
+   * @brief decode the body of a function into `code`
+   */
+  void decode_body(function_t &function, std::string_view body);
+
+  /**
+   * @brief run the module, the instructions are only counted if `counted`,
+   * so run() doesn't pay for it
+   *
+   * @return std::uint64_t number of instructions executed, if counted
+   */
+  template <bool counted>
+  std::uint64_t execute(std::istream &in, std::ostream &out);
+};
+
+} // namespace wasm
+
+#endif /* INTERPRETER_HPP */
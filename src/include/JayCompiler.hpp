@@ -4,8 +4,11 @@
 #include <memory>
 
 #include "ASTNode.hpp"
+#include "FlatAST.hpp"
 #include "Lexer.hpp"
+#include "NodeArena.hpp"
 #include "SemanticAnalyzer.hpp"
+#include "SourceBuffer.hpp"
 #include "parser.tab.hpp"
 
 namespace yy {
@@ -20,7 +23,11 @@ struct JayCompiler {
   std::unique_ptr<Lexer> lexer;
   std::unique_ptr<Parser> parser;
   std::unique_ptr<SemanticAnalyzer> semanticAnalyzer;
+  // owns every node of the current ast, released with the compiler
+  std::unique_ptr<NodeArena> arena;
   ASTNode *ast;
+  // struct-of-arrays copy of `ast`, built once parsing succeeds
+  std::shared_ptr<FlatAST> flat_ast;
   std::string filename;
 
   /**
@@ -30,9 +37,34 @@ struct JayCompiler {
    * @param is input stream, can be file input or stdin
    * @param file filename that will be opened and parsed; used for better error
    * handling
-   * @return ASTNode* an Abstract Syntax Tree of the specified  input
+   * @return ASTNode* an Abstract Syntax Tree of the specified  input. the tree
+   * is owned by the compiler and stays valid until the next call to `parse`
    */
   ASTNode *parse(std::istream *is, std::string file);
+
+  /**
+   * @brief Parse a source buffer in place and return resulting Abstract Syntax
+   * Tree. token text is read straight from the buffer, which only has to stay
+   * alive until this returns
+   *
+   * @param source source text, usually a memory mapped file
+   * @param file filename of the source; used for better error handling
+   * @param backend scanner to read the source with
+   * @return ASTNode* an Abstract Syntax Tree of the source. the tree is owned
+   * by the compiler and stays valid until the next call to `parse`
+   */
+  ASTNode *parse(const SourceBuffer &source, std::string file,
+                 Lexer::Backend backend = Lexer::best_backend());
+
+private:
+  /**
+   * @brief run the parser over the tokens of `lexer`
+   *
+   * @param lexer lexer to read tokens from
+   * @param file filename of the input
+   * @return ASTNode* resulting ast, nullptr if parsing failed
+   */
+  ASTNode *parse(std::unique_ptr<Lexer> lexer, std::string file);
 };
 
 } // namespace yy
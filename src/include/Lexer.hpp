@@ -1,35 +1,165 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "ScanKernels.hpp"
+#include "SourceBuffer.hpp"
 #include "StringBuilder.hpp"
 #include "parser.tab.hpp"
 #include <iostream>
+#include <streambuf>
 #include <string>
+#include <string_view>
 
 #ifndef yyFlexLexerOnce
 #include <FlexLexer.h>
 #endif
 
+// if there will be more than 10 warnings/error, the lexer will halt
+#define WARNING_THRESHOLD 10
+
+/**
+ * @brief read-only stream buffer over a SourceBuffer, so flex can read a
+ * memory mapped source without another copy
+ */
+class source_streambuf : public std::streambuf {
+public:
+  explicit source_streambuf(std::string_view text) {
+    char *begin = const_cast<char *>(text.data());
+    setg(begin, begin, begin + text.size());
+  }
+};
+
 /**
  * @brief Lexer is C++ wrapper for flex, it inherits yyFlexLexer that is
- * provided by the `flex`
+ * provided by the `flex`. A lexer created from a SourceBuffer can instead
+ * scan the buffer in place with a hand-written scanner that follows the same
+ * rules as `scanner.l`. Literals are passed to the parser as spans either way.
  */
 class Lexer : public yyFlexLexer {
 public:
   using TokenType = yy::Parser::semantic_type;
 
+  /**
+   * @brief scanner implementation
+   */
+  enum class Backend {
+    // generated by flex from scanner.l
+    flex,
+    // hand-written, one character at a time
+    scalar,
+    // hand-written, with whitespace, comments, identifiers and strings
+    // scanned 16 (sse2) or 32 (avx2) bytes at a time
+    sse2,
+    avx2,
+  };
+
   Lexer(std::istream *is = nullptr, std::ostream *os = nullptr)
       : yyFlexLexer(is, os) {}
 
+  /**
+   * @brief create a lexer over `source`. the buffer has to outlive the lexer
+   *
+   * @param source text to scan
+   * @param backend scanner to use, falls back to the fastest supported one if
+   * the machine can't run it
+   */
+  explicit Lexer(const SourceBuffer *source,
+                 Backend backend = Lexer::best_backend());
+
+  /**
+   * @brief get the fastest backend the machine supports
+   */
+  static Backend best_backend();
+
+  /**
+   * @brief check if the machine can run a backend
+   */
+  static bool is_supported(Backend backend);
+
+  /**
+   * @brief find a backend by name: flex, scalar, sse2, avx2 or simd (the
+   * fastest supported one)
+   *
+   * @param name name of the backend
+   * @param backend set to the backend, if the name is valid
+   * @return true if the name is valid
+   */
+  static bool backend_from_name(std::string_view name, Backend &backend);
+
+  Backend get_backend() const { return backend; }
+
   int yylex();
 
-  int lex(TokenType *semval) {
-    m_val = semval;
-    return yylex();
-  }
+  /**
+   * @brief scan the next token with the selected backend
+   *
+   * @param semval semantic value of the token
+   * @return int token type, 0 at the end of the input
+   */
+  int lex(TokenType *semval);
+
+  /**
+   * @brief get the text of a literal token. the view stays valid while the
+   * lexer and its source buffer are alive
+   *
+   * @param span span of the token, as returned with T_NUM or T_STR
+   * @return std::string_view text of the token
+   */
+  std::string_view text(span_t span) const;
+
+  // number of warnings after which the lexer aborts the process
+  int warning_threshold = WARNING_THRESHOLD;
 
 private:
   TokenType *m_val;
+  Backend backend = Backend::flex;
+
+  // number of warnings reported so far
+  int warning_count = 0;
+
+  // source scanned in place, nullptr when scanning a stream with flex
+  const SourceBuffer *source = nullptr;
+  // offset of the next character to scan in `source`
+  std::size_t pos = 0;
+
+  // flex input when flex scans `source`
+  source_streambuf source_buf{std::string_view()};
+  std::istream source_stream{&source_buf};
+
+  // text that isn't in the source as is: every literal scanned by flex, and
+  // strings that had to be rewritten. spans past the end of the source
+  // point in here
+  std::string spilled;
+
+  /**
+   * @brief copy token text to the spill buffer
+   *
+   * @param text token text
+   * @return span_t span of the copy
+   */
+  span_t spill(std::string_view text);
+
+  /**
+   * @brief scan the next token from `source`
+   *
+   * @tparam Kernels character class scans to use, see ScanKernels.hpp
+   * @return int token type, 0 at the end of the input
+   */
+  template <typename Kernels> int scan();
+
+  /**
+   * @brief scan the rest of a string literal, after the opening quote
+   *
+   * @tparam Kernels character class scans to use, see ScanKernels.hpp
+   * @return true if the string was terminated and its span is set
+   * @return false if it ran into a newline or the end of the input
+   */
+  template <typename Kernels> bool scan_string();
+
+  /**
+   * @brief report a character that doesn't start any token
+   */
+  void unknown_char();
 };
 
-#endif /* LEXER_H */
\ No newline at end of file
+#endif /* LEXER_H */
@@ -0,0 +1,143 @@
+/**
+ * @file NodeArena.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Per-compilation arena for AST nodes and their children lists
+ */
+
+#ifndef NODE_ARENA_HPP
+#define NODE_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace yy {
+
+enum class Node;
+struct ASTNode;
+class NodeArena;
+
+/**
+ * @brief list of child nodes that lives inside of a NodeArena. It behaves like
+ * a minimal std::vector<ASTNode *>, but never frees its storage: when the list
+ * grows, the old slots are simply abandoned until the arena is released.
+ */
+class NodeList {
+public:
+  using iterator = ASTNode **;
+  using const_iterator = ASTNode *const *;
+
+  NodeList() = default;
+  NodeList(NodeArena *arena, std::initializer_list<ASTNode *> nodes);
+
+  iterator begin() { return items; }
+  iterator end() { return items + count; }
+  const_iterator begin() const { return items; }
+  const_iterator end() const { return items + count; }
+
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  ASTNode *&operator[](std::size_t i) { return items[i]; }
+  ASTNode *operator[](std::size_t i) const { return items[i]; }
+
+  ASTNode *front() const { return items[0]; }
+  ASTNode *back() const { return items[count - 1]; }
+
+  /**
+   * @brief append a node to the list, growing the storage inside the arena
+   *
+   * @param node node to append
+   */
+  void push_back(ASTNode *node);
+
+  /**
+   * @brief remove the nodes in [first, last), keeping the order of the
+   * others. the storage is kept
+   *
+   * @param first first node to remove
+   * @param last node after the last one to remove
+   * @return iterator position of the node that followed the removed ones
+   */
+  iterator erase(iterator first, iterator last);
+
+private:
+  NodeArena *arena = nullptr;
+  ASTNode **items = nullptr;
+  std::uint32_t count = 0;
+  std::uint32_t capacity = 0;
+};
+
+/**
+ * @brief NodeArena owns every AST node created while parsing a single file.
+ * Nodes are carved out of fixed-size slabs and children lists out of large
+ * bump-allocated blocks, so the whole tree is released in one shot when the
+ * arena is destroyed.
+ */
+class NodeArena {
+public:
+  NodeArena() = default;
+  NodeArena(NodeArena const &) = delete;
+  NodeArena &operator=(NodeArena const &) = delete;
+  ~NodeArena() { release(); }
+
+  /**
+   * @brief create a new node inside of the arena
+   *
+   * @param type type of the node
+   * @param value value associated with the node
+   * @param linenum line number where the token was found
+   * @param children children of the node
+   * @return ASTNode* newly created node
+   */
+  ASTNode *make(Node type, std::string value, int linenum,
+                NodeList children);
+
+  ASTNode *make(Node type, std::string value, int linenum,
+                std::initializer_list<ASTNode *> children = {});
+
+  /**
+   * @brief create an empty, arena-backed list of nodes
+   *
+   * @return NodeList* newly created list
+   */
+  NodeList *make_list();
+
+  /**
+   * @brief allocate uninitialized storage for `n` node pointers
+   *
+   * @param n number of slots
+   * @return ASTNode** pointer to the first slot
+   */
+  ASTNode **allocate_slots(std::size_t n);
+
+  /**
+   * @brief destroy all nodes and free every slab and block owned by the arena
+   */
+  void release();
+
+  std::size_t node_count() const { return nodes_allocated; }
+  std::size_t bytes_reserved() const;
+
+private:
+  static constexpr std::size_t NODES_PER_SLAB = 1024;
+  static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<ASTNode *> node_slabs;
+  std::size_t slab_used = NODES_PER_SLAB;
+  std::size_t nodes_allocated = 0;
+
+  std::vector<char *> blocks;
+  std::size_t block_bytes = 0;
+  char *cursor = nullptr;
+  char *limit = nullptr;
+
+  void *allocate(std::size_t size, std::size_t align);
+  ASTNode *next_node_slot();
+};
+
+} // namespace yy
+
+#endif /* NODE_ARENA_HPP */
@@ -0,0 +1,92 @@
+/**
+ * @file Runtime.hpp
+ * @author Artem Golovin (30018900)
+ * @brief The WAT runtime of the generated modules, split into its functions
+ */
+
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include "Interner.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief texts of src/lib/runtime.wat and src/lib/runtime_buffered.wat,
+ * compiled into the compiler by make (src/runtime.wat.cpp is generated from
+ * them)
+ */
+extern const char RUNTIME_WAT[];
+extern const char RUNTIME_BUFFERED_WAT[];
+
+/**
+ * @brief how the runtime of a module prints
+ */
+enum class RuntimeMode {
+  // a `putchar` host call per character
+  unbuffered,
+  // into a buffer in linear memory, written out by the `write` host import
+  // when it's full, on halt() and at the end of main
+  buffered,
+};
+
+/**
+ * @brief Runtime holds the functions of a WAT runtime, each with the comment
+ * above it, and the runtime functions each of them calls. A function that is
+ * defined again replaces the earlier one, so a variant of the runtime is the
+ * runtime followed by the functions it changes. A module only gets the
+ * builtins its program calls and the helpers they need.
+ */
+class Runtime {
+public:
+  /**
+   * @brief get the runtime embedded in the compiler, it's split the first
+   * time it's used
+   *
+   * @param mode how the runtime prints
+   */
+  static Runtime const &embedded(RuntimeMode mode = RuntimeMode::unbuffered);
+
+  /**
+   * @brief split the text of a runtime into its functions
+   *
+   * @param wat top level functions and comments
+   * @throws std::runtime_error if a function isn't closed
+   */
+  explicit Runtime(std::string_view wat);
+
+  /**
+   * @brief get the functions a program needs: the builtins it calls and the
+   * runtime functions they call, in the order of the runtime
+   *
+   * @param called names of the functions the program calls, names that
+   * aren't in the runtime are ignored
+   * @return std::string WAT text of the functions
+   */
+  std::string functions(std::unordered_set<name_id_t> const &called) const;
+
+  /**
+   * @brief number of functions in the runtime
+   */
+  std::size_t size() const { return fragments.size(); }
+
+private:
+  /**
+   * @brief a function of the runtime and the comment above it
+   */
+  struct fragment_t {
+    name_id_t name;
+    std::size_t begin;
+    std::size_t end;
+    // runtime functions it calls, the imports aren't
+    std::vector<std::size_t> calls;
+  };
+
+  std::string wat;
+  std::vector<fragment_t> fragments;
+};
+
+#endif /* RUNTIME_HPP */
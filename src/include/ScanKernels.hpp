@@ -0,0 +1,69 @@
+/**
+ * @file ScanKernels.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Character class scans of the in-place scanner, in scalar, SSE2 and
+ * AVX2 versions
+ */
+
+#ifndef SCAN_KERNELS_HPP
+#define SCAN_KERNELS_HPP
+
+#include <cstddef>
+
+namespace scan {
+
+/**
+ * @brief Each kernel set scans `s[pos, n)` and returns the position of the
+ * first character outside of a class, or `n` if there's none:
+ *   - skip_blanks: spaces, tabs and newlines. adds the number of `\n` it
+ *     skipped to `lines`
+ *   - skip_id: identifier characters, [a-zA-Z0-9_]
+ *   - find_eol: stops at the first `\n` or `\r`
+ *   - find_string_special: stops at the first character a string literal has
+ *     to look at: `"`, `\`, `\n`, `\r` or NUL
+ *
+ * The SIMD versions look at 16 (SSE2) or 32 (AVX2) bytes at a time and finish
+ * the tail with the scalar code. AVX2 has to be checked with has_avx2()
+ * before use.
+ */
+struct scalar_kernels {
+  static std::size_t skip_blanks(const char *s, std::size_t pos,
+                                 std::size_t n, int &lines);
+  static std::size_t skip_id(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_eol(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_string_special(const char *s, std::size_t pos,
+                                         std::size_t n);
+};
+
+struct sse2_kernels {
+  static std::size_t skip_blanks(const char *s, std::size_t pos,
+                                 std::size_t n, int &lines);
+  static std::size_t skip_id(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_eol(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_string_special(const char *s, std::size_t pos,
+                                         std::size_t n);
+};
+
+struct avx2_kernels {
+  static std::size_t skip_blanks(const char *s, std::size_t pos,
+                                 std::size_t n, int &lines);
+  static std::size_t skip_id(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_eol(const char *s, std::size_t pos, std::size_t n);
+  static std::size_t find_string_special(const char *s, std::size_t pos,
+                                         std::size_t n);
+};
+
+/**
+ * @brief check if the SSE2 kernels can run on this machine. they fall back
+ * to the scalar code when they can't
+ */
+bool has_sse2();
+
+/**
+ * @brief check if the AVX2 kernels can run on this machine
+ */
+bool has_avx2();
+
+} // namespace scan
+
+#endif /* SCAN_KERNELS_HPP */
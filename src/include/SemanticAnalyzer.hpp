@@ -8,13 +8,18 @@
 #define SEMANTIC_ANALYZER_H
 
 #include "ASTNode.hpp"
+#include "FlatAST.hpp"
 #include "FunctionSymbol.hpp"
 #include "SymTable.hpp"
 #include "Symbol.hpp"
+#include "Visitor.hpp"
+#include <climits>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <stdexcept>
+#include <unordered_set>
 #include <vector>
 
 using namespace yy;
@@ -24,11 +29,17 @@ typedef std::vector<std::vector<Node>> expr_list_t;
 /**
  * @brief perform semantic analysis of the ast and build a symbol table
  */
-class SemanticAnalyzer {
+class SemanticAnalyzer : public Visitor<SemanticAnalyzer> {
 public:
   std::shared_ptr<SymTable> sym_table;
 
-  SemanticAnalyzer(std::shared_ptr<ASTNode> ast) : ast(ast) {
+  SemanticAnalyzer(std::shared_ptr<ASTNode> ast,
+                   std::shared_ptr<FlatAST> flat_ast = nullptr)
+      : ast(ast), flat_ast(flat_ast) {
+    if (this->flat_ast == nullptr) {
+      this->flat_ast = std::make_shared<FlatAST>(ast.get());
+    }
+
     sym_table = std::shared_ptr<SymTable>(new SymTable());
     // build the list of expected types for bool and math expressions
     expression_types.insert(std::pair<Node, expr_list_t>(
@@ -71,7 +82,10 @@ public:
 
   /**
    * @brief perform semantic validation of the ast and build a symtable. the
-   * method traverses ast multiple times to find all semantic errors
+   * method declares all global symbols, then walks the ast once, keeping the
+   * enclosing function, loop and block on an explicit context stack. type
+   * checks that need the complete symbol table are queued during the walk and
+   * run afterwards, so diagnostics come out in the same order as before
    *
    * @return true if ast is semantically correct and passed all the checks
    * @return false otherwise
@@ -79,8 +93,65 @@ public:
   bool validate();
 
 private:
+  friend class Visitor<SemanticAnalyzer>;
+
+  /**
+   * @brief state of the enclosing scope during the traversal
+   */
+  struct context_t {
+    ASTNode *node;
+    // enclosing function, NO_NAME at the top level
+    name_id_t function;
+    Node return_type;
+    // number of enclosing `while` loops
+    int loop_depth;
+    // number of enclosing blocks inside the function
+    int block_depth;
+  };
+
+  /**
+   * @brief outermost nodes that set `can_generate_wasm_getter` of the ids
+   * below them, as depths on the path from the function node. the flag ends
+   * up with the value written by the outermost writer, since it runs last
+   */
+  struct getter_writers_t {
+    static constexpr int NONE = INT_MAX;
+
+    // writes every id below it, either `false` or whether it's a variable
+    int all = NONE;
+    bool all_by_symbol = false;
+    // writes `true` to every variable below it
+    int variables = NONE;
+    // writes `true` to this node only
+    int direct = NONE;
+    // function call whose actual parameters are the children of this node
+    int params = NONE;
+  };
+
   std::shared_ptr<ASTNode> ast;
+  std::shared_ptr<FlatAST> flat_ast;
   std::map<Node, expr_list_t> expression_types;
+  const name_id_t main_name = intern("main");
+
+  std::vector<context_t> context_stack;
+
+  // returns and blocks of the current function, in the order a
+  // `find_recursive` from the function would have reported them
+  std::vector<ASTNode *> function_returns;
+  std::vector<ASTNode *> function_blocks;
+
+  // nodes waiting for the type checking, in post-order
+  std::vector<ASTNode *> deferred_type_checks;
+
+  // errors found while filling out the symbol table
+  std::vector<bool> declaration_errors;
+
+  // memoized `validate_expr` result of every expression, by flat index
+  std::vector<std::int8_t> expr_validity;
+
+  // ids that are indexed or declare an array, the only places an array can
+  // appear
+  std::unordered_set<ASTNode *> array_ids;
 
   /**
    * @brief check if declaration is allowed at current block level. the method
@@ -95,67 +166,84 @@ private:
   bool is_declaration_allowed();
 
   /**
-   * @brief traverse the ast with possible pre and post order callbacks.
+   * @brief populate the symtable with global variables, functions and their
+   * parameters. only looks at the top level of the program
+   */
+  void declare_globals();
+
+  /**
+   * @brief create the symbol of a variable declaration
    *
-   * @param node ast node to start traversing from
-   * @param pre pre-order callback function
-   * @param post pos-order callback function
-   * @param err_stack a vector to keep track of errors displayed. Rather
-   * **hacky** way to allow semantic analyzer to print all errors after checks
-   * have been performed
+   * @param node global or local variable declaration
+   * @return Symbol* the variable, an array if it's declared with a length
    */
-  void
-  traverse(ASTNode *node,
-           std::function<void(ASTNode *n, std::vector<bool> &err_stack)> pre,
-           std::function<void(ASTNode *n, std::vector<bool> &err_stack)> post,
-           std::vector<bool> &err_stack);
+  Symbol *make_variable(ASTNode *node);
 
   /**
-   * @brief post-order callback function, used to collect & populate sym table
-   * with information about global variables and functions. In addition it also
-   * creates scopes for all global functions and specifies allowed function
-   * scope for all identifiers found in the function block.
+   * @brief check the length of an array declaration
    *
-   * @param node ast node returned from `#traverse`
-   * @param err_stack error stack returned from `#traverse`
+   * @param node global or local variable declaration
+   * @param err_stack error stack of the traversal
    */
-  void globals_post_order_pass_cb(ASTNode *node, std::vector<bool> &err_stack);
+  void check_array(ASTNode *node, std::vector<bool> &err_stack);
 
   /**
-   * @brief post-order callback function, used to populate the symtable. In
-   * addition it performs lookups to make sure identifiers haven't been
-   * re-declared multiple times or if they exist.
+   * @brief get the type of the value of an expression, as far as it can be
+   * told without checking the expression
    *
-   * @param node ast node returned from `#traverse`
-   * @param err_stack error stack returned from `#traverse`
+   * @param node expression
+   * @return Node int_t or boolean_t, or the type of the node if it's neither
    */
-  void sym_table_post_pass_cb(ASTNode *node, std::vector<bool> &err_stack);
+  Node value_type(ASTNode *node);
 
   /**
-   * @brief post-order callback function, used to perform type checking of
-   * functions, identifiers, expressions, etc.
+   * @brief bind every identifier under `node` to the symbol it refers to. has
+   * to run once all the symbols visible from `node` are defined
    *
-   * @param node ast node returned from `#traverse`
-   * @param err_stack error stack returned from `#traverse`
+   * @param node function or global declaration
    */
-  void type_checking_post_order_pass_cb(ASTNode *node,
-                                        std::vector<bool> &err_stack);
+  void resolve_ids(ASTNode *node);
 
   /**
-   * @brief pre-order callback function, used to determine block nesting level.
+   * @brief pre-order step of the traversal. opens function, loop and block
+   * contexts and tags identifiers with the function they belong to
    *
-   * @param node ast node returned from `#traverse`
-   * @param err_stack error stack returned from `#traverse`
+   * @param node visited node
    */
-  void enter_scope_cb(ASTNode *node, std::vector<bool> &err_stack);
+  void enter(ASTNode *node);
 
   /**
-   * @brief pre-order callback function, used to enter function scopes
+   * @brief post-order step of the traversal. defines local variables, checks
+   * declarations, calls and assignments of each block and closes contexts
    *
-   * @param node ast node returned from `#traverse`
-   * @param err_stack error stack returned from `#traverse`
+   * @param node visited node
    */
-  void build_scope_cb(ASTNode *node, std::vector<bool> &err_stack);
+  void leave(ASTNode *node);
+
+  /**
+   * @brief check return statements and `break` placement of a function, once
+   * the whole function has been visited
+   *
+   * @param node function declaration
+   * @param err_stack error stack of the traversal
+   */
+  void check_function(ASTNode *node, std::vector<bool> &err_stack);
+
+  /**
+   * @brief decide which identifiers of a function are read as values and need
+   * a `get` instruction. walks the function once with an explicit stack
+   *
+   * @param function function declaration
+   */
+  void mark_getters(ASTNode *function);
+
+  /**
+   * @brief perform type checking of functions, identifiers, expressions, etc.
+   *
+   * @param node queued node
+   * @param err_stack error stack of the type checking
+   */
+  void type_check(ASTNode *node, std::vector<bool> &err_stack);
 
   /**
    * @brief perform recursive expression validation based on expected types,
@@ -166,7 +254,29 @@ private:
    * @return true if expression is valid
    * @return false otherwise
    */
-  bool validate_expr(ASTNode *expr, expr_list_t expected_tyes);
+  bool validate_expr(ASTNode *expr, const expr_list_t &expected_tyes);
+
+  /**
+   * @brief check the operands of an operator or assignment against the types
+   * the operator expects. the result only depends on the subtree, so it's
+   * computed once per node. nested operators are checked bottom up, so
+   * arbitrarily deep expressions don't grow the thread stack
+   *
+   * @param expr operator or assignment
+   * @return true if expression is valid
+   * @return false otherwise
+   */
+  bool is_valid_expr(ASTNode *expr);
+
+  /**
+   * @brief check if a node is an operator or assignment, validated by
+   * is_valid_expr
+   *
+   * @param node node to check
+   * @return true if the node is validated against expression_types
+   * @return false otherwise
+   */
+  bool is_checked_expr(const ASTNode *node) const;
 
   /**
    * @brief print semantic error message to stderr
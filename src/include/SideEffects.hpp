@@ -0,0 +1,26 @@
+/**
+ * @file SideEffects.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Find the expressions that can't be reordered or skipped freely
+ */
+
+#ifndef SIDE_EFFECTS_HPP
+#define SIDE_EFFECTS_HPP
+
+#include "ASTNode.hpp"
+#include <unordered_set>
+
+using namespace yy;
+
+/**
+ * @brief find the nodes of a tree that call a function, assign a variable or
+ * may trap (divide, index an array), or that contain such a node. The other
+ * expressions only read variables, so evaluating them early, late or not at
+ * all doesn't change what the program does
+ *
+ * @param root root of the tree
+ * @return std::unordered_set<ASTNode *> nodes with side effects
+ */
+std::unordered_set<ASTNode *> find_side_effects(ASTNode *root);
+
+#endif /* SIDE_EFFECTS_HPP */
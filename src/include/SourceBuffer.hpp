@@ -0,0 +1,80 @@
+/**
+ * @file SourceBuffer.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Read-only source text, memory mapped straight from the file
+ */
+
+#ifndef SOURCE_BUFFER_HPP
+#define SOURCE_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief position of a token's text, as an offset and a length in bytes. the
+ * scanner hands these to the parser instead of copying the text
+ */
+struct span_t {
+  std::uint32_t offset;
+  std::uint32_t length;
+};
+
+/**
+ * @brief SourceBuffer holds the text of a source file for the scanner. A
+ * regular file is mapped into memory and scanned in place; anything that
+ * can't be mapped (pipes, empty files) is read into an owned string instead.
+ * Offsets are 32-bit, so sources are limited to 4 GB.
+ */
+class SourceBuffer {
+public:
+  SourceBuffer() = default;
+  SourceBuffer(SourceBuffer const &) = delete;
+  SourceBuffer &operator=(SourceBuffer const &) = delete;
+  ~SourceBuffer() { close(); }
+
+  /**
+   * @brief create a buffer that owns a copy of `text`
+   *
+   * @param text source text
+   */
+  explicit SourceBuffer(std::string text);
+
+  /**
+   * @brief map the file at `path` into memory, replacing the current text
+   *
+   * @param path path to the file
+   * @return true if the file was opened
+   * @return false if it can't be read or is larger than 4 GB
+   */
+  bool open(std::string const &path);
+
+  /**
+   * @brief unmap the file, leaving the buffer empty
+   */
+  void close();
+
+  std::string_view text() const { return {data, length}; }
+  std::size_t size() const { return length; }
+
+  /**
+   * @brief get the text of a span
+   *
+   * @param span position of the text inside the buffer
+   * @return std::string_view text of the span, valid as long as the buffer
+   */
+  std::string_view substr(span_t span) const {
+    return {data + span.offset, span.length};
+  }
+
+private:
+  const char *data = nullptr;
+  std::size_t length = 0;
+
+  // mapped region, nullptr when the text lives in `owned`
+  void *mapping = nullptr;
+  std::string owned;
+};
+
+#endif /* SOURCE_BUFFER_HPP */
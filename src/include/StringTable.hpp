@@ -12,6 +12,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 struct entry_t {
   unsigned int offset;
@@ -38,6 +39,15 @@ public:
    */
   void define(std::string str);
 
+  /**
+   * @brief leave room after the strings defined so far. it's a part of the
+   * memory the strings take, but no string is placed there
+   *
+   * @param bytes size of the room
+   * @return unsigned int offset of the room
+   */
+  unsigned int reserve(unsigned int bytes);
+
   /**
    * @brief lookup a string in a table
    *
@@ -46,6 +56,28 @@ public:
    */
   entry_t lookup(std::string str);
 
+  /**
+   * @brief check if a string is already in the table
+   *
+   * @param str string to look for
+   * @return true if it was defined
+   */
+  bool contains(std::string const &str) const;
+
+  /**
+   * @brief get the strings in the order of their offsets
+   *
+   * @return std::vector<std::pair<std::string, entry_t>> strings and their
+   * entries
+   */
+  std::vector<std::pair<std::string, entry_t>> entries() const;
+
+  /**
+   * @brief get the number of bytes the strings take, the memory after them
+   * is free
+   */
+  unsigned int size() const { return offset_counter; }
+
   /**
    * @brief Generate WASM code with all the strings in the source code
    *
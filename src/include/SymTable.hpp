@@ -4,6 +4,7 @@
  * @brief Implementation of Symbol table using variation of scope stack. Symbol
  * table stack is built using hash map with scope name as a key (either function
  * name or hardcoded globad/predefined) and symbol table hash map as its value.
+ * Both maps are flat open-addressing tables keyed on interned names.
  */
 
 #ifndef SYM_TABLE_HPP
@@ -11,19 +12,21 @@
 
 #include "ASTNode.hpp"
 #include "FunctionSymbol.hpp"
+#include "IdMap.hpp"
+#include "Interner.hpp"
 #include "Symbol.hpp"
 #include <algorithm>
+#include <deque>
 #include <exception>
 #include <iomanip>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 using namespace yy;
 
-typedef std::map<std::string, Symbol *> symbol_table_t;
+typedef IdMap<Symbol *> symbol_table_t;
 
 /**
  * @brief Scope stack symbol table implementation
@@ -43,7 +46,7 @@ public:
    *
    * @param fun_name name of the function to define a scope
    */
-  void push_scope(std::string fun_name);
+  void push_scope(name_id_t fun_name);
 
   /**
    * @brief increment current block nesting level
@@ -61,18 +64,26 @@ public:
    * @param symbol symbol to define
    * @param fun_name name of the function (scope for the symbol)
    */
-  void define(Symbol *symbol, std::string fun_name);
+  void define(Symbol *symbol, name_id_t fun_name);
+
+  /**
+   * @brief remove a symbol from specified function scope
+   *
+   * @param name name of the symbol
+   * @param fun_name name of the function (scope of the symbol)
+   */
+  void remove(name_id_t name, name_id_t fun_name);
 
   /**
    * @brief lookup a symbol of a given name inside specified function scope. if
    * a symbol doesn't exist in the specified function scope look in global and
-   * predefined scopes before returning nullptr.
+   * predefined scopes before returning nullptr. never allocates.
    *
    * @param name symbol name to look for
    * @param fun scope of the symbol
    * @return Symbol* resulting symbol
    */
-  Symbol *lookup(std::string name, std::string fun);
+  Symbol *lookup(name_id_t name, name_id_t fun) const;
 
   /**
    * @brief lookup a symbol of a given name only inside specified function
@@ -82,7 +93,7 @@ public:
    * @param fun scope of the symbol
    * @return Symbol* resulting symbol
    */
-  Symbol *lookup_in_local(std::string name, std::string fun);
+  Symbol *lookup_in_local(name_id_t name, name_id_t fun) const;
 
   /**
    * @brief find a function with a given name
@@ -90,9 +101,30 @@ public:
    * @param name function name
    * @return FunctionSymbol*  resulting function symbol
    */
-  FunctionSymbol *find_function(std::string name);
+  FunctionSymbol *find_function(name_id_t name) const;
 
-  symbol_table_t get_scope(std::string scope_name);
+  /**
+   * @brief get the table of a scope. the reference stays valid for the
+   * lifetime of the symbol table
+   *
+   * @param scope_name name of the scope (function name or global/predefined)
+   * @return const symbol_table_t& symbols defined in the scope
+   */
+  const symbol_table_t &get_scope(name_id_t scope_name) const;
+
+  /**
+   * @brief get a handle to the table of a scope
+   *
+   * @param scope_name name of the scope (function name or global/predefined)
+   * @return const symbol_table_t* symbols defined in the scope, nullptr if the
+   * scope doesn't exist
+   */
+  const symbol_table_t *find_scope(name_id_t scope_name) const;
+
+  /**
+   * @brief get the name of the scope that holds global variables and functions
+   */
+  name_id_t global_scope() const { return GLOBAL_SCOPE_NAME; }
 
   friend std::ostream &operator<<(std::ostream &os, const SymTable &sym_table);
 
@@ -100,10 +132,17 @@ private:
   const int PREDEFINED_SCOPE = 0;
   const int GLOBAL_SCOPE = 1;
 
-  const std::string PREDEFINED_SCOPE_NAME = "predefined";
-  const std::string GLOBAL_SCOPE_NAME = "global";
+  const name_id_t PREDEFINED_SCOPE_NAME = intern("predefined");
+  const name_id_t GLOBAL_SCOPE_NAME = intern("global");
+
+  // scope tables in creation order. a deque never moves its elements, so
+  // handles to the tables stay valid while new scopes are pushed
+  std::deque<symbol_table_t> scope_stack;
+  std::vector<name_id_t> scope_names;
+  IdMap<symbol_table_t *> scope_index;
 
-  std::map<std::string, symbol_table_t> scope_stack;
+  symbol_table_t *predefined_table = nullptr;
+  symbol_table_t *global_table = nullptr;
 
   /**
    * @brief build any predefined symbols (functions, variables)
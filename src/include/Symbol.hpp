@@ -2,34 +2,43 @@
 #define SYMBOL_HPP
 
 #include "ASTNode.hpp"
+#include "Interner.hpp"
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <string_view>
 
 using namespace yy;
 
 class Symbol {
 public:
-  std::string name;
+  name_id_t name;
   std::string kind;
-  std::string wasm_name;
+  // `$name`, owned by the interner
+  std::string_view wasm_name;
   Node type;
   // what level is the symbol located
   int scope_level;
   // where on the scope stack it is
   int block_scope;
+  // number of elements of an array, 0 if the variable isn't one. `type` is
+  // the type of the elements
+  std::uint32_t length = 0;
 
-  Symbol(std::string name, std::string kind, Node type, int scope_level,
+  Symbol(name_id_t name, std::string kind, Node type, int scope_level,
          int block_scope)
-      : name(name), kind(kind), type(type), scope_level(scope_level),
-        block_scope(block_scope) {
-    wasm_name = "$" + name;
-  }
+      : name(name), kind(kind), wasm_name(Interner::global().wasm_name(name)),
+        type(type), scope_level(scope_level), block_scope(block_scope) {}
 
   bool is_global() const { return scope_level == 1; }
+  bool is_array() const { return length != 0; }
 
   virtual void print(std::ostream &os) const {
-    os << "<" << kind << ": " << get_str_for_type(type) << ", " << name
-       << ", scope level: " << scope_level
+    os << "<" << kind << ": " << get_str_for_type(type);
+    if (is_array()) {
+      os << "[" << length << "]";
+    }
+    os << ", " << name_str(name) << ", scope level: " << scope_level
        << ", block_scope (in symtable): " << block_scope
        << ", wasm_name: " << wasm_name << ">";
   }
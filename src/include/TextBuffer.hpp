@@ -0,0 +1,94 @@
+/**
+ * @file TextBuffer.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Indented text collected in one buffer and written out at once
+ */
+
+#ifndef TEXT_BUFFER_HPP
+#define TEXT_BUFFER_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief TextBuffer collects generated text in one contiguous buffer that
+ * grows geometrically and is written out with a single call. A line starts
+ * with a slice of a precomputed run of spaces and numbers are formatted with
+ * std::to_chars, so nothing is allocated per line or per token; flushing
+ * keeps the storage for the next use.
+ */
+class TextBuffer {
+public:
+  /**
+   * @param capacity bytes to reserve up front
+   * @param tabsize spaces per indentation level
+   */
+  explicit TextBuffer(std::size_t capacity = 1 << 16, int tabsize = 2)
+      : tabsize(tabsize) {
+    text.reserve(capacity);
+  }
+
+  /**
+   * @brief start a new line at the current indentation and append `content`
+   */
+  void line(std::string_view content) {
+    // a newline followed by enough spaces for all but the deepest levels
+    static const std::string blank = "\n" + std::string(256, ' ');
+
+    auto spaces = static_cast<std::size_t>(std::max(depth, 0) * tabsize);
+    auto run = std::min(spaces, blank.size() - 1);
+    text.append(blank.data(), 1 + run);
+    // deeper lines take more than one slice
+    for (spaces -= run; spaces != 0; spaces -= run) {
+      run = std::min(spaces, blank.size() - 1);
+      text.append(blank.data() + 1, run);
+    }
+    append(content);
+  }
+
+  /**
+   * @brief append a space and `content` to the current line
+   */
+  void add(std::string_view content) {
+    text.push_back(' ');
+    append(content);
+  }
+
+  void append(std::string_view content) {
+    text.append(content.data(), content.size());
+  }
+
+  /**
+   * @brief append a number in decimal
+   */
+  void number(std::int64_t value) {
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    text.append(digits, static_cast<std::size_t>(result.ptr - digits));
+  }
+
+  void indent() { depth++; }
+  void dedent() { depth--; }
+
+  std::size_t size() const { return text.size(); }
+
+  /**
+   * @brief write the buffered text to `out` with one call and empty the
+   * buffer, keeping its storage
+   */
+  void flush(std::ostream &out) {
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    text.clear();
+  }
+
+private:
+  std::string text;
+  int depth = 0;
+  int tabsize;
+};
+
+#endif /* TEXT_BUFFER_HPP */
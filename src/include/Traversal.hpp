@@ -0,0 +1,114 @@
+/**
+ * @file Traversal.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Iterative depth-first traversal shared by every pass over the AST
+ */
+
+#ifndef TRAVERSAL_HPP
+#define TRAVERSAL_HPP
+
+#include <type_traits>
+#include <vector>
+
+namespace yy {
+
+/**
+ * @brief what a traversal hook tells the walker to do next
+ */
+enum class Visit {
+  // carry on with the traversal
+  next,
+  // don't descend into the children of the node. only meaningful from a
+  // pre-order hook, the post-order hook of the node still runs
+  skip_children,
+  // end the traversal right away
+  stop,
+};
+
+namespace detail {
+
+/**
+ * @brief call a traversal hook. hooks may return a Visit or nothing, and
+ * `nullptr` stands for a missing hook
+ */
+template <typename Fn, typename T> Visit call_hook(Fn &fn, T *node) {
+  if constexpr (std::is_null_pointer_v<std::decay_t<Fn>>) {
+    return Visit::next;
+  } else if constexpr (std::is_same_v<std::invoke_result_t<Fn &, T *>,
+                                      Visit>) {
+    return fn(node);
+  } else {
+    fn(node);
+    return Visit::next;
+  }
+}
+
+} // namespace detail
+
+/**
+ * @brief walk the tree rooted at `root` depth-first, calling `pre` before and
+ * `post` after the children of every node. the work stack lives on the heap,
+ * so the depth of the tree is bounded by memory and not by the size of the
+ * thread stack
+ *
+ * @param root node to start from, anything with `children` (ASTNode)
+ * @param pre pre-order hook, takes a node pointer
+ * @param post post-order hook, takes a node pointer
+ * @return true if the whole tree was visited, false if a hook stopped early
+ */
+template <typename T, typename Pre, typename Post>
+bool walk(T *root, Pre &&pre, Post &&post) {
+  if (root == nullptr) {
+    return true;
+  }
+
+  using child_iterator = decltype(root->children.begin());
+
+  // node and the children that are left to visit
+  struct frame_t {
+    T *node;
+    child_iterator next;
+    child_iterator end;
+  };
+
+  std::vector<frame_t> stack;
+  stack.reserve(64);
+
+  auto enter = [&](T *node) {
+    auto visit = detail::call_hook(pre, node);
+    if (visit == Visit::stop) {
+      return false;
+    } else if (visit == Visit::skip_children) {
+      return detail::call_hook(post, node) != Visit::stop;
+    }
+
+    stack.push_back({node, node->children.begin(), node->children.end()});
+    return true;
+  };
+
+  if (!enter(root)) {
+    return false;
+  }
+
+  while (!stack.empty()) {
+    auto &top = stack.back();
+    if (top.next != top.end) {
+      T *child = *top.next++;
+      if (!enter(child)) {
+        return false;
+      }
+    } else {
+      T *node = top.node;
+      stack.pop_back();
+      if (detail::call_hook(post, node) == Visit::stop) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace yy
+
+#endif /* TRAVERSAL_HPP */
@@ -0,0 +1,56 @@
+/**
+ * @file VM.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Virtual machine that runs register bytecode
+ */
+
+#ifndef VM_HPP
+#define VM_HPP
+
+#include "Bytecode.hpp"
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace vm {
+
+/**
+ * @brief Trap is thrown when a program traps: division by zero, call stack
+ * exhaustion, an array index out of bounds, or a function that returns a
+ * value running off its end
+ */
+class Trap : public std::runtime_error {
+public:
+  explicit Trap(std::string const &message)
+      : std::runtime_error("trap: " + message) {}
+};
+
+/**
+ * @brief VM runs a compiled program. Each frame is a window of registers in
+ * one register file; the arguments of a call are the temporaries of the
+ * caller that become the first registers of the callee. Instructions are
+ * dispatched with computed goto where the compiler supports it, and with a
+ * switch otherwise. The builtins `printi`, `prints`, `printc`, `printb`,
+ * `getchar` and `halt` are instructions of their own.
+ */
+class VM {
+public:
+  explicit VM(Program const &program) : program(program) {}
+
+  /**
+   * @brief run the program from its main function
+   *
+   * @param in stream `getchar` reads from
+   * @param out stream the program prints to
+   * @throws Trap if the program traps
+   */
+  void run(std::istream &in, std::ostream &out);
+
+private:
+  Program const &program;
+};
+
+} // namespace vm
+
+#endif /* VM_HPP */
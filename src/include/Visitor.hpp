@@ -0,0 +1,66 @@
+/**
+ * @file Visitor.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Compile time visitor over the AST
+ */
+
+#ifndef VISITOR_HPP
+#define VISITOR_HPP
+
+#include "ASTNode.hpp"
+#include "Traversal.hpp"
+
+namespace yy {
+
+/**
+ * @brief Visitor is a CRTP base for passes over the AST. The derived class
+ * implements `enter` (pre-order) and/or `leave` (post-order), usually as a
+ * switch on the node type. Both are resolved at compile time, so they're
+ * called directly from the traversal loop and can be inlined into it. A hook
+ * may return a Visit to skip the children of a node or stop the traversal.
+ *
+ *   class Counter : public Visitor<Counter> {
+ *   public:
+ *     int calls = 0;
+ *     void enter(ASTNode *node) {
+ *       switch (node->type) {
+ *       case Node::function_call:
+ *         calls++;
+ *         break;
+ *       default:
+ *         break;
+ *       }
+ *     }
+ *   };
+ *
+ * A derived class that keeps its hooks private has to befriend
+ * `Visitor<Derived>`.
+ *
+ * @tparam Derived class implementing the hooks
+ */
+template <typename Derived> class Visitor {
+public:
+  /**
+   * @brief visit every node of the subtree rooted at `root`, in constant
+   * thread stack space
+   *
+   * @param root node to start from
+   * @return true if the whole subtree was visited, false if a hook stopped
+   * the traversal
+   */
+  bool visit(ASTNode *root) {
+    auto &self = static_cast<Derived &>(*this);
+    return walk(
+        root, [&self](ASTNode *node) { return self.enter(node); },
+        [&self](ASTNode *node) { return self.leave(node); });
+  }
+
+protected:
+  // default hooks, hidden by the hooks of the derived class
+  void enter(ASTNode *) {}
+  void leave(ASTNode *) {}
+};
+
+} // namespace yy
+
+#endif /* VISITOR_HPP */
@@ -0,0 +1,366 @@
+/**
+ * @file Wasm.hpp
+ * @author Artem Golovin (30018900)
+ * @brief In-memory WebAssembly module and its binary encoding
+ */
+
+#ifndef WASM_HPP
+#define WASM_HPP
+
+#include "Interner.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+/**
+ * @brief kind of the immediate that follows an opcode
+ */
+enum class Imm {
+  none,
+  // block type of block, loop and if
+  block,
+  // label of br and br_if
+  label,
+  // labels of br_table, the last one is the default
+  table,
+  // function index of call
+  func,
+  local,
+  global,
+  // signed LEB128 constant
+  i32,
+  // alignment and offset of a memory access
+  memarg,
+};
+
+// name, mnemonic, opcode, immediate. every value in J-- is an i32, so only the
+// i32 part of the instruction set is here
+#define WASM_OPCODES(X)                                                        \
+  X(unreachable, "unreachable", 0x00, none)                                    \
+  X(nop, "nop", 0x01, none)                                                    \
+  X(block, "block", 0x02, block)                                               \
+  X(loop, "loop", 0x03, block)                                                 \
+  X(if_, "if", 0x04, block)                                                    \
+  X(else_, "else", 0x05, none)                                                 \
+  X(end, "end", 0x0b, none)                                                    \
+  X(br, "br", 0x0c, label)                                                     \
+  X(br_if, "br_if", 0x0d, label)                                               \
+  X(br_table, "br_table", 0x0e, table)                                         \
+  X(return_, "return", 0x0f, none)                                             \
+  X(call, "call", 0x10, func)                                                  \
+  X(drop, "drop", 0x1a, none)                                                  \
+  X(select, "select", 0x1b, none)                                              \
+  X(local_get, "local.get", 0x20, local)                                       \
+  X(local_set, "local.set", 0x21, local)                                       \
+  X(local_tee, "local.tee", 0x22, local)                                       \
+  X(global_get, "global.get", 0x23, global)                                    \
+  X(global_set, "global.set", 0x24, global)                                    \
+  X(i32_load, "i32.load", 0x28, memarg)                                        \
+  X(i32_load8_s, "i32.load8_s", 0x2c, memarg)                                  \
+  X(i32_load8_u, "i32.load8_u", 0x2d, memarg)                                  \
+  X(i32_load16_u, "i32.load16_u", 0x2f, memarg)                                \
+  X(i32_store, "i32.store", 0x36, memarg)                                      \
+  X(i32_store8, "i32.store8", 0x3a, memarg)                                    \
+  X(i32_store16, "i32.store16", 0x3b, memarg)                                  \
+  X(i32_const, "i32.const", 0x41, i32)                                         \
+  X(i32_eqz, "i32.eqz", 0x45, none)                                            \
+  X(i32_eq, "i32.eq", 0x46, none)                                              \
+  X(i32_ne, "i32.ne", 0x47, none)                                              \
+  X(i32_lt_s, "i32.lt_s", 0x48, none)                                          \
+  X(i32_lt_u, "i32.lt_u", 0x49, none)                                          \
+  X(i32_gt_s, "i32.gt_s", 0x4a, none)                                          \
+  X(i32_gt_u, "i32.gt_u", 0x4b, none)                                          \
+  X(i32_le_s, "i32.le_s", 0x4c, none)                                          \
+  X(i32_le_u, "i32.le_u", 0x4d, none)                                          \
+  X(i32_ge_s, "i32.ge_s", 0x4e, none)                                          \
+  X(i32_ge_u, "i32.ge_u", 0x4f, none)                                          \
+  X(i32_clz, "i32.clz", 0x67, none)                                            \
+  X(i32_ctz, "i32.ctz", 0x68, none)                                            \
+  X(i32_popcnt, "i32.popcnt", 0x69, none)                                      \
+  X(i32_add, "i32.add", 0x6a, none)                                            \
+  X(i32_sub, "i32.sub", 0x6b, none)                                            \
+  X(i32_mul, "i32.mul", 0x6c, none)                                            \
+  X(i32_div_s, "i32.div_s", 0x6d, none)                                        \
+  X(i32_div_u, "i32.div_u", 0x6e, none)                                        \
+  X(i32_rem_s, "i32.rem_s", 0x6f, none)                                        \
+  X(i32_rem_u, "i32.rem_u", 0x70, none)                                        \
+  X(i32_and, "i32.and", 0x71, none)                                            \
+  X(i32_or, "i32.or", 0x72, none)                                              \
+  X(i32_xor, "i32.xor", 0x73, none)                                            \
+  X(i32_shl, "i32.shl", 0x74, none)                                            \
+  X(i32_shr_s, "i32.shr_s", 0x75, none)                                        \
+  X(i32_shr_u, "i32.shr_u", 0x76, none)                                        \
+  X(i32_rotl, "i32.rotl", 0x77, none)                                          \
+  X(i32_rotr, "i32.rotr", 0x78, none)
+
+enum class Op : std::uint8_t {
+#define WASM_OP_ENUM(name, text, code, imm) name = code,
+  WASM_OPCODES(WASM_OP_ENUM)
+#undef WASM_OP_ENUM
+};
+
+/**
+ * @brief get the WAT mnemonic of an opcode
+ */
+const char *op_name(Op op);
+
+/**
+ * @brief get the kind of immediate an opcode takes
+ */
+Imm op_imm(Op op);
+
+/**
+ * @brief get the natural alignment of a memory access, as log2 of the
+ * number of bytes it reads or writes
+ */
+std::uint32_t op_alignment(Op op);
+
+/**
+ * @brief find an opcode by its WAT mnemonic
+ *
+ * @param name mnemonic, such as `i32.add`
+ * @param op set to the opcode, if the mnemonic is known
+ * @return true if the mnemonic is known
+ */
+bool op_from_name(std::string_view name, Op &op);
+
+/**
+ * @brief append an unsigned LEB128 number
+ */
+void write_u32(std::string &out, std::uint32_t value);
+
+/**
+ * @brief append a signed LEB128 number
+ */
+void write_i32(std::string &out, std::int32_t value);
+
+/**
+ * @brief decode the escapes of a WAT string literal (without the quotes).
+ * besides the WAT escapes, `\b` and `\f` of J-- strings are understood, and
+ * a backslash that doesn't start an escape is kept as is
+ *
+ * @param text text between the quotes
+ * @return std::string bytes of the string
+ */
+std::string unescape(std::string_view text);
+
+/**
+ * @brief signature of a function. every value is an i32
+ */
+struct Signature {
+  std::uint32_t params = 0;
+  bool has_result = false;
+
+  bool operator==(Signature const &other) const {
+    return params == other.params && has_result == other.has_result;
+  }
+};
+
+class Module;
+
+/**
+ * @brief Function collects the code of one function. locals, globals and
+ * labels are referenced by name and encoded as indices right away; callees
+ * are resolved by Module::encode, so a function can call one that is
+ * defined after it
+ */
+class Function {
+public:
+  Function(Module &module, name_id_t name, std::vector<name_id_t> params,
+           bool has_result);
+
+  name_id_t name;
+  Signature signature;
+
+  /**
+   * @brief declare a local variable, after the parameters
+   */
+  void local(name_id_t local_name);
+
+  /**
+   * @brief emit an instruction without immediates
+   */
+  void op(Op op);
+
+  /**
+   * @brief emit `i32.const`
+   */
+  void i32_const(std::int32_t value);
+
+  /**
+   * @brief emit local.get/set/tee of a local or a parameter
+   */
+  void local_op(Op op, name_id_t local_name);
+
+  /**
+   * @brief emit global.get/set
+   */
+  void global_op(Op op, name_id_t global_name);
+
+  /**
+   * @brief emit a call, the callee index is filled in by Module::encode
+   */
+  void call(name_id_t callee);
+
+  /**
+   * @brief emit a load or a store
+   *
+   * @param align log2 of the alignment
+   * @param offset constant offset of the address
+   */
+  void memory_op(Op op, std::uint32_t align, std::uint32_t offset);
+
+  /**
+   * @brief open a block, loop or if
+   *
+   * @param label label the branches refer to, NO_NAME if there's none
+   * @param has_result true if the construct leaves an i32
+   */
+  void begin(Op op, name_id_t label, bool has_result);
+
+  /**
+   * @brief switch an open if to its else branch
+   */
+  void else_();
+
+  /**
+   * @brief close the innermost block, loop or if
+   */
+  void end();
+
+  /**
+   * @brief emit br or br_if to a label of an enclosing block
+   *
+   * @throws std::runtime_error if no enclosing block has the label
+   */
+  void branch(Op op, name_id_t label);
+
+  /**
+   * @brief emit br or br_if by relative depth, 0 is the innermost block
+   */
+  void branch_depth(Op op, std::uint32_t depth);
+
+  /**
+   * @brief emit br_table, which branches to the label at the index on the
+   * stack, or to the last one if the index is out of range
+   *
+   * @param depths relative depths of the targets, the default last
+   */
+  void branch_table(std::vector<std::uint32_t> const &depths);
+
+  /**
+   * @brief get the relative depth of an enclosing block
+   *
+   * @throws std::runtime_error if no enclosing block has the label
+   */
+  std::uint32_t label_depth(name_id_t label) const;
+
+  /**
+   * @brief close the body of the function
+   */
+  void finish();
+
+  std::uint32_t local_count() const {
+    return static_cast<std::uint32_t>(locals.size()) - signature.params;
+  }
+
+  std::string const &code() const { return body; }
+
+private:
+  friend class Module;
+
+  Module &module;
+  // parameters, then locals
+  std::vector<name_id_t> locals;
+  std::unordered_map<name_id_t, std::uint32_t> local_index;
+  // labels of the open blocks, innermost last
+  std::vector<name_id_t> labels;
+  std::string body;
+  // offsets in `body` where the index of a callee has to be inserted
+  std::vector<std::pair<std::size_t, name_id_t>> calls;
+};
+
+/**
+ * @brief Module holds everything that ends up in a binary module and encodes
+ * it. functions are numbered in the order they are added, after the imports
+ */
+class Module {
+public:
+  /**
+   * @brief import a host function
+   */
+  void import(std::string module_name, std::string field, name_id_t name,
+              Signature signature);
+
+  /**
+   * @brief define a function. the reference stays valid until the module is
+   * destroyed
+   */
+  Function &function(name_id_t name, std::vector<name_id_t> params,
+                     bool has_result);
+
+  /**
+   * @brief define a mutable i32 global
+   */
+  void global(name_id_t name, std::int32_t value = 0);
+
+  /**
+   * @brief get the index of a global
+   *
+   * @throws std::runtime_error if there's no such global
+   */
+  std::uint32_t global_index(name_id_t name) const;
+
+  /**
+   * @brief export a function under `field`
+   */
+  void export_function(std::string field, name_id_t name);
+
+  /**
+   * @brief place bytes in the memory at `offset` when the module is loaded
+   */
+  void data(std::uint32_t offset, std::string bytes);
+
+  void set_memory(std::uint32_t pages) { memory_pages = pages; }
+  void set_start(name_id_t name) { start = name; }
+
+  /**
+   * @brief encode the module in the binary format
+   *
+   * @throws std::runtime_error if a call or an export names an unknown
+   * function
+   */
+  std::string encode() const;
+
+private:
+  struct import_t {
+    std::string module_name;
+    std::string field;
+    name_id_t name;
+    Signature signature;
+  };
+
+  struct data_t {
+    std::uint32_t offset;
+    std::string bytes;
+  };
+
+  std::vector<import_t> imports;
+  // functions keep their address, they are referenced while being built
+  std::vector<std::unique_ptr<Function>> functions;
+  std::vector<std::int32_t> globals;
+  std::unordered_map<name_id_t, std::uint32_t> global_indices;
+  std::vector<std::pair<std::string, name_id_t>> exports;
+  std::vector<data_t> segments;
+  std::uint32_t memory_pages = 0;
+  name_id_t start = NO_NAME;
+};
+
+} // namespace wasm
+
+#endif /* WASM_HPP */
@@ -0,0 +1,105 @@
+/**
+ * @file WatAssembler.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Assembler for the subset of the WebAssembly text format that the
+ * compiler and its runtime use
+ */
+
+#ifndef WAT_ASSEMBLER_HPP
+#define WAT_ASSEMBLER_HPP
+
+#include "Wasm.hpp"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief WatAssembler adds the contents of WAT text to a wasm::Module. It
+ * understands a whole `(module ...)` or a bare list of module fields (as in
+ * `runtime.wat`): imported functions, memory, i32 globals, functions with
+ * inline exports, data, start and exports. Instructions may be written
+ * plainly or folded. Everything is referenced by `$name`.
+ */
+class WatAssembler {
+public:
+  explicit WatAssembler(wasm::Module &module) : module(module) {}
+
+  /**
+   * @brief assemble WAT text into the module
+   *
+   * @param wat text to assemble
+   * @throws std::runtime_error on anything outside the supported subset,
+   * with the line it's on
+   */
+  void assemble(std::string_view wat);
+
+private:
+  enum class Kind { lparen, rparen, atom, string, eof };
+
+  struct token_t {
+    Kind kind;
+    std::string_view text;
+    int line;
+  };
+
+  wasm::Module &module;
+  std::vector<token_t> tokens;
+  std::size_t pos = 0;
+
+  void tokenize(std::string_view wat);
+
+  const token_t &peek(std::size_t ahead = 0) const;
+  const token_t &next();
+
+  /**
+   * @brief check if the next tokens are `(` and the keyword
+   */
+  bool at_field(std::string_view keyword) const;
+
+  void expect(Kind kind, std::string_view what);
+  std::string_view expect_atom(std::string_view what);
+  std::string_view expect_string(std::string_view what);
+
+  /**
+   * @brief read a `$name` and intern it without the `$`
+   */
+  name_id_t expect_name(std::string_view what);
+  std::int32_t expect_i32();
+
+  [[noreturn]] void error(std::string const &message) const;
+
+  void field();
+  void import();
+  void memory();
+  void global();
+  void func();
+  void data();
+  void start();
+  void export_();
+
+  /**
+   * @brief read `(param ...)` and `(result ...)` of a function type
+   *
+   * @param params names of the parameters, NO_NAME for unnamed ones
+   * @return true if the function has a result
+   */
+  bool signature(std::vector<name_id_t> &params);
+
+  /**
+   * @brief read a block type, `(result i32)` if there's one
+   */
+  bool block_result();
+
+  /**
+   * @brief read instructions until the closing parenthesis of the enclosing
+   * field, or a plain `end` / `else` when `plain_block` is set
+   */
+  void instructions(wasm::Function &function, bool plain_block = false);
+
+  void plain(wasm::Function &function, wasm::Op op);
+  void folded(wasm::Function &function);
+  void immediate(wasm::Function &function, wasm::Op op);
+};
+
+#endif /* WAT_ASSEMBLER_HPP */
@@ -0,0 +1,219 @@
+/**
+ * @file X86Generator.hpp
+ * @author Artem Golovin (30018900)
+ * @brief Generate x86-64 assembly (GNU as, AT&T syntax) for J-- code
+ */
+
+#ifndef X86_GENERATOR_HPP
+#define X86_GENERATOR_HPP
+
+#include "ASTNode.hpp"
+#include "IdMap.hpp"
+#include "SymTable.hpp"
+#include "Visitor.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace yy;
+
+/**
+ * @brief X86Generator writes an x86-64 assembly file for a checked program,
+ * to be assembled with `as` and linked with `ld` against
+ * src/lib/runtime_x86_64.s, which implements the builtins on top of Linux
+ * system calls.
+ *
+ * Parameters and locals of a function are placed in callee-saved registers
+ * by a linear scan over their live intervals; the ones that don't fit live
+ * in the frame. Expressions are computed in %eax, with operands that are
+ * constants or variables used in place and intermediate values pushed on the
+ * machine stack. Comparisons are fused with the branch of an `if` or
+ * `while`. Local arrays are in the frame below the variables, global ones in
+ * .bss; elements are 4 bytes.
+ *
+ * Arguments are pushed left to right and popped by the caller; the result is
+ * returned in %eax. The runtime takes its argument in %edi.
+ */
+class X86Generator : public Visitor<X86Generator> {
+public:
+  X86Generator(std::shared_ptr<ASTNode> ast,
+               std::shared_ptr<SymTable> sym_table, std::ostream &out)
+      : ast(ast), sym_table(sym_table), out(out) {}
+
+  /**
+   * @brief generate the assembly file and write it to the out stream
+   */
+  void generate();
+
+private:
+  /**
+   * @brief where the value of an expression is
+   */
+  struct operand_t {
+    enum Kind {
+      // constant, or the index of a string literal
+      imm,
+      // variable read in place, a register or a memory operand
+      loc,
+      // %eax
+      acc,
+      // pushed on the machine stack
+      stacked,
+      // comparison that hasn't been emitted yet
+      cmp,
+    } kind;
+    std::int32_t value = 0;
+    // loc: the operand, cmp: the left side
+    std::string where;
+    // cmp: the right side and the condition code of `left op right`
+    std::string right;
+    std::string cc;
+  };
+
+  /**
+   * @brief if or while statement being generated
+   */
+  struct control_t {
+    ASTNode *node;
+    std::string false_label;
+    std::string end_label;
+    // while: the condition is moved below the body
+    std::size_t cond_start = 0;
+    std::size_t cond_end = 0;
+    std::string body_label;
+    operand_t cond{operand_t::imm};
+  };
+
+  std::shared_ptr<ASTNode> ast;
+  std::shared_ptr<SymTable> sym_table;
+  std::ostream &out;
+
+  std::unordered_set<FunctionSymbol *> functions;
+  std::unordered_map<std::string, std::int32_t> string_index;
+  std::vector<std::string> strings;
+  int next_label = 0;
+
+  // nodes from the root to the one being visited
+  std::vector<ASTNode *> path;
+  std::vector<control_t> controls;
+  // expressions that call, assign or may trap, && and || jump over them
+  std::unordered_set<ASTNode *> effects;
+  // labels after the right side of every && and || being generated
+  std::vector<std::string> short_circuits;
+
+  // state of the function being generated
+  std::vector<std::string> lines;
+  // code that is rarely run, placed after the function
+  std::vector<std::string> cold;
+  IdMap<std::int32_t> location_index;
+  std::vector<std::string> locations;
+  // offset of the first element of every local array from %rbp
+  IdMap<std::int64_t> array_location;
+  std::vector<std::string> saved_registers;
+  std::int32_t frame_size = 0;
+  std::string return_label;
+  // locals are read into %eax right away when an expression can assign them
+  bool eager_locals = false;
+  std::vector<operand_t> operands;
+
+  friend class Visitor<X86Generator>;
+
+  /**
+   * @brief pre-order step, opens functions and statements
+   */
+  Visit enter(ASTNode *node);
+
+  /**
+   * @brief post-order step, emits the instructions of a node once its
+   * operands are generated
+   */
+  void leave(ASTNode *node);
+
+  /**
+   * @brief a child of an if, while, call, && or || is generated, emit what
+   * follows it
+   */
+  void after_child(ASTNode *parent, ASTNode *child);
+
+  void begin_function(ASTNode *node);
+  void end_function(ASTNode *node);
+
+  /**
+   * @brief assign a register or a frame slot to every parameter and local
+   * of a function, with a linear scan over their live intervals
+   */
+  void allocate(ASTNode *node);
+
+  void call(ASTNode *node);
+  void arithmetic(ASTNode *node);
+  void compare(ASTNode *node);
+  void divide(ASTNode *node);
+  void assign(ASTNode *node);
+
+  /**
+   * @brief check the index of an element access, and load the element
+   * unless it is assigned to
+   */
+  void element(ASTNode *node);
+
+  /**
+   * @brief memory operand of an array element
+   *
+   * @param sym array
+   * @param index constant index, added to the one in `index_reg`
+   * @param index_reg 64-bit register with the index, or empty. the address
+   * of a global array has to be in %rcx then
+   */
+  std::string element_operand(Symbol *sym, std::int32_t index,
+                              std::string const &index_reg) const;
+
+  /**
+   * @brief store the value of an assignment to an array element, the index
+   * was checked before the value was computed
+   */
+  void store_element(ASTNode *node);
+
+  void emit(std::string line);
+  std::string label();
+  void place(std::string const &label);
+
+  void push(operand_t operand);
+  operand_t pop();
+
+  /**
+   * @brief pop an operand, computing a pending comparison into %eax
+   */
+  operand_t pop_value();
+
+  /**
+   * @brief push whatever is in %eax on the machine stack, so %eax can be
+   * written. pending comparisons are computed and pushed as well, since they
+   * need %eax once they are used
+   */
+  void save_acc();
+
+  /**
+   * @brief get an operand into a register
+   *
+   * @param operand operand to load, not stacked unless it's on top of the
+   * machine stack
+   * @param reg 32-bit register to load it into
+   */
+  void load(operand_t const &operand, std::string const &reg);
+
+  /**
+   * @brief emit a jump to `target` taken when the truth of `cond` is `when`
+   */
+  void branch(operand_t const &cond, bool when, std::string const &target);
+
+  /**
+   * @brief assembler name of a string literal
+   */
+  std::string string_label(std::int32_t index) const;
+};
+
+#endif /* X86_GENERATOR_HPP */
@@ -92,252 +92,114 @@
   )
 )
 
-;;
-;; @brief Helper function that gets ASCII representation of a single digit
-;; @param $num: i32 integer to convert
-;; @return i32 ASCII value of a $num
-;;
-(func $_get_int_char (param $num i32) (result i32)
-  local.get $num
-  i32.const 48  ;; '0' in ASCII
-  i32.add       ;; add value of '0' to integer that needs to be printed
-)
-
-;;
-;; @brief Helper function that gets the power of passed integer.
-;;        For example, an integer 1234 will return power 3 (10^3 = 1000)
-;; @return i32 power of the $num
-;;
-(func $_get_exponent (param $num i32) (result i32)
-  (local $power i32)
-
-  loop $pow
-    local.get $num
-    i32.const 10
-    i32.div_u
-    local.set $num
-    
-    ;; $power += 1
-    i32.const 1
-    local.get $power
-    i32.add
-    local.set $power
-
-    ;; if $num != 0, keep looping
-    local.get $num
-    i32.const 0
-    i32.ne
-    br_if $pow
-  end $pow
-
-  local.get $power
-  i32.const 1
-  i32.sub
-  local.set $power
-
-  local.get $power
-)
-
-;;
-;; @brief Raise to to the given power and return the result.
-;;        For example, 10^2 == 100, 10^0 == 1
-;; @param $exp: i32, exponent
-;; @return i32, 10 to the power of $exp
-;;
-(func $_10_to_pow (param $exp i32) (result i32)
-  (local $result i32)
-  (local $base i32)
-
-  i32.const 1
-  local.set $result
-
-  i32.const 10
-  local.set $base
-
-  block $_outer
-    local.get $exp
-    i32.const 0
-    i32.eq
-    br_if $_outer
-
-    local.get $exp
-    i32.const 0
-    i32.lt_s
-    br_if $_outer
-
-    loop $_exp
-      ;; $result = $result * $base
-      local.get $result
-      local.get $base
-      i32.mul
-      local.set $result
-
-      ;; exp -= 1
-      local.get $exp
-      i32.const 1
-      i32.sub
-      local.set $exp
-
-      local.get $exp
-      i32.const 0
-      i32.ne
-      br_if $_exp
-    end $_exp
-  end $_outer
-
-
-  local.get $result
-)
-
 ;;
 ;; void printi(int num);
 ;; 
-;; @brief Function that prints an integer.
+;; @brief Function that prints an integer. Its digits are written from the
+;;        end of a scratch space to the front, two at a time from a table of
+;;        the pairs "00" to "99", and printed with a single call of prints.
+;;        The compiler places the table at 9, after "true" and "false", and
+;;        the 11 bytes of scratch, enough for "-2147483648", after it
 ;; @param $num: i32, an integer to print
 ;;
 (func $printi (export "printi") (param $num i32)
-  (local $last_int i32)
-  (local $exponent i32)
-  (local $decimal i32)
-  (local $num_part i32)
-  
+  (local $n i32)   ;; digits left to write
+  (local $pos i32) ;; first character written so far
+
+  i32.const 220    ;; end of the scratch space
+  local.set $pos
+
+  local.get $num
+  local.set $n
+
   block $_if_neg
     ;; if $num >= 0, branch out
     local.get $num
     i32.const 0
     i32.ge_s
     br_if $_if_neg
-    
-    ;; otherwise print minus sign
-    i32.const 45  ;; '-' in ASCII
-    call $printc
 
-    ;; and negate the number before printing digits
-    i32.const 0   ;; negate $num by doing 0 - $num
+    ;; otherwise negate the number, 0 - $num is its magnitude as an unsigned
+    ;; integer, -2147483648 included
+    i32.const 0
     local.get $num
     i32.sub
-    local.set $num
+    local.set $n
   end $_if_neg
-  
-  ;; find out the exponent of the given number
-  local.get $num
-  call $_get_exponent
-  local.set $exponent
-
-  ;; get the 10^$exponent
-  local.get $exponent
-  call $_10_to_pow
-  local.set $decimal
 
-  ;; iterate to print number by number
   block $_outer
-    loop $print_num
-      ;; calculate $num / 10^$exponent
-      local.get $num
-      local.get $decimal
-      i32.div_u
-      local.set $num_part ;; save it to $num_part
-
-      ;; get the leftmost digit to print
-      ;; $num_part % 10
-      local.get $num_part
-      i32.const 10
-      i32.rem_u
-      call $_get_int_char
-      call $printc
+    loop $_pairs
+      ;; if $n < 100, one or two digits are left
+      local.get $n
+      i32.const 100
+      i32.lt_u
+      br_if $_outer
 
-      ;; go to the next exponent
-      ;; $exponent -= 1
-      local.get $exponent
-      i32.const 1
+      ;; $pos -= 2
+      local.get $pos
+      i32.const 2
       i32.sub
-      local.set $exponent
+      local.tee $pos
 
-      ;; if $exponent less than 0, branch out
-      local.get $exponent
-      i32.const 0
-      i32.lt_s
-      br_if $_outer
+      ;; copy the pair of the last two digits, $n % 100
+      local.get $n
+      i32.const 100
+      i32.rem_u
+      i32.const 1
+      i32.shl
+      i32.load16_u offset=9
+      i32.store16
 
-      ;; otherwise update the $decimal
-      local.get $exponent
-      call $_10_to_pow
-      local.set $decimal
+      ;; $n /= 100
+      local.get $n
+      i32.const 100
+      i32.div_u
+      local.set $n
 
-      ;; keep iterating if $exponent >= 0
-      local.get $exponent
-      i32.const 0
-      i32.ge_u
-      br_if $print_num
-    end $print_num
+      br $_pairs
+    end $_pairs
   end $_outer
-)
 
-;;
-;; boolean __and_op(boolean lhs, boolean rhs);
-;; 
-;; @brief Helper for a boolean and operation (&&)
-;;
-;; @param $lhs: i32, a "boolean"
-;; @param $rhs: i32, a "boolean"
-;;
-(func $__and_op (param $l i32) (param $r i32) (result i32)
-  (if
-    (block (result i32)
-      local.get $l
-      i32.const 0
-      i32.eq
-    )
-    (then 
-      i32.const 0
-      return
-    )
-  )
-  (if
-    (block (result i32)
-      local.get $r
-      i32.const 0
-      i32.eq
-    )
-    (then 
-      i32.const 0
-      return
-    )
-  )
-  i32.const 1
-  return
-)
-;;
-;; boolean __or_op(boolean lhs, boolean rhs);
-;; 
-;; @brief Helper for a boolean or operation (||)
-;;
-;; @param $lhs: i32, a "boolean"
-;; @param $rhs: i32, a "boolean"
-;;
-(func $__or_op (param $l i32) (param $r i32) (result i32)
-  (if
-    (block (result i32)
-      local.get $l
+  (if (i32.lt_u (local.get $n) (i32.const 10))
+    (then
+      ;; a single digit
+      local.get $pos
       i32.const 1
-      i32.eq
+      i32.sub
+      local.tee $pos
+      local.get $n
+      i32.const 48  ;; '0' in ASCII
+      i32.add
+      i32.store8
     )
-    (then 
+    (else
+      local.get $pos
+      i32.const 2
+      i32.sub
+      local.tee $pos
+      local.get $n
       i32.const 1
-      return
+      i32.shl
+      i32.load16_u offset=9
+      i32.store16
     )
   )
-  (if
-    (block (result i32)
-      local.get $r
-      i32.const 1
-      i32.eq
-    )
-    (then 
+
+  (if (i32.lt_s (local.get $num) (i32.const 0))
+    (then
+      local.get $pos
       i32.const 1
-      return
+      i32.sub
+      local.tee $pos
+      i32.const 45  ;; '-' in ASCII
+      i32.store8
     )
   )
-  i32.const 0
-  return
-)
\ No newline at end of file
+
+  ;; print the characters from $pos to the end of the scratch space
+  local.get $pos
+  i32.const 220
+  local.get $pos
+  i32.sub
+  call $prints
+)
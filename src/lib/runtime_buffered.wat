@@ -0,0 +1,122 @@
+;;
+;; Buffered output, for modules compiled with --runtime=buffered. These
+;; functions take the place of the ones in runtime.wat with the same name.
+;; Characters are collected in a buffer in linear memory, from $__out up to
+;; $__out_end, and written out with a single call of the `write` host import
+;; when the buffer is full, on halt() and at the end of main. $__out_pos is
+;; where the next character goes. The compiler places the buffer and defines
+;; the globals.
+;;
+
+;;
+;; @brief Write the buffered characters with the host and empty the buffer
+;;
+(func $__flush
+  (if (i32.ne (global.get $__out_pos) (global.get $__out))
+    (then
+      global.get $__out
+      global.get $__out_pos
+      global.get $__out
+      i32.sub
+      call $write
+
+      global.get $__out
+      global.set $__out_pos
+    )
+  )
+)
+
+;;
+;; void halt();
+;;
+;; @brief Function that writes the buffered output and stops execution
+;;
+(func $halt (export "halt")
+  call $__flush
+  call $exit
+)
+
+;;
+;; void printc(int char);
+;;
+;; @brief Function takes in a single character and adds it to the buffer
+;; @param $char: i32 an integer representation of a single character
+;;
+(func $printc (export "printc") (param $char i32)
+  ;; make room for the character
+  (if (i32.eq (global.get $__out_pos) (global.get $__out_end))
+    (then
+      call $__flush
+    )
+  )
+
+  global.get $__out_pos
+  local.get $char
+  i32.store8
+
+  global.get $__out_pos
+  i32.const 1
+  i32.add
+  global.set $__out_pos
+)
+
+;;
+;; void prints(string str);
+;;
+;; @brief Function takes in a string and copies it to the buffer
+;; @param $offset: i32 position of the string to print
+;; @param $length: i32 length of the string
+;;
+(func $prints (export "prints") (param $offset i32) (param $length i32)
+  (local $end i32)
+
+  ;; make room for the string
+  (if (i32.gt_u (local.get $length)
+                (i32.sub (global.get $__out_end) (global.get $__out_pos)))
+    (then
+      call $__flush
+    )
+  )
+
+  ;; a string that doesn't fit in the buffer at all is written as it is
+  (if (i32.gt_u (local.get $length)
+                (i32.sub (global.get $__out_end) (global.get $__out)))
+    (then
+      local.get $offset
+      local.get $length
+      call $write
+      return
+    )
+  )
+
+  local.get $offset
+  local.get $length
+  i32.add
+  local.set $end
+
+  block $_done
+    loop $_copy
+      local.get $offset
+      local.get $end
+      i32.ge_u
+      br_if $_done      ;; stop once the whole string is copied
+
+      global.get $__out_pos
+      local.get $offset
+      i32.load8_u
+      i32.store8        ;; copy a single byte
+
+      global.get $__out_pos
+      i32.const 1
+      i32.add
+      global.set $__out_pos
+
+      local.get $offset
+      i32.const 1
+      i32.add
+      local.set $offset ;; $offset += 1
+
+      br $_copy
+    end $_copy
+  end $_done
+)
@@ -0,0 +1,258 @@
+#
+# runtime_x86_64.s
+#
+# @brief J-- builtins for programs compiled with `jay --target=x86_64`,
+#        written against Linux system calls so no C library is needed:
+#
+#          as src/lib/runtime_x86_64.s -o runtime.o
+#          jay --target=x86_64 program.j -o program.s
+#          as program.s -o program.o
+#          ld program.o runtime.o -o program
+#
+#        Functions take their argument in %edi and may clobber the
+#        caller-saved registers. Output is buffered; the buffer is flushed on
+#        exit, by halt(), and before getchar() waits for input.
+#
+
+	.set OUT_SIZE, 65536
+	.set IN_SIZE, 4096
+
+	.text
+
+#
+# Entry point: run main, then exit with status 0
+#
+	.globl _start
+_start:
+	call jay_main
+	jmp jay_halt
+
+#
+# void halt();
+#
+# @brief Function that stops execution
+#
+	.globl jay_halt
+jay_halt:
+	call flush
+	movl $60, %eax             # exit(0)
+	xorl %edi, %edi
+	syscall
+
+#
+# void printc(int char);
+#
+# @brief Function takes in a single character and prints it to stdout
+# @param %edi: an integer representation of a single character
+#
+	.globl jay_printc
+jay_printc:
+	movq out_len(%rip), %rax
+	cmpq $OUT_SIZE, %rax
+	jb 1f
+	pushq %rdi
+	call flush
+	popq %rdi
+	xorl %eax, %eax
+1:	leaq out_buf(%rip), %rcx
+	movb %dil, (%rcx,%rax)
+	incq %rax
+	movq %rax, out_len(%rip)
+	ret
+
+#
+# void prints(string str);
+#
+# @brief Function takes in a string and prints it to stdout
+# @param %rdi: address of the string
+# @param %esi: length of the string
+#
+	.globl jay_prints
+jay_prints:
+	pushq %rbx
+	pushq %r12
+	movq %rdi, %rbx
+	movl %esi, %r12d
+1:	testl %r12d, %r12d
+	jz 2f
+	movzbl (%rbx), %edi
+	call jay_printc
+	incq %rbx
+	decl %r12d
+	jmp 1b
+2:	popq %r12
+	popq %rbx
+	ret
+
+#
+# void printb(boolean bool);
+#
+# @brief Function takes in a boolean and prints it to stdout
+# @param %edi: bool value, "true" for integers > 0
+#
+	.globl jay_printb
+jay_printb:
+	testl %edi, %edi
+	jle 1f
+	leaq true_str(%rip), %rdi
+	movl $4, %esi
+	jmp jay_prints
+1:	leaq false_str(%rip), %rdi
+	movl $5, %esi
+	jmp jay_prints
+
+#
+# void printi(int num);
+#
+# @brief Function that prints an integer
+# @param %edi: an integer to print
+#
+	.globl jay_printi
+jay_printi:
+	movslq %edi, %rax
+	testq %rax, %rax
+	jns 1f
+	pushq %rax
+	movl $45, %edi             # '-'
+	call jay_printc
+	popq %rax
+	negq %rax                  # in 64 bits, so INT_MIN is fine
+1:	subq $24, %rsp             # digits are written backwards from the end
+	leaq 24(%rsp), %rsi
+	movl $10, %ecx
+2:	xorl %edx, %edx
+	divq %rcx
+	addb $48, %dl              # '0'
+	decq %rsi
+	movb %dl, (%rsi)
+	testq %rax, %rax
+	jnz 2b
+	leaq 24(%rsp), %rdx
+	subq %rsi, %rdx
+	movq %rsi, %rdi
+	movl %edx, %esi
+	call jay_prints
+	addq $24, %rsp
+	ret
+
+#
+# int getchar();
+#
+# @brief Function that reads a single byte from stdin
+# @return %eax: the byte, or -1 at the end of the input
+#
+	.globl jay_getchar
+jay_getchar:
+	call flush
+	movq in_pos(%rip), %rax
+	cmpq in_len(%rip), %rax
+	jb 1f
+	xorl %eax, %eax            # read(0, in_buf, IN_SIZE)
+	xorl %edi, %edi
+	leaq in_buf(%rip), %rsi
+	movl $IN_SIZE, %edx
+	syscall
+	testq %rax, %rax
+	jle 2f
+	movq %rax, in_len(%rip)
+	xorl %eax, %eax
+1:	leaq in_buf(%rip), %rcx
+	movzbl (%rcx,%rax), %edx
+	incq %rax
+	movq %rax, in_pos(%rip)
+	movl %edx, %eax
+	ret
+2:	movl $-1, %eax
+	ret
+
+#
+# Traps: print the reason to stderr and exit with status 1
+#
+	.globl jay_div_zero
+jay_div_zero:
+	leaq div_zero_msg(%rip), %rsi
+	movl $div_zero_len, %edx
+	jmp trap
+
+	.globl jay_overflow
+jay_overflow:
+	leaq overflow_msg(%rip), %rsi
+	movl $overflow_len, %edx
+	jmp trap
+
+	.globl jay_unreachable
+jay_unreachable:
+	leaq unreachable_msg(%rip), %rsi
+	movl $unreachable_len, %edx
+	jmp trap
+
+	.globl jay_out_of_bounds
+jay_out_of_bounds:
+	leaq out_of_bounds_msg(%rip), %rsi
+	movl $out_of_bounds_len, %edx
+	jmp trap
+
+trap:
+	pushq %rsi
+	pushq %rdx
+	call flush
+	popq %rdx
+	popq %rsi
+	movl $1, %eax              # write(2, message, length)
+	movl $2, %edi
+	syscall
+	movl $60, %eax             # exit(1)
+	movl $1, %edi
+	syscall
+
+#
+# @brief Helper that writes out the output buffer
+#
+flush:
+	leaq out_buf(%rip), %rsi
+	movq out_len(%rip), %rdx
+1:	testq %rdx, %rdx
+	jz 2f
+	movl $1, %eax              # write(1, out_buf, out_len)
+	movl $1, %edi
+	syscall
+	testq %rax, %rax
+	jle 2f                     # stdout is gone, drop the rest
+	addq %rax, %rsi
+	subq %rax, %rdx
+	jmp 1b
+2:	movq $0, out_len(%rip)
+	ret
+
+	.section .rodata
+true_str:
+	.ascii "true"
+false_str:
+	.ascii "false"
+div_zero_msg:
+	.ascii "error: trap: integer divide by zero\n"
+	.set div_zero_len, . - div_zero_msg
+overflow_msg:
+	.ascii "error: trap: integer overflow\n"
+	.set overflow_len, . - overflow_msg
+unreachable_msg:
+	.ascii "error: trap: function ended without returning a value\n"
+	.set unreachable_len, . - unreachable_msg
+out_of_bounds_msg:
+	.ascii "error: trap: index out of bounds\n"
+	.set out_of_bounds_len, . - out_of_bounds_msg
+
+	.bss
+	.align 8
+out_len:
+	.zero 8
+in_pos:
+	.zero 8
+in_len:
+	.zero 8
+out_buf:
+	.zero OUT_SIZE
+in_buf:
+	.zero IN_SIZE
+
+	.section .note.GNU-stack,"",@progbits
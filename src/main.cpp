@@ -1,21 +1,102 @@
+#include "BytecodeCompiler.hpp"
+#include "CGenerator.hpp"
 #include "CodeGenerator.hpp"
+#include "ConstantFolding.hpp"
+#include "DeadCode.hpp"
+#include "Interpreter.hpp"
 #include "JayCompiler.hpp"
 #include "SemanticAnalyzer.hpp"
+#include "SourceBuffer.hpp"
+#include "VM.hpp"
+#include "X86Generator.hpp"
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * @brief how a program is run in process
+ */
+enum class Runner {
+  // compile it, don't run it
+  none,
+  // compile to a wasm module and interpret that
+  wasm,
+  // compile to register bytecode and run it on the VM
+  vm,
+};
+
+/**
+ * @brief machine the code is generated for
+ */
+enum class Target {
+  wasm,
+  // x86-64 assembly for the GNU assembler
+  x86_64,
+  // a C file for the host compiler, written with --emit=c
+  c,
+};
+
+/**
+ * @brief command line options
+ */
+struct options_t {
+  // scanner to read the source with
+  Lexer::Backend backend = Lexer::best_backend();
+  Target target = Target::wasm;
+  // WAT text or a binary module
+  OutputFormat format = OutputFormat::wat;
+  // how the wasm runtime prints
+  RuntimeMode runtime = RuntimeMode::unbuffered;
+  // file to write the output to, stdout if empty
+  std::string out_file;
+  // run the program instead of writing it out
+  Runner run = Runner::none;
+  // 0 generates the program as written, 1 folds constants and removes dead
+  // code first
+  int optimization = 0;
+  // print what the optimizations did to stderr
+  bool stats = false;
+};
+
+/**
+ * @brief compile a checked program to bytecode and run it on the VM, with
+ * stdin and stdout as its input and output
+ *
+ * @param ast root of the program
+ * @param sym_table symbol table built by semantic analysis
+ * @return int exit status of the compiler
+ */
+int run_vm(std::shared_ptr<ASTNode> ast, std::shared_ptr<SymTable> sym_table) {
+  std::ios::sync_with_stdio(false);
+  try {
+    vm::Program program = BytecodeCompiler(ast, sym_table).compile();
+    vm::VM(program).run(std::cin, std::cout);
+  } catch (std::runtime_error const &error) {
+    std::cout.flush();
+    std::cerr << "error: " << error.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
 
 /**
  * @brief build an ast from bison generated parser
  *
  * @param driver main driver, contains lexer and parser
- * @param is input stream from where parser will be reading input
- * @param file filename, if input stream is a fstream
+ * @param source source text the parser scans in place
+ * @param file filename of the source
+ * @param options command line options
+ * @param out stream the generated code goes to
+ * @return int exit status of the compiler
  */
-void build_ast(yy::JayCompiler &driver, std::istream *is, std::string file,
-               std::ostream &out) {
-  std::shared_ptr<ASTNode> ast(driver.parse(is, file));
+int build_ast(yy::JayCompiler &driver, const SourceBuffer &source,
+              std::string file, options_t const &options, std::ostream &out) {
+  // nodes are owned by the driver's arena, so the ast must not be deleted here
+  std::shared_ptr<ASTNode> ast(driver.parse(source, file, options.backend),
+                               [](ASTNode *) {});
 
   if (ast == nullptr) {
     std::cerr << "Failed parsing" << std::endl;
@@ -24,7 +105,7 @@ void build_ast(yy::JayCompiler &driver, std::istream *is, std::string file,
 
   std::shared_ptr<SymTable> sym_table(new SymTable());
   std::unique_ptr<SemanticAnalyzer> semantic_analyzer(
-      new SemanticAnalyzer(ast));
+      new SemanticAnalyzer(ast, driver.flat_ast));
 
   bool is_valid = semantic_analyzer->validate();
   // std::cout << *semantic_analyzer->sym_table << std::endl;
@@ -32,32 +113,175 @@ void build_ast(yy::JayCompiler &driver, std::istream *is, std::string file,
     exit(EXIT_FAILURE);
   }
 
+  if (options.optimization >= 1) {
+    auto folded = fold_constants(ast.get());
+    auto removed = eliminate_dead_code(ast.get(), *semantic_analyzer->sym_table);
+    // the flat copy of the tree still has the nodes as they were parsed
+    driver.flat_ast = std::make_shared<FlatAST>(ast.get());
+
+    if (options.stats) {
+      std::cerr << "folded " << folded << " nodes, removed " << removed.nodes
+                << " of " << removed.total
+                << " nodes (functions: " << removed.functions
+                << ", globals: " << removed.globals
+                << ", unreachable statements: " << removed.statements << ")"
+                << std::endl;
+    }
+  }
+
+  if (options.run == Runner::vm) {
+    return run_vm(ast, semantic_analyzer->sym_table);
+  }
+
+  if (options.target == Target::x86_64) {
+    X86Generator(ast, semantic_analyzer->sym_table, out).generate();
+    return EXIT_SUCCESS;
+  }
+
+  if (options.target == Target::c) {
+    CGenerator(ast, semantic_analyzer->sym_table, out).generate();
+    return EXIT_SUCCESS;
+  }
+
   std::unique_ptr<CodeGenerator> code_gen(
-      new CodeGenerator(ast, semantic_analyzer->sym_table, out));
+      new CodeGenerator(ast, driver.flat_ast, semantic_analyzer->sym_table, out,
+                        options.format, options.runtime));
 
-  code_gen->generate_wasm();
+  try {
+    code_gen->generate_wasm();
+  } catch (std::runtime_error const &error) {
+    std::cerr << "error: " << error.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief run a compiled module with stdin and stdout as its input and output
+ *
+ * @param binary module in the binary format
+ * @return int exit status of the compiler
+ */
+int run(std::string const &binary) {
+  std::ios::sync_with_stdio(false);
+  try {
+    wasm::Interpreter(binary).run(std::cin, std::cout);
+  } catch (std::runtime_error const &error) {
+    std::cout.flush();
+    std::cerr << "error: " << error.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
 }
 
 int main(int argc, char **argv) {
   yy::JayCompiler driver;
 
-  if (argc >= 2) {
-    std::string filename = argv[1];
-    std::ifstream file{filename};
-    if (!file.is_open()) {
+  std::string filename;
+  options_t options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.empty() || arg[0] != '-') {
+      if (filename.empty()) {
+        filename = arg;
+      }
+      continue;
+    }
+
+    if ((arg == "-o" || arg == "--out") && i + 1 < argc) {
+      options.out_file = argv[++i];
+    } else if (arg.rfind("--lexer=", 0) == 0) {
+      // flex, scalar, sse2, avx2 or simd
+      std::string name = arg.substr(std::string("--lexer=").size());
+      if (!Lexer::backend_from_name(name, options.backend)) {
+        std::cerr << "Unknown lexer \"" << name << "\"" << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else if (arg == "-O0" || arg == "-O1") {
+      options.optimization = arg[2] - '0';
+    } else if (arg == "--stats") {
+      options.stats = true;
+    } else if (arg.rfind("-O", 0) == 0) {
+      std::cerr << "Unknown optimization level \"" << arg.substr(2) << "\""
+                << std::endl;
+      return EXIT_FAILURE;
+    } else if (arg == "--emit=wat") {
+      options.format = OutputFormat::wat;
+    } else if (arg == "--emit=wasm") {
+      options.format = OutputFormat::wasm;
+    } else if (arg == "--emit=c") {
+      options.target = Target::c;
+    } else if (arg.rfind("--emit=", 0) == 0) {
+      std::cerr << "Unknown output format \"" << arg.substr(7) << "\""
+                << std::endl;
+      return EXIT_FAILURE;
+    } else if (arg == "--runtime=unbuffered") {
+      options.runtime = RuntimeMode::unbuffered;
+    } else if (arg == "--runtime=buffered") {
+      options.runtime = RuntimeMode::buffered;
+    } else if (arg.rfind("--runtime=", 0) == 0) {
+      std::cerr << "Unknown runtime \"" << arg.substr(10) << "\"" << std::endl;
+      return EXIT_FAILURE;
+    } else if (arg == "--target=wasm") {
+      options.target = Target::wasm;
+    } else if (arg == "--target=x86_64") {
+      options.target = Target::x86_64;
+    } else if (arg.rfind("--target=", 0) == 0) {
+      std::cerr << "Unknown target \"" << arg.substr(9) << "\"" << std::endl;
+      return EXIT_FAILURE;
+    } else if (arg == "--run" || arg == "--run=wasm") {
+      options.run = Runner::wasm;
+    } else if (arg == "--run=vm") {
+      options.run = Runner::vm;
+    } else if (arg.rfind("--run=", 0) == 0) {
+      std::cerr << "Unknown runner \"" << arg.substr(6) << "\"" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.target == Target::x86_64 && options.run != Runner::none) {
+    std::cerr << "--run can't be used with --target=x86_64, assemble and "
+                 "link the output instead"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (options.target == Target::c && options.run != Runner::none) {
+    std::cerr << "--run can't be used with --emit=c, compile the output "
+                 "instead"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.runtime == RuntimeMode::buffered &&
+      (options.target != Target::wasm || options.run == Runner::vm)) {
+    std::cerr << "--runtime=buffered only applies to WebAssembly" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!filename.empty()) {
+    SourceBuffer file;
+    if (!file.open(filename)) {
       std::cerr << "File \"" << filename << "\" not found" << std::endl;
       return EXIT_SUCCESS;
     }
 
-    if (argc == 4 &&
-        (std::string(argv[2]) == "-o" || std::string(argv[2]) == "--out") &&
-        argv[3] != nullptr) {
-      std::ofstream out(argv[3]);
-      build_ast(driver, &file, filename, out);
-    } else {
-      build_ast(driver, &file, filename, std::cout);
+    if (options.run == Runner::vm) {
+      std::ostringstream unused;
+      return build_ast(driver, file, filename, options, unused);
     }
 
+    if (options.run == Runner::wasm) {
+      options.format = OutputFormat::wasm;
+      std::ostringstream module;
+      build_ast(driver, file, filename, options, module);
+      return run(module.str());
+    }
+
+    if (!options.out_file.empty()) {
+      std::ofstream out(options.out_file, std::ios::binary);
+      return build_ast(driver, file, filename, options, out);
+    }
+    return build_ast(driver, file, filename, options, std::cout);
   } else {
     std::cerr << "Please specify the filename" << std::endl;
     return EXIT_FAILURE;
@@ -12,17 +12,24 @@
   #define yylex driver.lexer->lex
 %}
 
+%code requires {
+  #include "Interner.hpp"
+  #include "SourceBuffer.hpp"
+}
+
 %parse-param { struct JayCompiler& driver }
 %error-verbose
 
 %union {
   struct ASTNode *node;
-  std::vector<struct ASTNode *> *list;
+  class NodeList *list;
+  name_id_t name;
+  span_t span;
 }
 
-%token T_ID
-%token T_STR
-%token T_NUM
+%token <name> T_ID
+%token <span> T_STR
+%token <span> T_NUM
 %token T_TYPE_INT
 %token T_TYPE_BOOLEAN
 %token T_TYPE_VOID
@@ -39,6 +46,8 @@
 %token T_SEPARATOR_RBRACE
 %token T_SEPARATOR_SEMI
 %token T_SEPARATOR_COMMA
+%token T_SEPARATOR_LBRACKET
+%token T_SEPARATOR_RBRACKET
 %token T_OP_PLUS
 %token T_OP_MINUS
 %token T_OP_TIMES
@@ -81,6 +90,8 @@
 
 %type<node> expression
 %type<node> assignment
+%type<node> array_assignment
+%type<node> array_access
 %type<node> assignment_expression
 %type<node> statement_expression
 %type<node> function_invocation
@@ -102,47 +113,48 @@
 
 program: /* empty */
      | globaldeclarations {
-         std::vector<ASTNode *> nodes = *$1;
-         driver.ast = new ASTNode{ Node::program, "", driver.lexer->lineno(), nodes };
+         NodeList nodes = *$1;
+         driver.ast = driver.arena->make(Node::program, "", driver.lexer->lineno(), nodes);
        }
      ;
 
 literal: T_NUM {
-           auto num_val = std::string(driver.lexer->YYText());
-           auto *num_node = new ASTNode { Node::int_t, num_val, driver.lexer->lineno(), {} };
+           auto num_val = std::string(driver.lexer->text($1));
+           auto *num_node = driver.arena->make(Node::int_t, num_val, driver.lexer->lineno());
            $$ = num_node;
          }
        | T_STR {
-           auto str_val = std::string(driver.lexer->YYText());
-           auto *str_node = new ASTNode { Node::string, str_val, driver.lexer->lineno(), {} };
+           auto str_val = std::string(driver.lexer->text($1));
+           auto *str_node = driver.arena->make(Node::string, str_val, driver.lexer->lineno());
            $$ = str_node;
          }
        | T_RESERVED_TRUE {
-           auto *true_node = new ASTNode { Node::boolean_t, "true", driver.lexer->lineno(), {} };
+           auto *true_node = driver.arena->make(Node::boolean_t, "true", driver.lexer->lineno());
            $$ = true_node;
          }
        | T_RESERVED_FALSE {
-           auto *false_node = new ASTNode { Node::boolean_t, "false", driver.lexer->lineno(), {} };
+           auto *false_node = driver.arena->make(Node::boolean_t, "false", driver.lexer->lineno());
            $$ = false_node;
          }
        ;
 
 type: T_TYPE_INT {
-        $$ = new ASTNode{ Node::int_t, "", driver.lexer->lineno(), {} };
+        $$ = driver.arena->make(Node::int_t, "", driver.lexer->lineno());
       }
     | T_TYPE_BOOLEAN {
-        $$ = new ASTNode{ Node::boolean_t, "", driver.lexer->lineno(), {} };
+        $$ = driver.arena->make(Node::boolean_t, "", driver.lexer->lineno());
       }
     ;
 
 identifier: T_ID {
-              auto id_name = std::string(driver.lexer->YYText());
-              $$ = new ASTNode{ Node::id, id_name, driver.lexer->lineno(), {} };
+              // the scanner already interned the identifier
+              $$ = driver.arena->make(Node::id, name_str($1), driver.lexer->lineno());
+              $$->name = $1;
             }
           ;
 
 globaldeclarations: globaldeclaration {
-                      $$ = new std::vector<ASTNode *>();
+                      $$ = driver.arena->make_list();
                       $$->push_back($1);
                     }
                   | globaldeclarations globaldeclaration {
@@ -152,12 +164,12 @@ globaldeclarations: globaldeclaration {
                   ;
 
 globaldeclaration: variable_declaration {
-                     std::vector<ASTNode *> global_var_nodes = *$1;
-                     $$ = new ASTNode { Node::global_var_decl, "", driver.lexer->lineno(), global_var_nodes };
+                     NodeList global_var_nodes = *$1;
+                     $$ = driver.arena->make(Node::global_var_decl, "", driver.lexer->lineno(), global_var_nodes);
                    }
                  | function_declaration {
-                   std::vector<ASTNode *> func_decl_nodes = *$1;
-                   $$ = new ASTNode { Node::function_decl, "", driver.lexer->lineno(), func_decl_nodes };
+                   NodeList func_decl_nodes = *$1;
+                   $$ = driver.arena->make(Node::function_decl, "", driver.lexer->lineno(), func_decl_nodes);
                  }
                  | main_function_declaration {
                      ASTNode *main_func_node = $1;
@@ -166,17 +178,26 @@ globaldeclaration: variable_declaration {
                  ;
 
 variable_declaration: type identifier T_SEPARATOR_SEMI {
-                        auto *nodes = new std::vector<ASTNode *>();
+                        auto *nodes = driver.arena->make_list();
 
                         nodes->push_back($1);
                         nodes->push_back($2);
                         $$ = nodes;
                       }
+                    | type identifier T_SEPARATOR_LBRACKET T_NUM T_SEPARATOR_RBRACKET T_SEPARATOR_SEMI {
+                        auto length = std::string(driver.lexer->text($4));
+                        auto *array_node = driver.arena->make(Node::array_t, length, driver.lexer->lineno(), { $1 });
+                        auto *nodes = driver.arena->make_list();
+
+                        nodes->push_back(array_node);
+                        nodes->push_back($2);
+                        $$ = nodes;
+                      }
                     ;
 
 function_declaration: type identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN block {
-                        auto *func_nodes = new std::vector<ASTNode *>();
-                        auto *empty_formals = new ASTNode { Node::formal_params, "", 0, {} };
+                        auto *func_nodes = driver.arena->make_list();
+                        auto *empty_formals = driver.arena->make(Node::formal_params, "", 0);
 
                         func_nodes->push_back($1); // type
                         func_nodes->push_back($2); // id
@@ -185,7 +206,7 @@ function_declaration: type identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN bloc
                         $$ = func_nodes;
                       }
                     | type identifier T_SEPARATOR_LPAREN param_list T_SEPARATOR_RPAREN block {
-                        auto *func_nodes = new std::vector<ASTNode *>();
+                        auto *func_nodes = driver.arena->make_list();
 
                         func_nodes->push_back($1);
                         func_nodes->push_back($2);
@@ -194,9 +215,9 @@ function_declaration: type identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN bloc
                         $$ = func_nodes;
                       }
                     | T_TYPE_VOID identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN block {
-                        auto *void_t_node = new ASTNode { Node::void_t, "", driver.lexer->lineno(), {} };
-                        auto *func_nodes = new std::vector<ASTNode *>();
-                        auto *empty_formals = new ASTNode { Node::formal_params, "", 0, {} };
+                        auto *void_t_node = driver.arena->make(Node::void_t, "", driver.lexer->lineno());
+                        auto *func_nodes = driver.arena->make_list();
+                        auto *empty_formals = driver.arena->make(Node::formal_params, "", 0);
 
                         func_nodes->push_back(void_t_node);
                         func_nodes->push_back($2);
@@ -205,8 +226,8 @@ function_declaration: type identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN bloc
                         $$ = func_nodes;
                       }
                     | T_TYPE_VOID identifier T_SEPARATOR_LPAREN param_list T_SEPARATOR_RPAREN block {
-                        auto *void_t_node = new ASTNode { Node::void_t, "", driver.lexer->lineno(), {} };
-                        auto *func_nodes = new std::vector<ASTNode *>();
+                        auto *void_t_node = driver.arena->make(Node::void_t, "", driver.lexer->lineno());
+                        auto *func_nodes = driver.arena->make_list();
 
                         func_nodes->push_back(void_t_node);
                         func_nodes->push_back($2);
@@ -218,19 +239,19 @@ function_declaration: type identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN bloc
 
 main_function_declaration: identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN block {
                              auto main_id = $1;
-                             auto *void_t_node = new ASTNode { Node::void_t, "", driver.lexer->lineno(), {} };
-                             auto *empty_formals = new ASTNode { Node::formal_params, "", 0, {} };
+                             auto *void_t_node = driver.arena->make(Node::void_t, "", driver.lexer->lineno());
+                             auto *empty_formals = driver.arena->make(Node::formal_params, "", 0);
 
-                             $$ = new ASTNode { 
+                             $$ = driver.arena->make(
                                Node::main_func_decl,
                                "",
                                driver.lexer->lineno(),
                                { void_t_node, main_id, empty_formals, $4 }
-                              };
+                              );
                            }
                          ;
 param_list: param {
-              auto *param_list = new ASTNode { Node::formal_params, "", 0, { $1 } };
+              auto *param_list = driver.arena->make(Node::formal_params, "", 0, { $1 });
               $$ = param_list;
             }
           | param_list T_SEPARATOR_COMMA param {
@@ -240,24 +261,24 @@ param_list: param {
           ;
 
 param: type identifier {
-         ASTNode *formal_param_node = new ASTNode { Node::formal, "", driver.lexer->lineno(), { $1, $2 } };
+         ASTNode *formal_param_node = driver.arena->make(Node::formal, "", driver.lexer->lineno(), { $1, $2 });
          $$ = formal_param_node;
        }
      ;
 
 block: T_SEPARATOR_LBRACE T_SEPARATOR_RBRACE {
-       $$ = new ASTNode { Node::block, "", driver.lexer->lineno(), {} };
+       $$ = driver.arena->make(Node::block, "", driver.lexer->lineno());
      }
      | T_SEPARATOR_LBRACE block_statements T_SEPARATOR_RBRACE {
        auto *block_children = $2;
-       auto *block = new ASTNode { Node::block, "", driver.lexer->lineno(), *block_children };
+       auto *block = driver.arena->make(Node::block, "", driver.lexer->lineno(), *block_children);
 
        $$ = block;
      }
      ;
 
 block_statements: block_statement {
-                    auto *block_statements = new std::vector<ASTNode *>();
+                    auto *block_statements = driver.arena->make_list();
                     block_statements->push_back($1);
                     $$ = block_statements;
                   }
@@ -268,7 +289,7 @@ block_statements: block_statement {
                 ;
 
 block_statement: variable_declaration {
-                   auto *var_decl_node = new ASTNode{ Node::variable_decl, "", driver.lexer->lineno(), *$1 };
+                   auto *var_decl_node = driver.arena->make(Node::variable_decl, "", driver.lexer->lineno(), *$1);
                    $$ = var_decl_node;
                  }
                | statement {
@@ -280,67 +301,70 @@ statement: block {
              $$ = $1;
            }
          | T_SEPARATOR_SEMI {
-             auto *null_statement = new ASTNode { Node::null_statement, "", driver.lexer->lineno(), {} };
+             auto *null_statement = driver.arena->make(Node::null_statement, "", driver.lexer->lineno());
              $$ = null_statement;
            }
          | statement_expression T_SEPARATOR_SEMI {
              $$ = $1;
            }
          | T_RESERVED_BREAK T_SEPARATOR_SEMI {
-             auto *break_statement = new ASTNode { Node::break_statement, "", driver.lexer->lineno(), {} };
+             auto *break_statement = driver.arena->make(Node::break_statement, "", driver.lexer->lineno());
              $$ = break_statement;
            }
          | T_RESERVED_RETURN expression T_SEPARATOR_SEMI {
-             auto *return_statement = new ASTNode { Node::return_statement, "", driver.lexer->lineno(), { $2 } };
+             auto *return_statement = driver.arena->make(Node::return_statement, "", driver.lexer->lineno(), { $2 });
              $$ = return_statement;
            }
          | T_RESERVED_RETURN T_SEPARATOR_SEMI {
-             auto *return_statement = new ASTNode { Node::return_statement, "", driver.lexer->lineno(), {} };
+             auto *return_statement = driver.arena->make(Node::return_statement, "", driver.lexer->lineno());
              $$ = return_statement;
            }
          | T_RESERVED_IF T_SEPARATOR_LPAREN expression T_SEPARATOR_RPAREN statement {
              auto *expression_node = $3;
              auto *statement_node = $5;
-             auto *if_node = new ASTNode { Node::if_statement, "", driver.lexer->lineno(), { expression_node, statement_node } };
+             auto *if_node = driver.arena->make(Node::if_statement, "", driver.lexer->lineno(), { expression_node, statement_node });
              $$ = if_node;
            }
          | T_RESERVED_IF T_SEPARATOR_LPAREN expression T_SEPARATOR_RPAREN statement T_RESERVED_ELSE statement {
              auto *expression_node = $3;
              auto *if_statement_node = $5;
              auto *else_statement_node = $7;
-             auto *if_else_node = new ASTNode { Node::if_else_statement, "", driver.lexer->lineno(), { expression_node, if_statement_node, else_statement_node } };
+             auto *if_else_node = driver.arena->make(Node::if_else_statement, "", driver.lexer->lineno(), { expression_node, if_statement_node, else_statement_node });
              $$ = if_else_node;
            }
          | T_RESERVED_WHILE T_SEPARATOR_LPAREN expression T_SEPARATOR_RPAREN statement {
              auto *expression_node = $3;
              auto *while_statement_node = $5;
-             auto *while_node = new ASTNode { Node::while_statement, "", driver.lexer->lineno(), { expression_node, while_statement_node } };
+             auto *while_node = driver.arena->make(Node::while_statement, "", driver.lexer->lineno(), { expression_node, while_statement_node });
              $$ = while_node;
            }
          ;
 
 statement_expression: assignment {
-                        $$ = new ASTNode{ Node::statement_expr, "", driver.lexer->lineno(), { $1 } };
+                        $$ = driver.arena->make(Node::statement_expr, "", driver.lexer->lineno(), { $1 });
                       }
                     | function_invocation {
-                        $$ = new ASTNode { Node::statement_expr, "", driver.lexer->lineno(), { $1 } };
+                        $$ = driver.arena->make(Node::statement_expr, "", driver.lexer->lineno(), { $1 });
+                      }
+                    | array_assignment {
+                        $$ = driver.arena->make(Node::statement_expr, "", driver.lexer->lineno(), { $1 });
                       }
                     ;
 
 function_invocation: identifier T_SEPARATOR_LPAREN actuals T_SEPARATOR_RPAREN {
-                       auto *actuals_node = new ASTNode { Node::actual_params, "", driver.lexer->lineno(), *$3 };
-                       auto *func_call_node = new ASTNode { Node::function_call, "", driver.lexer->lineno(), { $1, actuals_node } };
+                       auto *actuals_node = driver.arena->make(Node::actual_params, "", driver.lexer->lineno(), *$3);
+                       auto *func_call_node = driver.arena->make(Node::function_call, "", driver.lexer->lineno(), { $1, actuals_node });
                        $$ = func_call_node;
                      }
                    | identifier T_SEPARATOR_LPAREN T_SEPARATOR_RPAREN {
-                       auto *actuals_node = new ASTNode { Node::actual_params, "", 0, {} };
-                       auto *func_call_node = new ASTNode { Node::function_call, "", driver.lexer->lineno(), { $1, actuals_node } };
+                       auto *actuals_node = driver.arena->make(Node::actual_params, "", 0);
+                       auto *func_call_node = driver.arena->make(Node::function_call, "", driver.lexer->lineno(), { $1, actuals_node });
                        $$ = func_call_node;
                      }
                    ;
 
 actuals: expression {
-           auto *actuals_list = new std::vector<ASTNode *>();
+           auto *actuals_list = driver.arena->make_list();
            actuals_list->push_back($1);
            $$ = actuals_list;
          }
@@ -364,6 +388,9 @@ primary: literal {
 postfix_expression: identifier {
                       $$ = $1;
                     }
+                  | array_access {
+                      $$ = $1;
+                    }
                   | primary {
                       $$ = $1;
                     }
@@ -371,16 +398,19 @@ postfix_expression: identifier {
 
 unary_expression: T_OP_MINUS unary_expression {
                     auto *node = $2;
-                    if (node && node->is_num()) {
-                      node->value = node->value.insert(0, 1, '-');
+                    // a negative literal is a constant of its own, a minus in
+                    // front of it negates it again
+                    if (node && node->type == Node::int_t && node->is_const() &&
+                        node->value[0] != '-') {
+                      node->value.insert(0, 1, '-');
                       $$ = node;
                     } else {
-                      auto *unary_minus_node = new ASTNode{ Node::sub_op, "", driver.lexer->lineno(), { node } };
+                      auto *unary_minus_node = driver.arena->make(Node::sub_op, "", driver.lexer->lineno(), { node });
                       $$ = unary_minus_node;
                     }
                   }
                 | T_OP_NOT unary_expression {
-                    auto *not_node = new ASTNode{ Node::not_op, "", driver.lexer->lineno(), { $2 } };
+                    auto *not_node = driver.arena->make(Node::not_op, "", driver.lexer->lineno(), { $2 });
                     $$ = not_node;
                   }
                 | postfix_expression {
@@ -392,15 +422,15 @@ multiplicative_expression: unary_expression {
                              $$ = $1;
                            }
                          | multiplicative_expression T_OP_TIMES unary_expression {
-                             auto *mul_node = new ASTNode { Node::mul_op, "", driver.lexer->lineno(), { $1, $3 } };
+                             auto *mul_node = driver.arena->make(Node::mul_op, "", driver.lexer->lineno(), { $1, $3 });
                              $$ = mul_node;
                            }
                          | multiplicative_expression T_OP_DIV unary_expression {
-                             auto *div_node = new ASTNode { Node::div_op, "", driver.lexer->lineno(), { $1, $3 } };
+                             auto *div_node = driver.arena->make(Node::div_op, "", driver.lexer->lineno(), { $1, $3 });
                              $$ = div_node;
                            }
                          | multiplicative_expression T_OP_MOD unary_expression {
-                             auto *mod_node = new ASTNode { Node::mod_op, "", driver.lexer->lineno(), { $1, $3 } };
+                             auto *mod_node = driver.arena->make(Node::mod_op, "", driver.lexer->lineno(), { $1, $3 });
                              $$ = mod_node;
                            }
                          ;
@@ -409,11 +439,11 @@ additive_expression: multiplicative_expression {
                        $$ = $1;
                      }
                    | additive_expression T_OP_PLUS multiplicative_expression {
-                       auto *add_node = new ASTNode { Node::add_op, "", driver.lexer->lineno(), { $1, $3 } };
+                       auto *add_node = driver.arena->make(Node::add_op, "", driver.lexer->lineno(), { $1, $3 });
                        $$ = add_node;
                      }
                    | additive_expression T_OP_MINUS multiplicative_expression {
-                       auto *sub_node = new ASTNode { Node::sub_op, "", driver.lexer->lineno(), { $1, $3 } };
+                       auto *sub_node = driver.arena->make(Node::sub_op, "", driver.lexer->lineno(), { $1, $3 });
                        $$ = sub_node;
                      }
                    ;
@@ -422,19 +452,19 @@ relational_expression: additive_expression {
                          $$ = $1;
                        }
                      | relational_expression T_OP_LT additive_expression {
-                         auto *lt_node = new ASTNode { Node::lt_op, "", driver.lexer->lineno(), { $1, $3 } };
+                         auto *lt_node = driver.arena->make(Node::lt_op, "", driver.lexer->lineno(), { $1, $3 });
                          $$ = lt_node;
                        }
                      | relational_expression T_OP_GT additive_expression {
-                         auto *gt_node = new ASTNode { Node::gt_op, "", driver.lexer->lineno(), { $1, $3 } };
+                         auto *gt_node = driver.arena->make(Node::gt_op, "", driver.lexer->lineno(), { $1, $3 });
                          $$ = gt_node;
                        }
                      | relational_expression T_OP_LTEQ additive_expression {
-                         auto *lteq_node = new ASTNode { Node::lteq_op, "", driver.lexer->lineno(), { $1, $3 } };
+                         auto *lteq_node = driver.arena->make(Node::lteq_op, "", driver.lexer->lineno(), { $1, $3 });
                          $$ = lteq_node;
                        }
                      | relational_expression T_OP_GTEQ additive_expression {
-                         auto *gteq_node = new ASTNode { Node::gteq_op,  "", driver.lexer->lineno(), { $1, $3 } };
+                         auto *gteq_node = driver.arena->make(Node::gteq_op,  "", driver.lexer->lineno(), { $1, $3 });
                          $$ = gteq_node;
                        }
                      ;
@@ -443,11 +473,11 @@ equality_expression: relational_expression {
                        $$ = $1;
                      }
                    | equality_expression T_OP_EQEQ relational_expression {
-                       auto *equality_node = new ASTNode { Node::eqeq_op,  "", driver.lexer->lineno(), { $1, $3 } };
+                       auto *equality_node = driver.arena->make(Node::eqeq_op,  "", driver.lexer->lineno(), { $1, $3 });
                        $$ = equality_node;
                      }
                    | equality_expression T_OP_NOTEQ relational_expression {
-                       auto *not_equality_node = new ASTNode { Node::noteq_op,  "", driver.lexer->lineno(), { $1, $3 } };
+                       auto *not_equality_node = driver.arena->make(Node::noteq_op,  "", driver.lexer->lineno(), { $1, $3 });
                        $$ = not_equality_node;
                      }
                    ;
@@ -456,7 +486,7 @@ conditional_and_expression: equality_expression {
                               $$ = $1;
                             }
                           | conditional_and_expression T_OP_AND equality_expression {
-                              auto *and_node = new ASTNode { Node::bin_and_op,  "", driver.lexer->lineno(), { $1, $3 } };
+                              auto *and_node = driver.arena->make(Node::bin_and_op,  "", driver.lexer->lineno(), { $1, $3 });
                               $$ = and_node;
                             }
                           ;
@@ -465,7 +495,7 @@ conditional_or_expression: conditional_and_expression {
                              $$ = $1;
                            }
                          | conditional_or_expression T_OP_OR conditional_and_expression {
-                             auto *or_node = new ASTNode { Node::bin_or_op,  "", driver.lexer->lineno(), { $1, $3 } };
+                             auto *or_node = driver.arena->make(Node::bin_or_op,  "", driver.lexer->lineno(), { $1, $3 });
                              $$ = or_node;
                            }
                          ;
@@ -479,10 +509,21 @@ assignment_expression: conditional_or_expression {
                      ;
 
 assignment: identifier T_OP_EQ assignment_expression {
-              $$ = new ASTNode{ Node::eq_op, "", driver.lexer->lineno(), { $1, $3 } };
+              $$ = driver.arena->make(Node::eq_op, "", driver.lexer->lineno(), { $1, $3 });
             }
           ;
 
+array_access: identifier T_SEPARATOR_LBRACKET expression T_SEPARATOR_RBRACKET {
+                $$ = driver.arena->make(Node::index_op, "", driver.lexer->lineno(), { $1, $3 });
+              }
+            ;
+
+// an element is only assigned by a statement, the assignment isn't a value
+array_assignment: array_access T_OP_EQ assignment_expression {
+                    $$ = driver.arena->make(Node::eq_op, "", driver.lexer->lineno(), { $1, $3 });
+                  }
+                ;
+
 expression: assignment_expression {
               $$ = $1;
             }
@@ -0,0 +1,543 @@
+/**
+ * @file bench.test.cpp
+ * @author Artem Golovin (30018900)
+ * @brief Micro benchmarks for compiler internals. Benchmarks are hidden, run
+ * them with `make bench` or `./jay.test "[!benchmark]"`
+ */
+
+#include "BytecodeCompiler.hpp"
+#include "CodeGenerator.hpp"
+#include "Interpreter.hpp"
+#include "JayCompiler.hpp"
+#include "Lexer.hpp"
+#include "SemanticAnalyzer.hpp"
+#include "SourceBuffer.hpp"
+#include "SymTable.hpp"
+#include "VM.hpp"
+#include "Visitor.hpp"
+#include "catch.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * @brief build a symbol table with `globals` global variables, a function
+ * `f` with a single local variable and return ids of all globals
+ */
+static std::vector<name_id_t> populate(SymTable &sym_table, int globals) {
+  std::vector<name_id_t> ids;
+  for (int i = 0; i < globals; i++) {
+    auto id = intern("g" + std::to_string(i));
+    sym_table.define(new Symbol(id, "variable", Node::int_t, 1, 0),
+                     sym_table.global_scope());
+    ids.push_back(id);
+  }
+
+  sym_table.push_scope(intern("f"));
+  sym_table.define(new Symbol(intern("l"), "variable", Node::int_t, 2, 0),
+                   intern("f"));
+  return ids;
+}
+
+TEST_CASE("symbol table lookup stays flat as globals grow",
+          "[!benchmark][symtable]") {
+  for (int globals : {10, 100, 1000, 10000, 100000}) {
+    SymTable sym_table;
+    auto ids = populate(sym_table, globals);
+    auto f = intern("f");
+    auto l = intern("l");
+    auto printi = intern("printi");
+
+    REQUIRE(sym_table.lookup(ids.back(), f) != nullptr);
+    REQUIRE(sym_table.lookup(l, f) != nullptr);
+
+    // walk the globals with a stride so lookups don't hit the same cache line
+    std::size_t next = 0;
+    BENCHMARK("global from function scope, " + std::to_string(globals) +
+              " globals") {
+      next = (next + 7919) % ids.size();
+      return sym_table.lookup(ids[next], f);
+    };
+
+    BENCHMARK("local, " + std::to_string(globals) + " globals") {
+      return sym_table.lookup(l, f);
+    };
+
+    BENCHMARK("predefined function, " + std::to_string(globals) +
+              " globals") {
+      return sym_table.find_function(printi);
+    };
+  }
+}
+
+/**
+ * @brief build a `main` with an `else if` chain `depth` levels deep
+ */
+static std::string else_if_chain(int depth) {
+  std::string src = "main() {\n  int x;\n  x = 0;\n  ";
+  for (int i = 0; i < depth; i++) {
+    src += "if (x == " + std::to_string(i) + ") { x = x + " +
+           std::to_string(i) + "; } else ";
+  }
+  src += "{ printi(x); }\n}\n";
+  return src;
+}
+
+/**
+ * @brief build a `main` with `depth` nested `while` loops
+ */
+static std::string nested_loops(int depth) {
+  std::string src = "main() {\n  int x;\n  x = 0;\n";
+  for (int i = 0; i < depth; i++) {
+    src += "while (x < " + std::to_string(i) + ") { x = x + 1; ";
+  }
+  src += "break;";
+  for (int i = 0; i < depth; i++) {
+    src += " }";
+  }
+  src += "\n}\n";
+  return src;
+}
+
+/**
+ * @brief parse `src` and benchmark the semantic analysis of the result
+ */
+static void benchmark_analysis(std::string name, std::string const &src) {
+  yy::JayCompiler driver;
+  std::istringstream in(src);
+  std::shared_ptr<ASTNode> ast(driver.parse(&in, name), [](ASTNode *) {});
+  REQUIRE(ast != nullptr);
+
+  BENCHMARK(std::string(name)) {
+    SemanticAnalyzer analyzer(ast, driver.flat_ast);
+    return analyzer.validate();
+  };
+}
+
+TEST_CASE("semantic analysis is linear in nesting depth",
+          "[!benchmark][semantic]") {
+  for (int depth : {1000, 10000, 100000}) {
+    benchmark_analysis("else if chain, depth " + std::to_string(depth),
+                       else_if_chain(depth));
+    benchmark_analysis("nested while, depth " + std::to_string(depth),
+                       nested_loops(depth));
+  }
+}
+
+/**
+ * @brief build a `main` with `statements` arithmetic statements, a wide and
+ * shallow tree
+ */
+static std::string statements(int statements) {
+  std::string src = "main() {\n  int x;\n  x = 0;\n";
+  for (int i = 0; i < statements; i++) {
+    src += "  x = x * " + std::to_string(i) + " + (x - 1) / 2;\n";
+  }
+  src += "  printi(x);\n}\n";
+  return src;
+}
+
+/**
+ * @brief recursive traversal with callbacks taken as std::function by value,
+ * the way the passes used to walk the tree
+ */
+static void function_traverse(ASTNode *node,
+                              std::function<void(ASTNode *n)> pre,
+                              std::function<void(ASTNode *n)> post) {
+  if (pre != nullptr) {
+    pre(node);
+  }
+
+  for (auto *next : node->children) {
+    function_traverse(next, pre, post);
+  }
+
+  if (post != nullptr) {
+    post(node);
+  }
+}
+
+/**
+ * @brief counts operators and identifiers, with a switch like the passes
+ */
+class NodeCounter : public Visitor<NodeCounter> {
+public:
+  std::size_t ops = 0;
+  std::size_t ids = 0;
+
+  void enter(ASTNode *node) {
+    switch (node->type) {
+    case Node::add_op:
+    case Node::sub_op:
+    case Node::mul_op:
+    case Node::div_op:
+      ops++;
+      break;
+    case Node::id:
+      ids++;
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+TEST_CASE("per-node visit cost", "[!benchmark][visitor]") {
+  // the small tree stays in cache and shows the dispatch overhead, the large
+  // one is bound by memory
+  for (int count : {1000, 100000}) {
+    yy::JayCompiler driver;
+    std::istringstream in(statements(count));
+    auto *ast = driver.parse(&in, "statements");
+    REQUIRE(ast != nullptr);
+
+    NodeCounter expected;
+    expected.visit(ast);
+    REQUIRE(expected.ops == 4 * static_cast<std::size_t>(count));
+
+    auto nodes = std::to_string(driver.flat_ast->size()) + " nodes";
+    auto counting = [](NodeCounter &counter) {
+      return [&counter](ASTNode *node) { counter.enter(node); };
+    };
+
+    BENCHMARK("recursive std::function traversal, " + nodes) {
+      NodeCounter counter;
+      function_traverse(ast, counting(counter), nullptr);
+      return counter.ops;
+    };
+
+    BENCHMARK("ASTNode::traverse with std::function, " + nodes) {
+      NodeCounter counter;
+      std::function<void(ASTNode * n)> pre = counting(counter);
+      std::function<void(ASTNode * n)> post;
+      ast->traverse(pre, post);
+      return counter.ops;
+    };
+
+    BENCHMARK("CRTP visitor, " + nodes) {
+      NodeCounter counter;
+      counter.visit(ast);
+      return counter.ops;
+    };
+  }
+}
+
+/**
+ * @brief lex everything `lexer` produces
+ *
+ * @return number of tokens
+ */
+static std::size_t lex_all(Lexer &lexer) {
+  Lexer::TokenType value;
+  std::size_t tokens = 0;
+  while (lexer.lex(&value) != 0) {
+    tokens++;
+  }
+  return tokens;
+}
+
+TEST_CASE("lexing MB-scale sources", "[!benchmark][lexer]") {
+  auto path = std::filesystem::temp_directory_path() / "jay_bench_lexer.j";
+
+  for (int count : {30000, 300000}) {
+    auto src = statements(count);
+    std::ofstream(path) << src;
+    auto size = std::to_string(src.size() / 1000000.0).substr(0, 4) + " MB";
+
+    std::size_t expected;
+    {
+      std::ifstream in(path);
+      Lexer lexer(&in);
+      expected = lex_all(lexer);
+    }
+
+    BENCHMARK("ifstream through flex, " + size) {
+      std::ifstream in(path);
+      Lexer lexer(&in);
+      return lex_all(lexer);
+    };
+
+    BENCHMARK("mmap, scanned in place, " + size) {
+      SourceBuffer source;
+      source.open(path);
+      Lexer lexer(&source);
+      return lex_all(lexer);
+    };
+
+    SourceBuffer source;
+    REQUIRE(source.open(path));
+    Lexer lexer(&source);
+    REQUIRE(lex_all(lexer) == expected);
+
+    // the source is mapped once, so only the scanners are measured
+    std::pair<const char *, Lexer::Backend> backends[] = {
+        {"flex", Lexer::Backend::flex},
+        {"scalar", Lexer::Backend::scalar},
+        {"sse2", Lexer::Backend::sse2},
+        {"avx2", Lexer::Backend::avx2},
+    };
+    for (auto [name, backend] : backends) {
+      if (!Lexer::is_supported(backend)) {
+        continue;
+      }
+
+      BENCHMARK(std::string(name) + " backend, " + size) {
+        Lexer lexer(&source, backend);
+        return lex_all(lexer);
+      };
+    }
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("generating WAT", "[!benchmark][codegen]") {
+  // the program is parsed and checked once, only the code generator runs
+  for (int count : {10000, 100000}) {
+    yy::JayCompiler driver;
+    std::istringstream in(statements(count));
+    std::shared_ptr<ASTNode> ast(driver.parse(&in, "statements"),
+                                 [](ASTNode *) {});
+    REQUIRE(ast != nullptr);
+    SemanticAnalyzer analyzer(ast, driver.flat_ast);
+    REQUIRE(analyzer.validate());
+
+    std::ostringstream wat;
+    CodeGenerator(ast, driver.flat_ast, analyzer.sym_table, wat,
+                  OutputFormat::wat)
+        .generate_wasm();
+    auto size = std::to_string(wat.str().size() / 1000000.0).substr(0, 4);
+
+    BENCHMARK("WAT of " + std::to_string(count) + " statements, " + size +
+              " MB") {
+      std::ostringstream out;
+      CodeGenerator(ast, driver.flat_ast, analyzer.sym_table, out,
+                    OutputFormat::wat)
+          .generate_wasm();
+      return out.tellp();
+    };
+  }
+
+  // the emitter on its own, with the instructions of `x = x * i + 1`
+  auto x = intern("x");
+  auto f = intern("f");
+  auto emit = [x, f](std::ostream &out) {
+    StringTable strings;
+    auto emitter = make_emitter(OutputFormat::wat, out);
+    emitter->begin_module(1, RuntimeMode::unbuffered);
+    emitter->begin_func(f, {}, false, {x});
+    for (int i = 0; i < 200000; i++) {
+      emitter->variable(wasm::Op::local_get, x);
+      emitter->i32_const(i);
+      emitter->op(wasm::Op::i32_mul);
+      emitter->i32_const(1);
+      emitter->op(wasm::Op::i32_add);
+      emitter->variable(wasm::Op::local_set, x);
+    }
+    emitter->end_func();
+    emitter->end_module(strings, f);
+  };
+
+  std::ostringstream wat;
+  emit(wat);
+  auto size = std::to_string(wat.str().size() / 1000000.0).substr(0, 4);
+  BENCHMARK("emitter only, 1.2M instructions, " + size + " MB") {
+    std::ostringstream out;
+    emit(out);
+    return out.tellp();
+  };
+}
+
+/**
+ * @brief compile `src` to a binary module
+ */
+static std::string
+compile_wasm(std::string name, std::string const &src,
+             RuntimeMode runtime = RuntimeMode::unbuffered) {
+  yy::JayCompiler driver;
+  std::istringstream in(src);
+  std::shared_ptr<ASTNode> ast(driver.parse(&in, name), [](ASTNode *) {});
+  REQUIRE(ast != nullptr);
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  REQUIRE(analyzer.validate());
+
+  std::ostringstream out;
+  CodeGenerator(ast, driver.flat_ast, analyzer.sym_table, out,
+                OutputFormat::wasm, runtime)
+      .generate_wasm();
+  return out.str();
+}
+
+/**
+ * @brief compile `src` to bytecode for the VM
+ */
+static vm::Program compile_bytecode(std::string name, std::string const &src) {
+  yy::JayCompiler driver;
+  std::istringstream in(src);
+  std::shared_ptr<ASTNode> ast(driver.parse(&in, name), [](ASTNode *) {});
+  REQUIRE(ast != nullptr);
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  REQUIRE(analyzer.validate());
+  return BytecodeCompiler(ast, analyzer.sym_table).compile();
+}
+
+TEST_CASE("interpreting compiled programs", "[!benchmark][run]") {
+  auto read = [](const char *path) {
+    std::ostringstream src;
+    src << std::ifstream(path).rdbuf();
+    return src.str();
+  };
+
+  std::pair<std::string, std::string> programs[] = {
+      {"art-life", read("./test/codegen/art-life.j--")},
+      {"art-sieve", read("./test/codegen/art-sieve.j--")},
+      {"art-select", read("./test/codegen/art-select.j--")},
+      {"gen.t10, fib up to 20", read("./test/codegen/gen.t10")},
+      {"fib(25)", "main() { printi(fib(25)); }\n"
+                  "int fib(int n) {\n"
+                  "  if (n < 2) return n;\n"
+                  "  return fib(n - 1) + fib(n - 2);\n"
+                  "}\n"},
+  };
+
+  for (auto const &[name, src] : programs) {
+    auto binary = compile_wasm(name, src);
+
+    BENCHMARK("decode, " + name) { return wasm::Interpreter(binary); };
+
+    wasm::Interpreter interpreter(binary);
+    BENCHMARK("run, " + name) {
+      std::istringstream in;
+      std::ostringstream out;
+      interpreter.run(in, out);
+      return out.str().size();
+    };
+
+    auto program = compile_bytecode(name, src);
+    BENCHMARK("run on the bytecode VM, " + name) {
+      std::istringstream in;
+      std::ostringstream out;
+      vm::VM(program).run(in, out);
+      return out.str().size();
+    };
+  }
+}
+
+/**
+ * @brief output stream of a host, counts the calls it gets: one per byte from
+ * `putchar`, one per buffer from `write`
+ */
+class HostCalls : public std::streambuf {
+public:
+  std::size_t calls = 0;
+  std::size_t bytes = 0;
+
+protected:
+  int_type overflow(int_type c) override {
+    calls++;
+    bytes++;
+    return c;
+  }
+
+  std::streamsize xsputn(char const *, std::streamsize count) override {
+    calls++;
+    bytes += static_cast<std::size_t>(count);
+    return count;
+  }
+};
+
+// a run takes seconds, `./jay.test "[print]" --benchmark-samples 3` is
+// enough to compare them
+TEST_CASE("printing 10M integers", "[!benchmark][run][print]") {
+  auto src = "main() {\n"
+             "  int i;\n"
+             "  i = 0;\n"
+             "  while (i < 10000000) {\n"
+             "    printi(i);\n"
+             "    printc(10);\n"
+             "    i = i + 1;\n"
+             "  }\n"
+             "}\n";
+
+  std::size_t printed = 0;
+  std::pair<std::string, RuntimeMode> modes[] = {
+      {"putchar per character", RuntimeMode::unbuffered},
+      {"buffered, write per 64 KiB", RuntimeMode::buffered},
+  };
+  for (auto const &[name, mode] : modes) {
+    wasm::Interpreter interpreter(compile_wasm("print", src, mode));
+
+    HostCalls host;
+    std::ostream out(&host);
+    std::istringstream in;
+    interpreter.run(in, out);
+    // 7 digits and a newline for most of them
+    REQUIRE(host.bytes > 70000000);
+    if (printed != 0) {
+      REQUIRE(host.bytes == printed);
+    }
+    printed = host.bytes;
+
+    BENCHMARK(name + ", " + std::to_string(host.calls) + " host calls") {
+      HostCalls counter;
+      std::ostream counted(&counter);
+      interpreter.run(in, counted);
+      return counter.calls;
+    };
+  }
+}
+
+TEST_CASE("instructions per printed integer", "[!benchmark][run][print]") {
+  // the same loop once assigning the number and once printing it, the
+  // difference is what printing takes
+  auto loop = [](std::string const &body) {
+    return "int x;\n"
+           "main() {\n"
+           "  int i;\n"
+           "  i = 0;\n"
+           "  while (i < 1000) {\n"
+           "    " + body + ";\n"
+           "    i = i + 1;\n"
+           "  }\n"
+           "}\n";
+  };
+  auto executed = [](std::string const &src, RuntimeMode mode) {
+    wasm::Interpreter interpreter(compile_wasm("printi", src, mode));
+    HostCalls host;
+    std::ostream out(&host);
+    std::istringstream in;
+    return interpreter.count(in, out);
+  };
+
+  const char *numbers[] = {"7", "42", "12345", "1234567890",
+                           "-2147483647 - 1"};
+  std::pair<std::string, RuntimeMode> modes[] = {
+      {"putchar per character", RuntimeMode::unbuffered},
+      {"buffered", RuntimeMode::buffered},
+  };
+  for (auto const &[name, mode] : modes) {
+    for (auto number : numbers) {
+      auto printing = loop(std::string("printi(") + number + ")");
+      auto assigning = loop(std::string("x = ") + number);
+      auto per_number =
+          (executed(printing, mode) - executed(assigning, mode)) / 1000;
+
+      wasm::Interpreter interpreter(compile_wasm("printi", printing, mode));
+      BENCHMARK(name + ", printi(" + number + "), " +
+                std::to_string(per_number) + " instructions") {
+        HostCalls counter;
+        std::ostream counted(&counter);
+        std::istringstream in;
+        interpreter.run(in, counted);
+        return counter.bytes;
+      };
+    }
+  }
+}
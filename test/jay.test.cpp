@@ -1,10 +1,28 @@
 #define CATCH_CONFIG_MAIN
 
+#include "BytecodeCompiler.hpp"
+#include "CGenerator.hpp"
+#include "CodeGenerator.hpp"
+#include "ConstantFolding.hpp"
+#include "DeadCode.hpp"
+#include "Interpreter.hpp"
 #include "JayCompiler.hpp"
+#include "Runtime.hpp"
+#include "SemanticAnalyzer.hpp"
+#include "TextBuffer.hpp"
+#include "VM.hpp"
+#include "WatAssembler.hpp"
+#include "X86Generator.hpp"
 #include "catch.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 std::string file(std::string test_name) { return "./test/parser/" + test_name; }
 
@@ -117,6 +135,24 @@ TEST_CASE("null_str.pass: string with null character in the middle", "[ast]") {
   }
 }
 
+TEST_CASE("null_str.pass: string with null character, scanned in place",
+          "[ast][source]") {
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  REQUIRE(source.open(file("null_str.pass")));
+  auto *ast = driver.parse(source, file("null_str.pass"));
+
+  SECTION("AST should be initialized") { REQUIRE_FALSE(ast == nullptr); }
+
+  SECTION("should contain a string 'abcd'") {
+    auto string_node = ast->find_recursive(Node::string)[0];
+    REQUIRE_FALSE(string_node == nullptr);
+
+    auto value = string_node->value;
+    REQUIRE_THAT(value, Catch::Matchers::Equals("abcd"));
+  }
+}
+
 TEST_CASE("comment_in_expression.fail: if statement contains a comment",
           "[ast]") {
   yy::JayCompiler driver;
@@ -278,4 +314,1061 @@ TEST_CASE("gen.t18.pass: recursive descend parser implemented in j--",
     auto func_exprs = ast->find_all(Node::function_decl);
     REQUIRE(func_exprs.size() == 12);
   }
-}
\ No newline at end of file
+}
+TEST_CASE("deep_else_if: 1M nested else-if statements don't overflow the "
+          "stack",
+          "[ast][semantic]") {
+  const std::size_t depth = 1000000;
+
+  std::string src = "main() {\n  boolean b;\n  b = true;\n  ";
+  src.reserve(src.size() + depth * 20);
+  for (std::size_t i = 0; i < depth; i++) {
+    src += "if (b) ; else ";
+  }
+  src += ";\n}\n";
+
+  yy::JayCompiler driver;
+  std::istringstream in(src);
+  std::shared_ptr<ASTNode> ast(driver.parse(&in, "deep_else_if"),
+                               [](ASTNode *) {});
+  REQUIRE_FALSE(ast == nullptr);
+
+  std::size_t nodes = 0;
+  std::function<void(ASTNode * n)> count = [&nodes](ASTNode *) { nodes++; };
+  std::function<void(ASTNode * n)> none;
+  ast->traverse(count, none);
+  REQUIRE(nodes == driver.flat_ast->size());
+
+  REQUIRE(ast->find_recursive(Node::if_else_statement).size() == depth);
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  REQUIRE(analyzer.validate());
+}
+
+TEST_CASE("gen.t18.pass: scanning in place builds the same ast as flex",
+          "[ast][source]") {
+  std::ostringstream from_stream;
+  {
+    yy::JayCompiler driver;
+    std::ifstream testfile(file("gen.t18.pass"));
+    auto *ast = driver.parse(&testfile, file("gen.t18.pass"));
+    REQUIRE_FALSE(ast == nullptr);
+    from_stream << *ast;
+  }
+
+  std::ostringstream from_source;
+  {
+    yy::JayCompiler driver;
+    SourceBuffer source;
+    REQUIRE(source.open(file("gen.t18.pass")));
+    auto *ast = driver.parse(source, file("gen.t18.pass"));
+    REQUIRE_FALSE(ast == nullptr);
+    from_source << *ast;
+  }
+
+  REQUIRE(from_source.str() == from_stream.str());
+}
+
+/**
+ * @brief scan all of `source` with `backend`, one line per token: its type,
+ * its text for identifiers and literals, and the line the lexer is on after it
+ */
+std::vector<std::string> tokens(const SourceBuffer &source,
+                                Lexer::Backend backend) {
+  using token = yy::Parser::token;
+
+  Lexer lexer(&source, backend);
+  // wtf.t12 is a binary, don't let its unknown characters end the test run
+  lexer.warning_threshold = INT_MAX;
+
+  std::vector<std::string> result;
+  Lexer::TokenType value;
+  while (int type = lexer.lex(&value)) {
+    std::string text;
+    if (type == token::T_ID) {
+      text = name_str(value.name);
+    } else if (type == token::T_NUM || type == token::T_STR) {
+      text = std::string(lexer.text(value.span));
+    }
+    result.push_back(std::to_string(type) + " " + text + " @" +
+                     std::to_string(lexer.lineno()));
+  }
+  return result;
+}
+
+TEST_CASE("every scanner backend produces the same tokens as flex on the "
+          "test corpus",
+          "[lexer][source]") {
+  for (auto dir : {"./test/lexer", "./test/parser", "./test/semantic",
+                   "./test/codegen"}) {
+    for (auto const &entry : std::filesystem::directory_iterator(dir)) {
+      SourceBuffer source;
+      REQUIRE(source.open(entry.path()));
+      auto expected = tokens(source, Lexer::Backend::flex);
+
+      for (auto backend : {Lexer::Backend::scalar, Lexer::Backend::sse2,
+                           Lexer::Backend::avx2}) {
+        if (!Lexer::is_supported(backend)) {
+          continue;
+        }
+
+        INFO(entry.path() << ", backend " << static_cast<int>(backend));
+        REQUIRE(tokens(source, backend) == expected);
+      }
+    }
+  }
+}
+
+/**
+ * @brief compile a program from test/codegen
+ *
+ * @param path path to the program
+ * @param format output format
+ * @return std::string generated module, empty if the program doesn't compile
+ */
+std::string compile(std::string const &path, OutputFormat format,
+                    bool optimize = false,
+                    RuntimeMode runtime = RuntimeMode::unbuffered) {
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  if (!source.open(path)) {
+    return "";
+  }
+
+  std::shared_ptr<ASTNode> ast(driver.parse(source, path), [](ASTNode *) {});
+  if (ast == nullptr) {
+    return "";
+  }
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  if (!analyzer.validate()) {
+    return "";
+  }
+
+  if (optimize) {
+    fold_constants(ast.get());
+    eliminate_dead_code(ast.get(), *analyzer.sym_table);
+    driver.flat_ast = std::make_shared<FlatAST>(ast.get());
+  }
+
+  std::ostringstream out;
+  CodeGenerator(ast, driver.flat_ast, analyzer.sym_table, out, format,
+                runtime)
+      .generate_wasm();
+  return out.str();
+}
+
+TEST_CASE("TextBuffer indents lines and writes everything at once",
+          "[wasm]") {
+  TextBuffer text;
+  text.append("(module");
+  text.indent();
+  text.line("i32.const");
+  text.add("");
+  text.number(INT32_MIN);
+  for (int i = 0; i < 200; i++) {
+    text.indent();
+  }
+  text.line("deep");
+  for (int i = 0; i < 201; i++) {
+    text.dedent();
+  }
+  text.line(")");
+
+  std::ostringstream out;
+  text.flush(out);
+  REQUIRE(text.size() == 0);
+  REQUIRE(out.str() == "(module\n  i32.const -2147483648\n" +
+                           std::string(402, ' ') + "deep\n)");
+}
+
+TEST_CASE("LEB128 encoding", "[wasm]") {
+  auto u32 = [](std::uint32_t value) {
+    std::string out;
+    wasm::write_u32(out, value);
+    return out;
+  };
+  auto i32 = [](std::int32_t value) {
+    std::string out;
+    wasm::write_i32(out, value);
+    return out;
+  };
+
+  REQUIRE(u32(0) == std::string("\x00", 1));
+  REQUIRE(u32(127) == "\x7f");
+  REQUIRE(u32(128) == "\x80\x01");
+  REQUIRE(u32(624485) == "\xe5\x8e\x26");
+  REQUIRE(u32(UINT32_MAX) == "\xff\xff\xff\xff\x0f");
+
+  REQUIRE(i32(0) == std::string("\x00", 1));
+  REQUIRE(i32(63) == "\x3f");
+  REQUIRE(i32(64) == std::string("\xc0\x00", 2));
+  REQUIRE(i32(-1) == "\x7f");
+  REQUIRE(i32(-64) == "\x40");
+  REQUIRE(i32(-65) == "\xbf\x7f");
+  REQUIRE(i32(-123456) == "\xc0\xbb\x78");
+  REQUIRE(i32(INT32_MIN) == "\x80\x80\x80\x80\x78");
+}
+
+TEST_CASE("--emit=wasm builds the same module as assembling the WAT output",
+          "[codegen][wasm]") {
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    auto wat = compile(entry.path(), OutputFormat::wat);
+    if (wat.empty()) {
+      continue;
+    }
+
+    INFO(entry.path());
+    auto binary = compile(entry.path(), OutputFormat::wasm);
+    REQUIRE(binary.substr(0, 4) == std::string("\0asm", 4));
+
+    wasm::Module module;
+    WatAssembler(module).assemble(wat);
+    REQUIRE(module.encode() == binary);
+  }
+}
+
+/**
+ * @brief run a binary module
+ *
+ * @param binary module to run
+ * @param input what the program reads with getchar()
+ * @return std::string what the program prints
+ */
+std::string run(std::string const &binary, std::string const &input = "") {
+  std::istringstream in(input);
+  std::ostringstream out;
+  wasm::Interpreter(binary).run(in, out);
+  return out.str();
+}
+
+TEST_CASE("the interpreter runs compiled programs", "[wasm][run]") {
+  auto fib = run(compile("./test/codegen/gen.t10", OutputFormat::wasm));
+  REQUIRE(fib.rfind("fib(0) = 0\n", 0) == 0);
+  REQUIRE(fib.find("fib(10) = 55\n") != std::string::npos);
+  REQUIRE(fib.find("fib(20) = 6765\n") != std::string::npos);
+
+  auto sieve = run(compile("./test/codegen/art-sieve.j--", OutputFormat::wasm));
+  REQUIRE(sieve.find("97") != std::string::npos);
+
+  // gen.t31 divides by zero
+  REQUIRE_THROWS_AS(run(compile("./test/codegen/gen.t31", OutputFormat::wasm)),
+                    wasm::Trap);
+}
+
+TEST_CASE("&& and || skip their right side", "[wasm][run]") {
+  auto wat = compile("./test/codegen/gen.t29", OutputFormat::wat);
+  // the operands are calls, so they are branches of an if; nothing calls a
+  // runtime helper for them
+  REQUIRE(wat.find("(if (result i32)") != std::string::npos);
+  REQUIRE(wat.find("call $__and_op") == std::string::npos);
+  REQUIRE(wat.find("call $__or_op") == std::string::npos);
+
+  auto output = run(compile("./test/codegen/gen.t29", OutputFormat::wasm));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  // A is false, so B isn't called
+  REQUIRE(output.rfind("if ((A && B) || C) {...} else {...}, with A=false "
+                       "B=false C=false\nevaluated A\nevaluated C\n",
+                       0) == 0);
+  // A && B is true, so C isn't called
+  REQUIRE(output.find("A=true B=true C=true\nevaluated A\nevaluated B\n"
+                      "if-part executed\n") != std::string::npos);
+
+  // comparisons of variables can't have side effects, so they are combined
+  // without branching
+  auto life = compile("./test/codegen/art-life.j--", OutputFormat::wat);
+  REQUIRE(life.find("i32.or") != std::string::npos);
+}
+
+TEST_CASE("if/else-if chains on a variable dispatch with one jump",
+          "[wasm][run]") {
+  // i == 0, i == 1, ... i == 14
+  auto select = compile("./test/codegen/art-select.j--", OutputFormat::wat);
+  REQUIRE(select.find("br_table $_switch0_case0 $_switch0_case1") !=
+          std::string::npos);
+
+  // dense chains use br_table, the sparse ones a binary search
+  auto path = "./test/codegen/else-if-chains.j--";
+  auto wat = compile(path, OutputFormat::wat);
+  REQUIRE(wat.find("br_table") != std::string::npos);
+  REQUIRE(wat.find("i32.lt_s") != std::string::npos);
+
+  auto output = run(compile(path, OutputFormat::wasm));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output.find("minus fifty\n0\n") != std::string::npos);
+  REQUIRE(output.find("never") == std::string::npos);
+  REQUIRE(output.find("other\n110\n") != std::string::npos);
+  REQUIRE(output.find("big\n0\ndone\n") != std::string::npos);
+}
+
+TEST_CASE("ifs, loops, && and || are generated around their branches",
+          "[wasm][run]") {
+  auto path = "./test/codegen/control-flow.j--";
+  auto wat = compile(path, OutputFormat::wat);
+
+  // a loop around a compiled chain of cases, && and || that call a function
+  // and a break, byte for byte
+  std::string expected = R"((block $_block0
+      (loop $_loop0
+        local.get $i
+        i32.const 6
+        i32.lt_s
+        i32.eqz
+        br_if $_block0
+        (block $_switch0_end
+          (block $_switch0_default
+            (block $_switch0_case4
+              (block $_switch0_case3
+                (block $_switch0_case2
+                  (block $_switch0_case1
+                    (block $_switch0_case0
+                      local.get $i
+                      br_table $_switch0_case0 $_switch0_case1 $_switch0_case2 $_switch0_case3 $_switch0_case4 $_switch0_default
+                    )
+                    i32.const 220
+                    i32.const 4
+                    call $prints
+                    br $_switch0_end
+                  )
+                  i32.const 224
+                  i32.const 3
+                  call $prints
+                  br $_switch0_end
+                )
+                i32.const 227
+                i32.const 3
+                call $prints
+                br $_switch0_end
+              )
+              (if
+                (block (result i32)
+                  (if (result i32)
+                    (block (result i32)
+                      call $f
+                    )
+                    (then 
+                      call $f
+                    )
+                    (else 
+                      i32.const 0
+                    )
+                  )
+                )
+                (then 
+                  i32.const 230
+                  i32.const 3
+                  call $prints
+                )
+                (else 
+                  i32.const 233
+                  i32.const 2
+                  call $prints
+                )
+              )
+              br $_switch0_end
+            )
+            (if
+              (block (result i32)
+                (if (result i32)
+                  (block (result i32)
+                    local.get $i
+                    i32.const 5
+                    i32.gt_s
+                  )
+                  (then 
+                    i32.const 1
+                  )
+                  (else 
+                    call $f
+                  )
+                )
+              )
+              (then 
+                br $_block0
+              )
+            )
+          )
+        )
+        local.get $i
+        i32.const 1
+        i32.add
+        local.set $i
+        br $_loop0
+      )
+    ))";
+  auto loop = wat.find("(block $_block0");
+  REQUIRE(loop != std::string::npos);
+  REQUIRE(wat.substr(loop, expected.size()) == expected);
+
+  auto output = run(compile(path, OutputFormat::wasm));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "zeroonetwono43");
+}
+
+TEST_CASE("modules only get the runtime functions their program needs",
+          "[wasm][run]") {
+  Runtime runtime(";; a calls b\n"
+                  "(func $a (export \"a\")\n"
+                  "  call $b\n"
+                  ")\n"
+                  "\n"
+                  "(func $b ;; not (closed\n"
+                  "  call $putchar\n"
+                  ")\n"
+                  "(func $c (param $x i32)\n"
+                  "  (if (local.get $x) (then call $b))\n"
+                  ")\n");
+  REQUIRE(runtime.size() == 3);
+  REQUIRE(runtime.functions({intern("a")}) ==
+          ";; a calls b\n(func $a (export \"a\")\n  call $b\n)\n\n"
+          "(func $b ;; not (closed\n  call $putchar\n)");
+  REQUIRE(runtime.functions({intern("c"), intern("main")}) ==
+          "(func $b ;; not (closed\n  call $putchar\n)\n\n"
+          "(func $c (param $x i32)\n  (if (local.get $x) (then call $b))\n)");
+  REQUIRE(runtime.functions({}).empty());
+  REQUIRE_THROWS_AS(Runtime("(func $open\n  (block\n)\n"), std::runtime_error);
+
+  // the runtime is a part of the compiler, it doesn't depend on where it runs
+  auto path = std::filesystem::absolute("./test/codegen/control-flow.j--");
+  auto cwd = std::filesystem::current_path();
+  std::filesystem::current_path(std::filesystem::temp_directory_path());
+  auto wat = compile(path.string(), OutputFormat::wat);
+  auto binary = compile(path.string(), OutputFormat::wasm);
+  std::filesystem::current_path(cwd);
+
+  REQUIRE(wat.find("(func $halt") != std::string::npos);
+  REQUIRE(wat.find("(func $printi") != std::string::npos);
+  // prints calls printc
+  REQUIRE(wat.find("(func $printc") != std::string::npos);
+  REQUIRE(wat.find("(func $printb") == std::string::npos);
+
+  auto output = run(binary);
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "zeroonetwono43");
+}
+
+TEST_CASE("a buffered runtime prints what the unbuffered one does",
+          "[wasm][run]") {
+  auto path = "./test/codegen/control-flow.j--";
+  auto wat = compile(path, OutputFormat::wat, false, RuntimeMode::buffered);
+  REQUIRE(wat.find(R"((import "host" "write")") != std::string::npos);
+  REQUIRE(wat.find(R"((import "host" "putchar")") == std::string::npos);
+  REQUIRE(wat.find("(global $__out_end") != std::string::npos);
+
+  // the characters are only in memory until main ends
+  auto binary = compile(path, OutputFormat::wasm, false, RuntimeMode::buffered);
+  auto output = run(binary);
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "zeroonetwono43");
+
+  // whatever a program prints before a trap is lost with the buffer
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    auto unbuffered = compile(entry.path(), OutputFormat::wasm);
+    if (unbuffered.empty()) {
+      continue;
+    }
+
+    INFO(entry.path());
+    auto buffered = compile(entry.path(), OutputFormat::wasm, false,
+                            RuntimeMode::buffered);
+    std::string expected;
+    try {
+      expected = run(unbuffered, "42 x\n");
+    } catch (wasm::Trap const &) {
+      REQUIRE_THROWS_AS(run(buffered, "42 x\n"), wasm::Trap);
+      continue;
+    }
+    REQUIRE(run(buffered, "42 x\n") == expected);
+  }
+}
+
+TEST_CASE("printi writes numbers through the digit pair table",
+          "[wasm][run]") {
+  auto path = "./test/codegen/printi.j--";
+  auto wat = compile(path, OutputFormat::wat);
+  // right after "true" and "false", where the runtime looks for it
+  REQUIRE(wat.find(R"((data 0 (i32.const 9) "00010203)") != std::string::npos);
+  REQUIRE(wat.find("i32.load16_u offset=9") != std::string::npos);
+  // a program that doesn't print numbers doesn't get the table
+  auto strings = compile("./test/codegen/gen.t1", OutputFormat::wat);
+  REQUIRE(strings.find("(i32.const 9) \"0001") == std::string::npos);
+
+  auto expected = "0 7 -1 10 99 100 -105 1000000000 2147483647 -2147483648 "
+                  "-2147483647 12345 ";
+  for (auto mode : {RuntimeMode::unbuffered, RuntimeMode::buffered}) {
+    REQUIRE(run(compile(path, OutputFormat::wasm, false, mode)) == expected);
+  }
+}
+
+TEST_CASE("-O1 folds constants without changing what programs print",
+          "[wasm][run]") {
+  auto path = "./test/codegen/constant-folding.j--";
+  auto wat = compile(path, OutputFormat::wat);
+  auto folded = compile(path, OutputFormat::wat, true);
+  REQUIRE(folded.size() < wat.size());
+  // 2 * 3 + 4 and the untaken branches are gone, the calls are still there
+  REQUIRE(wat.find("i32.const 3\n") != std::string::npos);
+  REQUIRE(folded.find("i32.const 3\n") == std::string::npos);
+  REQUIRE(folded.find("i32.const 10\n") != std::string::npos);
+  auto calls = [](std::string const &text) {
+    std::size_t count = 0;
+    for (auto pos = text.find("call $f\n"); pos != std::string::npos;
+         pos = text.find("call $f\n", pos + 1)) {
+      count++;
+    }
+    return count;
+  };
+  // only the one in `false && f(1) == 1` is dropped, it never runs
+  REQUIRE(calls(folded) == calls(wat) - 1);
+
+  auto output = run(compile(path, OutputFormat::wasm, true));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "10\n-2147483648 -2147483648 -2147483648 0 -3 -1 10\n"
+                    "5010falsefalsefalsetrue4\ntaken ten\n");
+
+  // every test program runs the same folded
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    auto binary = compile(entry.path(), OutputFormat::wasm);
+    if (binary.empty()) {
+      continue;
+    }
+
+    INFO(entry.path());
+    auto optimized = compile(entry.path(), OutputFormat::wasm, true);
+    std::string expected;
+    try {
+      expected = run(binary, "42 x\n");
+    } catch (wasm::Trap const &) {
+      REQUIRE_THROWS_AS(run(optimized, "42 x\n"), wasm::Trap);
+      continue;
+    }
+    REQUIRE(run(optimized, "42 x\n") == expected);
+  }
+}
+
+TEST_CASE("erasing from an IdMap keeps the other entries reachable",
+          "[symtable]") {
+  IdMap<int> map;
+  for (name_id_t key = 1; key <= 1000; key++) {
+    map.insert(key, static_cast<int>(key));
+  }
+  for (name_id_t key = 1; key <= 1000; key += 3) {
+    REQUIRE(map.erase(key));
+  }
+  REQUIRE_FALSE(map.erase(1));
+  REQUIRE(map.size() == 666);
+  for (name_id_t key = 1; key <= 1000; key++) {
+    auto *value = map.find(key);
+    if (key % 3 == 1) {
+      REQUIRE(value == nullptr);
+    } else {
+      REQUIRE(value != nullptr);
+      REQUIRE(*value == static_cast<int>(key));
+    }
+  }
+}
+
+TEST_CASE("-O1 removes code that never runs", "[wasm][run]") {
+  auto path = "./test/codegen/dead-code.j--";
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  REQUIRE(source.open(path));
+  std::shared_ptr<ASTNode> ast(driver.parse(source, path), [](ASTNode *) {});
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  REQUIRE(analyzer.validate());
+
+  auto removed = eliminate_dead_code(ast.get(), *analyzer.sym_table);
+  REQUIRE(removed.functions == 3);
+  REQUIRE(removed.globals == 2);
+  REQUIRE(removed.statements == 5);
+  REQUIRE(removed.nodes < removed.total);
+  REQUIRE(analyzer.sym_table->find_function(intern("even")) == nullptr);
+  REQUIRE(analyzer.sym_table->find_function(intern("sign")) != nullptr);
+
+  auto wat = compile(path, OutputFormat::wat);
+  auto optimized = compile(path, OutputFormat::wat, true);
+  REQUIRE(optimized.size() < wat.size());
+  REQUIRE(wat.find("(func $odd") != std::string::npos);
+  REQUIRE(optimized.find("(func $odd") == std::string::npos);
+  REQUIRE(optimized.find("(func $never") == std::string::npos);
+  REQUIRE(optimized.find("(global $unused") == std::string::npos);
+  REQUIRE(optimized.find("(global $used") != std::string::npos);
+
+  auto output = run(compile(path, OutputFormat::wasm, true));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "-1\nstop\n");
+}
+
+TEST_CASE("arrays are stored in linear memory", "[wasm][run]") {
+  auto path = "./test/codegen/arrays.j--";
+  auto wat = compile(path, OutputFormat::wat);
+  // global arrays follow the strings, booleans take a byte. local ones are
+  // in frames on a stack that starts after them, so the memory has room for
+  // the stack on top of the 1 page they need
+  REQUIRE(wat.find("(memory 17)") != std::string::npos);
+  REQUIRE(wat.find("(global $__sp (mut i32) (i32.const ") !=
+          std::string::npos);
+  REQUIRE(wat.find("i32.load8_u offset=") != std::string::npos);
+  REQUIRE(wat.find("i32.store offset=") != std::string::npos);
+  REQUIRE(compile("./test/codegen/gen.t10", OutputFormat::wat)
+              .find("(memory 1)") != std::string::npos);
+
+  auto output = run(compile(path, OutputFormat::wasm));
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output.find("193 197 199 \n9\n4181\ntrue\n12\n110\n3342\n"
+                      "truetrue\n") != std::string::npos);
+  REQUIRE(output.find("not zeroed") == std::string::npos);
+
+  // the index is checked before the value is computed
+  std::ostringstream out;
+  std::istringstream in;
+  REQUIRE_THROWS_AS(
+      wasm::Interpreter(compile("./test/codegen/array-bounds.j--",
+                                OutputFormat::wasm))
+          .run(in, out),
+      wasm::Trap);
+  output = out.str();
+  output.erase(std::remove(output.begin(), output.end(), '\0'), output.end());
+  REQUIRE(output == "value\n1\n");
+
+  REQUIRE(compile("./test/semantic/15_array_misuse.test", OutputFormat::wat)
+              .empty());
+}
+
+/**
+ * @brief assemble a module that imports the host functions
+ */
+static std::string assemble(std::string const &fields) {
+  wasm::Module module;
+  WatAssembler(module).assemble(
+      R"((import "host" "exit" (func $exit))
+         (import "host" "putchar" (func $putchar (param i32)))
+         (import "host" "getchar" (func $getchar (result i32)))
+         (memory 1))" +
+      fields);
+  return module.encode();
+}
+
+TEST_CASE("interpreter host functions and traps", "[wasm][run]") {
+  // copy the input to the output, stopping at the first `!`
+  auto echo = assemble(R"(
+    (func $main (local $c i32)
+      block $done
+        loop $next
+          call $getchar
+          local.tee $c
+          i32.const -1
+          i32.eq
+          br_if $done
+          (if (i32.eq (local.get $c) (i32.const 33))
+            (then call $exit))
+          local.get $c
+          call $putchar
+          br $next
+        end
+      end)
+    (start $main))");
+  REQUIRE(run(echo, "abc") == "abc");
+  REQUIRE(run(echo, "ab!cd") == "ab");
+
+  // values carried by branches and returns out of nested blocks
+  auto blocks = assemble(R"(
+    (func $pick (param $x i32) (result i32)
+      (block $out (result i32)
+        i32.const 1
+        local.get $x
+        br_if $out
+        drop
+        i32.const 2
+        (if (result i32) (local.get $x)
+          (then i32.const 3)
+          (else i32.const 4))
+        i32.add))
+    (func $main
+      i32.const 1
+      call $pick
+      i32.const 48
+      i32.add
+      call $putchar
+      i32.const 0
+      call $pick
+      i32.const 48
+      i32.add
+      call $putchar)
+    (start $main))");
+  REQUIRE(run(blocks) == "16");
+  {
+    std::istringstream in;
+    std::ostringstream out;
+    // main takes 11 with its return, $pick 4 for 1 and 10 for 0, blocks
+    // and ends aren't counted
+    REQUIRE(wasm::Interpreter(blocks).count(in, out) == 25);
+    REQUIRE(out.str() == "16");
+  }
+
+  // the index is unsigned, anything past the labels goes to the last one
+  auto table = assemble(R"(
+    (func $digit (param $x i32)
+      block $default
+        block $two
+          block $one
+            block $zero
+              local.get $x
+              br_table $zero $one $two $one $default
+            end
+            i32.const 48
+            call $putchar
+            return
+          end
+          i32.const 49
+          call $putchar
+          return
+        end
+        i32.const 50
+        call $putchar
+        return
+      end
+      i32.const 63
+      call $putchar)
+    (func $main
+      (call $digit (i32.const 0))
+      (call $digit (i32.const 1))
+      (call $digit (i32.const 2))
+      (call $digit (i32.const 3))
+      (call $digit (i32.const 4))
+      (call $digit (i32.const -1)))
+    (start $main))");
+  REQUIRE(run(table) == "0121??");
+
+  auto overflow = assemble(R"(
+    (func $main (i32.div_s (i32.const -2147483648) (i32.const -1)) drop)
+    (start $main))");
+  REQUIRE_THROWS_AS(run(overflow), wasm::Trap);
+
+  auto recursion = assemble(R"(
+    (func $main call $main)
+    (start $main))");
+  REQUIRE_THROWS_AS(run(recursion), wasm::Trap);
+
+  auto out_of_bounds = assemble(R"(
+    (func $main (i32.load (i32.const 65534)) drop)
+    (start $main))");
+  REQUIRE_THROWS_AS(run(out_of_bounds), wasm::Trap);
+
+  REQUIRE_THROWS_AS(wasm::Interpreter(std::string("\0asm\2\0\0\0", 8)),
+                    std::runtime_error);
+}
+
+/**
+ * @brief compile a program to bytecode
+ *
+ * @param path path to the program
+ * @param program gets the compiled program
+ * @return bool true if the program compiles
+ */
+bool compile_bytecode(std::string const &path, vm::Program &program) {
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  if (!source.open(path)) {
+    return false;
+  }
+
+  std::shared_ptr<ASTNode> ast(driver.parse(source, path), [](ASTNode *) {});
+  if (ast == nullptr) {
+    return false;
+  }
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  if (!analyzer.validate()) {
+    return false;
+  }
+
+  program = BytecodeCompiler(ast, analyzer.sym_table).compile();
+  return true;
+}
+
+/**
+ * @brief run a program on the VM
+ *
+ * @param program program to run
+ * @param input what the program reads with getchar()
+ * @return std::string what the program prints
+ */
+std::string run_vm(vm::Program const &program, std::string const &input = "") {
+  std::istringstream in(input);
+  std::ostringstream out;
+  vm::VM(program).run(in, out);
+  return out.str();
+}
+
+TEST_CASE("the VM prints what the wasm interpreter prints", "[vm][run]") {
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    vm::Program program;
+    // gen.t33 reads until getchar() returns -1, the wasm code compares the
+    // value `i` had before the assignment and prints the -1
+    if (!compile_bytecode(entry.path(), program) ||
+        entry.path().filename() == "gen.t33") {
+      continue;
+    }
+
+    INFO(entry.path());
+    std::string expected;
+    bool traps = false;
+    try {
+      expected = run(compile(entry.path(), OutputFormat::wasm), "42 x\n");
+    } catch (wasm::Trap const &) {
+      traps = true;
+    }
+
+    if (traps) {
+      REQUIRE_THROWS_AS(run_vm(program, "42 x\n"), vm::Trap);
+      continue;
+    }
+
+    // the wasm runtime prints a NUL for every escape sequence of a string
+    expected.erase(std::remove(expected.begin(), expected.end(), '\0'),
+                   expected.end());
+    REQUIRE(run_vm(program, "42 x\n") == expected);
+  }
+}
+
+TEST_CASE("bytecode fuses comparisons with branches", "[vm]") {
+  vm::Program program;
+  REQUIRE(compile_bytecode("./test/semantic/fib.pass", program));
+
+  std::ostringstream listing;
+  vm::disassemble(program, listing);
+  INFO(listing.str());
+
+  // `while (i <= 47)` is tested at the bottom of the loop, `i = i + 1` is a
+  // single instruction and `n == 0` jumps over the return on its own
+  REQUIRE(listing.str().find("jlei r0, 47") != std::string::npos);
+  REQUIRE(listing.str().find("addi r0, r0, 1\n") != std::string::npos);
+  REQUIRE(listing.str().find("jnei r0, 0") != std::string::npos);
+  REQUIRE(listing.str().find("\tle ") == std::string::npos);
+  REQUIRE(listing.str().find("\teq ") == std::string::npos);
+}
+
+TEST_CASE("VM input and traps", "[vm][run]") {
+  vm::Program program;
+  REQUIRE(compile_bytecode("./test/codegen/gen.t33", program));
+  REQUIRE(run_vm(program, "echo\n") == "echo\n");
+  REQUIRE(run_vm(program) == "");
+
+  REQUIRE(compile_bytecode("./test/codegen/gen.t31", program));
+  REQUIRE_THROWS_AS(run_vm(program), vm::Trap);
+
+  // a function that falls off its end without returning a value
+  REQUIRE(compile_bytecode("./test/codegen/gen.t30", program));
+  REQUIRE_THROWS_AS(run_vm(program), vm::Trap);
+
+  // unbounded recursion runs out of frames instead of crashing
+  vm::Program recursion;
+  recursion.functions.push_back({"main", 0, 0, 1, 0});
+  recursion.code.push_back({vm::Op::call, 0, 0, 0});
+  recursion.code.push_back({vm::Op::halt, 0, 0, 0});
+  REQUIRE_THROWS_AS(run_vm(recursion), vm::Trap);
+}
+
+/**
+ * @brief compile a program to x86-64 assembly
+ *
+ * @param path path to the program
+ * @return std::string assembly, empty if the program doesn't compile
+ */
+std::string compile_x86(std::string const &path) {
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  if (!source.open(path)) {
+    return "";
+  }
+
+  std::shared_ptr<ASTNode> ast(driver.parse(source, path), [](ASTNode *) {});
+  if (ast == nullptr) {
+    return "";
+  }
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  if (!analyzer.validate()) {
+    return "";
+  }
+
+  std::ostringstream out;
+  X86Generator(ast, analyzer.sym_table, out).generate();
+  return out.str();
+}
+
+TEST_CASE("x86-64 code keeps variables in registers", "[x86]") {
+  auto fib = compile_x86("./test/semantic/fib.pass");
+  INFO(fib);
+
+  // `i` of main and `n` of fib are allocated to %ebx, `i = i + 1` updates
+  // it in place and the loop condition is a compare and jump
+  REQUIRE(fib.find("\taddl $1, %ebx\n") != std::string::npos);
+  REQUIRE(fib.find("\tcmpl $47, %ebx\n\tjle ") != std::string::npos);
+  REQUIRE(fib.find("\tmovl 16(%rbp), %ebx\n") != std::string::npos);
+  REQUIRE(fib.find("set") == std::string::npos);
+}
+
+TEST_CASE("x86-64 programs print what the VM prints", "[x86][run]") {
+  if (std::system("as --version > /dev/null 2>&1") != 0 ||
+      std::system("ld --version > /dev/null 2>&1") != 0) {
+    WARN("as or ld isn't available, skipped");
+    return;
+  }
+
+  auto dir = std::filesystem::temp_directory_path() / "jay_x86_test";
+  std::filesystem::create_directories(dir);
+  auto runtime = (dir / "runtime.o").string();
+  auto assemble_runtime = "as ./src/lib/runtime_x86_64.s -o " + runtime;
+  REQUIRE(std::system(assemble_runtime.c_str()) == 0);
+
+  std::string const input = "42 x\n";
+  std::ofstream(dir / "input") << input;
+
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    vm::Program program;
+    if (!compile_bytecode(entry.path(), program)) {
+      continue;
+    }
+
+    INFO(entry.path());
+    std::ofstream(dir / "program.s") << compile_x86(entry.path());
+    auto build = "as " + (dir / "program.s").string() + " -o " +
+                 (dir / "program.o").string() + " && ld " +
+                 (dir / "program.o").string() + " " + runtime + " -o " +
+                 (dir / "program").string();
+    REQUIRE(std::system(build.c_str()) == 0);
+
+    std::string expected;
+    bool traps = false;
+    try {
+      expected = run_vm(program, input);
+    } catch (vm::Trap const &) {
+      traps = true;
+    }
+
+    auto command = (dir / "program").string() + " < " +
+                   (dir / "input").string() + " > " +
+                   (dir / "output").string() + " 2> /dev/null";
+    int status = std::system(command.c_str());
+    REQUIRE((status != 0) == traps);
+
+    std::ostringstream output;
+    output << std::ifstream(dir / "output", std::ios::binary).rdbuf();
+    if (!traps) {
+      REQUIRE(output.str() == expected);
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+/**
+ * @brief translate a program to C
+ *
+ * @param path path to the program
+ * @return std::string C file, empty if the program doesn't compile
+ */
+std::string compile_c(std::string const &path) {
+  yy::JayCompiler driver;
+  SourceBuffer source;
+  if (!source.open(path)) {
+    return "";
+  }
+
+  std::shared_ptr<ASTNode> ast(driver.parse(source, path), [](ASTNode *) {});
+  if (ast == nullptr) {
+    return "";
+  }
+
+  SemanticAnalyzer analyzer(ast, driver.flat_ast);
+  if (!analyzer.validate()) {
+    return "";
+  }
+
+  std::ostringstream out;
+  CGenerator(ast, analyzer.sym_table, out).generate();
+  return out.str();
+}
+
+TEST_CASE("C programs print what the wasm interpreter prints", "[c][run]") {
+  if (std::system("cc --version > /dev/null 2>&1") != 0) {
+    WARN("cc isn't available, skipped");
+    return;
+  }
+
+  auto dir = std::filesystem::temp_directory_path() / "jay_c_test";
+  std::filesystem::create_directories(dir);
+
+  std::string const input = "42 x\n";
+  std::ofstream(dir / "input") << input;
+
+  for (auto const &entry :
+       std::filesystem::directory_iterator("./test/codegen")) {
+    auto c = compile_c(entry.path());
+    // gen.t33 reads until getchar() returns -1, the wasm code compares the
+    // value `i` had before the assignment and prints the -1
+    if (c.empty() || entry.path().filename() == "gen.t33") {
+      continue;
+    }
+
+    INFO(entry.path());
+    std::ofstream(dir / "program.c") << c;
+    auto build = "cc -O2 " + (dir / "program.c").string() + " -o " +
+                 (dir / "program").string();
+    REQUIRE(std::system(build.c_str()) == 0);
+
+    std::string expected;
+    bool traps = false;
+    try {
+      expected = run(compile(entry.path(), OutputFormat::wasm), input);
+    } catch (wasm::Trap const &) {
+      traps = true;
+    }
+
+    auto command = (dir / "program").string() + " < " +
+                   (dir / "input").string() + " > " +
+                   (dir / "output").string() + " 2> /dev/null";
+    int status = std::system(command.c_str());
+    REQUIRE((status != 0) == traps);
+
+    std::ostringstream output;
+    output << std::ifstream(dir / "output", std::ios::binary).rdbuf();
+    if (!traps) {
+      // the wasm runtime prints a NUL for every escape sequence of a string
+      expected.erase(std::remove(expected.begin(), expected.end(), '\0'),
+                     expected.end());
+      REQUIRE(output.str() == expected);
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("C code keeps J-- evaluation order and int32 semantics", "[c]") {
+  auto c = compile_c("./test/codegen/gen.t34");
+  INFO(c);
+
+  // every call to baz changes the global d, so the arguments before the
+  // last call are stored in temporaries in the order J-- evaluates them
+  REQUIRE(c.find("  int32_t t0 = jay_fn_bar(2, jay_fn_baz(3), 4);\n"
+                 "  int32_t t1 = jay_fn_bar(5, jay_fn_baz(6), 7);\n"
+                 "  jay_printi(jay_fn_foo(1, t0, t1, jay_fn_baz(8)));\n") !=
+          std::string::npos);
+  REQUIRE(c.find("  g_d = jay_add(g_d, 1);\n") != std::string::npos);
+
+  // "true" and "false" come first in the string table, then "\n"
+  REQUIRE(c.find("static const unsigned char jay_strings[] = {\n"
+                 "    116, 114, 117, 101, 102, 97, 108, 115, 101, 10,\n"
+                 "};") != std::string::npos);
+  REQUIRE(c.find("  jay_prints(jay_strings + 9, 1);\n") != std::string::npos);
+  REQUIRE(c.find("int main(void) {\n  jay_fn_mane();\n") !=
+          std::string::npos);
+}
+